@@ -2,7 +2,7 @@
  ****************************************************************************************
  * @file da14531_config_basic.h
  * @brief Basic compile configuration file.
- * @note Albert Nguyen: defined CFG_PRINTF
+ * @note Albert Nguyen: defined CFG_PRINTF and CFG_SPI_FLASH_ENABLE, added CFG_PWM_RUN_IN_SLEEP, CFG_PWM_DITHER, CFG_PWM_BIAS_LOOP and CFG_PWM_VBAT_DEADBAND_MV
  ****************************************************************************************
  */
 
@@ -81,8 +81,9 @@
 /* Select external memory device for data storage                                                               */
 /* SPI FLASH  (#define CFG_SPI_FLASH_ENABLE)                                                                    */
 /* I2C EEPROM (#define CFG_I2C_EEPROM_ENABLE)                                                                   */
+/* The SPI flash keeps the PWM configuration records (user_cfg_store.c). Boards without it run on defaults.     */
 /****************************************************************************************************************/
-#undef CFG_SPI_FLASH_ENABLE
+#define CFG_SPI_FLASH_ENABLE
 #undef CFG_I2C_EEPROM_ENABLE
 
 /****************************************************************************************************************/
@@ -103,4 +104,33 @@
 /****************************************************************************************************************/
 #undef CFG_POWER_MODE_BYPASS
 
+/****************************************************************************************************************/
+/* Keep the Timer2 PWM running through extended sleep when it is clocked from TIM2_CLK_LP. PD_TIM is kept       */
+/* powered in sleep and the PWM no longer holds the SoC in ARCH_SLEEP_OFF. Verify on the target board that the  */
+/* PWM pads keep toggling while the pad latches are closed before enabling.                                     */
+/****************************************************************************************************************/
+#undef CFG_PWM_RUN_IN_SLEEP
+
+/****************************************************************************************************************/
+/* Dither the PWM pulse width with a first-order sigma-delta to resolve 1/256 of a timer count. Every 10 ms the */
+/* END_CYCLE of each active channel alternates between adjacent counts, so a short period (high PWM frequency)  */
+/* keeps mV bias resolution. Needs a bias filter that averages over the dither pattern, and wakes the SoC every */
+/* 10 ms while the PWM runs.                                                                                    */
+/****************************************************************************************************************/
+#undef CFG_PWM_DITHER
+
+/****************************************************************************************************************/
+/* Allow the closed-loop bias mode. The bias node of the regulated channel is read on P0_2 and a PI controller  */
+/* trims the feed-forward duty cycle until the measured bias matches the request. P0_2 is also SWCLK, so the    */
+/* debugger cannot attach to a build with this enabled. Only for boards that route the bias node to P0_2.       */
+/****************************************************************************************************************/
+#undef CFG_PWM_BIAS_LOOP
+
+/****************************************************************************************************************/
+/* VBAT change in mV that triggers a recompute of the PWM duty cycles. At 2 mV a 1 V bias pulse moves by well   */
+/* under one timer count. A larger deadband saves register writes on a noisy supply, at a bias error of up to a */
+/* third of the deadband at a 1 V target on a 3 V cell.                                                         */
+/****************************************************************************************************************/
+#define CFG_PWM_VBAT_DEADBAND_MV 2
+
 #endif // _DA14531_CONFIG_BASIC_H_
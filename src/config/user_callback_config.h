@@ -3,6 +3,7 @@
  * @file user_callback_config.h
  * @brief Callback functions configuration file.
  * @note Albert Nguyen: Rerouted app_on_init and app_on_system_powered to user space
+ * @note Albert Nguyen: Rerouted app_going_to_sleep and app_resume_from_sleep for the PWM register shadows
  ****************************************************************************************
  */
 
@@ -158,8 +159,10 @@ static const struct arch_main_loop_callbacks user_app_main_loop_callbacks = {
 
     .app_before_sleep       = NULL,
     .app_validate_sleep     = NULL,
-    .app_going_to_sleep     = NULL,
-    .app_resume_from_sleep  = NULL,
+    // .app_going_to_sleep     = NULL,
+		.app_going_to_sleep     = user_app_going_to_sleep,
+    // .app_resume_from_sleep  = NULL,
+		.app_resume_from_sleep  = user_app_resume_from_sleep,
 };
 
 //place in this structure the app_<profile>_db_create and app_<profile>_enable functions
@@ -60,6 +60,14 @@
     #define ADC_INPUT_PIN               GPIO_PIN_6 // RX on MikroBus
 #endif
 
+// for closed-loop bias feedback (CFG_PWM_BIAS_LOOP), the last free ADC pin is shared with SWCLK
+#define BIAS_FB_INPUT_PORT              GPIO_PORT_0
+#define BIAS_FB_INPUT_PIN               GPIO_PIN_2
+
+// Virtual ground the bias is referenced to, as the feedback pin sees it. Measure it on the board
+// with the regulated channel released: a wrong value ends up as a bias offset of the same size
+#define BIAS_FB_REF_MV                  1350
+
 // for PWM
 #ifdef BOARD_CUSTOM_PCB
     #define PWM2_OUTPUT_PORT                   GPIO_PORT_0
@@ -132,6 +140,12 @@
     #define SPI_DI_PIN              GPIO_PIN_5
 #endif
 
+// SPI flash size and the regions used by the application, the boot image stays at the bottom
+#define SPI_FLASH_DEV_SIZE          (256 * 1024) // MX25R2035F on the DA14531 boards
+#define CFG_STORE_FLASH_ADDR        (SPI_FLASH_DEV_SIZE - 0x2000) // last two 4 KB sectors, configuration records
+#define LOG_STORE_FLASH_ADDR        0x10000 // sensor log ring from 64 KB up to the configuration records
+#define LOG_STORE_FLASH_SIZE        (CFG_STORE_FLASH_ADDR - LOG_STORE_FLASH_ADDR)
+
 /*
  ****************************************************************************************
  * Production debug output configuration
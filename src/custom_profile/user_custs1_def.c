@@ -59,6 +59,19 @@ static const uint8_t SVC1_PWM_VBIAS_AND_OFFSET_UUID_128[ATT_UUID_128_LEN] = DEF_
 static const uint8_t SVC1_PWM_STATE_UUID_128[ATT_UUID_128_LEN] = DEF_SVC1_PWM_STATE_UUID_128;
 // Battery Voltage
 static const uint8_t SVC1_BATTERY_VOLTAGE_UUID_128[ATT_UUID_128_LEN] = DEF_SVC1_BATTERY_VOLTAGE_UUID_128;
+// Sensor stream config
+static const uint8_t SVC1_SENSOR_STREAM_CFG_UUID_128[ATT_UUID_128_LEN] = DEF_SVC1_SENSOR_STREAM_CFG_UUID_128;
+// PWM frequency planner
+static const uint8_t SVC1_PWM_FREQ_PLAN_UUID_128[ATT_UUID_128_LEN] = DEF_SVC1_PWM_FREQ_PLAN_UUID_128;
+// PWM bias ramp
+static const uint8_t SVC1_PWM_RAMP_UUID_128[ATT_UUID_128_LEN] = DEF_SVC1_PWM_RAMP_UUID_128;
+static const uint8_t SVC1_PWM_LOOP_UUID_128[ATT_UUID_128_LEN] = DEF_SVC1_PWM_LOOP_UUID_128;
+static const uint8_t SVC1_PWM_ZCAL_UUID_128[ATT_UUID_128_LEN] = DEF_SVC1_PWM_ZCAL_UUID_128;
+// Sensor log
+static const uint8_t SVC1_SENSOR_LOG_UUID_128[ATT_UUID_128_LEN] = DEF_SVC1_SENSOR_LOG_UUID_128;
+// Log download control point and data stream
+static const uint8_t SVC1_LOG_CTRL_UUID_128[ATT_UUID_128_LEN] = DEF_SVC1_LOG_CTRL_UUID_128;
+static const uint8_t SVC1_LOG_DATA_UUID_128[ATT_UUID_128_LEN] = DEF_SVC1_LOG_DATA_UUID_128;
 
 /*
  ****************************************************************************************
@@ -115,7 +128,7 @@ const struct attm_desc_128 custs1_att_db[CUSTS1_IDX_NB] =
 		SVC1_SENSOR_VOLTAGE_UUID_128, // custom
 		ATT_UUID_128_LEN,
 		PERM(RD, ENABLE) | PERM(NTF, ENABLE), // custom
-		PERM(RI, ENABLE) | DEF_SVC1_SENSOR_VOLTAGE_CHAR_LEN, // custom
+		PERM(RI, ENABLE) | DEF_SVC1_SENSOR_VOLTAGE_FRAME_MAX_LEN, // custom, max length fits a framed notification
 		0,
 		NULL
 	},
@@ -293,6 +306,304 @@ const struct attm_desc_128 custs1_att_db[CUSTS1_IDX_NB] =
 		sizeof(DEF_SVC1_BATTERY_VOLTAGE_USER_DESC) - 1,
 		sizeof(DEF_SVC1_BATTERY_VOLTAGE_USER_DESC) - 1,
 		(uint8_t *) DEF_SVC1_BATTERY_VOLTAGE_USER_DESC
+	},
+	
+	/*
+	----------------------------------
+	- Sensor Stream Config Characteristic
+	----------------------------------
+	*/
+	
+	// Declaration
+	[SVC1_IDX_SENSOR_STREAM_CFG_CHAR] = {
+		(uint8_t*)&att_decl_char,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		0,
+		0,
+		NULL
+	},
+	
+	// Value
+	[SVC1_IDX_SENSOR_STREAM_CFG_VAL] = {
+		SVC1_SENSOR_STREAM_CFG_UUID_128,
+		ATT_UUID_128_LEN,
+		PERM(RD, ENABLE) | PERM(WR, ENABLE) | PERM(WRITE_REQ, ENABLE),
+		PERM(RI, ENABLE) | DEF_SVC1_SENSOR_STREAM_CFG_CHAR_LEN,
+		0,
+		NULL
+	},
+	
+	// User description
+	[SVC1_IDX_SENSOR_STREAM_CFG_USER_DESC] = {
+		(uint8_t*)&att_desc_user_desc,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		sizeof(DEF_SVC1_SENSOR_STREAM_CFG_USER_DESC) - 1,
+		sizeof(DEF_SVC1_SENSOR_STREAM_CFG_USER_DESC) - 1,
+		(uint8_t *) DEF_SVC1_SENSOR_STREAM_CFG_USER_DESC
+	},
+	
+	/*
+	----------------------------------
+	- PWM Frequency Planner Characteristic
+	----------------------------------
+	*/
+	
+	// Declaration
+	[SVC1_IDX_PWM_FREQ_PLAN_CHAR] = {
+		(uint8_t*)&att_decl_char,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		0,
+		0,
+		NULL
+	},
+	
+	// Value
+	[SVC1_IDX_PWM_FREQ_PLAN_VAL] = {
+		SVC1_PWM_FREQ_PLAN_UUID_128,
+		ATT_UUID_128_LEN,
+		PERM(RD, ENABLE) | PERM(WR, ENABLE) | PERM(WRITE_REQ, ENABLE),
+		PERM(RI, ENABLE) | DEF_SVC1_PWM_FREQ_PLAN_CHAR_LEN, // max length is the read response, writes are shorter
+		0,
+		NULL
+	},
+	
+	// User description
+	[SVC1_IDX_PWM_FREQ_PLAN_USER_DESC] = {
+		(uint8_t*)&att_desc_user_desc,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		sizeof(DEF_SVC1_PWM_FREQ_PLAN_USER_DESC) - 1,
+		sizeof(DEF_SVC1_PWM_FREQ_PLAN_USER_DESC) - 1,
+		(uint8_t *) DEF_SVC1_PWM_FREQ_PLAN_USER_DESC
+	},
+	
+	/*
+	----------------------------------
+	- PWM Bias Ramp Characteristic
+	----------------------------------
+	*/
+	
+	// Declaration
+	[SVC1_IDX_PWM_RAMP_CHAR] = {
+		(uint8_t*)&att_decl_char,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		0,
+		0,
+		NULL
+	},
+	
+	// Value
+	[SVC1_IDX_PWM_RAMP_VAL] = {
+		SVC1_PWM_RAMP_UUID_128,
+		ATT_UUID_128_LEN,
+		PERM(RD, ENABLE) | PERM(WR, ENABLE) | PERM(WRITE_REQ, ENABLE),
+		PERM(RI, ENABLE) | DEF_SVC1_PWM_RAMP_CHAR_LEN, // max length is the read response, writes are shorter
+		0,
+		NULL
+	},
+	
+	// User description
+	[SVC1_IDX_PWM_RAMP_USER_DESC] = {
+		(uint8_t*)&att_desc_user_desc,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		sizeof(DEF_SVC1_PWM_RAMP_USER_DESC) - 1,
+		sizeof(DEF_SVC1_PWM_RAMP_USER_DESC) - 1,
+		(uint8_t *) DEF_SVC1_PWM_RAMP_USER_DESC
+	},
+	
+	/*
+	----------------------------------
+	- PWM Closed-Loop Bias Characteristic
+	----------------------------------
+	*/
+	
+	// Declaration
+	[SVC1_IDX_PWM_LOOP_CHAR] = {
+		(uint8_t*)&att_decl_char,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		0,
+		0,
+		NULL
+	},
+	
+	// Value
+	[SVC1_IDX_PWM_LOOP_VAL] = {
+		SVC1_PWM_LOOP_UUID_128,
+		ATT_UUID_128_LEN,
+		PERM(RD, ENABLE) | PERM(WR, ENABLE) | PERM(WRITE_REQ, ENABLE),
+		PERM(RI, ENABLE) | DEF_SVC1_PWM_LOOP_CHAR_LEN, // max length is the read response, writes are shorter
+		0,
+		NULL
+	},
+	
+	// User description
+	[SVC1_IDX_PWM_LOOP_USER_DESC] = {
+		(uint8_t*)&att_desc_user_desc,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		sizeof(DEF_SVC1_PWM_LOOP_USER_DESC) - 1,
+		sizeof(DEF_SVC1_PWM_LOOP_USER_DESC) - 1,
+		(uint8_t *) DEF_SVC1_PWM_LOOP_USER_DESC
+	},
+	
+	/*
+	----------------------------------
+	- PWM Zero Calibration Characteristic
+	----------------------------------
+	*/
+	
+	// Declaration
+	[SVC1_IDX_PWM_ZCAL_CHAR] = {
+		(uint8_t*)&att_decl_char,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		0,
+		0,
+		NULL
+	},
+	
+	// Value
+	[SVC1_IDX_PWM_ZCAL_VAL] = {
+		SVC1_PWM_ZCAL_UUID_128,
+		ATT_UUID_128_LEN,
+		PERM(RD, ENABLE) | PERM(WR, ENABLE) | PERM(WRITE_REQ, ENABLE),
+		PERM(RI, ENABLE) | DEF_SVC1_PWM_ZCAL_CHAR_LEN, // max length is the read response, writes are shorter
+		0,
+		NULL
+	},
+	
+	// User description
+	[SVC1_IDX_PWM_ZCAL_USER_DESC] = {
+		(uint8_t*)&att_desc_user_desc,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		sizeof(DEF_SVC1_PWM_ZCAL_USER_DESC) - 1,
+		sizeof(DEF_SVC1_PWM_ZCAL_USER_DESC) - 1,
+		(uint8_t *) DEF_SVC1_PWM_ZCAL_USER_DESC
+	},
+	
+	/*
+	----------------------------------
+	- Sensor Log Characteristic
+	----------------------------------
+	*/
+	
+	// Declaration
+	[SVC1_IDX_SENSOR_LOG_CHAR] = {
+		(uint8_t*)&att_decl_char,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		0,
+		0,
+		NULL
+	},
+	
+	// Value
+	[SVC1_IDX_SENSOR_LOG_VAL] = {
+		SVC1_SENSOR_LOG_UUID_128,
+		ATT_UUID_128_LEN,
+		PERM(RD, ENABLE) | PERM(WR, ENABLE) | PERM(WRITE_REQ, ENABLE),
+		PERM(RI, ENABLE) | DEF_SVC1_SENSOR_LOG_CHAR_LEN, // max length is the read response, writes are shorter
+		0,
+		NULL
+	},
+	
+	// User description
+	[SVC1_IDX_SENSOR_LOG_USER_DESC] = {
+		(uint8_t*)&att_desc_user_desc,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		sizeof(DEF_SVC1_SENSOR_LOG_USER_DESC) - 1,
+		sizeof(DEF_SVC1_SENSOR_LOG_USER_DESC) - 1,
+		(uint8_t *) DEF_SVC1_SENSOR_LOG_USER_DESC
+	},
+	
+	/*
+	----------------------------------
+	- Log Download Control Point Characteristic
+	----------------------------------
+	*/
+	
+	// Declaration
+	[SVC1_IDX_LOG_CTRL_CHAR] = {
+		(uint8_t*)&att_decl_char,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		0,
+		0,
+		NULL
+	},
+	
+	// Value
+	[SVC1_IDX_LOG_CTRL_VAL] = {
+		SVC1_LOG_CTRL_UUID_128,
+		ATT_UUID_128_LEN,
+		PERM(RD, ENABLE) | PERM(WR, ENABLE) | PERM(WRITE_REQ, ENABLE),
+		PERM(RI, ENABLE) | DEF_SVC1_LOG_CTRL_CHAR_LEN, // max length is the read response, writes are shorter
+		0,
+		NULL
+	},
+	
+	// User description
+	[SVC1_IDX_LOG_CTRL_USER_DESC] = {
+		(uint8_t*)&att_desc_user_desc,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		sizeof(DEF_SVC1_LOG_CTRL_USER_DESC) - 1,
+		sizeof(DEF_SVC1_LOG_CTRL_USER_DESC) - 1,
+		(uint8_t *) DEF_SVC1_LOG_CTRL_USER_DESC
+	},
+	
+	/*
+	----------------------------------
+	- Log Download Data Stream Characteristic
+	----------------------------------
+	*/
+	
+	// Declaration
+	[SVC1_IDX_LOG_DATA_CHAR] = {
+		(uint8_t*)&att_decl_char,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		0,
+		0,
+		NULL
+	},
+	
+	// Value
+	[SVC1_IDX_LOG_DATA_VAL] = {
+		SVC1_LOG_DATA_UUID_128,
+		ATT_UUID_128_LEN,
+		PERM(NTF, ENABLE),
+		PERM(RI, ENABLE) | DEF_SVC1_LOG_DATA_CHAR_LEN, // notify only, max length fits a full-MTU notification
+		0,
+		NULL
+	},
+	
+	// Client Characteristic Configuration Descriptor (CCCD) for notifications
+	[SVC1_IDX_LOG_DATA_NTF_CFG] = {
+		(uint8_t*)&att_desc_cfg,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE) | PERM(WR, ENABLE) | PERM(WRITE_REQ, ENABLE),
+		sizeof(uint16_t),
+		0,
+		NULL
+	},
+	
+	// User description
+	[SVC1_IDX_LOG_DATA_USER_DESC] = {
+		(uint8_t*)&att_desc_user_desc,
+		ATT_UUID_16_LEN,
+		PERM(RD, ENABLE),
+		sizeof(DEF_SVC1_LOG_DATA_USER_DESC) - 1,
+		sizeof(DEF_SVC1_LOG_DATA_USER_DESC) - 1,
+		(uint8_t *) DEF_SVC1_LOG_DATA_USER_DESC
 	}
 };
 
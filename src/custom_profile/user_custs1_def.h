@@ -47,6 +47,7 @@
 // Define sensor voltage
 #define DEF_SVC1_SENSOR_VOLTAGE_UUID_128 {0x35,0x8c,0x68,0x30,0xbb,0x00,0xec,0x89,0x46,0x4b,0x67,0xf2,0xc4,0xa7,0xf4,0xfe}
 #define DEF_SVC1_SENSOR_VOLTAGE_CHAR_LEN 2 // 2 bytes for 10-bit ADC
+#define DEF_SVC1_SENSOR_VOLTAGE_FRAME_MAX_LEN 244 // framed notifications, MTU of 247 minus 3 byte ATT header
 #define DEF_SVC1_SENSOR_VOLTAGE_USER_DESC "Sensor Voltage (little-endian bytes to mV)"
 
 // Define PWM freq
@@ -56,8 +57,10 @@
 
 // Define PWM vbias and offset
 #define DEF_SVC1_PWM_VBIAS_AND_OFFSET_UUID_128 {0xfb,0xbe,0x45,0xc7,0x2f,0xef,0x80,0xae,0xa5,0x4a,0x0c,0x5e,0xc0,0x5f,0xb1,0xcc}
-#define DEF_SVC1_PWM_VBIAS_AND_OFFSET_CHAR_LEN 10
-#define DEF_SVC1_PWM_VBIAS_AND_OFFSET_USER_DESC "Timer2 PWM2 and PWM3 Vbias and Offsets"
+#define DEF_SVC1_PWM_VBIAS_AND_OFFSET_ENTRY_LEN 5 // vbias_mv (2 bytes), zero_cal (2 bytes), offset (1 byte) per channel
+#define DEF_SVC1_PWM_VBIAS_AND_OFFSET_LEGACY_LEN 10 // PWM2 and PWM3 entries without a channel mask
+#define DEF_SVC1_PWM_VBIAS_AND_OFFSET_CHAR_LEN (1 + 6 * DEF_SVC1_PWM_VBIAS_AND_OFFSET_ENTRY_LEN) // channel mask and up to 6 entries
+#define DEF_SVC1_PWM_VBIAS_AND_OFFSET_USER_DESC "Timer2 PWM2 to PWM7 Channel Mask, Vbias, Zero Cal and Offsets"
 
 // Define PWM state
 #define DEF_SVC1_PWM_STATE_UUID_128 {0x42,0x2d,0x1b,0x1c,0x46,0x02,0x26,0xb4,0xd0,0x4a,0x1e,0xd5,0x25,0xf9,0xc3,0x2d}
@@ -69,6 +72,53 @@
 #define DEF_SVC1_BATTERY_VOLTAGE_CHAR_LEN 2
 #define DEF_SVC1_BATTERY_VOLTAGE_USER_DESC "Battery Voltage (little-endian bytes to mV)"
 
+// Define sensor stream config
+#define DEF_SVC1_SENSOR_STREAM_CFG_UUID_128 {0xbc,0xb5,0x3b,0x22,0x75,0x96,0x70,0xac,0x98,0x62,0x22,0xf6,0xf0,0x19,0x9d,0x31}
+#define DEF_SVC1_SENSOR_STREAM_CFG_CHAR_LEN 4
+#define DEF_SVC1_SENSOR_STREAM_CFG_USER_DESC "Sensor Stream Mode, Samples per Frame, Interval and Encoding"
+
+// Define PWM frequency planner
+#define DEF_SVC1_PWM_FREQ_PLAN_UUID_128 {0x3b,0xef,0x9f,0x5b,0x06,0x28,0x3d,0x65,0x50,0x04,0xba,0x9e,0x2e,0x23,0xae,0xb8}
+#define DEF_SVC1_PWM_FREQ_PLAN_WRITE_LEN 6 // target_hz (4 bytes), min_resolution_mv (2 bytes)
+#define DEF_SVC1_PWM_FREQ_PLAN_CHAR_LEN 13 // flags, clk_src, clk_div, pwm_div (2 bytes), freq_hz (4 bytes), resolution_uv (4 bytes)
+#define DEF_SVC1_PWM_FREQ_PLAN_USER_DESC "Timer2 PWM Frequency Planner (Target Hz, Min Resolution mV)"
+
+// Define PWM bias ramp
+#define DEF_SVC1_PWM_RAMP_UUID_128 {0xc0,0x9f,0x5a,0x67,0x3f,0x72,0x10,0x94,0x54,0xea,0x60,0x40,0xf6,0xca,0x9c,0xe9}
+#define DEF_SVC1_PWM_RAMP_WRITE_LEN 4 // slew_mv_per_s (2 bytes), filter tau_ms (2 bytes)
+#define DEF_SVC1_PWM_RAMP_CHAR_LEN 9 // slew_mv_per_s (2 bytes), tau_ms (2 bytes), flags, settle_ms (4 bytes)
+#define DEF_SVC1_PWM_RAMP_USER_DESC "Timer2 PWM Bias Slew Rate, Filter Time Constant and Settle Status"
+
+// Define PWM closed-loop bias regulation
+#define DEF_SVC1_PWM_LOOP_UUID_128 {0x91,0x6e,0x2c,0xda,0xe3,0x1f,0x4e,0x5a,0xaa,0x32,0xc2,0xf1,0x9f,0x69,0x4e,0x48}
+#define DEF_SVC1_PWM_LOOP_WRITE_LEN 5 // channel, period_ms (2 bytes), kp_q8, ki_q8
+#define DEF_SVC1_PWM_LOOP_CHAR_LEN 16 // flags, channel, period_ms (2 bytes), kp_q8, ki_q8, trim_mv (2 bytes), residual_uv (4 bytes), converge_ms (4 bytes)
+#define DEF_SVC1_PWM_LOOP_USER_DESC "Timer2 PWM Closed-Loop Bias (Channel, Loop Period, PI Gains) and Convergence"
+
+// Define PWM automatic zero calibration
+#define DEF_SVC1_PWM_ZCAL_UUID_128 {0x71,0xf2,0x73,0x4f,0x77,0x9d,0x44,0x5a,0x81,0xa5,0xd2,0x6a,0x31,0xce,0xfc,0x87}
+#define DEF_SVC1_PWM_ZCAL_WRITE_LEN 3 // channel_mask, gain_point_mv (2 bytes)
+#define DEF_SVC1_PWM_ZCAL_CHAR_LEN 35 // state, done_mask, failed_mask, duration_ms (2 bytes), 6 x [zero_cal_mv (2 bytes), gain_q12 (2 bytes), confidence]
+#define DEF_SVC1_PWM_ZCAL_USER_DESC "Timer2 PWM Automatic Zero Calibration (Channel Mask, Gain Point mV) and Results"
+
+// Define sensor log
+#define DEF_SVC1_SENSOR_LOG_UUID_128 {0x5e,0x0b,0x8d,0x41,0x2a,0x6c,0x4f,0x93,0xb7,0x18,0xe4,0x03,0x9c,0x52,0xa1,0x6f}
+#define DEF_SVC1_SENSOR_LOG_WRITE_LEN 1 // 0 = off, 1 = on
+#define DEF_SVC1_SENSOR_LOG_CHAR_LEN 20 // flags, buffered, boot (2 bytes), first_seq (4 bytes), next_seq (4 bytes), writes, erases, skipped, failed (2 bytes each)
+#define DEF_SVC1_SENSOR_LOG_USER_DESC "Sensor Log On/Off (Offline Logging to SPI Flash) and Status"
+
+// Define log download control point
+#define DEF_SVC1_LOG_CTRL_UUID_128 {0x2c,0x7e,0x94,0x0d,0x6b,0x35,0x4a,0x1f,0x8e,0xd2,0x57,0xc1,0x0a,0x63,0xbe,0x94}
+#define DEF_SVC1_LOG_CTRL_WRITE_LEN 5 // opcode, start_seq (4 bytes)
+#define DEF_SVC1_LOG_CTRL_CHAR_LEN 21 // state, first_seq, next_seq, cursor_seq, bytes, duration_ms (4 bytes each)
+#define DEF_SVC1_LOG_CTRL_USER_DESC "Log Download Control (Opcode, Start Sequence) and Progress"
+
+// Define log download data stream
+#define DEF_SVC1_LOG_DATA_UUID_128 {0xa8,0x13,0x5f,0xe6,0x90,0x2b,0x47,0xc4,0x9d,0x61,0x3e,0x07,0xf2,0x8a,0x45,0xd9}
+#define DEF_SVC1_LOG_DATA_HEADER_LEN 5 // seq (4 bytes), offset of the first byte in its block
+#define DEF_SVC1_LOG_DATA_CHAR_LEN 244 // MTU of 247 minus 3 byte ATT header
+#define DEF_SVC1_LOG_DATA_USER_DESC "Log Download Data Stream"
+
 /// Custom1 Service Data Base Characteristic enum
 enum
 {
@@ -98,6 +148,39 @@ enum
 		SVC1_IDX_BATTERY_VOLTAGE_VAL,
 		SVC1_IDX_BATTERY_VOLTAGE_NTF_CFG,
 		SVC1_IDX_BATTERY_VOLTAGE_USER_DESC,
+		
+		SVC1_IDX_SENSOR_STREAM_CFG_CHAR,
+		SVC1_IDX_SENSOR_STREAM_CFG_VAL,
+		SVC1_IDX_SENSOR_STREAM_CFG_USER_DESC,
+		
+		SVC1_IDX_PWM_FREQ_PLAN_CHAR,
+		SVC1_IDX_PWM_FREQ_PLAN_VAL,
+		SVC1_IDX_PWM_FREQ_PLAN_USER_DESC,
+		
+		SVC1_IDX_PWM_RAMP_CHAR,
+		SVC1_IDX_PWM_RAMP_VAL,
+		SVC1_IDX_PWM_RAMP_USER_DESC,
+		
+		SVC1_IDX_PWM_LOOP_CHAR,
+		SVC1_IDX_PWM_LOOP_VAL,
+		SVC1_IDX_PWM_LOOP_USER_DESC,
+		
+		SVC1_IDX_PWM_ZCAL_CHAR,
+		SVC1_IDX_PWM_ZCAL_VAL,
+		SVC1_IDX_PWM_ZCAL_USER_DESC,
+		
+		SVC1_IDX_SENSOR_LOG_CHAR,
+		SVC1_IDX_SENSOR_LOG_VAL,
+		SVC1_IDX_SENSOR_LOG_USER_DESC,
+		
+		SVC1_IDX_LOG_CTRL_CHAR,
+		SVC1_IDX_LOG_CTRL_VAL,
+		SVC1_IDX_LOG_CTRL_USER_DESC,
+		
+		SVC1_IDX_LOG_DATA_CHAR,
+		SVC1_IDX_LOG_DATA_VAL,
+		SVC1_IDX_LOG_DATA_NTF_CFG,
+		SVC1_IDX_LOG_DATA_USER_DESC,
 	
 		// Saves total number of enumeration (SDK line)
     CUSTS1_IDX_NB
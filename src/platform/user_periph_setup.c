@@ -21,6 +21,11 @@
 #include "uart.h"
 #include "syscntl.h"
 
+#if defined (CFG_SPI_FLASH_ENABLE)
+#include "spi.h"
+#include "spi_flash.h"
+#endif
+
 // Needed for uvp_shutdown
 #include "user_empty_peripheral_template.h"
 
@@ -44,11 +49,20 @@ void GPIO_reservations(void)
 			RESERVE_GPIO(SPI_EN, SPI_EN_PORT, SPI_EN_PIN, PID_SPI_EN);
 	#endif
 
+	#if defined (CFG_SPI_FLASH_ENABLE)
+			RESERVE_GPIO(SPI_CLK, SPI_CLK_PORT, SPI_CLK_PIN, PID_SPI_CLK);
+			RESERVE_GPIO(SPI_DO, SPI_DO_PORT, SPI_DO_PIN, PID_SPI_DO);
+			RESERVE_GPIO(SPI_DI, SPI_DI_PORT, SPI_DI_PIN, PID_SPI_DI);
+	#endif
+
 	// reserve UVP pins as GPIO
 	RESERVE_GPIO(UVP_EN_OUTPUT, UVP_EN_OUTPUT_PORT, UVP_EN_OUTPUT_PIN, PID_GPIO);
 	
 	// reserve ADC pins
 	RESERVE_GPIO(ADC_INPUT, ADC_INPUT_PORT, ADC_INPUT_PIN, PID_ADC);
+	#ifdef CFG_PWM_BIAS_LOOP
+	RESERVE_GPIO(BIAS_FB_INPUT, BIAS_FB_INPUT_PORT, BIAS_FB_INPUT_PIN, PID_ADC);
+	#endif
 	
 	// reserve PWM pins
 	RESERVE_GPIO(PWM2_OUTPUT, PWM2_OUTPUT_PORT, PWM2_OUTPUT_PIN, PID_PWM2);
@@ -79,6 +93,13 @@ void set_pad_functions(void)
 			GPIO_ConfigurePin(SPI_EN_PORT, SPI_EN_PIN, OUTPUT, PID_SPI_EN, true);
 	#endif
 
+	#if defined (CFG_SPI_FLASH_ENABLE)
+			// SPI flash holding the configuration records
+			GPIO_ConfigurePin(SPI_CLK_PORT, SPI_CLK_PIN, OUTPUT, PID_SPI_CLK, false);
+			GPIO_ConfigurePin(SPI_DO_PORT, SPI_DO_PIN, OUTPUT, PID_SPI_DO, false);
+			GPIO_ConfigurePin(SPI_DI_PORT, SPI_DI_PIN, INPUT, PID_SPI_DI, false);
+	#endif
+
 	#if defined (CFG_PRINTF_UART2)
 			// Configure UART2 TX Pad
 			GPIO_ConfigurePin(UART2_TX_PORT, UART2_TX_PIN, OUTPUT, PID_UART2_TX, false);
@@ -96,6 +117,9 @@ void set_pad_functions(void)
 	
 	// set ADC pin as input
 	GPIO_ConfigurePin(ADC_INPUT_PORT, ADC_INPUT_PIN, INPUT, PID_ADC, false);
+	#ifdef CFG_PWM_BIAS_LOOP
+	GPIO_ConfigurePin(BIAS_FB_INPUT_PORT, BIAS_FB_INPUT_PIN, INPUT, PID_ADC, false); // bias feedback, SWD is lost
+	#endif
 	
 	// set PWM pins
 	GPIO_ConfigurePin(PWM2_OUTPUT_PORT, PWM2_OUTPUT_PIN, OUTPUT, PID_PWM2, false);
@@ -123,6 +147,27 @@ static const uart_cfg_t uart_cfg = {
 };
 #endif
 
+#if defined (CFG_SPI_FLASH_ENABLE)
+// Configuration struct for SPI
+static const spi_cfg_t spi_cfg = {
+    .spi_ms = SPI_MS_MODE_MASTER,
+    .spi_cp = SPI_CP_MODE_0,
+    .spi_speed = SPI_SPEED_MODE_4MHz,
+    .spi_wsz = SPI_MODE_8BIT,
+    .spi_cs = SPI_CS_0,
+    .cs_pad.port = SPI_EN_PORT,
+    .cs_pad.pin = SPI_EN_PIN,
+#if defined (__DA14531__)
+    .spi_capture = SPI_MASTER_EDGE_CAPTURE,
+#endif
+};
+
+// Configuration struct for SPI flash
+static const spi_flash_cfg_t spi_flash_cfg = {
+    .chip_size = SPI_FLASH_DEV_SIZE,
+};
+#endif
+
 void periph_init(void)
 {
 	#if defined (__DA14531__)
@@ -150,6 +195,14 @@ void periph_init(void)
 			uart_initialize(UART2, &uart_cfg);
 	#endif
 
+	#if defined (CFG_SPI_FLASH_ENABLE)
+			// Configure SPI flash environment, the chip is identified by cfg_store_init()
+			spi_flash_configure_env(&spi_flash_cfg);
+
+			// Initialize SPI
+			spi_initialize(&spi_cfg);
+	#endif
+
 	// Set pad functionality
 	set_pad_functions();
 
@@ -0,0 +1,227 @@
+/**
+ ****************************************************************************************
+ * @file user_adc_stream.c
+ * @brief Interrupt-driven continuous GPADC acquisition into a RAM ring buffer.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h" // SW configuration
+#include "user_adc_stream.h"
+#include "user_empty_peripheral_template.h"
+#include "user_timebase.h"
+
+// For ADC functions
+#include "adc.h"
+#include "adc_531.h"
+
+// For sleep management
+#include "user_sleep_inhibit.h"
+
+/*
+ ****************************************************************************************
+ * DEFINITIONS
+ ****************************************************************************************
+ */
+
+// Sample time multiplier and chopping match the single-shot sensor configuration
+static const uint8_t GPADC_STREAM_SMPL_TIME_MULT = 6U;
+static const bool GPADC_STREAM_CHOPPING = true;
+
+/*
+----------------------------------
+- Retained / Global variables
+----------------------------------
+*/
+
+// These variables are retained across sleep cycles
+
+gpadc_ring_t gpadc_ring __SECTION_ZERO("retention_mem_area0");
+gpadc_stream_cfg_t gpadc_stream_cfg __SECTION_ZERO("retention_mem_area0");
+uint16_t gpadc_stream_dropped_seen __SECTION_ZERO("retention_mem_area0"); // consumer copy of dropped counter
+
+/*
+ ****************************************************************************************
+ * ADC STREAM FUNCTIONS
+ ****************************************************************************************
+*/
+
+void gpadc_stream_start(adc_input_se_t input, adc_input_attn_t input_attenuator, uint8_t oversampling, uint8_t interval_mult)
+{
+	// ADC interval timer needs the system clock so the SoC must stay awake, one hold per started stream
+	if (!gpadc_stream_cfg.started)
+	{
+		sleep_inhibit_acquire(SLEEP_OWNER_ADC_STREAM, ARCH_SLEEP_OFF);
+		gpadc_stream_cfg.started = true;
+	}
+
+	// Save settings so the stream can be resumed after a single-shot conversion
+	gpadc_stream_cfg.input = input;
+	gpadc_stream_cfg.input_attenuator = input_attenuator;
+	gpadc_stream_cfg.oversampling = oversampling;
+	gpadc_stream_cfg.interval_mult = (interval_mult == 0) ? 1 : interval_mult; // interval of 0 is not valid in continuous mode
+
+	// Empty ring buffer, no conversions are running so both indices can be written here
+	gpadc_ring.head = 0;
+	gpadc_ring.tail = 0;
+	gpadc_ring.dropped = 0;
+	gpadc_stream_dropped_seen = 0;
+
+	gpadc_stream_resume();
+
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[ADC STREAM] Started, interval = %u x 1.024 ms \n\r", gpadc_stream_cfg.interval_mult);
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void gpadc_stream_stop(void)
+{
+	gpadc_stream_suspend();
+
+	// Let the SoC sleep again unless another subsystem still needs it awake
+	if (gpadc_stream_cfg.started)
+	{
+		sleep_inhibit_release(SLEEP_OWNER_ADC_STREAM);
+		gpadc_stream_cfg.started = false;
+	}
+
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[ADC STREAM] Stopped, %u samples dropped in total \n\r", gpadc_ring.dropped);
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+bool gpadc_stream_suspend(void)
+{
+	if (!gpadc_stream_cfg.running)
+	{
+		return false;
+	}
+
+	// Stop conversions before removing the interrupt callback
+	adc_unregister_interrupt();
+	adc_disable();
+	gpadc_stream_cfg.running = false;
+
+	return true;
+}
+
+void gpadc_stream_resume(void)
+{
+	// Build ADC config structure for continuous single-ended measurement
+	adc_config_t adc_config_struct =
+	{
+		.input_mode = ADC_INPUT_MODE_SINGLE_ENDED,
+		.continuous = true,
+		.interval_mult = gpadc_stream_cfg.interval_mult,
+
+		.input = gpadc_stream_cfg.input,
+		.smpl_time_mult = GPADC_STREAM_SMPL_TIME_MULT,
+		.input_attenuator = gpadc_stream_cfg.input_attenuator,
+		.chopping = GPADC_STREAM_CHOPPING,
+		.oversampling = gpadc_stream_cfg.oversampling
+	};
+
+	// Apply configuration and cached offset calibration
+	gpadc_configure(&adc_config_struct);
+
+	// Every finished conversion raises the GPADC interrupt
+	adc_register_interrupt(gpadc_stream_isr);
+
+	// First start kicks off the continuous conversions
+	adc_enable();
+	adc_start();
+	gpadc_stream_cfg.running = true;
+}
+
+bool gpadc_stream_is_running(void)
+{
+	return gpadc_stream_cfg.running;
+}
+
+uint16_t gpadc_stream_count(void)
+{
+	// Indices are free-running so unsigned subtraction handles wrap-around
+	return (uint16_t)(gpadc_ring.head - gpadc_ring.tail);
+}
+
+uint16_t gpadc_stream_read(uint16_t *dst, uint16_t max_samples, uint32_t *last_time_us)
+{
+	uint16_t head;
+	uint32_t head_time_us;
+
+	// Snapshot producer index and its stamp together, retry if a sample arrived in between
+	do
+	{
+		head = gpadc_ring.head;
+		head_time_us = gpadc_ring.head_time_us;
+	} while (head != gpadc_ring.head);
+
+	uint16_t tail = gpadc_ring.tail;
+	uint16_t count = 0;
+
+	while (tail != head && count < max_samples)
+	{
+		dst[count++] = gpadc_ring.data[tail & GPADC_STREAM_BUF_MASK];
+		tail++;
+	}
+
+	// Make sure samples are copied before the slots are handed back to the interrupt
+	__DMB();
+	gpadc_ring.tail = tail;
+
+	// Samples left behind were taken after the last copied one, one interval apart
+	if (count > 0)
+	{
+		*last_time_us = head_time_us - (uint32_t)(uint16_t)(head - tail) * gpadc_stream_cfg.interval_mult * 1024U;
+	}
+
+	return count;
+}
+
+uint16_t gpadc_stream_take_dropped(void)
+{
+	uint16_t dropped = gpadc_ring.dropped;
+	uint16_t delta = (uint16_t)(dropped - gpadc_stream_dropped_seen);
+
+	gpadc_stream_dropped_seen = dropped;
+
+	return delta;
+}
+
+void gpadc_stream_isr(void)
+{
+	// Fetch raw ADC result then apply SDK correction routine (config-dependent)
+	uint16_t sample = adc_correct_sample(GetWord16(GP_ADC_RESULT_REG));
+	uint32_t time_us = timebase_now_us();
+	adc_clear_interrupt();
+
+	uint16_t head = gpadc_ring.head;
+
+	// Buffer full, count sample as dropped instead of overwriting unread data
+	if ((uint16_t)(head - gpadc_ring.tail) >= GPADC_STREAM_BUF_SIZE)
+	{
+		gpadc_ring.dropped++;
+		return;
+	}
+
+	gpadc_ring.data[head & GPADC_STREAM_BUF_MASK] = sample;
+	gpadc_ring.head_time_us = time_us;
+
+	// Make sure the sample is stored before the consumer can see the new index
+	__DMB();
+	gpadc_ring.head = head + 1;
+}
+
+/// @} APP
@@ -0,0 +1,191 @@
+/**
+ ****************************************************************************************
+ * @file user_adc_stream.h
+ * @brief Interrupt-driven continuous GPADC acquisition into a RAM ring buffer.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_ADC_STREAM_H_
+#define _USER_ADC_STREAM_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// For ADC types
+#include "adc_531.h"
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// Ring buffer length in samples, must be a power of two so indices can wrap with a mask
+#define GPADC_STREAM_BUF_SIZE 64
+#define GPADC_STREAM_BUF_MASK (GPADC_STREAM_BUF_SIZE - 1)
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Single-producer/single-consumer sample ring buffer
+typedef struct
+{
+    volatile uint16_t head;                  ///< Free-running write index, only written by the ADC interrupt
+    volatile uint16_t tail;                  ///< Free-running read index, only written by the application
+    volatile uint16_t dropped;               ///< Samples lost because the buffer was full, only written by the ADC interrupt
+    volatile uint32_t head_time_us;          ///< Timestamp of the newest sample (index head - 1), only written by the ADC interrupt
+    uint16_t data[GPADC_STREAM_BUF_SIZE];    ///< Corrected raw ADC samples
+} gpadc_ring_t;
+
+/// Saved continuous acquisition settings
+typedef struct
+{
+    bool started;                            ///< Between gpadc_stream_start() and gpadc_stream_stop()
+    bool running;                            ///< Continuous conversions are active (false while suspended)
+    adc_input_se_t input;                    ///< ADC input being streamed
+    adc_input_attn_t input_attenuator;       ///< Input attenuator setting
+    uint8_t oversampling;                    ///< Hardware oversampling setting (0 to 7)
+    uint8_t interval_mult;                   ///< Interval between conversions in 1.024 ms units
+} gpadc_stream_cfg_t;
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Start continuous ADC conversions that fill the ring buffer from the GPADC interrupt.
+ *
+ * @param[in] input            ADC input channel (e.g., P0_6).
+ * @param[in] input_attenuator Attenuation factor for the ADC input.
+ * @param[in] oversampling     Hardware oversampling setting (0 to 7).
+ * @param[in] interval_mult    Interval between conversions in 1.024 ms units (1 to 255).
+ *
+ * @details
+ *  - Configures the ADC in continuous mode through gpadc_configure() so the cached offset
+ *    calibration is reused.
+ *  - Registers gpadc_stream_isr() as the GPADC interrupt callback and starts conversions.
+ *  - Empties the ring buffer and clears the dropped sample counter.
+ *
+ * @note The ADC interval timer runs from the system clock, so SLEEP_OWNER_ADC_STREAM holds
+ *       the SoC out of extended sleep until gpadc_stream_stop() is called.
+ * @sa gpadc_stream_stop, gpadc_stream_read, gpadc_configure
+ ****************************************************************************************
+ */
+void gpadc_stream_start(adc_input_se_t input, adc_input_attn_t input_attenuator, uint8_t oversampling, uint8_t interval_mult);
+
+/**
+ ****************************************************************************************
+ * @brief Stop continuous ADC conversions and power down the ADC.
+ *
+ * @details Samples already in the ring buffer stay available to gpadc_stream_read().
+ *          The stream's sleep inhibit is released, other holders may still keep the SoC awake.
+ * @sa gpadc_stream_start
+ ****************************************************************************************
+ */
+void gpadc_stream_stop(void);
+
+/**
+ ****************************************************************************************
+ * @brief Temporarily stop the stream so the ADC can be used for a single-shot conversion.
+ *
+ * @return true if a stream was running and must be restarted with gpadc_stream_resume().
+ *
+ * @sa gpadc_stream_resume, gpadc_sched_timer_cb
+ ****************************************************************************************
+ */
+bool gpadc_stream_suspend(void);
+
+/**
+ ****************************************************************************************
+ * @brief Restart a stream stopped by gpadc_stream_suspend() with its saved settings.
+ *
+ * @sa gpadc_stream_suspend
+ ****************************************************************************************
+ */
+void gpadc_stream_resume(void);
+
+/**
+ ****************************************************************************************
+ * @brief Check whether continuous acquisition is active.
+ *
+ * @return true if the stream is running.
+ ****************************************************************************************
+ */
+bool gpadc_stream_is_running(void);
+
+/**
+ ****************************************************************************************
+ * @brief Number of samples waiting in the ring buffer.
+ *
+ * @return Sample count (0 to GPADC_STREAM_BUF_SIZE).
+ ****************************************************************************************
+ */
+uint16_t gpadc_stream_count(void);
+
+/**
+ ****************************************************************************************
+ * @brief Drain up to max_samples samples from the ring buffer in one call.
+ *
+ * @param[out] dst           Destination array for corrected raw samples (oldest first).
+ * @param[in]  max_samples   Capacity of dst in samples.
+ * @param[out] last_time_us  Timebase stamp of the last copied sample, unchanged if none were copied.
+ * @return Number of samples copied.
+ *
+ * @details Only the application (consumer) side calls this function. The read index is
+ *          published after the copy so the interrupt never overwrites unread samples.
+ *          Conversions are evenly spaced by the interval timer, so sample i was taken
+ *          (count - 1 - i) x interval_mult x 1024 us before last_time_us.
+ * @sa gpadc_stream_isr, timebase_now_us
+ ****************************************************************************************
+ */
+uint16_t gpadc_stream_read(uint16_t *dst, uint16_t max_samples, uint32_t *last_time_us);
+
+/**
+ ****************************************************************************************
+ * @brief Number of samples dropped because the buffer was full since the previous call.
+ *
+ * @return Dropped sample count since the previous call.
+ *
+ * @details The interrupt only increments gpadc_ring_t::dropped; the application keeps its
+ *          own copy of the last value seen so the counter is never written by both sides.
+ ****************************************************************************************
+ */
+uint16_t gpadc_stream_take_dropped(void);
+
+/**
+ ****************************************************************************************
+ * @brief GPADC interrupt callback (producer side of the ring buffer).
+ *
+ * @details Reads and corrects the conversion result, clears the interrupt and pushes the
+ *          sample together with its timebase stamp. When the buffer is full the sample is
+ *          counted as dropped instead.
+ * @sa adc_register_interrupt, adc_correct_sample, timebase_now_us
+ ****************************************************************************************
+ */
+void gpadc_stream_isr(void);
+
+/// @} APP
+
+#endif // _USER_ADC_STREAM_H_
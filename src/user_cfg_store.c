@@ -0,0 +1,314 @@
+/**
+ ****************************************************************************************
+ * @file user_cfg_store.c
+ * @brief Versioned, CRC-protected configuration records in SPI flash, written round-robin
+ *        over a few sectors so no sector is erased more than its share.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h" // SW configuration
+#include "user_cfg_store.h"
+#include "user_periph_setup.h"
+
+#ifdef CFG_SPI_FLASH_ENABLE
+#include "spi_flash.h"
+#endif
+
+#include <string.h>
+
+/*
+ ****************************************************************************************
+ * DEFINITIONS
+ ****************************************************************************************
+ */
+
+static const uint16_t CFG_STORE_SLOTS_PER_SECTOR = CFG_STORE_SECTOR_SIZE / CFG_STORE_SLOT_SIZE;
+static const uint8_t CFG_STORE_CHUNK = 32U; // blank checks and read-back go through a small stack buffer
+
+/*
+----------------------------------
+- Retained / Global variables
+----------------------------------
+*/
+
+// These variables are retained across sleep cycles
+
+cfg_store_t cfg_store __SECTION_ZERO("retention_mem_area0");
+
+/*
+ ****************************************************************************************
+ * LOCAL FUNCTIONS
+ ****************************************************************************************
+*/
+
+#ifdef CFG_SPI_FLASH_ENABLE
+
+static uint32_t cfg_store_slot_addr(uint16_t slot)
+{
+	return CFG_STORE_FLASH_ADDR + (uint32_t)slot * CFG_STORE_SLOT_SIZE;
+}
+
+static uint16_t cfg_store_next_sector(uint16_t slot)
+{
+	return (uint16_t)(((slot / CFG_STORE_SLOTS_PER_SECTOR + 1U) % CFG_STORE_SECTORS) * CFG_STORE_SLOTS_PER_SECTOR);
+}
+
+static bool cfg_store_read(uint32_t addr, uint8_t *data, uint32_t length)
+{
+	uint32_t actual = 0;
+
+	return (spi_flash_read_data(data, addr, length, &actual) == SPI_FLASH_ERR_OK) && (actual == length);
+}
+
+static bool cfg_store_read_record(uint16_t slot, uint8_t *record)
+{
+	// Header first, blank and foreign slots are rejected without reading the rest
+	if (!cfg_store_read(cfg_store_slot_addr(slot), record, CFG_STORE_HEADER_SIZE))
+	{
+		return false;
+	}
+
+	uint16_t magic = (uint16_t)(record[0] | (record[1] << 8));
+	uint8_t length = record[3];
+	if (magic != CFG_STORE_MAGIC || length > CFG_STORE_MAX_PAYLOAD)
+	{
+		return false;
+	}
+
+	if (!cfg_store_read(cfg_store_slot_addr(slot) + CFG_STORE_HEADER_SIZE, &record[CFG_STORE_HEADER_SIZE], length + 2U))
+	{
+		return false;
+	}
+
+	uint16_t crc = (uint16_t)(record[CFG_STORE_HEADER_SIZE + length] | (record[CFG_STORE_HEADER_SIZE + length + 1U] << 8));
+
+	return cfg_store_crc16(0xFFFFU, record, CFG_STORE_HEADER_SIZE + length) == crc;
+}
+
+static bool cfg_store_slot_equals(uint16_t slot, uint8_t const *expected)
+{
+	uint8_t data[CFG_STORE_CHUNK];
+
+	// expected is NULL for an erased slot
+	for (uint16_t pos = 0; pos < CFG_STORE_SLOT_SIZE; pos += CFG_STORE_CHUNK)
+	{
+		if (!cfg_store_read(cfg_store_slot_addr(slot) + pos, data, sizeof(data)))
+		{
+			return false;
+		}
+
+		for (uint8_t i = 0; i < CFG_STORE_CHUNK; i++)
+		{
+			if (data[i] != ((expected != NULL) ? expected[pos + i] : 0xFFU))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool cfg_store_program(uint16_t slot, uint8_t *record)
+{
+	uint32_t actual = 0;
+
+	if (spi_flash_write_data(record, cfg_store_slot_addr(slot), CFG_STORE_SLOT_SIZE, &actual) != SPI_FLASH_ERR_OK ||
+	    actual != CFG_STORE_SLOT_SIZE)
+	{
+		return false;
+	}
+
+	// Read back, a worn or disturbed cell shows up here instead of at the next boot
+	return cfg_store_slot_equals(slot, record);
+}
+
+#endif
+
+/*
+ ****************************************************************************************
+ * CONFIGURATION STORE FUNCTIONS
+ ****************************************************************************************
+*/
+
+uint16_t cfg_store_crc16(uint16_t crc, uint8_t const *data, uint32_t length)
+{
+	for (uint32_t i = 0; i < length; i++)
+	{
+		crc ^= (uint16_t)data[i] << 8;
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ 0x1021U) : (uint16_t)(crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+bool cfg_store_init(void)
+{
+	memset(&cfg_store, 0, sizeof(cfg_store));
+
+	#ifdef CFG_SPI_FLASH_ENABLE
+	uint8_t dev_id = 0;
+
+	// Boards without the flash fitted keep running on defaults
+	spi_flash_release_from_power_down();
+	if (spi_flash_auto_detect(&dev_id) != SPI_FLASH_ERR_OK)
+	{
+		return false;
+	}
+
+	// Newest valid record wins, sequence numbers only grow
+	uint8_t record[CFG_STORE_SLOT_SIZE];
+	bool found = false;
+	uint16_t newest = 0;
+	for (uint16_t slot = 0; slot < CFG_STORE_SLOTS; slot++)
+	{
+		if (!cfg_store_read_record(slot, record))
+		{
+			continue;
+		}
+
+		uint32_t seq = (uint32_t)record[4] | ((uint32_t)record[5] << 8) | ((uint32_t)record[6] << 16) | ((uint32_t)record[7] << 24);
+		if (!found || seq > cfg_store.seq)
+		{
+			found = true;
+			newest = slot;
+			cfg_store.seq = seq;
+			cfg_store.version = record[2];
+			cfg_store.length = record[3];
+			memcpy(cfg_store.payload, &record[CFG_STORE_HEADER_SIZE], record[3]);
+		}
+	}
+
+	cfg_store.next_slot = found ? (uint16_t)((newest + 1U) % CFG_STORE_SLOTS) : 0;
+	cfg_store.ready = true;
+
+	spi_flash_power_down();
+
+	return true;
+	#else
+	return false;
+	#endif
+}
+
+bool cfg_store_load(uint8_t version, void *payload, uint8_t length)
+{
+	if (!cfg_store.ready || cfg_store.seq == 0 || cfg_store.version != version || cfg_store.length != length)
+	{
+		return false;
+	}
+
+	memcpy(payload, cfg_store.payload, length);
+
+	return true;
+}
+
+cfg_store_result_t cfg_store_save(uint8_t version, void const *payload, uint8_t length)
+{
+	if (!cfg_store.ready || length > CFG_STORE_MAX_PAYLOAD)
+	{
+		return CFG_STORE_ERROR;
+	}
+
+	// Flash is only touched when the payload differs from the newest record
+	if (cfg_store.seq != 0 && cfg_store.version == version && cfg_store.length == length &&
+	    memcmp(cfg_store.payload, payload, length) == 0)
+	{
+		cfg_store.skipped++;
+		return CFG_STORE_UNCHANGED;
+	}
+
+	#ifdef CFG_SPI_FLASH_ENABLE
+	uint32_t seq = cfg_store.seq + 1U;
+	uint8_t record[CFG_STORE_SLOT_SIZE];
+
+	// Unused bytes stay erased, the whole slot is programmed and verified
+	memset(record, 0xFF, sizeof(record));
+	record[0] = (uint8_t)(CFG_STORE_MAGIC & 0xFF);
+	record[1] = (uint8_t)(CFG_STORE_MAGIC >> 8);
+	record[2] = version;
+	record[3] = length;
+	record[4] = (uint8_t)(seq & 0xFF);
+	record[5] = (uint8_t)((seq >> 8) & 0xFF);
+	record[6] = (uint8_t)((seq >> 16) & 0xFF);
+	record[7] = (uint8_t)(seq >> 24);
+	memcpy(&record[CFG_STORE_HEADER_SIZE], payload, length);
+	uint16_t crc = cfg_store_crc16(0xFFFFU, record, CFG_STORE_HEADER_SIZE + length);
+	record[CFG_STORE_HEADER_SIZE + length] = (uint8_t)(crc & 0xFF);
+	record[CFG_STORE_HEADER_SIZE + length + 1U] = (uint8_t)(crc >> 8);
+
+	// The sector holding the newest record is never erased, it is the fallback after a reset
+	uint16_t newest_sector = (uint16_t)(((cfg_store.next_slot + CFG_STORE_SLOTS - 1U) % CFG_STORE_SLOTS) / CFG_STORE_SLOTS_PER_SECTOR);
+	uint16_t slot = cfg_store.next_slot;
+	bool written = false;
+
+	spi_flash_release_from_power_down();
+
+	for (uint8_t tries = 0; tries < 2U * CFG_STORE_SECTORS && !written; tries++)
+	{
+		bool sector_start = (slot % CFG_STORE_SLOTS_PER_SECTOR) == 0;
+
+		if (sector_start && cfg_store.seq != 0 && (slot / CFG_STORE_SLOTS_PER_SECTOR) == newest_sector)
+		{
+			break;
+		}
+
+		if (sector_start)
+		{
+			if (spi_flash_block_erase(cfg_store_slot_addr(slot), SPI_FLASH_OP_SE) != SPI_FLASH_ERR_OK)
+			{
+				break;
+			}
+			cfg_store.erases++;
+		}
+		else if (!cfg_store_slot_equals(slot, NULL))
+		{
+			// Left over from a write cut short by a reset, start on a fresh sector
+			slot = cfg_store_next_sector(slot);
+			continue;
+		}
+
+		written = cfg_store_program(slot, record);
+		if (!written)
+		{
+			slot = cfg_store_next_sector(slot);
+		}
+	}
+
+	spi_flash_power_down();
+
+	if (!written)
+	{
+		return CFG_STORE_ERROR;
+	}
+
+	cfg_store.seq = seq;
+	cfg_store.version = version;
+	cfg_store.length = length;
+	memcpy(cfg_store.payload, payload, length);
+	cfg_store.next_slot = (uint16_t)((slot + 1U) % CFG_STORE_SLOTS);
+	cfg_store.writes++;
+
+	return CFG_STORE_WRITTEN;
+	#else
+	return CFG_STORE_ERROR;
+	#endif
+}
+
+cfg_store_t const *cfg_store_get(void)
+{
+	return &cfg_store;
+}
+
+/// @} APP
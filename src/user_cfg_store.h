@@ -0,0 +1,153 @@
+/**
+ ****************************************************************************************
+ * @file user_cfg_store.h
+ * @brief Versioned, CRC-protected configuration records in SPI flash, written round-robin
+ *        over a few sectors so no sector is erased more than its share.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_CFG_STORE_H_
+#define _USER_CFG_STORE_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// Record layout: [magic (2), version, length, seq (4), payload, crc (2)], one record per slot
+#define CFG_STORE_MAGIC          0xC5A1U
+#define CFG_STORE_SLOT_SIZE      128U
+#define CFG_STORE_HEADER_SIZE    8U
+#define CFG_STORE_MAX_PAYLOAD    (CFG_STORE_SLOT_SIZE - CFG_STORE_HEADER_SIZE - 2U)
+
+// Flash region at CFG_STORE_FLASH_ADDR (user_periph_setup.h), erased one sector at a time
+#define CFG_STORE_SECTOR_SIZE    4096U
+#define CFG_STORE_SECTORS        2U
+#define CFG_STORE_SLOTS          (CFG_STORE_SECTORS * CFG_STORE_SECTOR_SIZE / CFG_STORE_SLOT_SIZE)
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Outcome of cfg_store_save()
+typedef enum
+{
+    CFG_STORE_WRITTEN = 0,      ///< A new record was programmed
+    CFG_STORE_UNCHANGED,        ///< Payload equals the newest record, nothing was written
+    CFG_STORE_ERROR             ///< No flash, payload too long or a flash operation failed
+} cfg_store_result_t;
+
+/// Store state, kept in retention RAM
+typedef struct
+{
+    bool ready;                 ///< Flash answered and the region was scanned
+    uint8_t version;            ///< Version of the newest record
+    uint8_t length;             ///< Payload length of the newest record, 0 if there is none
+    uint32_t seq;               ///< Sequence number of the newest record, 0 if there is none
+    uint16_t next_slot;         ///< Slot the next record is programmed into
+    uint8_t payload[CFG_STORE_MAX_PAYLOAD]; ///< Payload of the newest record, to skip unchanged saves
+    uint16_t writes;            ///< Records programmed since boot
+    uint16_t erases;            ///< Sectors erased since boot
+    uint16_t skipped;           ///< Saves that found nothing changed
+} cfg_store_t;
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief CRC-16/CCITT-FALSE (polynomial 0x1021).
+ *
+ * @param[in] crc     Running CRC, 0xFFFF to start.
+ * @param[in] data    Bytes to add.
+ * @param[in] length  Number of bytes.
+ * @return Updated CRC.
+ ****************************************************************************************
+ */
+uint16_t cfg_store_crc16(uint16_t crc, uint8_t const *data, uint32_t length);
+
+/**
+ ****************************************************************************************
+ * @brief Detect the flash and find the newest valid record.
+ *
+ * @return true if the flash answered, whether or not a record was found.
+ *
+ * @details
+ *  - Every slot with the magic, a valid length and a matching CRC is a candidate; the one
+ *    with the highest sequence number wins. Torn or foreign slots are ignored, so a reset
+ *    during a write falls back to the previous record.
+ *  - The next record goes into the slot after the newest one.
+ *  - The flash is put back into power-down afterwards.
+ ****************************************************************************************
+ */
+bool cfg_store_init(void);
+
+/**
+ ****************************************************************************************
+ * @brief Copy the newest record.
+ *
+ * @param[in]  version  Payload layout the caller expects.
+ * @param[out] payload  Destination, untouched unless true is returned.
+ * @param[in]  length   Payload size the caller expects.
+ * @return true if a record with this version and length exists.
+ ****************************************************************************************
+ */
+bool cfg_store_load(uint8_t version, void *payload, uint8_t length);
+
+/**
+ ****************************************************************************************
+ * @brief Store a new record if the payload changed.
+ *
+ * @param[in] version  Payload layout version.
+ * @param[in] payload  Payload bytes.
+ * @param[in] length   Payload size, at most CFG_STORE_MAX_PAYLOAD.
+ * @return CFG_STORE_WRITTEN, CFG_STORE_UNCHANGED or CFG_STORE_ERROR.
+ *
+ * @details
+ *  - Wear levelling: records are appended slot by slot and the region is used as a ring.
+ *    A sector is erased only when the next record starts it, so every sector is erased
+ *    once per CFG_STORE_SLOTS records. The erased sector never holds the newest record.
+ *  - A slot that is not blank (e.g. a torn write before a reset) is skipped by moving on to
+ *    the next sector.
+ *  - Blocks for the page program and read-back, plus a sector erase (tens of ms) every
+ *    CFG_STORE_SECTOR_SIZE / CFG_STORE_SLOT_SIZE records.
+ ****************************************************************************************
+ */
+cfg_store_result_t cfg_store_save(uint8_t version, void const *payload, uint8_t length);
+
+/**
+ ****************************************************************************************
+ * @brief Store state.
+ * @return Pointer to the retained store state.
+ ****************************************************************************************
+ */
+cfg_store_t const *cfg_store_get(void);
+
+/// @} APP
+
+#endif // _USER_CFG_STORE_H_
@@ -29,6 +29,37 @@
 // For ADC functions
 #include "adc.h"
 #include "adc_531.h"
+#include "user_adc_stream.h"
+
+// For integer ADC conversion to mV and uV
+#include "user_gpadc_conv.h"
+
+// For sample timestamps
+#include "user_timebase.h"
+
+// For drift-free periodic tasks sharing one wake-up
+#include "user_periodic.h"
+
+// For sleep management
+#include "user_sleep_inhibit.h"
+
+// For PWM register shadows kept across sleep
+#include "user_pwm_shadow.h"
+
+// For division-free battery compensation
+#include "user_pwm_comp.h"
+
+// For the PWM frequency planner
+#include "user_pwm_plan.h"
+
+// For the closed-loop bias controller
+#include "user_pwm_loop.h"
+
+// For configuration records in SPI flash
+#include "user_cfg_store.h"
+
+// For the offline sensor log in SPI flash
+#include "user_log_store.h"
 
 // For timer 2 functions
 #include "timer0_2.h"
@@ -40,6 +71,9 @@
 // For BLE notifications
 #include "user_custs1_def.h"
 
+// For the free TX buffer count that paces log downloads
+#include "l2cm.h"
+
 // For PWM and sleep management
 #include "arch_api.h"
 
@@ -59,19 +93,107 @@
     #define ADC_ENUM_INPUT ADC_INPUT_SE_P0_6   // default USB devkit ADC pin
 #endif
 
+// Bias feedback pin of the closed-loop mode, BIAS_FB_INPUT_PIN in user_periph_setup.h
+#define BIAS_FB_ENUM_INPUT ADC_INPUT_SE_P0_2
+
 // Constants for Undervoltage Protection (UVP)
 static const uint16_t UVP_SHUTDOWN_THRESHOLD_MV = 1850U;
 static const uint16_t UVP_RESTART_THRESHOLD_MV = 1900U;
 
-// Constant ADC offset from GND measurement
-// Seems to be better to not include offset since measurements are not linear
-static const uint16_t ADC_OFFSET_MV = 0U;
+// Two-point ADC linearity correction per input attenuator, raw readings (mV) for a true 0 V and full-scale input
+// ADC reads 34 mV for GND with no attenuation but is accurate near full scale, so a plain offset over-corrects
+// Attenuated ranges have not been measured yet and use an identity correction
+static const gpadc_lin_cal_t GPADC_LIN_CAL[4] =
+{
+	[ADC_INPUT_ATTN_NO] = { .raw_zero_mv = 34U, .raw_fs_mv =  900U },
+	[ADC_INPUT_ATTN_2X] = { .raw_zero_mv =  0U, .raw_fs_mv = 1800U },
+	[ADC_INPUT_ATTN_3X] = { .raw_zero_mv =  0U, .raw_fs_mv = 2700U },
+	[ADC_INPUT_ATTN_4X] = { .raw_zero_mv =  0U, .raw_fs_mv = 3600U }
+};
+
+// Constants for ADC offset calibration cache
+#define GPADC_CAL_CACHE_SIZE 4                        // number of input/attenuation combinations cached
+static const uint16_t GPADC_CAL_MAX_USES      = 600U; // recalibrate after this many reuses (10 min for 1 s sensor reads)
+static const uint16_t GPADC_CAL_VBAT_DELTA_MV = 50U;  // recalibrate if VBAT moved more than this since last calibration
+
+// Constants for continuous sensor acquisition, interval is set by the client (0 keeps the burst read every 1 second)
+static const uint8_t SENSOR_STREAM_OVERSAMPLING  = 2U; // hardware oversampling setting per streamed sample
+static const uint8_t SENSOR_STREAM_MIN_INTERVAL = 20U; // ring of GPADC_STREAM_BUF_SIZE samples is drained every 1 s, 64 x 20 x 1.024 ms = 1.31 s leaves room for a late drain
+
+// Constants for framed sensor notifications, frame layout is defined in user_empty_peripheral_template.h
+static const uint16_t BLE_DEFAULT_MTU    = 23U;  // ATT MTU before the exchange completes
+static const uint16_t BLE_ATT_NTF_HDR    = 3U;   // opcode and handle in each notification
+static const uint16_t BLE_MAX_TX_OCTETS  = 251U; // LE data length requested after connection
+static const uint32_t SENSOR_FRAME_MAX_JITTER_US = 2000U; // largest stamp error kept inside one evenly spaced frame
+
+// Constants for sensor burst sampling, 2^3 bursts of 2^4 oversampled conversions match the old 2^7 conversion count
+static const uint8_t SENSOR_BURST_LOG2_N       = 3U; // number of conversions per burst as a power of two
+static const uint8_t SENSOR_BURST_OVERSAMPLING = 4U; // hardware oversampling setting per burst conversion
+#define GPADC_BURST_MAX_LOG2_N 6                     // largest burst (64 samples) that keeps the boxcar sum in 32 bits
+
+// Constants for the ADC sampling scheduler, every channel period must be a multiple of the base tick
+static const uint16_t GPADC_SCHED_TICK = 50U; // scheduler wake-up period in 10 ms timer ticks (0.5 s)
+static const uint16_t GPADC_SCHED_SLACK = 0U; // samples are taken on their deadline, other tasks align to them
+
+// Constants for PWM duty cycle compensation, deadband is set in da14531_config_basic.h
+#ifndef CFG_PWM_VBAT_DEADBAND_MV
+#define CFG_PWM_VBAT_DEADBAND_MV 2
+#endif
+static const uint16_t PWM_VBAT_DEADBAND_MV = CFG_PWM_VBAT_DEADBAND_MV; // duty cycles are recomputed when VBAT moves further than this
+
+#ifdef CFG_PWM_DITHER
+// Constants for PWM dithering, one sigma-delta step per timer tick (Timer2 has no period interrupt)
+static const uint16_t PWM_DITHER_TICK = 1U; // dither step period in 10 ms timer ticks
+#endif
 
-// Constants from datasheet
-static const uint16_t MIN_PWM_DIV     = 2U;
-static const uint16_t MAX_PWM_DIV     = 16383U;
-static const uint32_t SYS_CLK_FREQ_HZ = 16000000U;
-static const uint32_t LP_CLK_FREQ_HZ  = 32000U;
+// Constants from datasheet, shared with the frequency planner
+static const uint16_t MIN_PWM_DIV     = PWM_PLAN_MIN_DIV;
+static const uint16_t MAX_PWM_DIV     = PWM_PLAN_MAX_DIV;
+static const uint32_t SYS_CLK_FREQ_HZ = PWM_PLAN_SYS_CLK_HZ;
+static const uint32_t LP_CLK_FREQ_HZ  = PWM_PLAN_LP_CLK_HZ;
+
+// Frequency planner falls back to this VBAT before the first reading
+static const uint16_t PWM_PLAN_NOMINAL_VBAT_MV = 3000U;
+
+// Constants for bias ramps, the bias counts as settled once the filter is within the tolerance of every target
+static const uint16_t PWM_RAMP_TICK = 1U;                    // ramp step period in 10 ms timer ticks
+static const uint16_t PWM_RAMP_DEFAULT_MV_PER_S = 0U;        // 0 jumps straight to the target, as before ramps existed
+static const uint16_t PWM_BIAS_FILTER_TAU_MS_DEFAULT = 100U; // bias RC filter time constant, to be measured on the board
+static const uint16_t PWM_SETTLE_TOLERANCE_MV = 1U;          // residual filter error accepted as settled
+
+// Constants for the closed-loop bias mode, the feedback pin reads the bias on top of the amplifier's virtual ground (HW specific)
+static const uint16_t PWM_BIAS_FB_REF_MV = BIAS_FB_REF_MV;   // virtual ground on the feedback pin, board value in user_periph_setup.h
+static const uint8_t PWM_LOOP_OFF = 0xFFU;                   // loop channel value for open loop
+static const uint16_t PWM_LOOP_DEFAULT_PERIOD = 50U;         // loop period in 10 ms timer ticks (0.5 s)
+static const uint16_t PWM_LOOP_MIN_PERIOD = 5U;              // shortest loop period, a bias burst must fit in it
+static const uint8_t PWM_LOOP_DEFAULT_KP_Q8 = 64U;           // proportional gain 0.25
+static const uint8_t PWM_LOOP_DEFAULT_KI_Q8 = 128U;          // integral gain 0.5 per sample
+static const int32_t PWM_LOOP_TRIM_MAX_UV = 200000;          // largest correction of the feed-forward bias
+static const int32_t PWM_LOOP_TOLERANCE_UV = 1000;           // error band counted as converged
+static const uint8_t PWM_LOOP_CONVERGED_SAMPLES = 3U;        // samples in a row inside the band to count as converged
+
+// Constants for the automatic zero calibration, measured on the closed-loop feedback pin
+static const uint16_t PWM_ZCAL_TICK = 2U;                    // one bias burst per 20 ms once the filter has settled
+static const uint8_t PWM_ZCAL_LOG2_BURSTS = 4U;              // 16 bursts per calibration point
+static const uint8_t PWM_ZCAL_SETTLE_TAUS = 7U;              // e^-7 leaves under 1 mV of a 1 V step
+static const uint32_t PWM_ZCAL_MAX_MS = 20000U;              // runs needing a longer time budget are refused
+static const uint16_t PWM_ZCAL_MAX_STDERR_UV = 1000U;        // noisier points are rejected, confidence reaches 0 here
+static const int32_t PWM_ZCAL_MAX_OFFSET_UV = 300000;        // larger offsets point to a wiring fault
+static const uint16_t PWM_ZCAL_MIN_GAIN_Q12 = 3277U;         // 0.8
+static const uint16_t PWM_ZCAL_MAX_GAIN_Q12 = 4915U;         // 1.2
+static const int32_t PWM_GAIN_Q12_ONE = PWM_ZCAL_GAIN_Q12_ONE; // gain of 1.0
+static const uint16_t PWM_ZERO_CAL_KEEP = 0x8000U;           // zero_cal in a vbias write that keeps the stored value
+
+// Constants for the PWM configuration record in SPI flash
+static const uint8_t PWM_CFG_VERSION = 2U;                   // bump when pwm_cfg_t changes, older records are ignored
+static const uint16_t PWM_CFG_SAVE_DELAY = 500U;             // save 5 s after the last change, in 10 ms timer ticks
+
+// Constants for the sensor log
+static const uint16_t LOG_ERASE_DELAY = 5U;                  // erase the next sector 50 ms after the block that needs it, in 10 ms timer ticks
+
+// Constants for the log download
+static const uint8_t LOG_DL_MAX_IN_FLIGHT = 4U;              // data notifications queued in the BLE stack at once
+static const uint16_t LOG_DL_RESERVED_BUFFERS = 1U;          // TX buffers left for the other characteristics
 
 /*
 ----------------------------------
@@ -82,25 +204,137 @@ static const uint32_t LP_CLK_FREQ_HZ  = 32000U;
 // These variables are retained across sleep cycles
 
 // UVP variables
-timer_hnd uvp_timer __SECTION_ZERO("retention_mem_area0");
-bool uvp_timer_initialized __SECTION_ZERO("retention_mem_area0");
 uint16_t uvp_cccd_value __SECTION_ZERO("retention_mem_area0");
 uint16_t uvp_adc_sample_raw __SECTION_ZERO("retention_mem_area0");
 uint16_t uvp_adc_sample_mv __SECTION_ZERO("retention_mem_area0");
 bool uvp_shutdown __SECTION_ZERO("retention_mem_area0");
 
 // Sensor voltage variables
-timer_hnd sensor_timer __SECTION_ZERO("retention_mem_area0");
 uint16_t sensor_adc_sample_raw __SECTION_ZERO("retention_mem_area0");
 uint16_t sensor_adc_sample_mv __SECTION_ZERO("retention_mem_area0");
+uint32_t sensor_adc_sample_uv __SECTION_ZERO("retention_mem_area0");
+uint16_t sensor_adc_noise_q4 __SECTION_ZERO("retention_mem_area0");
+bool sensor_notify __SECTION_ZERO("retention_mem_area0");      // client enabled notifications on this connection
+bool sensor_log_enabled __SECTION_ZERO("retention_mem_area0"); // readings are appended to the flash log
+periodic_task_t log_erase_task __SECTION_ZERO("retention_mem_area0"); // erases the next log sector outside the sampling path
+
+// Log download variables
+uint8_t log_dl_state __SECTION_ZERO("retention_mem_area0");          // log_dl_state_t
+uint16_t log_dl_cccd_value __SECTION_ZERO("retention_mem_area0");    // data stream CCCD written by the client
+uint8_t log_dl_in_flight __SECTION_ZERO("retention_mem_area0");      // data notifications not yet confirmed by the stack
+log_store_cursor_t log_dl_cursor __SECTION_ZERO("retention_mem_area0");
+uint32_t log_dl_bytes __SECTION_ZERO("retention_mem_area0");         // log bytes sent since the start
+uint32_t log_dl_start_us __SECTION_ZERO("retention_mem_area0");
+uint32_t log_dl_duration_ms __SECTION_ZERO("retention_mem_area0");   // final once the end is reached
+
+// Sensor stream and framed notification variables
+uint8_t sensor_mode __SECTION_ZERO("retention_mem_area0");                  // sensor_mode_t set by the client
+uint8_t sensor_frame_samples __SECTION_ZERO("retention_mem_area0");         // samples per frame requested by the client
+uint8_t sensor_stream_interval_mult __SECTION_ZERO("retention_mem_area0");  // continuous interval, 0 = burst every 1 s
+uint8_t sensor_encoding __SECTION_ZERO("retention_mem_area0");              // sample_codec_t for framed samples, per connection
+uint16_t ble_mtu __SECTION_ZERO("retention_mem_area0");                     // negotiated ATT MTU
+sensor_frame_t sensor_frame __SECTION_ZERO("retention_mem_area0");
+
+// ADC sampling scheduler variables, one timer serves every channel
+periodic_task_t gpadc_sched_task __SECTION_ZERO("retention_mem_area0");
+bool gpadc_sched_initialized __SECTION_ZERO("retention_mem_area0");
+uint8_t gpadc_sched_enabled __SECTION_ZERO("retention_mem_area0");                    // bit mask of enabled channels
+uint16_t gpadc_sched_elapsed[GPADC_CH_COUNT] __SECTION_ZERO("retention_mem_area0"); // ticks since each channel was last sampled
+
+// Millivolt conversion descriptor for the current ADC configuration
+gpadc_conv_t gpadc_conv __SECTION_ZERO("retention_mem_area0");
+
+// ADC offset calibration cache, ADC registers are lost in sleep but the calibration result is still valid
+gpadc_cal_entry_t gpadc_cal_cache[GPADC_CAL_CACHE_SIZE] __SECTION_ZERO("retention_mem_area0");
 
 // PWM variables
-timer_hnd pwm_dc_control_timer __SECTION_ZERO("retention_mem_area0");
-int16_t target_vbias_1_mv __SECTION_ZERO("retention_mem_area0");
-int16_t target_vbias_2_mv __SECTION_ZERO("retention_mem_area0");
-uint32_t pulse_width_1 __SECTION_ZERO("retention_mem_area0");
-uint32_t pulse_width_2 __SECTION_ZERO("retention_mem_area0");
+bool pwm_enabled __SECTION_ZERO("retention_mem_area0");          // outputs running, holds SLEEP_OWNER_PWM
+pwm_channel_state_t pwm_channels[PWM_CHANNEL_COUNT] __SECTION_ZERO("retention_mem_area0"); // indexed like the user_pwm_shadow channel table
 uint32_t period_width __SECTION_ZERO("retention_mem_area0");
+pwm_comp_t pwm_comp __SECTION_ZERO("retention_mem_area0"); // reciprocal of 7 * VBAT, rebuilt when VBAT leaves the deadband
+uint16_t pwm_vbat_updates __SECTION_ZERO("retention_mem_area0"); // compensation passes triggered by VBAT
+uint16_t pwm_end_writes __SECTION_ZERO("retention_mem_area0");   // END_CYCLE values that actually changed
+#ifdef CFG_PWM_DITHER
+periodic_task_t pwm_dither_task __SECTION_ZERO("retention_mem_area0"); // sigma-delta steps while the outputs run
+#endif
+pwm_plan_t pwm_plan __SECTION_ZERO("retention_mem_area0"); // last planner result, pwm_div is 0 until a plan was applied
+
+// PWM bias ramp variables
+periodic_task_t pwm_ramp_task __SECTION_ZERO("retention_mem_area0"); // ramp steps and settle wait after a bias change
+uint16_t pwm_ramp_slew_mv_per_s __SECTION_ZERO("retention_mem_area0"); // client slew rate, 0 = no ramp
+uint16_t pwm_bias_tau_ms __SECTION_ZERO("retention_mem_area0");        // client bias filter time constant
+uint16_t pwm_ramp_lag_mv __SECTION_ZERO("retention_mem_area0");        // largest filter lag expected when the ramps end
+uint32_t pwm_ramp_start_us __SECTION_ZERO("retention_mem_area0");      // timebase time of the last bias change
+uint32_t pwm_settle_deadline_us __SECTION_ZERO("retention_mem_area0"); // filter expected settled, once every ramp is done
+bool pwm_ramp_settling __SECTION_ZERO("retention_mem_area0");          // every ramp is done, waiting for the filter
+bool pwm_bias_settled __SECTION_ZERO("retention_mem_area0");           // filtered bias within PWM_SETTLE_TOLERANCE_MV of every target
+uint32_t pwm_settle_ms __SECTION_ZERO("retention_mem_area0");          // last bias change to settle time
+
+// PWM closed-loop bias variables
+periodic_task_t pwm_loop_task __SECTION_ZERO("retention_mem_area0");   // reads the bias feedback once per loop period
+pwm_loop_pi_t pwm_loop_pi __SECTION_ZERO("retention_mem_area0");       // controller of the regulated channel
+uint8_t pwm_loop_channel __SECTION_ZERO("retention_mem_area0");        // regulated channel index, PWM_LOOP_OFF in open loop
+uint16_t pwm_loop_period __SECTION_ZERO("retention_mem_area0");        // loop period in 10 ms timer ticks
+int16_t pwm_loop_setpoint_mv __SECTION_ZERO("retention_mem_area0");    // setpoint the convergence timer runs for
+uint32_t pwm_loop_start_us __SECTION_ZERO("retention_mem_area0");      // timebase time of the last setpoint change
+uint8_t pwm_loop_in_band __SECTION_ZERO("retention_mem_area0");        // consecutive samples within PWM_LOOP_TOLERANCE_UV
+int32_t pwm_loop_residual_uv __SECTION_ZERO("retention_mem_area0");    // error of the last sample
+uint32_t pwm_loop_converge_ms __SECTION_ZERO("retention_mem_area0");   // setpoint change to convergence, 0 until converged
+
+// PWM automatic zero calibration variables
+periodic_task_t pwm_zcal_task __SECTION_ZERO("retention_mem_area0");   // settle waits and bursts of a calibration run
+pwm_zcal_t pwm_zcal __SECTION_ZERO("retention_mem_area0");             // run state
+pwm_zcal_result_t pwm_zcal_results[PWM_CHANNEL_COUNT] __SECTION_ZERO("retention_mem_area0"); // last result per channel
+
+// PWM configuration record variables
+periodic_task_t pwm_cfg_save_task __SECTION_ZERO("retention_mem_area0"); // delayed save after the last change
+pwm_cfg_t pwm_cfg_boot __SECTION_ZERO("retention_mem_area0");            // record loaded at boot, applied on the first main loop pass
+bool pwm_cfg_boot_valid __SECTION_ZERO("retention_mem_area0");           // pwm_cfg_boot holds a record to apply
+bool pwm_client_enabled __SECTION_ZERO("retention_mem_area0");           // outputs last switched on by the client, kept through UVP
+
+/*
+----------------------------------
+- ADC channel table
+----------------------------------
+*/
+
+// Channels read by gpadc_sched_timer_cb(), due channels share one ADC power-up in table order
+static const gpadc_sched_channel_t gpadc_sched_channels[GPADC_CH_COUNT] =
+{
+	[GPADC_CH_VBAT] =
+	{
+		.input = ADC_INPUT_SE_VBAT_HIGH,
+		.input_attenuator = ADC_INPUT_ATTN_3X,
+		.smpl_time_mult = 6,
+		.chopping = true,
+		.oversampling = 7,
+		.log2_n = 0,
+		.period_ticks = 50,  // 0.5 s
+		.on_sample = uvp_on_sample
+	},
+	[GPADC_CH_SENSOR] =
+	{
+		.input = ADC_ENUM_INPUT,
+		.input_attenuator = ADC_INPUT_ATTN_NO,
+		.smpl_time_mult = 6,
+		.chopping = true,
+		.oversampling = SENSOR_BURST_OVERSAMPLING,
+		.log2_n = SENSOR_BURST_LOG2_N,
+		.period_ticks = 100, // 1 s
+		.on_sample = sensor_on_sample
+	},
+	[GPADC_CH_BIAS] =
+	{
+		.input = BIAS_FB_ENUM_INPUT,
+		.input_attenuator = ADC_INPUT_ATTN_3X,
+		.smpl_time_mult = 6,
+		.chopping = true,
+		.oversampling = SENSOR_BURST_OVERSAMPLING,
+		.log2_n = SENSOR_BURST_LOG2_N,
+		.period_ticks = 0,   // read on demand by the closed loop and the zero calibration
+		.on_sample = bias_fb_on_sample
+	}
+};
 
 /*
  ****************************************************************************************
@@ -108,17 +342,17 @@ uint32_t period_width __SECTION_ZERO("retention_mem_area0");
  ****************************************************************************************
 */
 
-void uvp_wireless_timer_cb(void)
+void uvp_on_sample(gpadc_sched_result_t const *result)
 {
-	// Initialize ADC for a single conversion of VBAT HIGH rail
-	gpadc_init_se(ADC_INPUT_SE_VBAT_HIGH, 6, ADC_INPUT_ATTN_3X, true, 7);
+	// Save VBAT HIGH rail reading converted by the scheduler
+	uvp_adc_sample_raw = result->burst.mean;
+	uvp_adc_sample_mv = result->mv;
 	
-	// Read ADC and convert results to millivolts
-	adc_enable();
-	uvp_adc_sample_raw = gpadc_collect_sample();
-	uvp_adc_sample_mv = gpadc_sample_to_mv(uvp_adc_sample_raw);
-	uvp_adc_sample_mv -= ADC_OFFSET_MV;
-	adc_disable();
+	// Battery channel always runs, it keeps the log clock from missing a timebase wrap
+	log_store_clock(result->time_us);
+	
+	// Recompute PWM duty cycles only when the battery has moved outside the deadband
+	timer2_pwm_vbat_update(uvp_adc_sample_mv);
 	
 	// Hysteresis condition block
 	if (uvp_shutdown == false) // system is on, check for undervoltage
@@ -127,16 +361,27 @@ void uvp_wireless_timer_cb(void)
 		{
 			uvp_shutdown = true; // enable signal toggles low
 			
-			// Stop sensor voltage peripheral and timer
-			if (sensor_timer != EASY_TIMER_INVALID_TIMER)
+			// Stop sensor voltage sampling
+			gpadc_sched_enable(GPADC_CH_SENSOR, false);
+			if (gpadc_stream_is_running())
 			{
-				app_easy_timer_cancel(sensor_timer);
-				sensor_timer = EASY_TIMER_INVALID_TIMER;
+				gpadc_stream_stop();
 			}
-
-			// Stop vbias peripheral and timer
+			
+			// Stop vbias peripheral and timer before the flash draws its program current
 			timer2_pwm_disable();
 			
+			// Keep the buffered readings while the supply still holds up the flash, a page program
+			// only, a block waiting for its sector erase is lost
+			periodic_task_stop(&log_erase_task);
+			log_store_flush();
+			
+			// No more flash reads for the download, the client resumes from its last complete block
+			if (log_dl_state == LOG_DL_RUNNING)
+			{
+				log_dl_state = LOG_DL_IDLE;
+			}
+			
 			#ifdef CFG_PRINTF
 			arch_printf("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ \n\r");
 			arch_printf("[UVP] SHUTDOWN TRIGGERED! Battery voltage (%u mV) < Threshold (%u mV). \n\r", uvp_adc_sample_mv, UVP_SHUTDOWN_THRESHOLD_MV);
@@ -150,6 +395,25 @@ void uvp_wireless_timer_cb(void)
 		{
 			uvp_shutdown = false; // enable signal toggles high
 			
+			// Supply recovered from brown-out so cached ADC offsets are stale
+			gpadc_cal_invalidate();
+			
+			// Resume the excitation the client had running, the channels kept their targets
+			if (pwm_client_enabled)
+			{
+				timer2_pwm_enable();
+			}
+			
+			// Resume sensor readings for the log and for notifications
+			if (sensor_log_enabled || sensor_notify)
+			{
+				gpadc_sched_enable(GPADC_CH_SENSOR, true);
+			}
+			if (sensor_log_enabled)
+			{
+				log_erase_schedule();
+			}
+			
 			#ifdef CFG_PRINTF
 			arch_printf("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ \n\r");
 			arch_printf("[UVP] RESTART TRIGGERED! Battery voltage (%u mV) > Threshold (%u mV). \n\r", uvp_adc_sample_mv, UVP_RESTART_THRESHOLD_MV);
@@ -185,9 +449,6 @@ void uvp_wireless_timer_cb(void)
 		KE_MSG_SEND(req);
 	}
 	
-	// Restart this function every 0.5 second
-	uvp_timer = app_easy_timer(50, uvp_wireless_timer_cb);
-	
 	/*
    ****************************************************************************************
    * UART test prints
@@ -262,538 +523,2836 @@ void uvp_wireless_timer_cb(void)
 	}
 
 	arch_printf("[SLEEP] Current Mode: %s (Value: %u) \n\r", mode_str, (uint8_t)current_mode);
+	sleep_inhibit_print();
 	
 	// Print PWM parameters
-	arch_printf("[PWM DUTY] Pulse Width 1: %lu \n\r", pulse_width_1);
-	arch_printf("[PWM DUTY] Pulse Width 2: %lu \n\r", pulse_width_2);
+	for (uint8_t i = 0; i < PWM_CHANNEL_COUNT; i++)
+	{
+		if (pwm_channels[i].active)
+		{
+			#ifdef CFG_PWM_DITHER
+			arch_printf("[PWM DUTY] PWM%u Pulse Width: %u + %u/256 \n\r", i + 2, pwm_channels[i].pulse_width, pwm_channels[i].pulse_frac);
+			#else
+			arch_printf("[PWM DUTY] PWM%u Pulse Width: %u \n\r", i + 2, pwm_channels[i].pulse_width);
+			#endif
+		}
+	}
 	arch_printf("[PWM DUTY] Period Width: %lu \n\r", period_width);
+	arch_printf("[PWM DUTY] VBAT updates: %u, END_CYCLE writes: %u \n\r", pwm_vbat_updates, pwm_end_writes);
+	arch_printf("[PWM DUTY] Register restores after sleep: %u \n\r", pwm_shadow_get()->restores);
+	arch_printf("[PWM DUTY] Register commits: %u, missed safe points: %u, worst commit lag: %u us \n\r", pwm_shadow_get()->commits, pwm_shadow_get()->missed, pwm_shadow_get()->commit_lag_us);
+	arch_printf("[PWM RAMP] Slew rate: %u mV/s, tau: %u ms, bias %s, last settle time: %lu ms \n\r", pwm_ramp_slew_mv_per_s, pwm_bias_tau_ms, pwm_bias_settled ? "settled" : "not settled", pwm_settle_ms);
+	if (pwm_loop_channel < PWM_CHANNEL_COUNT)
+	{
+		arch_printf("[PWM LOOP] PWM%u trim: %d mV, residual: %ld uV, converged in: %lu ms \n\r", pwm_loop_channel + 2, pwm_channels[pwm_loop_channel].trim_mv, pwm_loop_residual_uv, pwm_loop_converge_ms);
+	}
+	if (pwm_zcal.state != PWM_ZCAL_IDLE)
+	{
+		arch_printf("[PWM ZCAL] State: %u, stored mask: 0x%02X, failed mask: 0x%02X, last run: %lu ms \n\r", pwm_zcal.state, pwm_zcal.done, pwm_zcal.failed, pwm_zcal.duration_ms);
+	}
+	if (cfg_store_get()->ready)
+	{
+		arch_printf("[CFG STORE] Record: %lu, writes: %u, erases: %u, unchanged saves: %u \n\r", cfg_store_get()->seq, cfg_store_get()->writes, cfg_store_get()->erases, cfg_store_get()->skipped);
+	}
+	if (log_store_get()->ready)
+	{
+		arch_printf("[LOG STORE] %s, blocks: %lu to %lu, buffered: %u, writes: %u, erases: %u, skipped: %u, failed: %u, dropped: %u \n\r", sensor_log_enabled ? "On" : "Off", log_store_get()->first_seq, log_store_get()->next_seq - 1U, log_store_get()->count, log_store_get()->writes, log_store_get()->erases, log_store_get()->skipped, log_store_get()->failed, log_store_get()->dropped);
+	}
+	if (log_dl_state != LOG_DL_IDLE)
+	{
+		arch_printf("[LOG DOWNLOAD] State: %u, block: %lu, bytes: %lu, in flight: %u \n\r", log_dl_state, log_dl_cursor.seq, log_dl_bytes, log_dl_in_flight);
+	}
 	#endif
 }
 
 /*
  ****************************************************************************************
- * ADC FUNCTIONS
+ * SENSOR FRAME FUNCTIONS
  ****************************************************************************************
 */
 
-void gpadc_wireless_timer_cb(void)
+uint8_t sensor_frame_capacity(void)
+{
+	uint16_t capacity = CLAMP(sensor_frame_samples, 1, SENSOR_FRAME_MAX_SAMPLES);
+	uint16_t mtu_samples = sensor_frame_payload_capacity();
+	
+	// Raw samples always take 2 bytes, encoded ones are limited by the payload bytes as they are pushed
+	if (sensor_encoding == SAMPLE_CODEC_RAW16)
+	{
+		mtu_samples >>= 1;
+	}
+	
+	if (mtu_samples == 0)
+	{
+		mtu_samples = 1;
+	}
+	
+	return (uint8_t)((capacity < mtu_samples) ? capacity : mtu_samples);
+}
+
+uint8_t sensor_frame_payload_capacity(void)
+{
+	// Bytes left for samples in one notification at the negotiated MTU
+	uint16_t payload = (ble_mtu > BLE_ATT_NTF_HDR + SENSOR_FRAME_HEADER_LEN) ? (ble_mtu - BLE_ATT_NTF_HDR - SENSOR_FRAME_HEADER_LEN) : SAMPLE_CODEC_MAX_LEN;
+	
+	return (uint8_t)((payload < SENSOR_FRAME_PAYLOAD_MAX) ? payload : SENSOR_FRAME_PAYLOAD_MAX);
+}
+
+void sensor_frame_push(uint16_t sample_mv, uint32_t timestamp_us, uint32_t interval_us)
+{
+	// Sample is off the frame's evenly spaced timeline (e.g., dropped samples or a late timer), start a new frame
+	if (sensor_frame.count > 0)
+	{
+		uint32_t expected_us = sensor_frame.base_us + (uint32_t)sensor_frame.count * sensor_frame.interval_us;
+		int32_t error_us = (int32_t)(timestamp_us - expected_us);
+		uint32_t tolerance_us = sensor_frame.interval_us >> 1;
+		
+		if (tolerance_us > SENSOR_FRAME_MAX_JITTER_US)
+		{
+			tolerance_us = SENSOR_FRAME_MAX_JITTER_US;
+		}
+		
+		if (interval_us != sensor_frame.interval_us || (uint32_t)((error_us < 0) ? -error_us : error_us) > tolerance_us)
+		{
+			sensor_frame_send();
+		}
+	}
+	
+	uint8_t encoded[SAMPLE_CODEC_MAX_LEN];
+	uint8_t payload_capacity = sensor_frame_payload_capacity();
+	uint8_t length = sample_codec_encode((sample_codec_t)sensor_encoding, sample_mv, sensor_frame.last_mv, (sensor_frame.count == 0), encoded);
+	
+	// Encoded sample does not fit, send the frame and start the next one with a keyframe
+	if (sensor_frame.count > 0 && (uint16_t)sensor_frame.len + length > payload_capacity)
+	{
+		sensor_frame_send();
+		length = sample_codec_encode((sample_codec_t)sensor_encoding, sample_mv, 0, true, encoded);
+	}
+	
+	// First sample of a frame sets the base timestamp, sample spacing and encoding
+	if (sensor_frame.count == 0)
+	{
+		sensor_frame.base_us = timestamp_us;
+		sensor_frame.interval_us = interval_us;
+		sensor_frame.encoding = sensor_encoding;
+	}
+	
+	memcpy(&sensor_frame.payload[sensor_frame.len], encoded, length);
+	sensor_frame.len += length;
+	sensor_frame.count++;
+	sensor_frame.last_mv = sample_mv;
+	
+	// Send as soon as the frame is full, capacity may have shrunk after an MTU change
+	if (sensor_frame.count >= sensor_frame_capacity() || sensor_frame.len >= payload_capacity)
+	{
+		sensor_frame_send();
+	}
+}
+
+void sensor_frame_send(void)
 {
-	// Initialize ADC for a single conversion of sensor voltage
-	gpadc_init_se(ADC_ENUM_INPUT, 6, ADC_INPUT_ATTN_NO, true, 7);
+	if (sensor_frame.count == 0)
+	{
+		return;
+	}
 	
-	// Read ADC and convert results to millivolts
-	adc_enable();
-	sensor_adc_sample_raw = gpadc_collect_sample();
-	sensor_adc_sample_mv = gpadc_sample_to_mv(sensor_adc_sample_raw);
-	sensor_adc_sample_mv -= ADC_OFFSET_MV;
-	adc_disable();
+	uint16_t length = SENSOR_FRAME_HEADER_LEN + sensor_frame.len;
 	
-	// Create dynamic kernel message for notifications
+	// Create dynamic kernel message sized for the frame
 	struct custs1_val_ntf_ind_req *req = KE_MSG_ALLOC_DYN(CUSTS1_VAL_NTF_REQ,
 																												prf_get_task_from_id(TASK_ID_CUSTS1),
 																												TASK_APP,
 																												custs1_val_ntf_ind_req,
-																												DEF_SVC1_SENSOR_VOLTAGE_CHAR_LEN);
+																												length);
 	
 	// Populate the notification structure
 	req->handle = SVC1_IDX_SENSOR_VOLTAGE_VAL;
-	req->length = DEF_SVC1_SENSOR_VOLTAGE_CHAR_LEN;
+	req->length = length;
 	req->notification = true;
 	
-	// Copies sensor voltage ADC value to notification payload
-	memcpy(req->value, &sensor_adc_sample_mv, DEF_SVC1_SENSOR_VOLTAGE_CHAR_LEN);
+	// Frame header, multi-byte fields are little-endian like the rest of the notifications
+	req->value[0] = sensor_frame.seq;
+	req->value[1] = sensor_frame.count;
+	req->value[2] = sensor_frame.encoding;
+	memcpy(&req->value[3], &sensor_frame.base_us, sizeof(uint32_t));
+	memcpy(&req->value[7], &sensor_frame.interval_us, sizeof(uint32_t));
+	
+	// Copies encoded millivolt samples to notification payload
+	memcpy(&req->value[SENSOR_FRAME_HEADER_LEN], sensor_frame.payload, sensor_frame.len);
 	
 	// Send structure to the kernel to be transmitted by the BLE stack
 	KE_MSG_SEND(req);
 	
-	// If phone is still connected, restart this function every 1 second
-	if (ke_state_get(TASK_APP) == APP_CONNECTED)
-	{
-			sensor_timer = app_easy_timer(100, gpadc_wireless_timer_cb);
-	}
-	
 	#ifdef CFG_PRINTF
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	arch_printf("[ADC] Sensor Voltage: %u mV \n\r", sensor_adc_sample_mv);
-	arch_printf("[ADC] LSB: 0x%02X, MSB: 0x%02X \n\r", sensor_adc_sample_mv & 0xFF, (sensor_adc_sample_mv >> 8) & 0xFF);
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[SENSOR FRAME] Sent seq %u with %u samples (%u bytes) \n\r", sensor_frame.seq, sensor_frame.count, length);
 	#endif
+	
+	sensor_frame.seq++;
+	sensor_frame.count = 0;
+	sensor_frame.len = 0;
 }
 
-void gpadc_init_se(adc_input_se_t input, uint8_t smpl_time_mult, adc_input_attn_t input_attenuator, bool chopping, uint8_t oversampling)
+void sensor_frame_reset(void)
 {
-	// Build ADC config structure for single-ended measurement
-	adc_config_t adc_config_struct =
-	{
-		// ADC options that are fixed due to hardware and implementation
-		.input_mode = ADC_INPUT_MODE_SINGLE_ENDED,
-		.continuous = false,
-		.interval_mult = 0,
+	// Drop buffered samples, sequence keeps counting so the client can detect the gap
+	sensor_frame.count = 0;
+	sensor_frame.len = 0;
+}
 
-		// Adjustable ADC options for SE mode only
-		.input = input,
-		.smpl_time_mult = smpl_time_mult,
-		.input_attenuator = input_attenuator,
-		.chopping = chopping,
-		.oversampling = oversampling
-	};
-	
-	// Initialize ADC with the configuration structure
-	adc_init(&adc_config_struct);
-	
-	// Disable input shifter (not needed)
-	adc_input_shift_disable();
+void sensor_stream_apply(void)
+{
+	// Restart continuous acquisition so a new interval takes effect
+	if (gpadc_stream_is_running())
+	{
+		gpadc_stream_stop();
+	}
 	
-	// Disable die temperature sensor (may lower noise)
-	adc_temp_sensor_disable();
+	if (sensor_stream_interval_mult > 0 && sensor_notify && gpadc_sched_is_enabled(GPADC_CH_SENSOR))
+	{
+		gpadc_stream_start(ADC_ENUM_INPUT, ADC_INPUT_ATTN_NO, SENSOR_STREAM_OVERSAMPLING, sensor_stream_interval_mult);
+	}
+}
+
+void sensor_log_set(bool enable)
+{
+	sensor_log_enabled = enable && log_store_get()->ready;
 	
-	// Set ADC startup delay after LDO powers on
-	adc_delay_set(64); // for 16 Mhz system clock, 16 us delay is recommended by datasheet
+	if (sensor_log_enabled)
+	{
+		if (!uvp_shutdown)
+		{
+			gpadc_sched_enable(GPADC_CH_SENSOR, true);
+		}
+	}
+	else
+	{
+		// Readings buffered for the partial block would otherwise be lost
+		log_store_flush();
+		
+		if (!sensor_notify)
+		{
+			gpadc_sched_enable(GPADC_CH_SENSOR, false);
+		}
+	}
 	
-	// Enable load current for ADC's LDO to improve stability during conversion
-	adc_ldo_const_current_enable();
+	// Sector for the first block, or for the partial block that could not be programmed yet
+	log_erase_schedule();
+}
 
-	// Perform offset calibration to remove DC offsets before sampling
-	// BUG: ADC still reads 34 mV for GND, compensated for this offset in SW during reads
-	adc_reset_offsets();
-	adc_offset_calibrate(ADC_INPUT_MODE_SINGLE_ENDED);
+void log_erase_schedule(void)
+{
+	if (!uvp_shutdown && log_store_erase_pending() && !periodic_task_is_running(&log_erase_task))
+	{
+		periodic_task_start(&log_erase_task, LOG_ERASE_DELAY, 0, log_erase_timer_cb);
+	}
 }
 
-uint16_t gpadc_collect_sample(void)
+void log_erase_timer_cb(uint8_t periods)
 {
-	// Fetch raw ADC sample then apply SDK correction routine (config-dependent)
-	uint16_t sample = adc_correct_sample(adc_get_sample());
+	(void)periods;
 	
-	return (sample);
+	periodic_task_stop(&log_erase_task);
+	
+	// The restart threshold schedules it again
+	if (uvp_shutdown)
+	{
+		return;
+	}
+	
+	uint16_t erases = log_store_get()->erases;
+	log_store_prepare();
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[LOG STORE] Next sector %s, head at page %u \n\r", (log_store_get()->erases != erases) ? "erased" : "blank", log_store_get()->head);
+	#else
+	(void)erases;
+	#endif
 }
 
-uint16_t gpadc_sample_to_mv(uint16_t sample)
+void log_dl_pump(void)
 {
-	// Effective resolution of ADC sample based on oversampling rate	
-	uint32_t adc_resolution = 10 + ((6 < adc_get_oversampling()) ? 6 : adc_get_oversampling());
-
-	// Reference voltage is 900mv but is scaled based on input attenation
-	uint32_t ref_mv = 900 * (GetBits16(GP_ADC_CTRL2_REG, GP_ADC_ATTN) + 1);
-
-	// Returns mV value read by the ADC
-	return (uint16_t)((((uint32_t)sample) * ref_mv) >> adc_resolution);
+	// Payload after the ATT header, limited by the value length in the database
+	uint16_t capacity = ble_mtu - 3U;
+	if (capacity > DEF_SVC1_LOG_DATA_CHAR_LEN)
+	{
+		capacity = DEF_SVC1_LOG_DATA_CHAR_LEN;
+	}
+	
+	// Confirmations restart the pump, so one notification may always wait in the stack
+	while (log_dl_state == LOG_DL_RUNNING && log_dl_in_flight < LOG_DL_MAX_IN_FLIGHT &&
+	       (log_dl_in_flight == 0 || l2cm_get_nb_buffer_available() > LOG_DL_RESERVED_BUFFERS))
+	{
+		// Create dynamic kernel message for notifications, log bytes are read straight into it
+		struct custs1_val_ntf_ind_req *req = KE_MSG_ALLOC_DYN(CUSTS1_VAL_NTF_REQ,
+																													prf_get_task_from_id(TASK_ID_CUSTS1),
+																													TASK_APP,
+																													custs1_val_ntf_ind_req,
+																													capacity);
+		
+		uint16_t length = log_store_read(&log_dl_cursor, &req->value[DEF_SVC1_LOG_DATA_HEADER_LEN], capacity - DEF_SVC1_LOG_DATA_HEADER_LEN);
+		
+		// Without log bytes this is the end marker, it points at the next block to ask for
+		uint32_t seq = (length > 0) ? log_dl_cursor.chunk_seq : log_dl_cursor.seq;
+		uint8_t offset = (length > 0) ? (uint8_t)log_dl_cursor.chunk_offset : 0;
+		memcpy(&req->value[0], &seq, sizeof(uint32_t));
+		req->value[4] = offset;
+		
+		req->handle = SVC1_IDX_LOG_DATA_VAL;
+		req->length = DEF_SVC1_LOG_DATA_HEADER_LEN + length;
+		req->notification = true;
+		
+		// Send structure to the kernel to be transmitted by the BLE stack
+		KE_MSG_SEND(req);
+		
+		log_dl_in_flight++;
+		log_dl_bytes += length;
+		
+		if (length == 0)
+		{
+			log_dl_state = LOG_DL_DONE;
+			log_dl_duration_ms = (timebase_now_us() - log_dl_start_us) / 1000U;
+			
+			#ifdef CFG_PRINTF
+			arch_printf("---------------------------------------------------------------------------------------- \n\r");
+			arch_printf("[LOG DOWNLOAD] Done at block %lu, %lu bytes in %lu ms \n\r", seq, log_dl_bytes, log_dl_duration_ms);
+			arch_printf("---------------------------------------------------------------------------------------- \n\r");
+			#endif
+		}
+	}
 }
 
 /*
  ****************************************************************************************
- * PWM FUNCTIONS
+ * ADC SCHEDULER FUNCTIONS
  ****************************************************************************************
 */
 
-// BUG: PWM registers do not retain value or can be wrote too when sleep mode is on
-
-void timer2_pwm_dc_control_timer_cb(void)
+void gpadc_sched_timer_cb(uint8_t periods)
 {
-	// Update duty cycles based on VBAT ADC reading for a select channel
-	timer2_pwm_dc_control(target_vbias_1_mv, TIM2_PWM_2);
-	timer2_pwm_dc_control(target_vbias_2_mv, TIM2_PWM_3);
+	uint8_t due = 0;
+	
+	// Advance every enabled channel and collect the ones whose period has elapsed
+	for (uint8_t ch = 0; ch < GPADC_CH_COUNT; ch++)
+	{
+		// Channels without a period are only read on demand
+		if (!(gpadc_sched_enabled & (1U << ch)) || gpadc_sched_channels[ch].period_ticks == 0)
+		{
+			continue;
+		}
+		
+		gpadc_sched_elapsed[ch] += GPADC_SCHED_TICK * periods;
+		if (gpadc_sched_elapsed[ch] >= gpadc_sched_channels[ch].period_ticks)
+		{
+			gpadc_sched_elapsed[ch] = 0;
+			due |= (1U << ch);
+		}
+	}
 	
-	// Restart this function every 0.5 second
-	pwm_dc_control_timer = app_easy_timer(50, timer2_pwm_dc_control_timer_cb);
+	gpadc_sched_run(due);
 }
 
-void timer2_pwm_dc_control(int16_t target_vbias_mv, tim2_pwm_t channel)
+void gpadc_sched_sample_now(gpadc_channel_id_t ch)
 {
-	// Prevent SoC from sleeping
-	arch_set_sleep_mode(ARCH_SLEEP_OFF);
-	
-	// Read Timer 2 period counter register
-	uint32_t period_count = GetWord16(TRIPLE_PWM_FREQUENCY) + 1u;
-	
-	// Declare variables used to read existing offset
-	volatile uint16_t *start_reg;
-	volatile uint16_t *end_reg;
-	
-	// Select the correct START and END cycle registers based on the channel
-	switch (channel)
-	{
-		case TIM2_PWM_2:
-				start_reg = (volatile uint16_t *)PWM2_START_CYCLE;
-				end_reg = (volatile uint16_t *)PWM2_END_CYCLE;
-				break;
-		case TIM2_PWM_3:
-				start_reg = (volatile uint16_t *)PWM3_START_CYCLE;
-				end_reg = (volatile uint16_t *)PWM3_END_CYCLE;
-				break;
-		case TIM2_PWM_4:
-				start_reg = (volatile uint16_t *)PWM4_START_CYCLE;
-				end_reg = (volatile uint16_t *)PWM4_END_CYCLE;
-				break;
-		#if defined (__DA14531__)
-		case TIM2_PWM_5:
-				start_reg = (volatile uint16_t *)PWM5_START_CYCLE;
-				end_reg = (volatile uint16_t *)PWM5_END_CYCLE;
-				break;
-		case TIM2_PWM_6:
-				start_reg = (volatile uint16_t *)PWM6_START_CYCLE;
-				end_reg = (volatile uint16_t *)PWM6_END_CYCLE;
-				break;
-		case TIM2_PWM_7:
-				start_reg = (volatile uint16_t *)PWM7_START_CYCLE;
-				end_reg = (volatile uint16_t *)PWM7_END_CYCLE;
-				break;
-		#endif
-		default:
-				return;
+	if (!gpadc_sched_is_enabled(ch))
+	{
+		return;
 	}
 	
-	// Read existing offset from correct START_CYCLE register
-	uint32_t offset_count = GetWord16(start_reg);
-	
-	// Read battery voltage
-	uint16_t vbat_mv = uvp_adc_sample_mv;
+	// The channel's period restarts from this reading, later ones keep the same spacing
+	gpadc_sched_elapsed[ch] = 0;
+	gpadc_sched_run(1U << ch);
+}
+
+void gpadc_sched_run(uint8_t due)
+{
+	// Sensor samples come from the ring buffer while continuous acquisition is running
+	uint8_t stream_due = 0;
+	if ((due & (1U << GPADC_CH_SENSOR)) && gpadc_stream_is_running())
+	{
+		due &= ~(1U << GPADC_CH_SENSOR);
+		stream_due = (1U << GPADC_CH_SENSOR);
+	}
 	
-	// Guard against division near zero
-	if(vbat_mv < 100)
+	// Read every due channel in a single ADC power-up
+	gpadc_sched_result_t results[GPADC_CH_COUNT];
+	if (due)
 	{
-		#ifdef CFG_PRINTF
-		arch_printf("[ERROR] Vbat divisor near zero (<100mV) \n\r");
-		#endif
+		// Pause sensor stream since the ADC is shared between channels
+		bool stream_suspended = gpadc_stream_suspend();
+		bool adc_on = false;
 		
-		return;
+		for (uint8_t ch = 0; ch < GPADC_CH_COUNT; ch++)
+		{
+			if (!(due & (1U << ch)))
+			{
+				continue;
+			}
+			
+			gpadc_sched_channel_t const *channel = &gpadc_sched_channels[ch];
+			
+			if (!adc_on)
+			{
+				// First due channel configures and powers up the ADC
+				gpadc_init_se(channel->input, channel->smpl_time_mult, channel->input_attenuator, channel->chopping, channel->oversampling);
+				adc_enable();
+				adc_on = true;
+			}
+			else
+			{
+				// Following channels only switch input settings, the ADC LDO stays powered
+				gpadc_switch_channel(channel);
+			}
+			
+			// Stamp burst start on the BLE timebase, then read and convert it while the ADC registers still hold this channel's settings
+			results[ch].time_us = timebase_now_us();
+			gpadc_collect_burst(channel->log2_n, &results[ch].burst);
+			results[ch].mv = gpadc_sample_to_mv(results[ch].burst.mean);
+			results[ch].uv = gpadc_burst_to_uv(&results[ch].burst);
+		}
+		
+		adc_disable();
+		
+		// Resume sensor stream with its saved configuration
+		if (stream_suspended)
+		{
+			gpadc_stream_resume();
+		}
 	}
 	
-	// Construct (duty cycle * period) function as function of vbias and vbat
-	int32_t half_period = (int32_t)period_count / 2;
-	int32_t numerator   = 5 * (int32_t)target_vbias_mv * (int32_t)period_count;
-	int32_t denominator = 7 * (int32_t)vbat_mv;
-	int32_t second_term = numerator / denominator;
-	int32_t pulse_width_raw = half_period - second_term;
-	
-	// Clamp pulse width as safety, not using CLAMP macro due to uint and int comparison
-	uint32_t pulse_width;
-	if (pulse_width_raw < 0)
+	// Publish results after the ADC is powered down, in table order so UVP runs first
+	for (uint8_t ch = 0; ch < GPADC_CH_COUNT; ch++)
 	{
-		pulse_width = 0;
+		// Channel may have been disabled by an earlier consumer (e.g., UVP shutdown)
+		if (!(gpadc_sched_enabled & (1U << ch)))
+		{
+			continue;
+		}
+		
+		if (due & (1U << ch))
+		{
+			gpadc_sched_channels[ch].on_sample(&results[ch]);
+		}
+		else if (stream_due & (1U << ch))
+		{
+			gpadc_sched_channels[ch].on_sample(NULL);
+		}
 	}
-	else if (pulse_width_raw > (int32_t)period_count)
+}
+
+void gpadc_sched_enable(gpadc_channel_id_t ch, bool enable)
+{
+	if (enable)
 	{
-		pulse_width = period_count;
+		// First sample is taken one full period after enabling
+		if (!(gpadc_sched_enabled & (1U << ch)))
+		{
+			gpadc_sched_elapsed[ch] = 0;
+		}
+		gpadc_sched_enabled |= (1U << ch);
 	}
 	else
 	{
-		pulse_width = (uint32_t)pulse_width_raw;
+		gpadc_sched_enabled &= ~(1U << ch);
 	}
-	
-	// Add offset to pulse width to create END_CYCLE value
-	uint32_t end_cycle_value_raw = pulse_width + offset_count;
-	uint32_t end_cycle_value;
-	
-	// Clamp END_CYCLE value via wrap-around logic
-	if (end_cycle_value_raw >= period_count)
+}
+
+bool gpadc_sched_is_enabled(gpadc_channel_id_t ch)
+{
+	return (gpadc_sched_enabled & (1U << ch)) != 0;
+}
+
+void gpadc_switch_channel(gpadc_sched_channel_t const *channel)
+{
+	// Reprogram only the fields that differ between channels, ADC stays enabled
+	adc_set_se_input(channel->input);
+	SetBits16(GP_ADC_CTRL2_REG, GP_ADC_ATTN, channel->input_attenuator);
+	SetBits16(GP_ADC_CTRL2_REG, GP_ADC_SMPL_TIME, channel->smpl_time_mult);
+	SetBits16(GP_ADC_CTRL_REG, GP_ADC_CHOP, channel->chopping);
+	adc_set_oversampling(channel->oversampling);
+	
+	// Offsets depend on input and attenuation so restore or measure them again
+	gpadc_cal_apply(channel->input, channel->input_attenuator);
+	
+	// Rebuild millivolt conversion for the new attenuation and oversampling
+	gpadc_conv_init(&gpadc_conv, channel->input_attenuator, channel->oversampling);
+}
+
+/*
+ ****************************************************************************************
+ * ADC FUNCTIONS
+ ****************************************************************************************
+*/
+
+void sensor_on_sample(gpadc_sched_result_t const *result)
+{
+	if (result == NULL)
 	{
-			end_cycle_value = end_cycle_value_raw - period_count;
+		// Drain every sample collected by the ADC interrupt since the last timer tick
+		uint16_t samples[GPADC_STREAM_BUF_SIZE];
+		uint32_t last_us = 0;
+		uint16_t count = gpadc_stream_read(samples, GPADC_STREAM_BUF_SIZE, &last_us);
+		uint16_t dropped = gpadc_stream_take_dropped();
+		
+		// Report the mean of the drained block, keep last value if nothing arrived
+		if (count > 0)
+		{
+			uint32_t sum = 0;
+			for (uint16_t i = 0; i < count; i++)
+			{
+				sum += samples[i];
+			}
+			sensor_adc_sample_raw = (uint16_t)(sum / count);
+			sensor_adc_sample_mv = gpadc_sample_to_mv(sensor_adc_sample_raw);
+			
+			// Log keeps one value per tick, every streamed sample would fill the flash in minutes
+			if (sensor_log_enabled)
+			{
+				log_store_append(last_us, sensor_adc_sample_mv);
+				log_erase_schedule();
+			}
+		}
+		
+		// Framed mode sends every streamed sample instead of the mean
+		if (sensor_notify && sensor_mode == SENSOR_MODE_FRAMED && count > 0)
+		{
+			// Oldest drained sample was taken (count - 1) intervals before the last one
+			uint32_t interval_us = (uint32_t)sensor_stream_interval_mult * 1024U;
+			uint32_t sample_us = last_us - (uint32_t)(count - 1) * interval_us;
+			
+			for (uint16_t i = 0; i < count; i++)
+			{
+				sensor_frame_push(gpadc_sample_to_mv(samples[i]), sample_us, interval_us);
+				sample_us += interval_us;
+			}
+		}
+		
+		#ifdef CFG_PRINTF
+		arch_printf("[ADC STREAM] Drained %u samples, %u dropped \n\r", count, dropped);
+		#else
+		(void)dropped;
+		#endif
 	}
 	else
 	{
-			end_cycle_value = end_cycle_value_raw;
+		// Save decimated burst converted by the scheduler
+		sensor_adc_sample_raw = result->burst.mean;
+		sensor_adc_sample_uv = result->uv;
+		sensor_adc_noise_q4 = result->burst.noise_q4;
+		sensor_adc_sample_mv = result->mv;
+		
+		if (sensor_log_enabled)
+		{
+			log_store_append(result->time_us, sensor_adc_sample_mv);
+			log_erase_schedule();
+		}
+		
+		// Framed mode buffers the value, the channel period is the sample interval
+		if (sensor_notify && sensor_mode == SENSOR_MODE_FRAMED)
+		{
+			uint32_t interval_us = (uint32_t)gpadc_sched_channels[GPADC_CH_SENSOR].period_ticks * 10000U;
+			sensor_frame_push(sensor_adc_sample_mv, result->time_us, interval_us);
+		}
+	}
+	
+	// Single mode sends every value as its own 2-byte notification
+	if (sensor_notify && sensor_mode == SENSOR_MODE_SINGLE)
+	{
+		// Create dynamic kernel message for notifications
+		struct custs1_val_ntf_ind_req *req = KE_MSG_ALLOC_DYN(CUSTS1_VAL_NTF_REQ,
+																													prf_get_task_from_id(TASK_ID_CUSTS1),
+																													TASK_APP,
+																													custs1_val_ntf_ind_req,
+																													DEF_SVC1_SENSOR_VOLTAGE_CHAR_LEN);
+		
+		// Populate the notification structure
+		req->handle = SVC1_IDX_SENSOR_VOLTAGE_VAL;
+		req->length = DEF_SVC1_SENSOR_VOLTAGE_CHAR_LEN;
+		req->notification = true;
+		
+		// Copies sensor voltage ADC value to notification payload
+		memcpy(req->value, &sensor_adc_sample_mv, DEF_SVC1_SENSOR_VOLTAGE_CHAR_LEN);
+		
+		// Send structure to the kernel to be transmitted by the BLE stack
+		KE_MSG_SEND(req);
 	}
 	
-	// Write the new END_CYCLE value directly to the register
-	SetWord16(end_reg, end_cycle_value);
+	// If phone disconnected, nobody is left to notify so stop sampling
+	// The log keeps the 1 s bursts going, continuous acquisition only runs for a client
+	if (ke_state_get(TASK_APP) != APP_CONNECTED)
+	{
+		if (!sensor_log_enabled)
+		{
+			gpadc_sched_enable(GPADC_CH_SENSOR, false);
+		}
+		if (gpadc_stream_is_running())
+		{
+			gpadc_stream_stop();
+		}
+	}
 	
-	// BUG: UART prints will cause CPU SW reset if function is called from BLE handler
-	/*
 	#ifdef CFG_PRINTF
 	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	arch_printf("[PWM CONTROL CH%u] Read target vbias: %ld mV \n\r", channel + 1, (int32_t)target_vbias_mv);
-	arch_printf("[PWM CONTROL CH%u] Read period count: %lu \n\r", channel + 1, period_count);
-	arch_printf("[PWM CONTROL CH%u] Read offset: %lu counts \n\r", channel + 1, offset_count);
-	arch_printf("[PWM CONTROL CH%u] Calculated Pulse Width: %lu counts \n\r", channel + 1, pulse_width);
-	arch_printf("[PWM CONTROL CH%u] Calculated END_CYCLE: %lu counts \n\r", channel + 1, end_cycle_value);
+	arch_printf("[ADC] Sensor Voltage: %u mV \n\r", sensor_adc_sample_mv);
+	if (result != NULL)
+	{
+		arch_printf("[ADC] Sensor Voltage (decimated): %lu uV, noise: %u.%02u LSB rms \n\r", sensor_adc_sample_uv, sensor_adc_noise_q4 >> 4, ((sensor_adc_noise_q4 & 0xF) * 100U) >> 4);
+	}
+	arch_printf("[ADC] LSB: 0x%02X, MSB: 0x%02X \n\r", sensor_adc_sample_mv & 0xFF, (sensor_adc_sample_mv >> 8) & 0xFF);
 	arch_printf("---------------------------------------------------------------------------------------- \n\r");
 	#endif
-	*/
+}
+
+void gpadc_init_se(adc_input_se_t input, uint8_t smpl_time_mult, adc_input_attn_t input_attenuator, bool chopping, uint8_t oversampling)
+{
+	// Build ADC config structure for single-ended measurement
+	adc_config_t adc_config_struct =
+	{
+		// ADC options that are fixed due to hardware and implementation
+		.input_mode = ADC_INPUT_MODE_SINGLE_ENDED,
+		.continuous = false,
+		.interval_mult = 0,
+
+		// Adjustable ADC options for SE mode only
+		.input = input,
+		.smpl_time_mult = smpl_time_mult,
+		.input_attenuator = input_attenuator,
+		.chopping = chopping,
+		.oversampling = oversampling
+	};
 	
-	// Save period width and pulse width to global variable and call UART printout in UVP timer callback function
-	period_width = period_count;
-	switch (channel)
-	{
-		case TIM2_PWM_2:
-				pulse_width_1 = pulse_width;
-				break;
-		case TIM2_PWM_3:
-				pulse_width_2 = pulse_width;
-				break;
-		case TIM2_PWM_4:
-				break;
-		#if defined (__DA14531__)
-		case TIM2_PWM_5:
-				break;
-		case TIM2_PWM_6:
-				break;
-		case TIM2_PWM_7:
-				break;
-		#endif
-		default:
-				return;
-	}
+	// Apply configuration and offset calibration
+	gpadc_configure(&adc_config_struct);
 }
 
-void timer2_pwm_set_offset(uint8_t offset_percentage, tim2_pwm_t channel)
+void gpadc_configure(const adc_config_t *adc_config)
 {
-	// Prevent SoC from sleeping
-	arch_set_sleep_mode(ARCH_SLEEP_OFF);
+	// Initialize ADC with the configuration structure
+	adc_init(adc_config);
 	
-	// Clamp input percentage
-	uint8_t offset_clamped = CLAMP(offset_percentage, 0, 100);
+	// Disable input shifter (not needed)
+	adc_input_shift_disable();
 	
-	// Read Timer 2 period counter register
-	uint32_t period_count = GetWord16(TRIPLE_PWM_FREQUENCY) + 1u;
+	// Disable die temperature sensor (may lower noise)
+	adc_temp_sensor_disable();
 	
-	// Calculate the offset value in timer counts (32-bit)
-	uint32_t offset_count = (period_count * offset_clamped) / 100u;
+	// Set ADC startup delay after LDO powers on
+	adc_delay_set(64); // for 16 Mhz system clock, 16 us delay is recommended by datasheet
 	
-	// Determine the correct register address based on the channel
-	volatile uint16_t *start_reg;
+	// Enable load current for ADC's LDO to improve stability during conversion
+	adc_ldo_const_current_enable();
+
+	// Restore or measure the offset calibration for this input and attenuation
+	gpadc_cal_apply(adc_config->input, adc_config->input_attenuator);
 	
-	switch (channel)
+	// Build millivolt conversion once per configuration instead of on every sample
+	gpadc_conv_init(&gpadc_conv, adc_config->input_attenuator, adc_config->oversampling);
+}
+
+void gpadc_cal_apply(adc_input_se_t input, adc_input_attn_t input_attenuator)
+{
+	// Look up the offset calibration result for this input and attenuation
+	gpadc_cal_entry_t *entry = gpadc_cal_lookup(input, input_attenuator);
+
+	if (gpadc_cal_is_fresh(entry))
 	{
-			case TIM2_PWM_2: start_reg = (volatile uint16_t *)PWM2_START_CYCLE; break;
-			case TIM2_PWM_3: start_reg = (volatile uint16_t *)PWM3_START_CYCLE; break;
-			case TIM2_PWM_4: start_reg = (volatile uint16_t *)PWM4_START_CYCLE; break;
-			#if defined (__DA14531__)
-			case TIM2_PWM_5: start_reg = (volatile uint16_t *)PWM5_START_CYCLE; break;
-			case TIM2_PWM_6: start_reg = (volatile uint16_t *)PWM6_START_CYCLE; break;
-			case TIM2_PWM_7: start_reg = (volatile uint16_t *)PWM7_START_CYCLE; break;
-			#endif
-			default: return;
+		// Restore cached offsets instead of running the calibration conversions again
+		SetWord16(GP_ADC_OFFP_REG, entry->offp);
+		SetWord16(GP_ADC_OFFN_REG, entry->offn);
+		entry->uses++;
+	}
+	else
+	{
+		// Perform offset calibration to remove DC offsets before sampling
+		// Residual 34 mV GND reading is corrected by GPADC_LIN_CAL in gpadc_conv_init()
+		adc_reset_offsets();
+		adc_offset_calibrate(ADC_INPUT_MODE_SINGLE_ENDED);
+
+		// Save calibration result and the conditions it was taken at
+		entry->input = input;
+		entry->attn = input_attenuator;
+		entry->offp = GetWord16(GP_ADC_OFFP_REG);
+		entry->offn = GetWord16(GP_ADC_OFFN_REG);
+		entry->vbat_mv = uvp_adc_sample_mv;
+		entry->uses = 0;
+		entry->valid = true;
 	}
-	
-	// Write the offset to the register
-	SetWord16(start_reg, offset_count);
-	
-	#ifdef CFG_PRINTF
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	arch_printf("[PWM OFFSET CH%u] Target Offset: %u percent \n\r", channel + 1, offset_clamped);
-	arch_printf("[PWM OFFSET CH%u] Read period count: %lu \n\r", channel + 1, period_count);
-	arch_printf("[PWM CONTROL CH%u] Calculated offset counts: %lu counts \n\r", channel + 1, offset_count);
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	#endif
 }
 
-void timer2_pwm_set_frequency(tim0_2_clk_div_t clk_div, tim2_clk_src_t clk_src, uint16_t pwm_div)
+gpadc_cal_entry_t *gpadc_cal_lookup(adc_input_se_t input, adc_input_attn_t input_attenuator)
 {
-	// Prevent SoC from sleeping
-	arch_set_sleep_mode(ARCH_SLEEP_OFF);
-	
-	// Create config structures for clock division and timer2 config
-	tim0_2_clk_div_config_t clk_cfg = {
-		.clk_div = clk_div
-	};
-	
-	tim2_config_t tmr_cfg =
+	gpadc_cal_entry_t *victim = &gpadc_cal_cache[0];
+
+	for (uint8_t i = 0; i < GPADC_CAL_CACHE_SIZE; i++)
 	{
-		.clk_source = clk_src,
-    .hw_pause = TIM2_HW_PAUSE_OFF
-	};
-	
-	// Apply clock division and timer config
-	timer0_2_clk_div_set(&clk_cfg);
-	timer2_config(&tmr_cfg);
-	
-	// Compute input clock frequency from selected clock source and divider
-	uint8_t clk_div_int = 1 << clk_div;
-	uint32_t clk_freq = (clk_src == TIM2_CLK_SYS) ? SYS_CLK_FREQ_HZ : LP_CLK_FREQ_HZ,
-					 input_freq = clk_freq / clk_div_int;
+		gpadc_cal_entry_t *entry = &gpadc_cal_cache[i];
 
-	// Clamp pwm_div to datasheet allowed range
-	pwm_div = CLAMP(pwm_div, MIN_PWM_DIV, MAX_PWM_DIV);
-	
-	// Calculate PWM output frequency based on formula from datasheet for Timer 2
-	uint32_t output_freq = input_freq / (uint32_t)pwm_div;
+		// Return existing entry for this combination
+		if (entry->valid && entry->input == input && entry->attn == input_attenuator)
+		{
+			return entry;
+		}
+
+		// Otherwise prefer an empty slot, then the most used (oldest) one
+		if (!victim->valid)
+		{
+			continue;
+		}
+		if (!entry->valid || entry->uses > victim->uses)
+		{
+			victim = entry;
+		}
+	}
+
+	// Slot is recalibrated by caller since it does not match
+	victim->valid = false;
+
+	return victim;
+}
+
+bool gpadc_cal_is_fresh(gpadc_cal_entry_t const *entry)
+{
+	if (!entry->valid)
+	{
+		return false;
+	}
+
+	// Recalibrate on a schedule to track slow drift such as die temperature
+	if (entry->uses >= GPADC_CAL_MAX_USES)
+	{
+		return false;
+	}
+
+	// Recalibrate if battery moved since the offsets were measured
+	uint16_t vbat_delta = (uvp_adc_sample_mv > entry->vbat_mv) ? (uvp_adc_sample_mv - entry->vbat_mv) : (entry->vbat_mv - uvp_adc_sample_mv);
+
+	return (vbat_delta <= GPADC_CAL_VBAT_DELTA_MV);
+}
+
+void gpadc_cal_invalidate(void)
+{
+	// Force calibration on next gpadc_init_se() call for every input
+	memset(gpadc_cal_cache, 0, sizeof(gpadc_cal_cache));
+}
 
-	// Set PWM output frequency
-	timer2_pwm_freq_set(output_freq, input_freq);
+uint16_t gpadc_collect_sample(void)
+{
+	// Fetch raw ADC sample then apply SDK correction routine (config-dependent)
+	uint16_t sample = adc_correct_sample(adc_get_sample());
 	
-	#ifdef CFG_PRINTF
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	arch_printf("[PWM FREQ] clk_div value = %u (0x%02X) \n\r", clk_div, clk_div);
-	arch_printf("[PWM FREQ] clk_src value = %u (0x%02X) \n\r", clk_src, clk_src);
-	arch_printf("[PWM FREQ] pwm_div (clamped value) = %u (0x%04X) \n\r", pwm_div, pwm_div);
-	arch_printf("[PWM FREQ] Input clock freq: %lu Hz \n\r", input_freq);
-	arch_printf("[PWM FREQ] Output PWM freq: %lu Hz \n\r", output_freq);
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	#endif
+	return (sample);
 }
 
-void timer2_pwm_enable(void)
+void gpadc_collect_burst(uint8_t log2_n, gpadc_burst_t *burst)
 {
-	// Prevent SoC from sleeping
-	arch_set_sleep_mode(ARCH_SLEEP_OFF);
+	// Clamp burst length so the boxcar sum of 16-bit samples fits in 32 bits
+	log2_n = (log2_n > GPADC_BURST_MAX_LOG2_N) ? GPADC_BURST_MAX_LOG2_N : log2_n;
+	uint8_t n = 1U << log2_n;
 	
-	// Enable timer input clock
-	timer0_2_clk_enable();
+	// First sample is the reference so deviations stay small and their squares fit in 32 bits
+	uint16_t first = gpadc_collect_sample();
+	uint32_t sum = first;
+	int32_t dev_sum = 0;
+	uint64_t dev_sq_sum = 0;
 	
-	// Start PWM duty cycle updates
-	pwm_dc_control_timer = app_easy_timer(50, timer2_pwm_dc_control_timer_cb);
+	for (uint8_t i = 1; i < n; i++)
+	{
+		uint16_t sample = gpadc_collect_sample();
+		int32_t dev = (int32_t)sample - (int32_t)first;
+		uint32_t dev_abs = (dev < 0) ? (uint32_t)(-dev) : (uint32_t)dev;
+		
+		// Boxcar decimator is a plain running sum, divided by a shift at the end
+		sum += sample;
+		dev_sum += dev;
+		dev_sq_sum += dev_abs * dev_abs; // at most 0xFFFF^2 so no 32-bit overflow
+	}
 	
-	// Enable PWM outputs
-	timer2_start();
+	// Population variance in Q8 from shifted sums: (sum(d^2) - sum(d)^2 / n) / n
+	uint64_t dev_sum_sq = (uint64_t)((int64_t)dev_sum * dev_sum);
+	uint64_t var_q8 = ((dev_sq_sum << 8) - ((dev_sum_sq << 8) >> log2_n)) >> log2_n;
 	
-	#ifdef CFG_PRINTF
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	arch_printf("[PWM ENABLE] PWM output on. \n\r");
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	#endif
+	burst->log2_n = log2_n;
+	burst->sum = sum;
+	burst->mean = (uint16_t)((sum + (n >> 1)) >> log2_n); // round to nearest
+	burst->noise_q4 = gpadc_isqrt((var_q8 > 0xFFFFFFFFU) ? 0xFFFFFFFFU : (uint32_t)var_q8);
 }
 
-void timer2_pwm_disable(void)
+uint32_t gpadc_burst_to_uv(gpadc_burst_t const *burst)
 {
-	// Stop PWM duty cycle updates
-	if (pwm_dc_control_timer != EASY_TIMER_INVALID_TIMER) // prevents cancel when timer does not exist
-	{
-		// Cancels existing timer
-		app_easy_timer_cancel(pwm_dc_control_timer);
-		pwm_dc_control_timer = EASY_TIMER_INVALID_TIMER;
-	}
-	
-	// Disable PWM outputs
-	timer2_stop();
+	return gpadc_conv_to_uv(&gpadc_conv, burst->sum, burst->log2_n);
+}
 
-	// Disable timer input clock
-	timer0_2_clk_disable();
-	
-	// Return sleep mode to default
-	arch_set_sleep_mode(ARCH_EXT_SLEEP_ON);
-	
-	#ifdef CFG_PRINTF
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	arch_printf("[PWM DISABLE] PWM output off. \n\r");
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	#endif
+void gpadc_conv_init(gpadc_conv_t *conv, adc_input_attn_t input_attenuator, uint8_t oversampling)
+{
+	// Linearity correction measured for this attenuator setting
+	gpadc_conv_build(conv, &GPADC_LIN_CAL[input_attenuator & 0x3], (uint8_t)input_attenuator, oversampling);
+}
+
+uint16_t gpadc_sample_to_mv(uint16_t sample)
+{
+	// Returns mV value read by the ADC using the descriptor built when the ADC was configured
+	return gpadc_conv_apply(&gpadc_conv, sample);
 }
 
 /*
  ****************************************************************************************
- * USER CALLBACK FUNCTIONS
+ * PWM FUNCTIONS
  ****************************************************************************************
 */
 
-void user_on_connection(uint8_t connection_idx, struct gapc_connection_req_ind const *param)
+// Timer2 registers are lost when PD_TIM powers down in extended sleep, every write goes through
+// user_pwm_shadow so the values are kept in retention RAM and restored in user_app_resume_from_sleep()
+// START/END values are only staged here, pwm_shadow_commit() writes all channels at a safe point in the period
+
+static bool pwm_channel_stage_pulse(uint8_t ch, uint32_t pulse_width)
 {
-	default_app_on_connection(connection_idx, param);
+	// Read Timer 2 period from the shadow, the register reads as zero after extended sleep
+	uint32_t period_count = pwm_shadow_period();
 	
-	#ifdef CFG_PRINTF
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	arch_printf("[BLE] Phone connected to DA14531. \n\r");
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	#endif
+	// Read existing offset from the channel's START_CYCLE shadow
+	uint32_t offset_count = pwm_shadow_start(ch);
+	
+	// Add offset to pulse width to create END_CYCLE value
+	uint32_t end_cycle_value_raw = pulse_width + offset_count;
+	uint32_t end_cycle_value;
+	
+	// Clamp END_CYCLE value via wrap-around logic
+	if (end_cycle_value_raw >= period_count)
+	{
+			end_cycle_value = end_cycle_value_raw - period_count;
+	}
+	else
+	{
+			end_cycle_value = end_cycle_value_raw;
+	}
+	
+	// Stage the new END_CYCLE value for the next commit, unchanged values are skipped
+	if (end_cycle_value == pwm_shadow_end(ch))
+	{
+		return false;
+	}
+	
+	pwm_shadow_stage_end(ch, (uint16_t)end_cycle_value);
+	pwm_end_writes++;
+	
+	return true;
 }
 
-void user_on_disconnect(struct gapc_disconnect_ind const *param )
+static uint32_t pwm_channel_stage_offset(uint8_t ch)
 {
-	default_app_on_disconnect(param);
+	// Read Timer 2 period from the shadow, the register reads as zero after extended sleep
+	uint32_t period_count = pwm_shadow_period();
 	
-	#ifdef CFG_PRINTF
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	arch_printf("[BLE] Phone disconnected from DA14531. \n\r");
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	#endif
+	// Calculate the offset value in timer counts (32-bit)
+	uint32_t offset_count = (period_count * pwm_channels[ch].offset_pct) / 100u;
+	
+	// Stage the offset, it is committed together with the END_CYCLE computed from it
+	pwm_shadow_stage_start(ch, (uint16_t)offset_count);
+	
+	return offset_count;
 }
 
-void user_catch_rest_hndl(ke_msg_id_t const msgid,
-													void const *param,
-													ke_task_id_t const dest_id,
-													ke_task_id_t const src_id)
+static void pwm_channel_update(uint8_t ch)
 {
-	switch(msgid)
+	pwm_channel_state_t *state = &pwm_channels[ch];
+	
+	// Read Timer 2 period from the shadow, the register reads as zero after extended sleep
+	uint32_t period_count = pwm_shadow_period();
+	
+	// Guard against division near zero, the reciprocal is only built for VBAT >= 100 mV
+	if (!pwm_comp_ready(&pwm_comp))
 	{
-		// Checks for case when phone writes data to a custom characteristic value
-		case CUSTS1_VAL_WRITE_IND:
-		{
-			// Param is generic constant so must change type to expected struct by casting it (SDK line)
-			struct custs1_val_write_ind const *msg_param = (struct custs1_val_write_ind const *)(param);
-			
-			// Determine which characteristic was written to by checking its handle and jumping to the respective handler
-			switch (msg_param->handle)
+		#ifdef CFG_PRINTF
+		arch_printf("[ERROR] Vbat divisor near zero (<100mV) \n\r");
+		#endif
+		
+		return;
+	}
+	
+	// Construct (duty cycle * period) = period / 2 - 5 * vbias * period / (7 * vbat), clamped to the period,
+	// with a multiply by the cached reciprocal in place of the division
+	// The closed-loop trim corrects the feed-forward target, the result stays in the hardware range
+	int32_t drive_mv = (int32_t)state->target_mv + state->trim_mv;
+	drive_mv = CLAMP(drive_mv, -1000, 1000);
+	
+	#ifdef CFG_PWM_DITHER
+	// Keep 1/256 count of the result, pwm_dither_timer_cb() spreads it over successive steps
+	uint32_t pulse_width_q8 = pwm_comp_pulse_width_q8(&pwm_comp, (int16_t)drive_mv, period_count);
+	uint32_t pulse_width = pulse_width_q8 >> PWM_COMP_FRAC_BITS;
+	state->pulse_frac = (uint8_t)(pulse_width_q8 & 0xFFU);
+	#else
+	uint32_t pulse_width = pwm_comp_pulse_width(&pwm_comp, (int16_t)drive_mv, period_count);
+	#endif
+	
+	pwm_channel_stage_pulse(ch, pulse_width);
+	
+	// BUG: UART prints will cause CPU SW reset if function is called from BLE handler
+	/*
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[PWM CONTROL PWM%u] Read target vbias: %ld mV \n\r", ch + 2, (int32_t)state->target_mv);
+	arch_printf("[PWM CONTROL PWM%u] Read period count: %lu \n\r", ch + 2, period_count);
+	arch_printf("[PWM CONTROL PWM%u] Calculated Pulse Width: %lu counts \n\r", ch + 2, pulse_width);
+	arch_printf("[PWM CONTROL PWM%u] Staged END_CYCLE: %u counts \n\r", ch + 2, pwm_shadow_end(ch));
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+	*/
+	
+	// Save period width and pulse width for the UART printout in the UVP timer callback function
+	period_width = period_count;
+	state->pulse_width = (uint16_t)pulse_width;
+}
+
+static void pwm_channels_update(void)
+{
+	// One pass over the channel table, inactive outputs keep their registers untouched
+	for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		if (pwm_channels[ch].active)
+		{
+			pwm_channel_update(ch);
+		}
+	}
+}
+
+static void pwm_channels_rescale(void)
+{
+	// VBAT may sit inside the deadband for good, so a new period cannot wait for pwm_channels_update()
+	for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		if (pwm_channels[ch].active)
+		{
+			pwm_channel_stage_offset(ch);
+			pwm_channel_update(ch);
+		}
+	}
+}
+
+#ifdef CFG_PWM_DITHER
+void pwm_dither_timer_cb(uint8_t periods)
+{
+	// First-order sigma-delta per channel: the fraction accumulates and every overflow widens the
+	// pulse by one count for one step, so the mean over 256 steps carries the full Q8 pulse width
+	bool changed = false;
+	
+	for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		pwm_channel_state_t *state = &pwm_channels[ch];
+		
+		if (!state->active)
+		{
+			continue;
+		}
+		
+		uint16_t acc = (uint16_t)state->dither_acc + state->pulse_frac;
+		state->dither_acc = (uint8_t)(acc & 0xFFU);
+		changed |= pwm_channel_stage_pulse(ch, (uint32_t)state->pulse_width + (acc >> PWM_COMP_FRAC_BITS));
+	}
+	
+	// All channels take their step in the same PWM period, a step that lands on the same count
+	// (zero fraction, or a carry on the step before and after) leaves the registers alone
+	if (changed)
+	{
+		pwm_shadow_commit();
+	}
+}
+#endif
+
+static uint32_t pwm_ramp_settle_us(void)
+{
+	// A first-order filter ends the ramps trailing by the lag, which then halves every tau * ln 2
+	uint8_t halvings = 0;
+	while (((uint32_t)PWM_SETTLE_TOLERANCE_MV << halvings) < pwm_ramp_lag_mv)
+	{
+		halvings++;
+	}
+	
+	// tau * ln 2 in microseconds is tau_ms * 693
+	return (uint32_t)halvings * pwm_bias_tau_ms * 693U;
+}
+
+static bool pwm_ramp_pending(void)
+{
+	for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		if (pwm_channels[ch].active && pwm_channels[ch].ramp_uv != (int32_t)pwm_channels[ch].setpoint_mv * 1000)
+		{
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static void pwm_ramp_wait_settle(void)
+{
+	// One run at the settle deadline instead of a tick every 10 ms, rounded up to whole ticks. A wait
+	// longer than the longest period (a long tau) takes more than one run.
+	int32_t wait_us = (int32_t)(pwm_settle_deadline_us - timebase_now_us());
+	uint32_t ticks = (wait_us > 0) ? (((uint32_t)wait_us + PERIODIC_TICK_US - 1U) / PERIODIC_TICK_US) : 1U;
+	
+	if (ticks > UINT16_MAX)
+	{
+		ticks = UINT16_MAX;
+	}
+	periodic_task_start(&pwm_ramp_task, (uint16_t)ticks, 0, pwm_ramp_timer_cb);
+}
+
+static void pwm_ramp_schedule(void)
+{
+	// Nothing moves the filter while the outputs are off, ramps and the settle wait resume on enable
+	if (!pwm_enabled || pwm_bias_settled)
+	{
+		periodic_task_stop(&pwm_ramp_task);
+		return;
+	}
+	
+	if (pwm_ramp_pending())
+	{
+		// Step every tick, a settle wait in progress starts over after the ramp
+		if (pwm_ramp_settling || !periodic_task_is_running(&pwm_ramp_task))
+		{
+			pwm_ramp_settling = false;
+			periodic_task_start(&pwm_ramp_task, PWM_RAMP_TICK, 0, pwm_ramp_timer_cb);
+		}
+		return;
+	}
+	
+	// Every target is reached, only the filter is left to wait for
+	if (!pwm_ramp_settling)
+	{
+		pwm_ramp_settling = true;
+		pwm_settle_deadline_us = timebase_now_us() + pwm_ramp_settle_us();
+		pwm_ramp_wait_settle();
+	}
+	else if (!periodic_task_is_running(&pwm_ramp_task))
+	{
+		pwm_ramp_wait_settle();
+	}
+}
+
+static void pwm_ramp_begin(uint8_t ch, int16_t setpoint_mv)
+{
+	pwm_channel_state_t *state = &pwm_channels[ch];
+	
+	// A channel that was not driven ramps from the target it was parked at
+	if (!state->active)
+	{
+		state->ramp_uv = (int32_t)state->target_mv * 1000;
+		state->active = true;
+	}
+	state->setpoint_mv = setpoint_mv;
+	
+	// The filter trails a ramp by slew * tau and a jump by the whole step
+	int32_t step_mv = (int32_t)setpoint_mv - state->target_mv;
+	uint32_t lag_mv = (step_mv < 0) ? (uint32_t)(-step_mv) : (uint32_t)step_mv;
+	if (pwm_ramp_slew_mv_per_s != 0)
+	{
+		uint32_t ramp_lag_mv = ((uint32_t)pwm_ramp_slew_mv_per_s * pwm_bias_tau_ms) / 1000U;
+		if (ramp_lag_mv < lag_mv)
+		{
+			lag_mv = ramp_lag_mv;
+		}
+	}
+	if (lag_mv > pwm_ramp_lag_mv)
+	{
+		pwm_ramp_lag_mv = (uint16_t)lag_mv;
+	}
+	
+	// Without a slew limit the output jumps now and only the settle wait runs on the tick
+	if (pwm_ramp_slew_mv_per_s == 0)
+	{
+		state->ramp_uv = (int32_t)setpoint_mv * 1000;
+		state->target_mv = setpoint_mv;
+	}
+	pwm_channel_update(ch);
+	
+	// Settling starts over from this change, a ramp already stepping keeps its tick
+	if (pwm_ramp_settling)
+	{
+		periodic_task_stop(&pwm_ramp_task);
+	}
+	pwm_ramp_settling = false;
+	pwm_bias_settled = false;
+	pwm_ramp_start_us = timebase_now_us();
+	
+	pwm_ramp_schedule();
+}
+
+void pwm_ramp_timer_cb(uint8_t periods)
+{
+	if (pwm_ramp_settling)
+	{
+		// The wake-up may come up to half a tick early, wait out the rest
+		uint32_t now_us = timebase_now_us();
+		if ((int32_t)(now_us - pwm_settle_deadline_us) < 0)
+		{
+			pwm_ramp_wait_settle();
+			return;
+		}
+		
+		pwm_ramp_settling = false;
+		pwm_bias_settled = true;
+		pwm_ramp_lag_mv = 0;
+		pwm_settle_ms = (now_us - pwm_ramp_start_us) / 1000U;
+		periodic_task_stop(&pwm_ramp_task);
+		
+		// Take the next sensor reading on the settled bias instead of at its fixed slot
+		gpadc_sched_sample_now(GPADC_CH_SENSOR);
+		return;
+	}
+	
+	// A slew rate in mV/s is a step in uV per ms
+	int32_t step_uv = (int32_t)pwm_ramp_slew_mv_per_s * (int32_t)(PERIODIC_TICK_US / 1000U) * PWM_RAMP_TICK * periods;
+	bool changed = false;
+	
+	for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		pwm_channel_state_t *state = &pwm_channels[ch];
+		int32_t setpoint_uv = (int32_t)state->setpoint_mv * 1000;
+		int32_t remaining_uv = setpoint_uv - state->ramp_uv;
+		
+		if (!state->active || remaining_uv == 0)
+		{
+			continue;
+		}
+		
+		// Move one step toward the setpoint, the last step lands on it exactly
+		if (pwm_ramp_slew_mv_per_s == 0 || (remaining_uv <= step_uv && remaining_uv >= -step_uv))
+		{
+			state->ramp_uv = setpoint_uv;
+		}
+		else
+		{
+			state->ramp_uv += (remaining_uv > 0) ? step_uv : -step_uv;
+		}
+		
+		// Duty cycles only change on whole millivolts, slow ramps skip the ticks in between
+		int16_t target_mv = (int16_t)(state->ramp_uv / 1000);
+		if (target_mv != state->target_mv)
+		{
+			state->target_mv = target_mv;
+			pwm_channel_update(ch);
+			changed = true;
+		}
+	}
+	
+	// Every channel takes its step in the same PWM period, ticks between whole millivolts write nothing
+	if (changed)
+	{
+		pwm_shadow_commit();
+	}
+	
+	// Once every ramp ends the tick gives way to a single run at the settle deadline
+	pwm_ramp_schedule();
+}
+
+static void pwm_loop_restart(void)
+{
+	// Controller keeps its gains, the next sample starts the convergence timer
+	pwm_loop_pi_init(&pwm_loop_pi, pwm_loop_pi.kp_q8, pwm_loop_pi.ki_q8, PWM_LOOP_TRIM_MAX_UV);
+	pwm_loop_setpoint_mv = INT16_MIN;
+	pwm_loop_in_band = 0;
+	pwm_loop_residual_uv = 0;
+	pwm_loop_converge_ms = 0;
+}
+
+static void pwm_loop_start(uint8_t channel, uint16_t period, uint8_t kp_q8, uint8_t ki_q8)
+{
+	pwm_loop_period = (period < PWM_LOOP_MIN_PERIOD) ? PWM_LOOP_MIN_PERIOD : period;
+	
+	pwm_loop_pi_init(&pwm_loop_pi, kp_q8, ki_q8, PWM_LOOP_TRIM_MAX_UV);
+	pwm_loop_restart();
+	pwm_loop_channel = channel;
+	
+	gpadc_sched_enable(GPADC_CH_BIAS, true);
+	periodic_task_start(&pwm_loop_task, pwm_loop_period, 0, pwm_loop_timer_cb);
+}
+
+static void pwm_loop_stop(void)
+{
+	periodic_task_stop(&pwm_loop_task);
+	gpadc_sched_enable(GPADC_CH_BIAS, false);
+	
+	// Back to the plain feed-forward duty cycle
+	if (pwm_loop_channel < PWM_CHANNEL_COUNT)
+	{
+		pwm_channels[pwm_loop_channel].trim_mv = 0;
+		if (pwm_channels[pwm_loop_channel].active)
+		{
+			pwm_channel_update(pwm_loop_channel);
+			pwm_shadow_commit();
+		}
+	}
+	pwm_loop_channel = PWM_LOOP_OFF;
+}
+
+void pwm_loop_timer_cb(uint8_t periods)
+{
+	// No bias to measure while the outputs are off, skip the ADC power-up
+	if (!pwm_enabled)
+	{
+		return;
+	}
+	
+	gpadc_sched_sample_now(GPADC_CH_BIAS);
+}
+
+void pwm_loop_on_sample(gpadc_sched_result_t const *result)
+{
+	if (result == NULL || pwm_loop_channel >= PWM_CHANNEL_COUNT)
+	{
+		return;
+	}
+	
+	// Hold the controller while there is no bias to regulate
+	pwm_channel_state_t *state = &pwm_channels[pwm_loop_channel];
+	if (!pwm_enabled || !state->active)
+	{
+		return;
+	}
+	
+	// Requested bias, following any ramp, before the gain and zero calibration were taken off
+	int32_t setpoint_mv = state->target_mv;
+	if (state->gain_q12 != 0)
+	{
+		setpoint_mv = (setpoint_mv * state->gain_q12) / PWM_GAIN_Q12_ONE;
+	}
+	setpoint_mv += state->zero_cal_mv;
+	setpoint_mv = CLAMP(setpoint_mv, -1000, 1000);
+	if (setpoint_mv != pwm_loop_setpoint_mv)
+	{
+		pwm_loop_setpoint_mv = (int16_t)setpoint_mv;
+		pwm_loop_start_us = result->time_us;
+		pwm_loop_in_band = 0;
+		pwm_loop_converge_ms = 0;
+	}
+	
+	// Feedback pin reads the bias on top of the virtual ground
+	int32_t measured_uv = pwm_loop_bias_uv(result->uv, PWM_BIAS_FB_REF_MV);
+	int32_t error_uv = setpoint_mv * 1000 - measured_uv;
+	int32_t trim_uv = pwm_loop_pi_step(&pwm_loop_pi, error_uv);
+	
+	// Round to the nearest millivolt, the feed-forward path takes whole millivolts
+	int16_t trim_mv = (int16_t)((trim_uv >= 0 ? trim_uv + 500 : trim_uv - 500) / 1000);
+	if (trim_mv != state->trim_mv)
+	{
+		state->trim_mv = trim_mv;
+		pwm_channel_update(pwm_loop_channel);
+		pwm_shadow_commit();
+	}
+	
+	// Converged after several samples in a row inside the band, timed from the setpoint change
+	pwm_loop_residual_uv = error_uv;
+	if (error_uv <= PWM_LOOP_TOLERANCE_UV && error_uv >= -PWM_LOOP_TOLERANCE_UV)
+	{
+		if (pwm_loop_in_band < PWM_LOOP_CONVERGED_SAMPLES)
+		{
+			pwm_loop_in_band++;
+			if (pwm_loop_in_band == PWM_LOOP_CONVERGED_SAMPLES && pwm_loop_converge_ms == 0)
 			{
-				case SVC1_IDX_SENSOR_VOLTAGE_NTF_CFG:
-					user_svc1_sensor_voltage_cfg_ind_handler(msgid, msg_param, dest_id, src_id);
-					break;
+				pwm_loop_converge_ms = (result->time_us - pwm_loop_start_us) / 1000U;
+			}
+		}
+	}
+	else
+	{
+		pwm_loop_in_band = 0;
+	}
+}
+
+void bias_fb_on_sample(gpadc_sched_result_t const *result)
+{
+	// The calibration owns the feedback pin while it runs, the loop is stopped then
+	if (pwm_zcal.state == PWM_ZCAL_RUNNING)
+	{
+		pwm_zcal_on_sample(result);
+	}
+	else
+	{
+		pwm_loop_on_sample(result);
+	}
+}
+
+static void pwm_zcal_drive(int16_t target_mv)
+{
+	// Jump straight to the calibration point, no ramp, no zero calibration, then wait for the filter
+	timer2_pwm_dc_control(target_mv, pwm_channel_desc(pwm_zcal.channel)->channel);
+	pwm_shadow_commit();
+	
+	pwm_zcal.sampling = false;
+	pwm_zcal.stats.count = 0;
+	pwm_zcal.phase_us = timebase_now_us();
+}
+
+static bool pwm_zcal_next_channel(void)
+{
+	// Selected channels are measured in ascending order
+	while (pwm_zcal.channel < PWM_CHANNEL_COUNT && !(pwm_zcal.mask & (1U << pwm_zcal.channel)))
+	{
+		pwm_zcal.channel++;
+	}
+	
+	if (pwm_zcal.channel >= PWM_CHANNEL_COUNT)
+	{
+		return false;
+	}
+	
+	pwm_zcal.saved_vbias_mv = pwm_channels[pwm_zcal.channel].vbias_mv;
+	pwm_zcal.saved_active = pwm_channels[pwm_zcal.channel].active;
+	pwm_zcal.point = 0;
+	pwm_zcal_drive(0);
+	
+	return true;
+}
+
+static void pwm_zcal_restore_channel(void)
+{
+	tim2_pwm_t channel = pwm_channel_desc(pwm_zcal.channel)->channel;
+	
+	// Back to the bias the channel had, now with its new calibration
+	if (pwm_zcal.saved_active)
+	{
+		timer2_pwm_set_bias(pwm_zcal.saved_vbias_mv, pwm_channels[pwm_zcal.channel].zero_cal_mv, channel);
+	}
+	else
+	{
+		timer2_pwm_release(channel);
+	}
+	pwm_shadow_commit();
+}
+
+static void pwm_zcal_finish(pwm_zcal_state_t state)
+{
+	pwm_zcal.state = state;
+	pwm_zcal.duration_ms = (timebase_now_us() - pwm_zcal.start_us) / 1000U;
+	periodic_task_stop(&pwm_zcal_task);
+	gpadc_sched_enable(GPADC_CH_BIAS, false);
+	
+	// Stored calibrations survive a power loss, an aborted run may have stored some channels too
+	if (pwm_zcal.done != 0)
+	{
+		pwm_cfg_changed();
+	}
+}
+
+static void pwm_zcal_point_done(void)
+{
+	int32_t mean_uv;
+	uint16_t stderr_uv = pwm_zcal_stats_result(&pwm_zcal.stats, PWM_ZCAL_LOG2_BURSTS, &mean_uv);
+	int32_t bias_uv = pwm_loop_bias_uv((uint32_t)mean_uv, PWM_BIAS_FB_REF_MV);
+	uint8_t ch = pwm_zcal.channel;
+	int32_t gain_q12 = 0;
+	
+	if (pwm_zcal.point == 0)
+	{
+		pwm_zcal.zero_uv = bias_uv;
+		pwm_zcal.zero_stderr_uv = stderr_uv;
+		
+		// Second point for the gain, the channel result waits for it
+		if (pwm_zcal.gain_point_mv != 0)
+		{
+			pwm_zcal.point = 1;
+			pwm_zcal_drive(pwm_zcal.gain_point_mv);
+			return;
+		}
+	}
+	else
+	{
+		gain_q12 = pwm_zcal_gain_q12(pwm_zcal.zero_uv, bias_uv, pwm_zcal.gain_point_mv);
+		if (pwm_zcal.zero_stderr_uv > stderr_uv)
+		{
+			stderr_uv = pwm_zcal.zero_stderr_uv;
+		}
+	}
+	
+	// Confidence falls linearly with the standard error and reaches 0 at the rejection limit
+	bool accepted = (stderr_uv < PWM_ZCAL_MAX_STDERR_UV) &&
+	                (pwm_zcal.zero_uv <= PWM_ZCAL_MAX_OFFSET_UV && pwm_zcal.zero_uv >= -PWM_ZCAL_MAX_OFFSET_UV) &&
+	                (pwm_zcal.gain_point_mv == 0 || (gain_q12 >= PWM_ZCAL_MIN_GAIN_Q12 && gain_q12 <= PWM_ZCAL_MAX_GAIN_Q12));
+	
+	pwm_zcal_result_t *result = &pwm_zcal_results[ch];
+	result->zero_cal_mv = (int16_t)((pwm_zcal.zero_uv >= 0 ? pwm_zcal.zero_uv + 500 : pwm_zcal.zero_uv - 500) / 1000);
+	result->gain_q12 = (uint16_t)CLAMP(gain_q12, 0, 0xFFFF);
+	result->stderr_uv = stderr_uv;
+	result->confidence = accepted ? pwm_zcal_confidence(stderr_uv, PWM_ZCAL_MAX_STDERR_UV) : 0;
+	
+	if (accepted)
+	{
+		pwm_channels[ch].zero_cal_mv = result->zero_cal_mv;
+		pwm_channels[ch].gain_q12 = result->gain_q12;
+		pwm_zcal.done |= (1U << ch);
+	}
+	else
+	{
+		pwm_zcal.failed |= (1U << ch);
+	}
+	
+	pwm_zcal_restore_channel();
+	
+	pwm_zcal.channel++;
+	if (!pwm_zcal_next_channel())
+	{
+		pwm_zcal_finish(PWM_ZCAL_DONE);
+	}
+}
+
+void pwm_zcal_on_sample(gpadc_sched_result_t const *result)
+{
+	if (result == NULL || !pwm_zcal.sampling)
+	{
+		return;
+	}
+	
+	pwm_zcal_stats_add(&pwm_zcal.stats, (int32_t)result->uv);
+	
+	if (pwm_zcal.stats.count == (1U << PWM_ZCAL_LOG2_BURSTS))
+	{
+		pwm_zcal_point_done();
+	}
+}
+
+void pwm_zcal_timer_cb(uint8_t periods)
+{
+	uint32_t now_us = timebase_now_us();
+	
+	// Out of time or outputs off, the channel being measured keeps its previous calibration
+	if (!pwm_enabled || (now_us - pwm_zcal.start_us) > pwm_zcal.budget_us)
+	{
+		pwm_zcal_restore_channel();
+		pwm_zcal_finish(PWM_ZCAL_ABORTED);
+		return;
+	}
+	
+	if (!pwm_zcal.sampling)
+	{
+		if ((now_us - pwm_zcal.phase_us) < pwm_zcal.settle_us)
+		{
+			return;
+		}
+		pwm_zcal.sampling = true;
+	}
+	
+	// One burst per tick, the result arrives in pwm_zcal_on_sample() before this returns
+	gpadc_sched_sample_now(GPADC_CH_BIAS);
+}
+
+void timer2_pwm_vbat_update(uint16_t vbat_mv)
+{
+	bool changed = true;
+	
+	// Small VBAT moves change the pulse width by a fraction of a count, keep the current duty cycles
+	if (pwm_comp_ready(&pwm_comp))
+	{
+		uint16_t delta = (vbat_mv > pwm_comp.vbat_mv) ? (vbat_mv - pwm_comp.vbat_mv) : (pwm_comp.vbat_mv - vbat_mv);
+		changed = (delta > PWM_VBAT_DEADBAND_MV);
+	}
+	
+	// Rebuild the reciprocal for the new VBAT, readings below 100 mV leave the duty cycles alone
+	if (changed && pwm_comp_set_vbat(&pwm_comp, vbat_mv))
+	{
+		// Update duty cycles of every active channel for the new VBAT
+		pwm_vbat_updates++;
+		pwm_channels_update();
+	}
+	
+	// Commit at a safe point in the period, with nothing staged this keeps the phase estimate fresh
+	pwm_shadow_commit();
+}
+
+void timer2_pwm_dc_control(int16_t target_vbias_mv, tim2_pwm_t channel)
+{
+	uint8_t ch;
+	
+	if (!pwm_channel_index(channel, &ch))
+	{
+		return;
+	}
+	
+	// Keep the target so the compensation loop follows VBAT from now on, a running ramp stops here
+	pwm_channels[ch].target_mv = target_vbias_mv;
+	pwm_channels[ch].setpoint_mv = target_vbias_mv;
+	pwm_channels[ch].ramp_uv = (int32_t)target_vbias_mv * 1000;
+	pwm_channels[ch].active = true;
+	
+	pwm_channel_update(ch);
+}
+
+void timer2_pwm_set_offset(uint8_t offset_percentage, tim2_pwm_t channel)
+{
+	uint8_t ch;
+	
+	if (!pwm_channel_index(channel, &ch))
+	{
+		return;
+	}
+	
+	// Clamp input percentage
+	uint8_t offset_clamped = CLAMP(offset_percentage, 0, 100);
+	pwm_channels[ch].offset_pct = offset_clamped;
+	
+	uint32_t offset_count = pwm_channel_stage_offset(ch);
+	
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[PWM OFFSET CH%u] Target Offset: %u percent \n\r", channel + 1, offset_clamped);
+	arch_printf("[PWM OFFSET CH%u] Read period count: %lu \n\r", channel + 1, pwm_shadow_period());
+	arch_printf("[PWM CONTROL CH%u] Calculated offset counts: %lu counts \n\r", channel + 1, offset_count);
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void timer2_pwm_set_bias(int16_t vbias_mv, int16_t zero_cal_mv, tim2_pwm_t channel)
+{
+	uint8_t ch;
+	
+	if (!pwm_channel_index(channel, &ch))
+	{
+		return;
+	}
+	
+	pwm_channels[ch].vbias_mv = vbias_mv;
+	pwm_channels[ch].zero_cal_mv = zero_cal_mv;
+	
+	// Compensate for uncentered op amp rails and clamp from -1V to 1V (HW specific)
+	int32_t target_mv = (int32_t)vbias_mv - (int32_t)zero_cal_mv;
+	
+	// A calibrated gain scales the target so the measured bias lands on the request
+	if (pwm_channels[ch].gain_q12 != 0)
+	{
+		target_mv = (target_mv * PWM_GAIN_Q12_ONE) / pwm_channels[ch].gain_q12;
+	}
+	target_mv = CLAMP(target_mv, -1000, 1000);
+	
+	// Move toward the new target at the client slew rate instead of jumping
+	pwm_ramp_begin(ch, (int16_t)target_mv);
+}
+
+void timer2_pwm_release(tim2_pwm_t channel)
+{
+	uint8_t ch;
+	
+	if (!pwm_channel_index(channel, &ch) || !pwm_channels[ch].active)
+	{
+		return;
+	}
+	
+	// A 0 mV target is half a period at any VBAT, so the output needs no further updates
+	pwm_channels[ch].vbias_mv = 0;
+	pwm_channels[ch].target_mv = 0;
+	pwm_channels[ch].setpoint_mv = 0;
+	pwm_channels[ch].ramp_uv = 0;
+	pwm_channel_update(ch);
+	pwm_channels[ch].active = false;
+}
+
+void timer2_pwm_set_frequency(tim0_2_clk_div_t clk_div, tim2_clk_src_t clk_src, uint16_t pwm_div)
+{
+	// Compute input clock frequency from selected clock source and divider
+	uint8_t clk_div_int = 1 << clk_div;
+	uint32_t clk_freq = (clk_src == TIM2_CLK_SYS) ? SYS_CLK_FREQ_HZ : LP_CLK_FREQ_HZ,
+					 input_freq = clk_freq / clk_div_int;
+
+	// Clamp pwm_div to datasheet allowed range
+	pwm_div = CLAMP(pwm_div, MIN_PWM_DIV, MAX_PWM_DIV);
+	
+	// Calculate PWM output frequency based on formula from datasheet for Timer 2
+	uint32_t output_freq = input_freq / (uint32_t)pwm_div;
+
+	// Apply clock division, timer config and the period count (pwm_div - 1, as timer2_pwm_freq_set()
+	// would derive it, without dividing by an output frequency that rounds to 0 Hz on the LP clock)
+	pwm_shadow_set_frequency(clk_div, clk_src, pwm_div - 1u);
+	
+	// START/END are counts of the old period, re-derive them for the new one
+	pwm_channels_rescale();
+	pwm_shadow_commit();
+	
+	#ifdef CFG_PWM_RUN_IN_SLEEP
+	// Changing between the LP and system clock changes how deep the running PWM lets the SoC sleep
+	if (pwm_enabled)
+	{
+		sleep_inhibit_release(SLEEP_OWNER_PWM);
+		sleep_inhibit_acquire(SLEEP_OWNER_PWM, pwm_shadow_sleep_level());
+	}
+	#endif
+	
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[PWM FREQ] clk_div value = %u (0x%02X) \n\r", clk_div, clk_div);
+	arch_printf("[PWM FREQ] clk_src value = %u (0x%02X) \n\r", clk_src, clk_src);
+	arch_printf("[PWM FREQ] pwm_div (clamped value) = %u (0x%04X) \n\r", pwm_div, pwm_div);
+	arch_printf("[PWM FREQ] Input clock freq: %lu Hz \n\r", input_freq);
+	arch_printf("[PWM FREQ] Output PWM freq: %lu Hz \n\r", output_freq);
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void timer2_pwm_enable(void)
+{
+	// A system-clocked PWM stops in extended sleep, hold the SoC awake while outputs run
+	if (!pwm_enabled)
+	{
+		sleep_inhibit_acquire(SLEEP_OWNER_PWM, pwm_shadow_sleep_level());
+		pwm_enabled = true;
+	}
+	
+	// Registers were restored on wake-up, only the duty cycles need the latest VBAT
+	pwm_channels_update();
+	
+	// Commit the staged duty cycles, then enable timer input clock and PWM outputs
+	pwm_shadow_run(true);
+	
+	// Ramps or a settle wait left over from a change made while the outputs were off
+	pwm_ramp_schedule();
+	
+	#ifdef CFG_PWM_DITHER
+	// Dither steps only make sense while the outputs toggle
+	if (!periodic_task_is_running(&pwm_dither_task))
+	{
+		periodic_task_start(&pwm_dither_task, PWM_DITHER_TICK, 0, pwm_dither_timer_cb);
+	}
+	#endif
+	
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[PWM ENABLE] PWM output on. \n\r");
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void timer2_pwm_disable(void)
+{
+	#ifdef CFG_PWM_DITHER
+	periodic_task_stop(&pwm_dither_task);
+	#endif
+	
+	// Disable PWM outputs and timer input clock
+	pwm_shadow_run(false);
+	
+	// Let the SoC sleep again unless another subsystem still needs it awake
+	if (pwm_enabled)
+	{
+		sleep_inhibit_release(SLEEP_OWNER_PWM);
+		pwm_enabled = false;
+	}
+	
+	// Ramps hold where they are, the settle wait starts over once the outputs run again
+	pwm_ramp_settling = false;
+	pwm_ramp_schedule();
+	
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[PWM DISABLE] PWM output off. \n\r");
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void pwm_cfg_capture(pwm_cfg_t *cfg)
+{
+	pwm_shadow_t const *shadow = pwm_shadow_get();
+	
+	// Padding is zeroed too, cfg_store_save() compares whole records
+	memset(cfg, 0, sizeof(*cfg));
+	
+	cfg->enabled = pwm_client_enabled;
+	if (shadow->configured)
+	{
+		cfg->clk_div = shadow->clk_div;
+		cfg->clk_src = shadow->clk_src;
+		cfg->pwm_div = shadow->frequency + 1U;
+	}
+	cfg->ramp_slew_mv_per_s = pwm_ramp_slew_mv_per_s;
+	cfg->bias_tau_ms = pwm_bias_tau_ms;
+	cfg->loop_period = pwm_loop_period;
+	cfg->loop_channel = pwm_loop_channel;
+	cfg->loop_kp_q8 = pwm_loop_pi.kp_q8;
+	cfg->loop_ki_q8 = pwm_loop_pi.ki_q8;
+	cfg->sensor_log = sensor_log_enabled;
+	
+	for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		if (pwm_channels[ch].active)
+		{
+			cfg->active |= (1U << ch);
+		}
+		cfg->offset_pct[ch] = pwm_channels[ch].offset_pct;
+		cfg->vbias_mv[ch] = pwm_channels[ch].vbias_mv;
+		cfg->zero_cal_mv[ch] = pwm_channels[ch].zero_cal_mv;
+		cfg->gain_q12[ch] = pwm_channels[ch].gain_q12;
+	}
+}
+
+void pwm_cfg_apply(pwm_cfg_t const *cfg)
+{
+	// Same checks as the PWM Frequency write, a record from a bad flash cell must not reach the timer
+	if (cfg->pwm_div != 0 && cfg->clk_div <= TIM0_2_CLK_DIV_8 && cfg->clk_src <= TIM2_CLK_SYS)
+	{
+		timer2_pwm_set_frequency((tim0_2_clk_div_t)cfg->clk_div, (tim2_clk_src_t)cfg->clk_src, cfg->pwm_div);
+	}
+	
+	// Ramp settings first so the restored biases ramp up like any other bias write
+	pwm_ramp_slew_mv_per_s = cfg->ramp_slew_mv_per_s;
+	pwm_bias_tau_ms = cfg->bias_tau_ms;
+	
+	for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		tim2_pwm_t channel = pwm_channel_desc(ch)->channel;
+		
+		pwm_channels[ch].zero_cal_mv = cfg->zero_cal_mv[ch];
+		pwm_channels[ch].gain_q12 = cfg->gain_q12[ch];
+		
+		if (cfg->active & (1U << ch))
+		{
+			timer2_pwm_set_offset(cfg->offset_pct[ch], channel);
+			timer2_pwm_set_bias(CLAMP(cfg->vbias_mv[ch], -1000, 1000), cfg->zero_cal_mv[ch], channel);
+		}
+	}
+	pwm_shadow_commit();
+	
+	pwm_client_enabled = (cfg->enabled != 0);
+	if (pwm_client_enabled)
+	{
+		timer2_pwm_enable();
+	}
+	
+	#ifdef CFG_PWM_BIAS_LOOP
+	if (cfg->loop_channel < PWM_CHANNEL_COUNT && cfg->loop_kp_q8 != 0 && cfg->loop_ki_q8 != 0)
+	{
+		pwm_loop_start(cfg->loop_channel, cfg->loop_period, cfg->loop_kp_q8, cfg->loop_ki_q8);
+	}
+	#endif
+	
+	// Logging resumes after a reset without waiting for a client
+	sensor_log_set(cfg->sensor_log != 0);
+	
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[CFG STORE] Restored record %lu: channel mask 0x%02X, PWM %s, sensor log %s \n\r", cfg_store_get()->seq, cfg->active, pwm_client_enabled ? "on" : "off", sensor_log_enabled ? "on" : "off");
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void pwm_cfg_changed(void)
+{
+	// Restarting the task pushes the save back, only the last change of a burst is written
+	periodic_task_start(&pwm_cfg_save_task, PWM_CFG_SAVE_DELAY, 0, pwm_cfg_save_timer_cb);
+}
+
+void pwm_cfg_save_timer_cb(uint8_t periods)
+{
+	// A calibration run drives its channels to temporary targets, wait until it has put them back
+	if (pwm_zcal.state == PWM_ZCAL_RUNNING)
+	{
+		return;
+	}
+	
+	periodic_task_stop(&pwm_cfg_save_task);
+	
+	pwm_cfg_t cfg;
+	pwm_cfg_capture(&cfg);
+	cfg_store_result_t result = cfg_store_save(PWM_CFG_VERSION, &cfg, sizeof(cfg));
+	
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[CFG STORE] Save: %s, record: %lu \n\r", (result == CFG_STORE_WRITTEN) ? "written" : ((result == CFG_STORE_UNCHANGED) ? "unchanged" : "failed"), cfg_store_get()->seq);
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#else
+	(void)result;
+	#endif
+}
+
+/*
+ ****************************************************************************************
+ * USER CALLBACK FUNCTIONS
+ ****************************************************************************************
+*/
+
+void user_on_connection(uint8_t connection_idx, struct gapc_connection_req_ind const *param)
+{
+	default_app_on_connection(connection_idx, param);
+	
+	// Start from the default MTU until the exchange completes
+	ble_mtu = BLE_DEFAULT_MTU;
+	sensor_frame_reset();
+	
+	// Request a larger ATT MTU so a full sensor frame fits one notification
+	struct gattc_exc_mtu_cmd *mtu_cmd = KE_MSG_ALLOC(GATTC_EXC_MTU_CMD,
+																									 KE_BUILD_ID(TASK_GATTC, connection_idx),
+																									 TASK_APP,
+																									 gattc_exc_mtu_cmd);
+	mtu_cmd->operation = GATTC_MTU_EXCH;
+	mtu_cmd->seq_num = 0;
+	KE_MSG_SEND(mtu_cmd);
+	
+	// Request LE data length extension so the frame is not fragmented over several link layer packets
+	app_easy_gap_set_data_packet_length(connection_idx, BLE_MAX_TX_OCTETS);
+	
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[BLE] Phone connected to DA14531. \n\r");
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void user_on_disconnect(struct gapc_disconnect_ind const *param )
+{
+	default_app_on_disconnect(param);
+	
+	// Next connection negotiates its own MTU and encoding, samples buffered for this one are dropped
+	ble_mtu = BLE_DEFAULT_MTU;
+	sensor_encoding = SAMPLE_CODEC_RAW16;
+	sensor_notify = false;
+	sensor_frame_reset();
+	
+	// Client resumes with a new start sequence on its next connection
+	if (log_dl_state == LOG_DL_RUNNING)
+	{
+		log_dl_state = LOG_DL_IDLE;
+	}
+	log_dl_cccd_value = 0;
+	log_dl_in_flight = 0;
+	
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[BLE] Phone disconnected from DA14531. \n\r");
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void user_catch_rest_hndl(ke_msg_id_t const msgid,
+													void const *param,
+													ke_task_id_t const dest_id,
+													ke_task_id_t const src_id)
+{
+	switch(msgid)
+	{
+		// Checks for case when phone writes data to a custom characteristic value
+		case CUSTS1_VAL_WRITE_IND:
+		{
+			// Param is generic constant so must change type to expected struct by casting it (SDK line)
+			struct custs1_val_write_ind const *msg_param = (struct custs1_val_write_ind const *)(param);
+			
+			// Determine which characteristic was written to by checking its handle and jumping to the respective handler
+			switch (msg_param->handle)
+			{
+				case SVC1_IDX_SENSOR_VOLTAGE_NTF_CFG:
+					user_svc1_sensor_voltage_cfg_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+
+				case SVC1_IDX_PWM_FREQ_VAL:
+					user_svc1_pwm_freq_wr_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_PWM_VBIAS_AND_OFFSET_VAL:
+					user_svc1_pwm_vbias_and_offset_wr_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_PWM_STATE_VAL:
+					user_svc1_pwm_state_wr_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_BATTERY_VOLTAGE_NTF_CFG:
+					user_svc1_battery_voltage_cfg_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_SENSOR_STREAM_CFG_VAL:
+					user_svc1_sensor_stream_cfg_wr_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_PWM_FREQ_PLAN_VAL:
+					user_svc1_pwm_freq_plan_wr_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_PWM_RAMP_VAL:
+					user_svc1_pwm_ramp_wr_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_PWM_LOOP_VAL:
+					user_svc1_pwm_loop_wr_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_PWM_ZCAL_VAL:
+					user_svc1_pwm_zcal_wr_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_SENSOR_LOG_VAL:
+					user_svc1_sensor_log_wr_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_LOG_CTRL_VAL:
+					user_svc1_log_ctrl_wr_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_LOG_DATA_NTF_CFG:
+					user_svc1_log_data_cfg_ind_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				default:
+					break;
+			}
+		} break;
+	
+		// Checks for case when client reads a custom characteristic value
+		case CUSTS1_VALUE_REQ_IND:
+		{
+			struct custs1_value_req_ind const *msg_param = (struct custs1_value_req_ind const *) param;
+			
+			switch (msg_param->att_idx)
+			{
+				case SVC1_IDX_SENSOR_VOLTAGE_VAL:
+					user_svc1_read_sensor_voltage_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_BATTERY_VOLTAGE_VAL:
+					user_svc1_read_battery_voltage_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_SENSOR_STREAM_CFG_VAL:
+					user_svc1_read_sensor_stream_cfg_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_PWM_FREQ_PLAN_VAL:
+					user_svc1_read_pwm_freq_plan_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_PWM_RAMP_VAL:
+					user_svc1_read_pwm_ramp_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_PWM_LOOP_VAL:
+					user_svc1_read_pwm_loop_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_PWM_ZCAL_VAL:
+					user_svc1_read_pwm_zcal_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_SENSOR_LOG_VAL:
+					user_svc1_read_sensor_log_handler(msgid, msg_param, dest_id, src_id);
+					break;
+				
+				case SVC1_IDX_LOG_CTRL_VAL:
+					user_svc1_read_log_ctrl_handler(msgid, msg_param, dest_id, src_id);
+					break;
+
+				default: // default read case is an SDK code snippet
+				{
+						// Send Error message
+						struct custs1_value_req_rsp *rsp = KE_MSG_ALLOC(CUSTS1_VALUE_REQ_RSP,
+																														src_id,
+																														dest_id,
+																														custs1_value_req_rsp);
+
+						// Provide the connection index.
+						rsp->conidx  = app_env[msg_param->conidx].conidx;
+						// Provide the attribute index.
+						rsp->att_idx = msg_param->att_idx;
+						// Force current length to zero.
+						rsp->length = 0;
+						// Set Error status
+						rsp->status  = ATT_ERR_APP_ERROR;
+						// Send message
+						KE_MSG_SEND(rsp);
+				} break;
+			}
+		} break;
+		
+		// Stack took a notification, the log download queues the next one
+		case CUSTS1_VAL_NTF_CFM:
+		{
+			struct custs1_val_ntf_cfm const *cfm = (struct custs1_val_ntf_cfm const *) param;
+			
+			if (cfm->handle == SVC1_IDX_LOG_DATA_VAL)
+			{
+				if (log_dl_in_flight > 0)
+				{
+					log_dl_in_flight--;
+				}
+				log_dl_pump();
+			}
+		} break;
+		
+		// MTU changed after an exchange started by either side
+		case GATTC_MTU_CHANGED_IND:
+		{
+			struct gattc_mtu_changed_ind const *ind = (struct gattc_mtu_changed_ind const *) param;
+			ble_mtu = ind->mtu;
+			
+			#ifdef CFG_PRINTF
+			arch_printf("[BLE] MTU changed to %u, sensor frame holds %u samples \n\r", ble_mtu, sensor_frame_capacity());
+			#endif
+		} break;
+		
+		// Code snippet given and required by SDK
+		case GATTC_EVENT_REQ_IND:
+		{
+			// Confirm unhandled indication to avoid GATT timeout
+			struct gattc_event_ind const *ind = (struct gattc_event_ind const *) param;
+			struct gattc_event_cfm *cfm = KE_MSG_ALLOC(GATTC_EVENT_CFM, src_id, dest_id, gattc_event_cfm);
+			cfm->handle = ind->handle;
+			KE_MSG_SEND(cfm);
+		} break;
+
+		default:
+			break;
+	}
+}
+
+void user_svc1_sensor_voltage_cfg_ind_handler(ke_msg_id_t const msgid,
+                                         struct custs1_val_write_ind const *param,
+                                         ke_task_id_t const dest_id,
+                                         ke_task_id_t const src_id)
+{
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+	
+	// Check UVP status
+	if(uvp_shutdown)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Prevented characteristic change and forced exit of handler function \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return;
+	}
+	
+	// Copy CCCD value written by the phone into a local variable
+	uint16_t cccd_value = 0; // set to zero for safe memcpy
+	memcpy(&cccd_value, param->value, param->length);
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - SENSOR VOLTAGE] cccd_value = %u \n\r", cccd_value);
+	#endif
+
+	if (cccd_value == 0x0001 && (ke_state_get(TASK_APP) == APP_CONNECTED)) // notifications enabled and phone connected
+	{
+		#ifdef CFG_PRINTF
+    arch_printf("[BLE - SENSOR VOLTAGE] Starting the ADC. \n\r");
+    #endif
+		
+		// Start continuous ADC conversions if enabled, scheduler then drains the buffer
+		// Add sensor channel to the 1 second sampling schedule
+		sensor_notify = true;
+		gpadc_sched_enable(GPADC_CH_SENSOR, true);
+		sensor_frame_reset();
+		
+		if (sensor_stream_interval_mult > 0 && !gpadc_stream_is_running())
+		{
+			gpadc_stream_start(ADC_ENUM_INPUT, ADC_INPUT_ATTN_NO, SENSOR_STREAM_OVERSAMPLING, sensor_stream_interval_mult);
+		}
+	}
+	else if (cccd_value == 0x0000) // notifications disabled
+	{
+		#ifdef CFG_PRINTF
+    arch_printf("[BLE - SENSOR VOLTAGE] Stopping the ADC. \n\r");
+    #endif
+		
+		// Remove sensor channel from the sampling schedule, the log still needs its readings
+		sensor_notify = false;
+		if (!sensor_log_enabled)
+		{
+			gpadc_sched_enable(GPADC_CH_SENSOR, false);
+		}
+		
+		// Stop continuous conversions
+		if (gpadc_stream_is_running())
+		{
+			gpadc_stream_stop();
+		}
+	}
+	
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void user_svc1_pwm_freq_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id)
+{
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif	
+	
+	// Check UVP status
+	if(uvp_shutdown)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Prevented characteristic change and forced exit of handler function \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return;
+	}
+	
+	// Validate length of characteristic value written by the phone
+	if (param->length != DEF_SVC1_PWM_FREQ_CHAR_LEN)
+	{
+    #ifdef CFG_PRINTF
+    arch_printf("[WARNING] Invalid packet byte length: %u (expected %u) \n\r", param->length, DEF_SVC1_PWM_FREQ_CHAR_LEN);
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+    #endif
+		
+    return; // ignore incomplete write
+	}
+	
+	// Parse byte array into expected values
+	// Byte order is [clk_div, clk_src, pwm_div_MSB, pwm_div_LSB]
+	uint8_t clk_div = param->value[0];
+	uint8_t clk_src = param->value[1];
+	uint16_t pwm_div = ((param->value[2] << 8) | param->value[3]);
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - PWM FREQ] Bytes received. \n\r");
+	arch_printf("[BLE - PWM FREQ] clk_div = %u (0x%02X) \n\r", clk_div, clk_div);
+	arch_printf("[BLE - PWM FREQ] clk_src = %u (0x%02X) \n\r", clk_src, clk_src);
+	arch_printf("[BLE - PWM FREQ] pwm_div = %u (0x%04X) \n\r", pwm_div, (uint16_t)pwm_div);
+	#endif
+
+	// Validate inputs with enum int literals from timer headers
+	if (clk_div > TIM0_2_CLK_DIV_8 || clk_src > TIM2_CLK_SYS) // literals are auto-promoted to uint8 for comparison
+	{
+		#ifdef CFG_PRINTF
+    arch_printf("[WARNING] Invalid clk_div or clk_src write (first 2 bytes), input is ignored. \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+    #endif
+		
+		return; // ignore invalid write
+	}
+
+	// A manual setting replaces the last planner result
+	memset(&pwm_plan, 0, sizeof(pwm_plan));
+	
+	// Apply values to function
+	timer2_pwm_set_frequency((tim0_2_clk_div_t)clk_div, (tim2_clk_src_t)clk_src, pwm_div); // note that pwm_div is clamped in this function already
+	pwm_cfg_changed();
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - PWM FREQ] SUCCESS on setting config. \n\r");
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void user_svc1_pwm_freq_plan_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id)
+{
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+	
+	// Check UVP status
+	if(uvp_shutdown)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Prevented characteristic change and forced exit of handler function \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return;
+	}
+	
+	// Validate length of characteristic value written by the phone
+	if (param->length != DEF_SVC1_PWM_FREQ_PLAN_WRITE_LEN)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid packet byte length: %u (expected %u) \n\r", param->length, DEF_SVC1_PWM_FREQ_PLAN_WRITE_LEN);
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore incomplete write
+	}
+	
+	// Parse byte array into expected values
+	// Byte order is [target_hz (4 bytes, MSB first), min_resolution_mv_MSB, min_resolution_mv_LSB]
+	uint32_t target_hz = ((uint32_t)param->value[0] << 24) | ((uint32_t)param->value[1] << 16) |
+	                     ((uint32_t)param->value[2] << 8) | param->value[3];
+	uint16_t min_resolution_mv = ((param->value[4] << 8) | param->value[5]);
+	
+	// Plan for the VBAT the compensation currently uses, the resolution scales with it
+	uint16_t vbat_mv = pwm_comp_ready(&pwm_comp) ? pwm_comp.vbat_mv : uvp_adc_sample_mv;
+	if (vbat_mv < PWM_COMP_MIN_VBAT_MV)
+	{
+		vbat_mv = PWM_PLAN_NOMINAL_VBAT_MV;
+	}
+	
+	#ifdef CFG_PWM_DITHER
+	uint8_t frac_bits = PWM_COMP_FRAC_BITS;
+	#else
+	uint8_t frac_bits = 0;
+	#endif
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - PWM PLAN] Bytes received. \n\r");
+	arch_printf("[BLE - PWM PLAN] target = %lu Hz, min resolution = %u mV at VBAT %u mV \n\r", target_hz, min_resolution_mv, vbat_mv);
+	#endif
+	
+	pwm_plan_t plan;
+	if (!pwm_plan_search(target_hz, min_resolution_mv, vbat_mv, frac_bits, &plan))
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid target frequency write (first 4 bytes), input is ignored. \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore invalid write
+	}
+	
+	// Apply the plan through the same path as the manual PWM Frequency write
+	pwm_plan = plan;
+	timer2_pwm_set_frequency((tim0_2_clk_div_t)plan.clk_div, plan.lp_clock ? TIM2_CLK_LP : TIM2_CLK_SYS, plan.pwm_div);
+	pwm_cfg_changed();
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - PWM PLAN] %s clock, clk_div = %u, pwm_div = %u \n\r", plan.lp_clock ? "LP" : "SYS", plan.clk_div, plan.pwm_div);
+	arch_printf("[BLE - PWM PLAN] Achieved %lu Hz, resolution %lu uV (%s) \n\r", plan.freq_hz, plan.resolution_uv, plan.resolution_met ? "met" : "NOT met");
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void user_svc1_read_pwm_freq_plan_handler(ke_msg_id_t const msgid,
+                                           struct custs1_value_req_ind const *param,
+                                           ke_task_id_t const dest_id,
+                                           ke_task_id_t const src_id)
+{
+	// Create dynamic kernel message for read response
+	struct custs1_value_req_rsp *rsp = KE_MSG_ALLOC_DYN(CUSTS1_VALUE_REQ_RSP,
+																											prf_get_task_from_id(TASK_ID_CUSTS1),
+																											TASK_APP,
+																											custs1_value_req_rsp,
+																											DEF_SVC1_PWM_FREQ_PLAN_CHAR_LEN);
+	
+	// Fill response fields with expected values by the SDK
+	rsp->conidx  = app_env[param->conidx].conidx; // connection index
+	rsp->att_idx = param->att_idx; // attribute index
+	rsp->length  = DEF_SVC1_PWM_FREQ_PLAN_CHAR_LEN; // current length that will be returned
+	rsp->status  = ATT_ERR_NO_ERROR; // ATT error code
+	
+	// Little-endian like the notifications:
+	// [flags, clk_src, clk_div, pwm_div (2 bytes), freq_hz (4 bytes), resolution_uv (4 bytes)]
+	// flags bit 0 = a plan was applied, bit 1 = resolution met, bit 2 = resolution includes dithering
+	uint8_t flags = 0;
+	if (pwm_plan.pwm_div != 0)
+	{
+		flags |= 0x01;
+	}
+	if (pwm_plan.resolution_met)
+	{
+		flags |= 0x02;
+	}
+	#ifdef CFG_PWM_DITHER
+	flags |= 0x04;
+	#endif
+	
+	rsp->value[0]  = flags;
+	rsp->value[1]  = pwm_plan.lp_clock ? TIM2_CLK_LP : TIM2_CLK_SYS;
+	rsp->value[2]  = pwm_plan.clk_div;
+	rsp->value[3]  = (uint8_t)(pwm_plan.pwm_div & 0xFF);
+	rsp->value[4]  = (uint8_t)(pwm_plan.pwm_div >> 8);
+	rsp->value[5]  = (uint8_t)(pwm_plan.freq_hz & 0xFF);
+	rsp->value[6]  = (uint8_t)((pwm_plan.freq_hz >> 8) & 0xFF);
+	rsp->value[7]  = (uint8_t)((pwm_plan.freq_hz >> 16) & 0xFF);
+	rsp->value[8]  = (uint8_t)(pwm_plan.freq_hz >> 24);
+	rsp->value[9]  = (uint8_t)(pwm_plan.resolution_uv & 0xFF);
+	rsp->value[10] = (uint8_t)((pwm_plan.resolution_uv >> 8) & 0xFF);
+	rsp->value[11] = (uint8_t)((pwm_plan.resolution_uv >> 16) & 0xFF);
+	rsp->value[12] = (uint8_t)(pwm_plan.resolution_uv >> 24);
+	
+	// Send structure to the kernel to be transmitted by the BLE stack
+	KE_MSG_SEND(rsp);
+}
+
+void user_svc1_pwm_ramp_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id)
+{
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+	
+	// Check UVP status
+	if(uvp_shutdown)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Prevented characteristic change and forced exit of handler function \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return;
+	}
+	
+	// Validate length of characteristic value written by the phone
+	if (param->length != DEF_SVC1_PWM_RAMP_WRITE_LEN)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid packet byte length: %u (expected %u) \n\r", param->length, DEF_SVC1_PWM_RAMP_WRITE_LEN);
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore incomplete write
+	}
+	
+	// Parse byte array into expected values
+	// Byte order is [slew_mv_per_s_MSB, slew_mv_per_s_LSB, tau_ms_MSB, tau_ms_LSB]
+	// A running ramp continues at the new rate from its next step
+	pwm_ramp_slew_mv_per_s = ((param->value[0] << 8) | param->value[1]);
+	pwm_bias_tau_ms = ((param->value[2] << 8) | param->value[3]);
+	pwm_cfg_changed();
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - PWM RAMP] Bytes received. \n\r");
+	if (pwm_ramp_slew_mv_per_s == 0)
+	{
+		arch_printf("[BLE - PWM RAMP] Slew rate: none, bias changes jump \n\r");
+	}
+	else
+	{
+		arch_printf("[BLE - PWM RAMP] Slew rate: %u mV/s \n\r", pwm_ramp_slew_mv_per_s);
+	}
+	arch_printf("[BLE - PWM RAMP] Filter time constant: %u ms \n\r", pwm_bias_tau_ms);
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void user_svc1_read_pwm_ramp_handler(ke_msg_id_t const msgid,
+                                      struct custs1_value_req_ind const *param,
+                                      ke_task_id_t const dest_id,
+                                      ke_task_id_t const src_id)
+{
+	// Create dynamic kernel message for read response
+	struct custs1_value_req_rsp *rsp = KE_MSG_ALLOC_DYN(CUSTS1_VALUE_REQ_RSP,
+																											prf_get_task_from_id(TASK_ID_CUSTS1),
+																											TASK_APP,
+																											custs1_value_req_rsp,
+																											DEF_SVC1_PWM_RAMP_CHAR_LEN);
+	
+	// Fill response fields with expected values by the SDK
+	rsp->conidx  = app_env[param->conidx].conidx; // connection index
+	rsp->att_idx = param->att_idx; // attribute index
+	rsp->length  = DEF_SVC1_PWM_RAMP_CHAR_LEN; // current length that will be returned
+	rsp->status  = ATT_ERR_NO_ERROR; // ATT error code
+	
+	// Little-endian like the notifications:
+	// [slew_mv_per_s (2 bytes), tau_ms (2 bytes), flags, settle_ms (4 bytes)]
+	// flags bit 0 = bias settled, bit 1 = ramping, bit 2 = waiting for the filter after the ramp
+	uint8_t flags = 0;
+	if (pwm_bias_settled)
+	{
+		flags |= 0x01;
+	}
+	else if (pwm_ramp_settling)
+	{
+		flags |= 0x04;
+	}
+	else if (periodic_task_is_running(&pwm_ramp_task))
+	{
+		flags |= 0x02;
+	}
+	
+	rsp->value[0] = (uint8_t)(pwm_ramp_slew_mv_per_s & 0xFF);
+	rsp->value[1] = (uint8_t)(pwm_ramp_slew_mv_per_s >> 8);
+	rsp->value[2] = (uint8_t)(pwm_bias_tau_ms & 0xFF);
+	rsp->value[3] = (uint8_t)(pwm_bias_tau_ms >> 8);
+	rsp->value[4] = flags;
+	rsp->value[5] = (uint8_t)(pwm_settle_ms & 0xFF);
+	rsp->value[6] = (uint8_t)((pwm_settle_ms >> 8) & 0xFF);
+	rsp->value[7] = (uint8_t)((pwm_settle_ms >> 16) & 0xFF);
+	rsp->value[8] = (uint8_t)(pwm_settle_ms >> 24);
+	
+	// Send structure to the kernel to be transmitted by the BLE stack
+	KE_MSG_SEND(rsp);
+}
+
+void user_svc1_pwm_loop_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id)
+{
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+	
+	// Check UVP status
+	if(uvp_shutdown)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Prevented characteristic change and forced exit of handler function \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return;
+	}
+	
+	// Validate length of characteristic value written by the phone
+	if (param->length != DEF_SVC1_PWM_LOOP_WRITE_LEN)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid packet byte length: %u (expected %u) \n\r", param->length, DEF_SVC1_PWM_LOOP_WRITE_LEN);
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore incomplete write
+	}
+	
+	// Parse byte array into expected values
+	// Byte order is [channel, period_ms_MSB, period_ms_LSB, kp_q8, ki_q8]
+	uint8_t channel = param->value[0];
+	uint16_t period_ms = ((param->value[1] << 8) | param->value[2]);
+	uint8_t kp_q8 = param->value[3];
+	uint8_t ki_q8 = param->value[4];
+	
+	if (channel != PWM_LOOP_OFF && channel >= PWM_CHANNEL_COUNT)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid channel write (first byte): %u, input is ignored. \n\r", channel);
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore invalid write
+	}
+	
+	#ifndef CFG_PWM_BIAS_LOOP
+	// Without the feedback pin there is nothing to close the loop on
+	if (channel != PWM_LOOP_OFF)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Closed-loop bias needs a CFG_PWM_BIAS_LOOP build, input is ignored. \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore invalid write
+	}
+	#endif
+	
+	// Every write starts from the plain feed-forward duty cycle
+	pwm_loop_stop();
+	
+	if (channel == PWM_LOOP_OFF)
+	{
+		pwm_cfg_changed();
+		
+		#ifdef CFG_PRINTF
+		arch_printf("[BLE - PWM LOOP] Bytes received. \n\r");
+		arch_printf("[BLE - PWM LOOP] Open loop, trim cleared \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return;
+	}
+	
+	if (kp_q8 == 0 && ki_q8 == 0)
+	{
+		kp_q8 = PWM_LOOP_DEFAULT_KP_Q8;
+		ki_q8 = PWM_LOOP_DEFAULT_KI_Q8;
+	}
+	
+	pwm_loop_start(channel, period_ms / 10U, kp_q8, ki_q8);
+	pwm_cfg_changed();
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - PWM LOOP] Bytes received. \n\r");
+	arch_printf("[BLE - PWM LOOP] Regulating PWM%u every %u ms, kp = %u/256, ki = %u/256 \n\r", channel + 2, pwm_loop_period * 10U, kp_q8, ki_q8);
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void user_svc1_read_pwm_loop_handler(ke_msg_id_t const msgid,
+                                      struct custs1_value_req_ind const *param,
+                                      ke_task_id_t const dest_id,
+                                      ke_task_id_t const src_id)
+{
+	// Create dynamic kernel message for read response
+	struct custs1_value_req_rsp *rsp = KE_MSG_ALLOC_DYN(CUSTS1_VALUE_REQ_RSP,
+																											prf_get_task_from_id(TASK_ID_CUSTS1),
+																											TASK_APP,
+																											custs1_value_req_rsp,
+																											DEF_SVC1_PWM_LOOP_CHAR_LEN);
+	
+	// Fill response fields with expected values by the SDK
+	rsp->conidx  = app_env[param->conidx].conidx; // connection index
+	rsp->att_idx = param->att_idx; // attribute index
+	rsp->length  = DEF_SVC1_PWM_LOOP_CHAR_LEN; // current length that will be returned
+	rsp->status  = ATT_ERR_NO_ERROR; // ATT error code
+	
+	// Little-endian like the notifications:
+	// [flags, channel, period_ms (2 bytes), kp_q8, ki_q8, trim_mv (2 bytes), residual_uv (4 bytes), converge_ms (4 bytes)]
+	// flags bit 0 = loop running, bit 1 = converged, bit 2 = trim at its limit, bit 3 = closed loop built in
+	uint8_t flags = 0;
+	int16_t trim_mv = 0;
+	if (pwm_loop_channel < PWM_CHANNEL_COUNT)
+	{
+		flags |= 0x01;
+		trim_mv = pwm_channels[pwm_loop_channel].trim_mv;
+		if (pwm_loop_in_band >= PWM_LOOP_CONVERGED_SAMPLES)
+		{
+			flags |= 0x02;
+		}
+		if (pwm_loop_pi.saturated)
+		{
+			flags |= 0x04;
+		}
+	}
+	#ifdef CFG_PWM_BIAS_LOOP
+	flags |= 0x08;
+	#endif
+	
+	uint16_t period_ms = pwm_loop_period * 10U;
+	uint32_t residual_uv = (uint32_t)pwm_loop_residual_uv;
+	
+	rsp->value[0]  = flags;
+	rsp->value[1]  = pwm_loop_channel;
+	rsp->value[2]  = (uint8_t)(period_ms & 0xFF);
+	rsp->value[3]  = (uint8_t)(period_ms >> 8);
+	rsp->value[4]  = pwm_loop_pi.kp_q8;
+	rsp->value[5]  = pwm_loop_pi.ki_q8;
+	rsp->value[6]  = (uint8_t)((uint16_t)trim_mv & 0xFF);
+	rsp->value[7]  = (uint8_t)((uint16_t)trim_mv >> 8);
+	rsp->value[8]  = (uint8_t)(residual_uv & 0xFF);
+	rsp->value[9]  = (uint8_t)((residual_uv >> 8) & 0xFF);
+	rsp->value[10] = (uint8_t)((residual_uv >> 16) & 0xFF);
+	rsp->value[11] = (uint8_t)(residual_uv >> 24);
+	rsp->value[12] = (uint8_t)(pwm_loop_converge_ms & 0xFF);
+	rsp->value[13] = (uint8_t)((pwm_loop_converge_ms >> 8) & 0xFF);
+	rsp->value[14] = (uint8_t)((pwm_loop_converge_ms >> 16) & 0xFF);
+	rsp->value[15] = (uint8_t)(pwm_loop_converge_ms >> 24);
+	
+	// Send structure to the kernel to be transmitted by the BLE stack
+	KE_MSG_SEND(rsp);
+}
 
-				case SVC1_IDX_PWM_FREQ_VAL:
-					user_svc1_pwm_freq_wr_ind_handler(msgid, msg_param, dest_id, src_id);
-					break;
-				
-				case SVC1_IDX_PWM_VBIAS_AND_OFFSET_VAL:
-					user_svc1_pwm_vbias_and_offset_wr_ind_handler(msgid, msg_param, dest_id, src_id);
-					break;
-				
-				case SVC1_IDX_PWM_STATE_VAL:
-					user_svc1_pwm_state_wr_ind_handler(msgid, msg_param, dest_id, src_id);
-					break;
-				
-				case SVC1_IDX_BATTERY_VOLTAGE_NTF_CFG:
-					user_svc1_battery_voltage_cfg_ind_handler(msgid, msg_param, dest_id, src_id);
-					break;
-				
-				default:
-					break;
-			}
-		} break;
+void user_svc1_pwm_zcal_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id)
+{
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
 	
-		// Checks for case when client reads a custom characteristic value
-		case CUSTS1_VALUE_REQ_IND:
+	// Check UVP status
+	if(uvp_shutdown)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Prevented characteristic change and forced exit of handler function \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return;
+	}
+	
+	// Validate length of characteristic value written by the phone
+	if (param->length != DEF_SVC1_PWM_ZCAL_WRITE_LEN)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid packet byte length: %u (expected %u) \n\r", param->length, DEF_SVC1_PWM_ZCAL_WRITE_LEN);
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore incomplete write
+	}
+	
+	// Parse byte array into expected values
+	// Byte order is [channel_mask, gain_point_mv_MSB, gain_point_mv_LSB]
+	uint8_t mask = param->value[0];
+	int16_t gain_point_mv = ((param->value[1] << 8) | param->value[2]);
+	
+	if (mask == 0 || mask >= (1U << PWM_CHANNEL_COUNT) || gain_point_mv > 1000 || gain_point_mv < -1000)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid channel mask 0x%02X or gain point %d mV, input is ignored. \n\r", mask, gain_point_mv);
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore invalid write
+	}
+	
+	#ifndef CFG_PWM_BIAS_LOOP
+	// The bias is measured on the closed-loop feedback pin
+	#ifdef CFG_PRINTF
+	arch_printf("[WARNING] Zero calibration needs a CFG_PWM_BIAS_LOOP build, input is ignored. \n\r");
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+	
+	return; // ignore invalid write
+	#else
+	if (!pwm_enabled || pwm_zcal.state == PWM_ZCAL_RUNNING)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Zero calibration needs the PWM on and no calibration running, input is ignored. \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore invalid write
+	}
+	
+	// Fixed time budget: settle wait and bursts for every point, plus a quarter for margin
+	uint8_t points = 0;
+	for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		if (mask & (1U << ch))
 		{
-			struct custs1_value_req_ind const *msg_param = (struct custs1_value_req_ind const *) param;
-			
-			switch (msg_param->att_idx)
-			{
-				case SVC1_IDX_SENSOR_VOLTAGE_VAL:
-					user_svc1_read_sensor_voltage_handler(msgid, msg_param, dest_id, src_id);
-					break;
-				
-				case SVC1_IDX_BATTERY_VOLTAGE_VAL:
-					user_svc1_read_battery_voltage_handler(msgid, msg_param, dest_id, src_id);
-					break;
+			points += (gain_point_mv != 0) ? 2U : 1U;
+		}
+	}
+	uint32_t settle_ms = (uint32_t)PWM_ZCAL_SETTLE_TAUS * pwm_bias_tau_ms;
+	uint32_t point_ms = settle_ms + ((1U << PWM_ZCAL_LOG2_BURSTS) + 1U) * PWM_ZCAL_TICK * (PERIODIC_TICK_US / 1000U);
+	uint32_t run_ms = points * point_ms;
+	
+	if (run_ms + run_ms / 4U > PWM_ZCAL_MAX_MS)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Zero calibration would take %lu ms (limit %lu ms), lower tau or the channel count. \n\r", run_ms + run_ms / 4U, PWM_ZCAL_MAX_MS);
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore invalid write
+	}
+	
+	// The loop would fight the fixed calibration targets
+	pwm_loop_stop();
+	
+	memset(&pwm_zcal, 0, sizeof(pwm_zcal));
+	pwm_zcal.state = PWM_ZCAL_RUNNING;
+	pwm_zcal.mask = mask;
+	pwm_zcal.gain_point_mv = gain_point_mv;
+	pwm_zcal.settle_us = settle_ms * 1000U;
+	pwm_zcal.budget_us = (run_ms + run_ms / 4U) * 1000U;
+	pwm_zcal.start_us = timebase_now_us();
+	
+	gpadc_sched_enable(GPADC_CH_BIAS, true);
+	pwm_zcal_next_channel();
+	periodic_task_start(&pwm_zcal_task, PWM_ZCAL_TICK, 0, pwm_zcal_timer_cb);
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - PWM ZCAL] Bytes received. \n\r");
+	arch_printf("[BLE - PWM ZCAL] Calibrating channel mask 0x%02X, gain point %d mV, budget %lu ms \n\r", mask, gain_point_mv, run_ms + run_ms / 4U);
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+	#endif
+}
 
-				default: // default read case is an SDK code snippet
-				{
-						// Send Error message
-						struct custs1_value_req_rsp *rsp = KE_MSG_ALLOC(CUSTS1_VALUE_REQ_RSP,
-																														src_id,
-																														dest_id,
-																														custs1_value_req_rsp);
+void user_svc1_read_pwm_zcal_handler(ke_msg_id_t const msgid,
+                                      struct custs1_value_req_ind const *param,
+                                      ke_task_id_t const dest_id,
+                                      ke_task_id_t const src_id)
+{
+	// Create dynamic kernel message for read response
+	struct custs1_value_req_rsp *rsp = KE_MSG_ALLOC_DYN(CUSTS1_VALUE_REQ_RSP,
+																											prf_get_task_from_id(TASK_ID_CUSTS1),
+																											TASK_APP,
+																											custs1_value_req_rsp,
+																											DEF_SVC1_PWM_ZCAL_CHAR_LEN);
+	
+	// Fill response fields with expected values by the SDK
+	rsp->conidx  = app_env[param->conidx].conidx; // connection index
+	rsp->att_idx = param->att_idx; // attribute index
+	rsp->length  = DEF_SVC1_PWM_ZCAL_CHAR_LEN; // current length that will be returned
+	rsp->status  = ATT_ERR_NO_ERROR; // ATT error code
+	
+	// Little-endian like the notifications:
+	// [state, done_mask, failed_mask, duration_ms (2 bytes), 6 x [zero_cal_mv (2 bytes), gain_q12 (2 bytes), confidence]]
+	// A running calibration reports the time so far
+	uint32_t duration_ms = pwm_zcal.duration_ms;
+	if (pwm_zcal.state == PWM_ZCAL_RUNNING)
+	{
+		duration_ms = (timebase_now_us() - pwm_zcal.start_us) / 1000U;
+	}
+	if (duration_ms > 0xFFFFU)
+	{
+		duration_ms = 0xFFFFU;
+	}
+	
+	rsp->value[0] = pwm_zcal.state;
+	rsp->value[1] = pwm_zcal.done;
+	rsp->value[2] = pwm_zcal.failed;
+	rsp->value[3] = (uint8_t)(duration_ms & 0xFF);
+	rsp->value[4] = (uint8_t)(duration_ms >> 8);
+	
+	uint8_t *entry = &rsp->value[5];
+	for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		pwm_zcal_result_t const *result = &pwm_zcal_results[ch];
+		entry[0] = (uint8_t)((uint16_t)result->zero_cal_mv & 0xFF);
+		entry[1] = (uint8_t)((uint16_t)result->zero_cal_mv >> 8);
+		entry[2] = (uint8_t)(result->gain_q12 & 0xFF);
+		entry[3] = (uint8_t)(result->gain_q12 >> 8);
+		entry[4] = result->confidence;
+		entry += 5;
+	}
+	
+	// Send structure to the kernel to be transmitted by the BLE stack
+	KE_MSG_SEND(rsp);
+}
 
-						// Provide the connection index.
-						rsp->conidx  = app_env[msg_param->conidx].conidx;
-						// Provide the attribute index.
-						rsp->att_idx = msg_param->att_idx;
-						// Force current length to zero.
-						rsp->length = 0;
-						// Set Error status
-						rsp->status  = ATT_ERR_APP_ERROR;
-						// Send message
-						KE_MSG_SEND(rsp);
-				} break;
+void user_svc1_pwm_vbias_and_offset_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id)
+{
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+	
+	// Check UVP status
+	if(uvp_shutdown)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Prevented characteristic change and forced exit of handler function \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return;
+	}
+	
+	// Byte order is [channel_mask, entry for each set bit from PWM2 up], entry is
+	// [vbias_mv_msb, vbias_mv_lsb, zero_cal_msb, zero_cal_lsb, offset]
+	// The old fixed layout is the PWM2 and PWM3 entries without the mask byte
+	uint8_t mask = 0;
+	uint8_t const *entry = param->value;
+	uint16_t expected_len = 0;
+	
+	if (param->length == DEF_SVC1_PWM_VBIAS_AND_OFFSET_LEGACY_LEN)
+	{
+		mask = 0x03;
+		expected_len = DEF_SVC1_PWM_VBIAS_AND_OFFSET_LEGACY_LEN;
+	}
+	else if (param->length >= 1 && param->value[0] < (1U << PWM_CHANNEL_COUNT))
+	{
+		mask = param->value[0];
+		entry = &param->value[1];
+		expected_len = 1;
+		for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+		{
+			if (mask & (1U << ch))
+			{
+				expected_len += DEF_SVC1_PWM_VBIAS_AND_OFFSET_ENTRY_LEN;
 			}
-		} break;
+		}
+	}
+	
+	// Validate length of characteristic value written by the phone against the channel mask
+	if (expected_len == 0 || param->length != expected_len)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid packet byte length: %u (expected %u for the channel mask) \n\r", param->length, expected_len);
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
 		
-		// Code snippet given and required by SDK
-		case GATTC_EVENT_REQ_IND:
+    return; // ignore incomplete write or unknown channel
+	}
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - PWM VBIAS] Bytes received, channel mask 0x%02X. \n\r", mask);
+	#endif
+	
+	for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		tim2_pwm_t channel = pwm_channel_desc(ch)->channel;
+		
+		// Channels left out of the write stop being driven
+		if (!(mask & (1U << ch)))
 		{
-			// Confirm unhandled indication to avoid GATT timeout
-			struct gattc_event_ind const *ind = (struct gattc_event_ind const *) param;
-			struct gattc_event_cfm *cfm = KE_MSG_ALLOC(GATTC_EVENT_CFM, src_id, dest_id, gattc_event_cfm);
-			cfm->handle = ind->handle;
-			KE_MSG_SEND(cfm);
-		} break;
+			timer2_pwm_release(channel);
+			continue;
+		}
+		
+		// Parse byte array into expected values
+		int16_t vbias_mv = ((entry[0] << 8) | entry[1]);
+		int16_t zero_cal = ((entry[2] << 8) | entry[3]); // vbias voltage value measured when target vbias is 0V
+		uint8_t offset = entry[4];
+		entry += DEF_SVC1_PWM_VBIAS_AND_OFFSET_ENTRY_LEN;
+		
+		// Keep the stored value, e.g. from the automatic zero calibration
+		if ((uint16_t)zero_cal == PWM_ZERO_CAL_KEEP)
+		{
+			zero_cal = pwm_channels[ch].zero_cal_mv;
+		}
+		
+		#ifdef CFG_PRINTF
+		arch_printf("[BLE - PWM VBIAS] PWM%u vbias_mv = %ld (0x%04X), zero_cal = %ld (0x%04X), offset = %u \n\r",
+								ch + 2, (int32_t)vbias_mv, (uint16_t)vbias_mv, (int32_t)zero_cal, (uint16_t)zero_cal, offset);
+		#endif
+		
+		// Set offset first so the initial duty cycle is computed from it
+		timer2_pwm_set_offset(offset, channel);
+		
+		// Compensate with zero_cal, clamp and set initial duty cycle
+		timer2_pwm_set_bias(vbias_mv, zero_cal, channel);
+	}
+	
+	// Every channel changes in the same period, so electrodes never see a mix of old and new biases
+	pwm_shadow_commit();
+	pwm_cfg_changed();
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - PWM VBIAS] Register commits: %u, missed safe points: %u \n\r", pwm_shadow_get()->commits, pwm_shadow_get()->missed);
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
 
-		default:
-			break;
+void user_svc1_pwm_state_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id)
+{	
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+	
+	// Check UVP status
+	if(uvp_shutdown)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Prevented characteristic change and forced exit of handler function \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return;
+	}
+	
+	// Copy single byte value to variable
+	uint8_t state = 0;
+	memcpy(&state, param->value, param->length);
+	
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - PWM STATE] Byte received. \n\r");
+	arch_printf("[BLE - PWM STATE] state value = %u (0x%02X) \n\r", state, state);
+	#endif
+	
+	// Turns on or off PWM output based on value
+	if(state > 1)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid input. \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore invalid write
+	} 
+	else if(state == 1)
+	{
+		timer2_pwm_enable(); // turn on output
+	}
+	else if(state == 0)
+	{
+		timer2_pwm_disable(); // turn off output
 	}
+	pwm_client_enabled = (state == 1);
+	pwm_cfg_changed();
+	
+	#ifdef CFG_PRINTF
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
 }
 
-void user_svc1_sensor_voltage_cfg_ind_handler(ke_msg_id_t const msgid,
-                                         struct custs1_val_write_ind const *param,
-                                         ke_task_id_t const dest_id,
-                                         ke_task_id_t const src_id)
+void user_svc1_battery_voltage_cfg_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id)
 {
 	#ifdef CFG_PRINTF
 	arch_printf("---------------------------------------------------------------------------------------- \n\r");
@@ -811,35 +3370,27 @@ void user_svc1_sensor_voltage_cfg_ind_handler(ke_msg_id_t const msgid,
 	}
 	
 	// Copy CCCD value written by the phone into a local variable
-	uint16_t cccd_value = 0; // set to zero for safe memcpy
+	uint16_t cccd_value = 0;
 	memcpy(&cccd_value, param->value, param->length);
 	
+	// Copy local variable into retained variable for notification logic in uvp_on_sample
+	uvp_cccd_value = cccd_value;
+	
 	#ifdef CFG_PRINTF
-	arch_printf("[BLE - SENSOR VOLTAGE] cccd_value = %u \n\r", cccd_value);
+	arch_printf("[BLE - BATTERY VOLTAGE] cccd_value = %u \n\r", cccd_value);
 	#endif
 
-	if (cccd_value == 0x0001 && (ke_state_get(TASK_APP) == APP_CONNECTED)) // notifications enabled and phone connected
+	if (uvp_cccd_value == 0x0001) // notifications enabled
 	{
 		#ifdef CFG_PRINTF
-    arch_printf("[BLE - SENSOR VOLTAGE] Starting the ADC. \n\r");
+    arch_printf("[BLE - BATTERY VOLTAGE] Starting notifications. \n\r");
     #endif
-		
-		// Start ADC conversions on 1 second timer
-		sensor_timer = app_easy_timer(100, gpadc_wireless_timer_cb);
 	}
-	else if (cccd_value == 0x0000) // notifications disabled
-	{
+	else if (uvp_cccd_value == 0x0000) // notifications disabled
+	{	
 		#ifdef CFG_PRINTF
-    arch_printf("[BLE - SENSOR VOLTAGE] Stopping the ADC. \n\r");
+    arch_printf("[BLE - BATTERY VOLTAGE] Stopping notifications. \n\r");
     #endif
-		
-		// Stop ADC conversions
-		if (sensor_timer != EASY_TIMER_INVALID_TIMER) // prevents cancel when timer does not exist
-		{
-			// Cancels existing timer
-			app_easy_timer_cancel(sensor_timer);
-			sensor_timer = EASY_TIMER_INVALID_TIMER;
-		}
 	}
 	
 	#ifdef CFG_PRINTF
@@ -847,14 +3398,14 @@ void user_svc1_sensor_voltage_cfg_ind_handler(ke_msg_id_t const msgid,
 	#endif
 }
 
-void user_svc1_pwm_freq_wr_ind_handler(ke_msg_id_t const msgid,
+void user_svc1_sensor_stream_cfg_wr_ind_handler(ke_msg_id_t const msgid,
                                struct custs1_val_write_ind const *param,
                                ke_task_id_t const dest_id,
                                ke_task_id_t const src_id)
 {
 	#ifdef CFG_PRINTF
 	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	#endif	
+	#endif
 	
 	// Check UVP status
 	if(uvp_shutdown)
@@ -868,50 +3419,115 @@ void user_svc1_pwm_freq_wr_ind_handler(ke_msg_id_t const msgid,
 	}
 	
 	// Validate length of characteristic value written by the phone
-	if (param->length != DEF_SVC1_PWM_FREQ_CHAR_LEN)
+	if (param->length != DEF_SVC1_SENSOR_STREAM_CFG_CHAR_LEN)
 	{
-    #ifdef CFG_PRINTF
-    arch_printf("[WARNING] Invalid packet byte length: %u (expected %u) \n\r", param->length, DEF_SVC1_PWM_FREQ_CHAR_LEN);
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid packet byte length: %u (expected %u) \n\r", param->length, DEF_SVC1_SENSOR_STREAM_CFG_CHAR_LEN);
 		arch_printf("---------------------------------------------------------------------------------------- \n\r");
-    #endif
+		#endif
 		
-    return; // ignore incomplete write
+		return; // ignore incomplete write
 	}
 	
 	// Parse byte array into expected values
-	// Byte order is [clk_div, clk_src, pwm_div_MSB, pwm_div_LSB]
-	uint8_t clk_div = param->value[0];
-	uint8_t clk_src = param->value[1];
-	uint16_t pwm_div = ((param->value[2] << 8) | param->value[3]);
+	// Byte order is [mode, samples_per_frame, stream_interval_mult, encoding]
+	uint8_t mode = param->value[0];
+	uint8_t samples_per_frame = param->value[1];
+	uint8_t interval_mult = param->value[2];
+	uint8_t encoding = param->value[3];
 	
 	#ifdef CFG_PRINTF
-	arch_printf("[BLE - PWM FREQ] Bytes received. \n\r");
-	arch_printf("[BLE - PWM FREQ] clk_div = %u (0x%02X) \n\r", clk_div, clk_div);
-	arch_printf("[BLE - PWM FREQ] clk_src = %u (0x%02X) \n\r", clk_src, clk_src);
-	arch_printf("[BLE - PWM FREQ] pwm_div = %u (0x%04X) \n\r", pwm_div, (uint16_t)pwm_div);
+	arch_printf("[BLE - SENSOR STREAM] Bytes received. \n\r");
+	arch_printf("[BLE - SENSOR STREAM] mode = %u (0x%02X) \n\r", mode, mode);
+	arch_printf("[BLE - SENSOR STREAM] samples_per_frame = %u (0x%02X) \n\r", samples_per_frame, samples_per_frame);
+	arch_printf("[BLE - SENSOR STREAM] interval_mult = %u (0x%02X) \n\r", interval_mult, interval_mult);
+	arch_printf("[BLE - SENSOR STREAM] encoding = %u (0x%02X) \n\r", encoding, encoding);
 	#endif
-
-	// Validate inputs with enum int literals from timer headers
-	if (clk_div > TIM0_2_CLK_DIV_8 || clk_src > TIM2_CLK_SYS) // literals are auto-promoted to uint8 for comparison
+	
+	// Validate mode with enum int literals
+	if (mode > SENSOR_MODE_FRAMED)
 	{
 		#ifdef CFG_PRINTF
-    arch_printf("[WARNING] Invalid clk_div or clk_src write (first 2 bytes), input is ignored. \n\r");
+		arch_printf("[WARNING] Invalid mode write (first byte), input is ignored. \n\r");
 		arch_printf("---------------------------------------------------------------------------------------- \n\r");
-    #endif
+		#endif
 		
 		return; // ignore invalid write
 	}
-
-	// Apply values to function
-	timer2_pwm_set_frequency((tim0_2_clk_div_t)clk_div, (tim2_clk_src_t)clk_src, pwm_div); // note that pwm_div is clamped in this function already
+	
+	// Validate encoding with enum int literals
+	if (encoding >= SAMPLE_CODEC_COUNT)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid encoding write (fourth byte), input is ignored. \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore invalid write
+	}
+	
+	// Validate interval, shorter ones would overrun the stream ring between two drains
+	if (interval_mult > 0 && interval_mult < SENSOR_STREAM_MIN_INTERVAL)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid interval write (third byte), minimum is %u, input is ignored. \n\r", SENSOR_STREAM_MIN_INTERVAL);
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore invalid write
+	}
+	
+	// Flush what was buffered with the old settings before switching
+	sensor_frame_send();
+	
+	// Update retained values, samples per frame is clamped again against the MTU when sending
+	bool interval_changed = (interval_mult != sensor_stream_interval_mult);
+	sensor_mode = mode;
+	sensor_frame_samples = CLAMP(samples_per_frame, 1, SENSOR_FRAME_MAX_SAMPLES);
+	sensor_stream_interval_mult = interval_mult;
+	sensor_encoding = encoding;
+	
+	// Apply new continuous acquisition interval if sensor sampling is running
+	if (interval_changed)
+	{
+		sensor_stream_apply();
+	}
 	
 	#ifdef CFG_PRINTF
-	arch_printf("[BLE - PWM FREQ] SUCCESS on setting config. \n\r");
+	arch_printf("[BLE - SENSOR STREAM] SUCCESS on setting config, frame holds %u samples at MTU %u. \n\r", sensor_frame_capacity(), ble_mtu);
 	arch_printf("---------------------------------------------------------------------------------------- \n\r");
 	#endif
 }
 
-void user_svc1_pwm_vbias_and_offset_wr_ind_handler(ke_msg_id_t const msgid,
+void user_svc1_read_sensor_stream_cfg_handler(ke_msg_id_t const msgid,
+                                           struct custs1_value_req_ind const *param,
+                                           ke_task_id_t const dest_id,
+                                           ke_task_id_t const src_id)
+{
+	// Create dynamic kernel message for read response
+	struct custs1_value_req_rsp *rsp = KE_MSG_ALLOC_DYN(CUSTS1_VALUE_REQ_RSP,
+																											prf_get_task_from_id(TASK_ID_CUSTS1),
+																											TASK_APP,
+																											custs1_value_req_rsp,
+																											DEF_SVC1_SENSOR_STREAM_CFG_CHAR_LEN);
+	
+	// Fill response fields with expected values by the SDK
+	rsp->conidx  = app_env[param->conidx].conidx; // connection index
+	rsp->att_idx = param->att_idx; // attribute index
+	rsp->length  = DEF_SVC1_SENSOR_STREAM_CFG_CHAR_LEN; // current length that will be returned
+	rsp->status  = ATT_ERR_NO_ERROR; // ATT error code
+	
+	// Same byte order as the write, samples per frame is the effective value for the current MTU
+	rsp->value[0] = sensor_mode;
+	rsp->value[1] = sensor_frame_capacity();
+	rsp->value[2] = sensor_stream_interval_mult;
+	rsp->value[3] = sensor_encoding;
+	
+	// Send structure to the kernel to be transmitted by the BLE stack
+	KE_MSG_SEND(rsp);
+}
+
+void user_svc1_sensor_log_wr_ind_handler(ke_msg_id_t const msgid,
                                struct custs1_val_write_ind const *param,
                                ke_task_id_t const dest_id,
                                ke_task_id_t const src_id)
@@ -932,63 +3548,82 @@ void user_svc1_pwm_vbias_and_offset_wr_ind_handler(ke_msg_id_t const msgid,
 	}
 	
 	// Validate length of characteristic value written by the phone
-	if (param->length != DEF_SVC1_PWM_VBIAS_AND_OFFSET_CHAR_LEN)
+	if (param->length != DEF_SVC1_SENSOR_LOG_WRITE_LEN)
 	{
 		#ifdef CFG_PRINTF
-		arch_printf("[WARNING] Invalid packet byte length: %u (expected %u) \n\r", param->length, DEF_SVC1_PWM_VBIAS_AND_OFFSET_CHAR_LEN);
+		arch_printf("[WARNING] Invalid packet byte length: %u (expected %u) \n\r", param->length, DEF_SVC1_SENSOR_LOG_WRITE_LEN);
 		arch_printf("---------------------------------------------------------------------------------------- \n\r");
 		#endif
 		
-    return; // ignore incomplete write
+		return; // ignore incomplete write
 	}
 	
-	// Parse byte array into expected values
-	// Byte order is [vbias_1_mv_msb, vbias_1_mv_lsb, zero_cal_1_msb, zero_cal_1_lsb, offset_1,
-	// vbias_2_mv_msb, vbias_2_mv_lsb, zero_cal_2_msb, zero_cal_2_lsb, offset_2]
-	int16_t vbias_1_mv = ((param->value[0] << 8)| param->value[1]);
-	int16_t zero_cal_1 = ((param->value[2] << 8)| param->value[3]); // vbias voltage value measured when target vbias is 0V
-	uint8_t offset_1 = param->value[4];
-	int16_t vbias_2_mv = ((param->value[5] << 8) | param->value[6]);
-	int16_t zero_cal_2 = ((param->value[7] << 8) | param->value[8]);
-	uint8_t offset_2 = param->value[9];
+	uint8_t state = param->value[0];
 	
 	#ifdef CFG_PRINTF
-	arch_printf("[BLE - PWM VBIAS] Bytes received. \n\r");
-	arch_printf("[BLE - PWM VBIAS] vbias_1_mv = %ld (0x%04X) \n\r", (int32_t)vbias_1_mv, (uint16_t)vbias_1_mv);
-	arch_printf("[BLE - PWM VBIAS] zero_cal_1 = %ld (0x%04X) \n\r", (int32_t)zero_cal_1, (uint16_t)zero_cal_1);
-	arch_printf("[BLE - PWM VBIAS] offset_1 = %u (0x%02X) \n\r", offset_1, offset_1);
-	arch_printf("[BLE - PWM VBIAS] vbias_2_mv = %ld (0x%04X) \n\r", (int32_t)vbias_2_mv, (uint16_t)vbias_2_mv);
-	arch_printf("[BLE - PWM VBIAS] zero_cal_2 = %ld (0x%04X) \n\r", (int32_t)zero_cal_2, (uint16_t)zero_cal_2);
-	arch_printf("[BLE - PWM VBIAS] offset_2 = %u (0x%02X) \n\r", offset_2, offset_2);
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[BLE - SENSOR LOG] Byte received. \n\r");
+	arch_printf("[BLE - SENSOR LOG] state = %u (0x%02X) \n\r", state, state);
 	#endif
 	
-	// Compensate for uncentered op amp rails via subtraction of zero_cal values
-	vbias_1_mv -= zero_cal_1;
-	vbias_2_mv -= zero_cal_2;
+	if (state > 1 || !log_store_get()->ready)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid state write or no SPI flash, input is ignored. \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore invalid write
+	}
+	
+	sensor_log_set(state == 1);
+	pwm_cfg_changed();
 	
-	// Clamp target vbias voltages from -1V to 1V (HW specific)
-	vbias_1_mv = CLAMP(vbias_1_mv, -1000, 1000);
-	vbias_2_mv = CLAMP(vbias_2_mv, -1000, 1000);
+	#ifdef CFG_PRINTF
+	arch_printf("[BLE - SENSOR LOG] SUCCESS, logging %s, next block %lu. \n\r", sensor_log_enabled ? "on" : "off", log_store_get()->next_seq);
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	#endif
+}
+
+void user_svc1_read_sensor_log_handler(ke_msg_id_t const msgid,
+                                    struct custs1_value_req_ind const *param,
+                                    ke_task_id_t const dest_id,
+                                    ke_task_id_t const src_id)
+{
+	// Create dynamic kernel message for read response
+	struct custs1_value_req_rsp *rsp = KE_MSG_ALLOC_DYN(CUSTS1_VALUE_REQ_RSP,
+																											prf_get_task_from_id(TASK_ID_CUSTS1),
+																											TASK_APP,
+																											custs1_value_req_rsp,
+																											DEF_SVC1_SENSOR_LOG_CHAR_LEN);
 	
-	// Set offsets for PWM2 and PWM3
-	timer2_pwm_set_offset(offset_1, TIM2_PWM_2);
-	timer2_pwm_set_offset(offset_2, TIM2_PWM_3);
+	// Fill response fields with expected values by the SDK
+	rsp->conidx  = app_env[param->conidx].conidx; // connection index
+	rsp->att_idx = param->att_idx; // attribute index
+	rsp->length  = DEF_SVC1_SENSOR_LOG_CHAR_LEN; // current length that will be returned
+	rsp->status  = ATT_ERR_NO_ERROR; // ATT error code
 	
-	// Set initial duty cycle for PWM2 and PWM3
-	timer2_pwm_dc_control(vbias_1_mv, TIM2_PWM_2);
-	timer2_pwm_dc_control(vbias_2_mv, TIM2_PWM_3);
+	// Little-endian like the notifications:
+	// [flags, buffered, boot (2 bytes), first_seq (4 bytes), next_seq (4 bytes), writes, erases, skipped, failed (2 bytes each)]
+	log_store_t const *log = log_store_get();
+	rsp->value[0] = (sensor_log_enabled ? 0x01 : 0x00) | (log->ready ? 0x02 : 0x00);
+	rsp->value[1] = log->count;
+	memcpy(&rsp->value[2], &log->boot, sizeof(uint16_t));
+	memcpy(&rsp->value[4], &log->first_seq, sizeof(uint32_t));
+	memcpy(&rsp->value[8], &log->next_seq, sizeof(uint32_t));
+	memcpy(&rsp->value[12], &log->writes, sizeof(uint16_t));
+	memcpy(&rsp->value[14], &log->erases, sizeof(uint16_t));
+	memcpy(&rsp->value[16], &log->skipped, sizeof(uint16_t));
+	memcpy(&rsp->value[18], &log->failed, sizeof(uint16_t));
 	
-	// Update retained value in memory for timer function when PWM enable
-	target_vbias_1_mv = vbias_1_mv;
-	target_vbias_2_mv = vbias_2_mv;
+	// Send structure to the kernel to be transmitted by the BLE stack
+	KE_MSG_SEND(rsp);
 }
 
-void user_svc1_pwm_state_wr_ind_handler(ke_msg_id_t const msgid,
+void user_svc1_log_ctrl_wr_ind_handler(ke_msg_id_t const msgid,
                                struct custs1_val_write_ind const *param,
                                ke_task_id_t const dest_id,
                                ke_task_id_t const src_id)
-{	
+{
 	#ifdef CFG_PRINTF
 	arch_printf("---------------------------------------------------------------------------------------- \n\r");
 	#endif
@@ -1004,85 +3639,131 @@ void user_svc1_pwm_state_wr_ind_handler(ke_msg_id_t const msgid,
 		return;
 	}
 	
-	// Copy single byte value to variable
-	uint8_t state = 0;
-	memcpy(&state, param->value, param->length);
+	// Validate length of characteristic value written by the phone
+	if (param->length != DEF_SVC1_LOG_CTRL_WRITE_LEN)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid packet byte length: %u (expected %u) \n\r", param->length, DEF_SVC1_LOG_CTRL_WRITE_LEN);
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore incomplete write
+	}
+	
+	// Parse byte array into expected values
+	// Byte order is [opcode, start_seq (4 bytes, MSB first)]
+	uint8_t opcode = param->value[0];
+	uint32_t start_seq = ((uint32_t)param->value[1] << 24) | ((uint32_t)param->value[2] << 16) | ((uint32_t)param->value[3] << 8) | param->value[4];
 	
 	#ifdef CFG_PRINTF
-	arch_printf("[BLE - PWM STATE] Byte received. \n\r");
-	arch_printf("[BLE - PWM STATE] state value = %u (0x%02X) \n\r", state, state);
+	arch_printf("[BLE - LOG DOWNLOAD] Bytes received. \n\r");
+	arch_printf("[BLE - LOG DOWNLOAD] opcode = %u, start_seq = %lu \n\r", opcode, start_seq);
 	#endif
 	
-	// Turns on or off PWM output based on value
-	if(state > 1)
+	if (opcode == 0)
 	{
+		if (log_dl_state == LOG_DL_RUNNING)
+		{
+			log_dl_state = LOG_DL_IDLE;
+		}
+		
 		#ifdef CFG_PRINTF
-		arch_printf("[WARNING] Invalid input. \n\r");
+		arch_printf("[BLE - LOG DOWNLOAD] Stopped at block %lu. \n\r", log_dl_cursor.seq);
 		arch_printf("---------------------------------------------------------------------------------------- \n\r");
 		#endif
 		
-		return; // ignore invalid write
-	} 
-	else if(state == 1)
-	{
-		timer2_pwm_enable(); // turn on output
+		return;
 	}
-	else if(state == 0)
+	
+	if (opcode != 1 || log_dl_cccd_value != 0x0001 || !log_store_get()->ready)
 	{
-		timer2_pwm_disable(); // turn off output
+		#ifdef CFG_PRINTF
+		arch_printf("[WARNING] Invalid opcode, data notifications off or no SPI flash, input is ignored. \n\r");
+		arch_printf("---------------------------------------------------------------------------------------- \n\r");
+		#endif
+		
+		return; // ignore invalid write
 	}
 	
+	// Readings still in RAM go to flash first so the download reaches the present
+	log_store_flush();
+	log_erase_schedule();
+	log_store_seek(start_seq, &log_dl_cursor);
+	
+	// Shorter connection events give more of them per second for the stream
+	app_easy_gap_param_update_start(param->conidx);
+	
+	log_dl_bytes = 0;
+	log_dl_duration_ms = 0;
+	log_dl_start_us = timebase_now_us();
+	log_dl_state = LOG_DL_RUNNING;
+	
 	#ifdef CFG_PRINTF
+	arch_printf("[BLE - LOG DOWNLOAD] SUCCESS, streaming blocks %lu to %lu at MTU %u. \n\r", log_dl_cursor.seq, log_store_get()->next_seq - 1U, ble_mtu);
 	arch_printf("---------------------------------------------------------------------------------------- \n\r");
 	#endif
+	
+	log_dl_pump();
 }
 
-void user_svc1_battery_voltage_cfg_ind_handler(ke_msg_id_t const msgid,
-                               struct custs1_val_write_ind const *param,
-                               ke_task_id_t const dest_id,
-                               ke_task_id_t const src_id)
+void user_svc1_read_log_ctrl_handler(ke_msg_id_t const msgid,
+                                  struct custs1_value_req_ind const *param,
+                                  ke_task_id_t const dest_id,
+                                  ke_task_id_t const src_id)
 {
-	#ifdef CFG_PRINTF
-	arch_printf("---------------------------------------------------------------------------------------- \n\r");
-	#endif
+	// Create dynamic kernel message for read response
+	struct custs1_value_req_rsp *rsp = KE_MSG_ALLOC_DYN(CUSTS1_VALUE_REQ_RSP,
+																											prf_get_task_from_id(TASK_ID_CUSTS1),
+																											TASK_APP,
+																											custs1_value_req_rsp,
+																											DEF_SVC1_LOG_CTRL_CHAR_LEN);
 	
-	// Check UVP status
-	if(uvp_shutdown)
+	// Fill response fields with expected values by the SDK
+	rsp->conidx  = app_env[param->conidx].conidx; // connection index
+	rsp->att_idx = param->att_idx; // attribute index
+	rsp->length  = DEF_SVC1_LOG_CTRL_CHAR_LEN; // current length that will be returned
+	rsp->status  = ATT_ERR_NO_ERROR; // ATT error code
+	
+	// Little-endian like the notifications:
+	// [state, first_seq, next_seq, cursor_seq, bytes, duration_ms (4 bytes each)]
+	// A running download reports the time so far
+	uint32_t duration_ms = log_dl_duration_ms;
+	if (log_dl_state == LOG_DL_RUNNING)
 	{
-		#ifdef CFG_PRINTF
-		arch_printf("[WARNING] Prevented characteristic change and forced exit of handler function \n\r");
-		arch_printf("---------------------------------------------------------------------------------------- \n\r");
-		#endif
-		
-		return;
+		duration_ms = (timebase_now_us() - log_dl_start_us) / 1000U;
 	}
 	
-	// Copy CCCD value written by the phone into a local variable
-	uint16_t cccd_value = 0;
-	memcpy(&cccd_value, param->value, param->length);
-	
-	// Copy local variable into retained variable for notification logic in uvp_wireless_timer_cb
-	uvp_cccd_value = cccd_value;
+	rsp->value[0] = log_dl_state;
+	memcpy(&rsp->value[1], &log_store_get()->first_seq, sizeof(uint32_t));
+	memcpy(&rsp->value[5], &log_store_get()->next_seq, sizeof(uint32_t));
+	memcpy(&rsp->value[9], &log_dl_cursor.seq, sizeof(uint32_t));
+	memcpy(&rsp->value[13], &log_dl_bytes, sizeof(uint32_t));
+	memcpy(&rsp->value[17], &duration_ms, sizeof(uint32_t));
 	
-	#ifdef CFG_PRINTF
-	arch_printf("[BLE - BATTERY VOLTAGE] cccd_value = %u \n\r", cccd_value);
-	#endif
+	// Send structure to the kernel to be transmitted by the BLE stack
+	KE_MSG_SEND(rsp);
+}
 
-	if (uvp_cccd_value == 0x0001) // notifications enabled
+void user_svc1_log_data_cfg_ind_handler(ke_msg_id_t const msgid,
+                                     struct custs1_val_write_ind const *param,
+                                     ke_task_id_t const dest_id,
+                                     ke_task_id_t const src_id)
+{
+	// Copy CCCD value written by the phone into retained memory
+	uint16_t cccd_value = 0; // set to zero for safe memcpy
+	memcpy(&cccd_value, param->value, param->length);
+	log_dl_cccd_value = cccd_value;
+	
+	// Nobody is listening any more
+	if (log_dl_cccd_value != 0x0001 && log_dl_state == LOG_DL_RUNNING)
 	{
-		#ifdef CFG_PRINTF
-    arch_printf("[BLE - BATTERY VOLTAGE] Starting notifications. \n\r");
-    #endif
-	}
-	else if (uvp_cccd_value == 0x0000) // notifications disabled
-	{	
-		#ifdef CFG_PRINTF
-    arch_printf("[BLE - BATTERY VOLTAGE] Stopping notifications. \n\r");
-    #endif
+		log_dl_state = LOG_DL_IDLE;
 	}
 	
 	#ifdef CFG_PRINTF
 	arch_printf("---------------------------------------------------------------------------------------- \n\r");
+	arch_printf("[BLE - LOG DOWNLOAD] cccd_value = %u \n\r", log_dl_cccd_value);
+	arch_printf("---------------------------------------------------------------------------------------- \n\r");
 	#endif
 }
 
@@ -1184,10 +3865,18 @@ arch_main_loop_callback_ret_t user_app_on_system_powered(void)
 {
 	wdg_freeze(); // freeze watchdog timer
 	
-	// Initiates UVP timer only once
-	if(!uvp_timer_initialized){
-		uvp_timer = app_easy_timer(50, uvp_wireless_timer_cb);
-		uvp_timer_initialized = true;
+	// Initiates ADC sampling scheduler with the UVP channel only once
+	if(!gpadc_sched_initialized){
+		gpadc_sched_enable(GPADC_CH_VBAT, true);
+		periodic_task_start(&gpadc_sched_task, GPADC_SCHED_TICK, GPADC_SCHED_SLACK, gpadc_sched_timer_cb);
+		gpadc_sched_initialized = true;
+		
+		// Resume the configuration kept in flash now that the easy timers are available
+		if (pwm_cfg_boot_valid)
+		{
+			pwm_cfg_boot_valid = false;
+			pwm_cfg_apply(&pwm_cfg_boot);
+		}
 	}
 	
 	wdg_resume(); // resume watchdog timer
@@ -1195,23 +3884,93 @@ arch_main_loop_callback_ret_t user_app_on_system_powered(void)
 	return GOTO_SLEEP; // returning KEEP_POWERED hardfaults to nmi_handler.c, likely due to how SDK handles sleep mode
 }
 
+void user_app_going_to_sleep(void)
+{
+	// Keep PD_TIM powered only for a PWM that runs through sleep
+	pwm_shadow_going_to_sleep();
+}
+
+void user_app_resume_from_sleep(void)
+{
+	// Timer2 registers are reset if PD_TIM was powered down, write them back from retention RAM
+	pwm_shadow_restore();
+}
+
 void user_app_on_init(void)
 {
 	// Initialize user retained variables to safe defaults
-	uvp_timer_initialized = false;
 	uvp_cccd_value = 0;
 	uvp_adc_sample_raw = 0;
 	uvp_adc_sample_mv = 0;
+	memset(&pwm_comp, 0, sizeof(pwm_comp));
+	pwm_vbat_updates = 0;
+	pwm_end_writes = 0;
 	uvp_shutdown = false;
 	
 	sensor_adc_sample_raw = 0;
 	sensor_adc_sample_mv = 0;
+	sensor_adc_sample_uv = 0;
+	sensor_adc_noise_q4 = 0;
+	
+	sensor_mode = SENSOR_MODE_SINGLE;
+	sensor_frame_samples = SENSOR_FRAME_MAX_SAMPLES;
+	sensor_stream_interval_mult = 0;
+	sensor_encoding = SAMPLE_CODEC_RAW16;
+	ble_mtu = BLE_DEFAULT_MTU;
+	memset(&sensor_frame, 0, sizeof(sensor_frame));
 	
-	target_vbias_1_mv = 0;
-	target_vbias_2_mv = 0;
-	pulse_width_1 = 0;
-	pulse_width_2 = 0;
+	gpadc_sched_initialized = false;
+	gpadc_sched_enabled = 0;
+	memset(gpadc_sched_elapsed, 0, sizeof(gpadc_sched_elapsed));
+	
+	gpadc_cal_invalidate();
+	
+	pwm_enabled = false;
+	memset(pwm_channels, 0, sizeof(pwm_channels));
+	memset(&pwm_plan, 0, sizeof(pwm_plan));
 	period_width = 0;
+	#ifdef CFG_PWM_DITHER
+	memset(&pwm_dither_task, 0, sizeof(pwm_dither_task));
+	#endif
+	
+	memset(&pwm_ramp_task, 0, sizeof(pwm_ramp_task));
+	pwm_ramp_slew_mv_per_s = PWM_RAMP_DEFAULT_MV_PER_S;
+	pwm_bias_tau_ms = PWM_BIAS_FILTER_TAU_MS_DEFAULT;
+	pwm_ramp_lag_mv = 0;
+	pwm_ramp_settling = false;
+	pwm_bias_settled = false;
+	pwm_settle_ms = 0;
+	
+	memset(&pwm_loop_task, 0, sizeof(pwm_loop_task));
+	pwm_loop_pi_init(&pwm_loop_pi, PWM_LOOP_DEFAULT_KP_Q8, PWM_LOOP_DEFAULT_KI_Q8, PWM_LOOP_TRIM_MAX_UV);
+	pwm_loop_channel = PWM_LOOP_OFF;
+	pwm_loop_period = PWM_LOOP_DEFAULT_PERIOD;
+	pwm_loop_restart();
+	
+	memset(&pwm_zcal_task, 0, sizeof(pwm_zcal_task));
+	memset(&pwm_zcal, 0, sizeof(pwm_zcal));
+	memset(pwm_zcal_results, 0, sizeof(pwm_zcal_results));
+	
+	sleep_inhibit_init();
+	pwm_shadow_init();
+	
+	// Load the configuration record before advertising starts, it is applied on the first main loop pass
+	memset(&pwm_cfg_save_task, 0, sizeof(pwm_cfg_save_task));
+	pwm_client_enabled = false;
+	pwm_cfg_boot_valid = cfg_store_init() && cfg_store_load(PWM_CFG_VERSION, &pwm_cfg_boot, sizeof(pwm_cfg_boot));
+	
+	// Recover the log position, readings buffered in RAM before a reset are lost
+	sensor_notify = false;
+	sensor_log_enabled = false;
+	memset(&log_erase_task, 0, sizeof(log_erase_task));
+	log_store_init();
+	
+	log_dl_state = LOG_DL_IDLE;
+	log_dl_cccd_value = 0;
+	log_dl_in_flight = 0;
+	log_dl_bytes = 0;
+	log_dl_duration_ms = 0;
+	memset(&log_dl_cursor, 0, sizeof(log_dl_cursor));
 	
 	// Start the default initialization process for BLE user application
 	// SDK doc states that this should be the last line called in this function
@@ -55,10 +55,201 @@ i.e.
 #include "gapm_task.h" // gap functions and messages
 #include "custs1_task.h"
 
+// For sensor frame sizes
+#include "user_custs1_def.h"
+
+// For sensor frame encodings
+#include "user_sample_codec.h"
+
+// For the ADC conversion descriptor
+#include "user_gpadc_conv.h"
+
+// For the PWM channel table
+#include "user_pwm_shadow.h"
+
+// For the zero calibration statistics
+#include "user_pwm_loop.h"
+
 // For user_periph_setup.c
 #include <stdbool.h>
 extern bool uvp_shutdown;
 
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// Framed sensor notification layout: [seq, count, encoding, base_us (4 bytes), interval_us (4 bytes), encoded samples]
+#define SENSOR_FRAME_HEADER_LEN 11
+#define SENSOR_FRAME_PAYLOAD_MAX (DEF_SVC1_SENSOR_VOLTAGE_FRAME_MAX_LEN - SENSOR_FRAME_HEADER_LEN)
+#define SENSOR_FRAME_MAX_SAMPLES SENSOR_FRAME_PAYLOAD_MAX // one byte per sample at best with SAMPLE_CODEC_ZIGZAG_VARINT
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Cached ADC offset calibration result for one input/attenuation combination
+typedef struct
+{
+    adc_input_se_t input;       ///< ADC input the offsets were measured on
+    adc_input_attn_t attn;      ///< Input attenuator setting the offsets were measured with
+    bool valid;                 ///< Entry holds a calibration result
+    uint16_t offp;              ///< Saved GP_ADC_OFFP_REG value
+    uint16_t offn;              ///< Saved GP_ADC_OFFN_REG value
+    uint16_t vbat_mv;           ///< Battery voltage when the calibration ran
+    uint16_t uses;              ///< Number of times the entry was reused since calibration
+} gpadc_cal_entry_t;
+
+/// Result of a decimated ADC burst
+typedef struct
+{
+    uint32_t sum;               ///< Boxcar sum of the burst, i.e. the mean with log2_n extra fractional bits
+    uint16_t mean;              ///< Sum rounded back to the ADC sample scale
+    uint16_t noise_q4;          ///< Standard deviation of the burst in ADC LSB (Q12.4, saturates at 4095.9)
+    uint8_t log2_n;             ///< Burst length as a power of two
+} gpadc_burst_t;
+
+/// Sensor Voltage notification modes selected through the Sensor Stream Config characteristic
+typedef enum
+{
+    SENSOR_MODE_SINGLE = 0,     ///< One 2-byte mV notification per reading (default)
+    SENSOR_MODE_FRAMED,         ///< Readings are buffered and sent as one framed notification
+} sensor_mode_t;
+
+/// Buffered framed notification
+typedef struct
+{
+    uint8_t seq;                                ///< Frame sequence number, wraps at 255
+    uint8_t count;                              ///< Samples buffered so far
+    uint8_t encoding;                           ///< sample_codec_t the payload is encoded with
+    uint8_t len;                                ///< Encoded payload bytes buffered so far
+    uint16_t last_mv;                           ///< Last buffered reading, reference for the next delta
+    uint32_t base_us;                           ///< BLE timebase stamp of the first sample in the frame
+    uint32_t interval_us;                       ///< Spacing between consecutive samples
+    uint8_t payload[SENSOR_FRAME_PAYLOAD_MAX];  ///< Encoded sensor readings in mV
+} sensor_frame_t;
+
+/// Channels read by the ADC sampling scheduler, also the bit position in the enable mask
+typedef enum
+{
+    GPADC_CH_VBAT = 0,          ///< VBAT_HIGH rail for undervoltage protection
+    GPADC_CH_SENSOR,            ///< Sensor voltage input
+    GPADC_CH_BIAS,              ///< Bias node of the closed-loop channel, sampled on demand
+    GPADC_CH_COUNT
+} gpadc_channel_id_t;
+
+/// Result handed to a channel consumer, converted while the ADC still held the channel settings
+typedef struct
+{
+    gpadc_burst_t burst;        ///< Decimated burst
+    uint16_t mv;                ///< Burst mean in millivolts
+    uint32_t uv;                ///< Burst mean in microvolts from the full-precision sum
+    uint32_t time_us;           ///< BLE timebase stamp taken when the burst started
+} gpadc_sched_result_t;
+
+/// Scheduler table entry describing how and how often a channel is sampled
+typedef struct
+{
+    adc_input_se_t input;                   ///< ADC input channel
+    adc_input_attn_t input_attenuator;      ///< Input attenuator setting
+    uint8_t smpl_time_mult;                 ///< Sample time multiplier
+    bool chopping;                          ///< Enable chopping
+    uint8_t oversampling;                   ///< Hardware oversampling setting (0 to 7)
+    uint8_t log2_n;                         ///< Burst length as a power of two
+    uint16_t period_ticks;                  ///< Sampling period in 10 ms timer ticks (multiple of the scheduler tick), 0 for gpadc_sched_sample_now() only
+    void (*on_sample)(gpadc_sched_result_t const *result); ///< Consumer called with each new result
+} gpadc_sched_channel_t;
+
+/// Runtime state of one Timer2 PWM output, indexed like the channel table in user_pwm_shadow
+typedef struct
+{
+    bool active;                ///< Target set, updated by the battery-compensation loop
+    uint8_t offset_pct;         ///< START_CYCLE as a percentage of the period
+    int16_t vbias_mv;           ///< Requested bias as written over BLE
+    int16_t zero_cal_mv;        ///< Bias measured with a 0 V target, subtracted from vbias_mv
+    int16_t target_mv;          ///< Bias target after zero calibration, -1000 to 1000 mV, follows the ramp
+    int16_t setpoint_mv;        ///< Bias target the ramp is heading for, -1000 to 1000 mV
+    int32_t ramp_uv;            ///< Ramp position in uV, target_mv is its whole millivolts
+    int16_t trim_mv;            ///< Closed-loop correction added to target_mv, 0 in open loop
+    uint16_t gain_q12;          ///< Measured bias per target mV (Q12, 4096 = 1.0), 0 until a gain point was calibrated
+    uint16_t pulse_width;       ///< Last computed pulse width in timer counts
+    uint8_t pulse_frac;         ///< Fraction of a count below pulse_width in 1/256 counts, CFG_PWM_DITHER only
+    uint8_t dither_acc;         ///< Sigma-delta error accumulator in 1/256 counts, CFG_PWM_DITHER only
+} pwm_channel_state_t;
+
+/// Progress of the automatic zero calibration
+typedef enum
+{
+    PWM_ZCAL_IDLE = 0,          ///< Not run since boot
+    PWM_ZCAL_RUNNING,           ///< Channels are being measured
+    PWM_ZCAL_DONE,              ///< Every selected channel was measured, failures are in the failed mask
+    PWM_ZCAL_ABORTED            ///< Stopped by the time budget or the PWM turning off
+} pwm_zcal_state_t;
+
+/// Automatic zero calibration result of one channel
+typedef struct
+{
+    int16_t zero_cal_mv;        ///< Bias measured with a 0 V target
+    uint16_t gain_q12;          ///< Bias per target mV between the two points (Q12), 0 without a gain point
+    uint16_t stderr_uv;         ///< Standard error of the mean of the noisier point
+    uint8_t confidence;         ///< 0 to 100 %, from stderr_uv, 0 if the channel was rejected
+} pwm_zcal_result_t;
+
+/// Automatic zero calibration run state
+typedef struct
+{
+    uint8_t state;              ///< pwm_zcal_state_t
+    uint8_t mask;               ///< Channels selected by the client, bit per index
+    uint8_t done;               ///< Channels measured and stored
+    uint8_t failed;             ///< Channels measured but rejected, their calibration is unchanged
+    uint8_t channel;            ///< Channel being measured
+    uint8_t point;              ///< 0 for the 0 V point, 1 for the gain point
+    bool sampling;              ///< Settle wait is over, bursts are being collected
+    int16_t gain_point_mv;      ///< Target of the second point, 0 for an offset-only calibration
+    int16_t saved_vbias_mv;     ///< Bias restored after the channel was measured
+    bool saved_active;          ///< Channel was driven before it was measured
+    pwm_zcal_stats_t stats;     ///< Bursts collected for this point
+    int32_t zero_uv;            ///< Bias measured at the 0 V point
+    uint16_t zero_stderr_uv;    ///< Standard error of the 0 V point
+    uint32_t start_us;          ///< Timebase time the run started
+    uint32_t phase_us;          ///< Timebase time the current settle wait started
+    uint32_t settle_us;         ///< Settle wait after each target change
+    uint32_t budget_us;         ///< Longest the run may take
+    uint32_t duration_ms;       ///< Run time, final once the run has ended
+} pwm_zcal_t;
+
+/// PWM and sensor log settings kept in the SPI flash configuration record and restored at boot
+typedef struct
+{
+    uint8_t enabled;            ///< Outputs were switched on by the client
+    uint8_t active;             ///< Channels with a bias set, bit per index
+    uint8_t clk_div;            ///< tim0_2_clk_div_t of the PWM frequency
+    uint8_t clk_src;            ///< tim2_clk_src_t of the PWM frequency
+    uint16_t pwm_div;           ///< Counts per PWM period, 0 if the frequency was never set
+    uint16_t ramp_slew_mv_per_s; ///< Bias slew rate, 0 = no ramp
+    uint16_t bias_tau_ms;       ///< Bias filter time constant
+    uint16_t loop_period;       ///< Closed-loop period in 10 ms timer ticks
+    uint8_t loop_channel;       ///< Regulated channel, PWM_LOOP_OFF in open loop
+    uint8_t loop_kp_q8;         ///< Closed-loop proportional gain
+    uint8_t loop_ki_q8;         ///< Closed-loop integral gain
+    uint8_t offset_pct[PWM_CHANNEL_COUNT];  ///< START_CYCLE percentage per channel
+    int16_t vbias_mv[PWM_CHANNEL_COUNT];    ///< Requested bias per channel
+    int16_t zero_cal_mv[PWM_CHANNEL_COUNT]; ///< Zero calibration per channel, also of inactive channels
+    uint16_t gain_q12[PWM_CHANNEL_COUNT];   ///< Calibrated gain per channel, 0 = 1.0
+    uint8_t sensor_log;         ///< Offline sensor logging was switched on by the client
+} pwm_cfg_t;
+
+/// Log download state, first byte of the Log Download Control read
+typedef enum
+{
+    LOG_DL_IDLE = 0,            ///< Nothing requested, or stopped by the client or a disconnect
+    LOG_DL_RUNNING,             ///< Blocks are being streamed
+    LOG_DL_DONE                 ///< Newest block reached and the end marker sent
+} log_dl_state_t;
+
 /*
  ****************************************************************************************
  * FUNCTION DECLARATIONS
@@ -67,40 +258,339 @@ extern bool uvp_shutdown;
 
  /**
  ****************************************************************************************
- * @brief UVP (for battery voltage) periodic timer callback.
+ * @brief UVP (for battery voltage) consumer of the VBAT_HIGH scheduler channel.
+ *
+ * @param[in] result  VBAT_HIGH reading taken and converted by gpadc_sched_timer_cb().
  *
  * @details
- * - Samples the VBAT_HIGH ADC channel (single-shot).
- * - Converts raw sample to millivolts.
+ * - Saves the raw and millivolt VBAT_HIGH reading (single-shot, oversampling 7).
  * - Compares to a chosen undervoltage shutdown threshold (1825 mV) and a restart threshold (1875 mV) using hysteresis logic.
- * - If shutdown is triggered, it disables the PWM VBIAS and the sensor sampling timer.
+ * - Passes the reading to timer2_pwm_vbat_update(), which recomputes the PWM duty cycles if VBAT left the deadband.
+ * - If shutdown is triggered, it disables the sensor scheduler channel and the PWM VBIAS, then
+ *   flushes the sensor log (a page program, never a sector erase) and stops a running log download.
  * - If phone notifications are enabled and the app is connected,
  * a BLE notification is built and sent containing the 16-bit
  * battery voltage (mV) in **little-endian** byte order (LSB first).
  *
- * @note app_easy_timer ticks are 10 ms each in SDK6; this callback reschedules
- * itself every 500 ms or 0.5 s via app_easy_timer(50, ...).
- * @sa gpadc_init_se, gpadc_collect_sample, gpadc_sample_to_mv, KE_MSG_ALLOC_DYN, KE_MSG_SEND
+ * @note Called every 500 ms or 0.5 s (channel period of 50 timer ticks).
+ * @sa gpadc_sched_timer_cb, gpadc_sample_to_mv, KE_MSG_ALLOC_DYN, KE_MSG_SEND
  ****************************************************************************************
  */
-void uvp_wireless_timer_cb(void);
+void uvp_on_sample(gpadc_sched_result_t const *result);
 
 /**
  ****************************************************************************************
- * @brief Sensor Voltage periodic timer callback.
+ * @brief Sensor Voltage consumer of the sensor scheduler channel.
+ *
+ * @param[in] result  Decimated sensor burst taken and converted by gpadc_sched_timer_cb(),
+ *                    or NULL when continuous acquisition is running.
  * @details
- *  - Initializes ADC for the sensor input (hardware-dependant).
- *  - Performs a single ADC conversion and converts the result to millivolts.
+ *  - Saves the decimated burst (mV, uV and noise estimate) of the sensor input (hardware-dependant).
+ *  - When result is NULL, the ring buffer is drained instead and the mean of the drained
+ *    samples is used.
  *  - Builds and sends a BLE notification with the 16-bit sensor voltage (mV),
- *    sent in little-endian byte order (LSB first).
- *  - Disables ADC to reduce power once sample and notification are done.
- *  - If the BLE connection remains active, it restarts the timer every 1 s.
+ *    sent in little-endian byte order (LSB first), while the client has them enabled.
+ *  - With the sensor log on, appends the value to the flash log with log_store_append().
+ *    In continuous mode the mean of the drained block is logged, one value per tick.
+ *  - If the BLE connection was lost, stops continuous acquisition and, unless the sensor
+ *    log is on, removes the sensor channel from the schedule.
+ *
+ * @note Client must wrie to CCCD to enable sensor notifications, or switch the sensor log on,
+ *       for sampling to run.
+ * @sa gpadc_sched_timer_cb, gpadc_collect_burst, gpadc_stream_read, KE_MSG_ALLOC_DYN, KE_MSG_SEND, ke_state_get
+ ****************************************************************************************
+ */
+void sensor_on_sample(gpadc_sched_result_t const *result);
+
+/**
+ ****************************************************************************************
+ * @brief Closed-loop bias consumer of the bias feedback scheduler channel.
+ *
+ * @param[in] result  Decimated burst of the bias node, taken by gpadc_sched_sample_now().
+ *
+ * @details
+ *  - The measured bias is the burst mean minus BIAS_FB_REF_MV, the virtual ground the bias
+ *    is referenced to on the feedback pin, set per board in user_periph_setup.h.
+ *  - The setpoint is the requested bias, target_mv scaled by gain_q12 plus zero_cal_mv, so a
+ *    calibration only seeds the feed-forward term and the loop removes whatever is left.
+ *  - pwm_loop_pi_step() turns the error into trim_mv, which pwm_channel_update() adds to the
+ *    feed-forward target before the END_CYCLE is computed, so the trim keeps following VBAT.
+ *  - The residual error of every sample is kept. The loop counts as converged after
+ *    PWM_LOOP_CONVERGED_SAMPLES samples in a row within PWM_LOOP_TOLERANCE_UV; the time from
+ *    the last setpoint change (or loop start) to that point is the convergence time.
+ *  - Holds the controller while the PWM is off or the channel is released.
+ *
+ * @sa pwm_loop_timer_cb, pwm_loop_pi_step, user_svc1_pwm_loop_wr_ind_handler
+ ****************************************************************************************
+ */
+void pwm_loop_on_sample(gpadc_sched_result_t const *result);
+
+/**
+ ****************************************************************************************
+ * @brief Consumer of the bias feedback scheduler channel.
+ *
+ * @param[in] result  Decimated burst of the bias node.
+ *
+ * @details Hands the result to pwm_zcal_on_sample() while a zero calibration runs and to
+ *          pwm_loop_on_sample() otherwise.
+ ****************************************************************************************
+ */
+void bias_fb_on_sample(gpadc_sched_result_t const *result);
+
+/**
+ ****************************************************************************************
+ * @brief Zero calibration consumer of the bias feedback scheduler channel.
+ *
+ * @param[in] result  Decimated burst of the bias node.
+ *
+ * @details
+ *  - Adds the burst to the sum and sum of squares of the current point, relative to its
+ *    first burst so 32-bit deviations stay exact.
+ *  - After 2^PWM_ZCAL_LOG2_BURSTS bursts the mean and the standard error of the mean are
+ *    computed. The 0 V point gives zero_cal_mv; the optional gain point gives gain_q12 from
+ *    the difference between the points.
+ *  - A channel is stored only if its standard error, offset and gain are inside the
+ *    PWM_ZCAL_MAX_* limits, otherwise it is marked failed and keeps its old calibration.
+ *  - Then the channel returns to its previous bias and the next selected channel starts.
+ *
+ * @sa pwm_zcal_timer_cb, user_svc1_pwm_zcal_wr_ind_handler
+ ****************************************************************************************
+ */
+void pwm_zcal_on_sample(gpadc_sched_result_t const *result);
+
+/**
+ ****************************************************************************************
+ * @brief Number of samples sent per framed notification.
+ *
+ * @return Client-requested samples per frame, limited by the negotiated MTU.
+ *
+ * @details With SAMPLE_CODEC_RAW16 every sample takes 2 bytes, so with the default MTU of 23
+ *          a frame holds 4 samples and with an MTU of 247 it holds up to 116. With
+ *          SAMPLE_CODEC_ZIGZAG_VARINT the value is an upper bound; a frame is also sent early
+ *          when the next encoded sample does not fit sensor_frame_payload_capacity().
+ ****************************************************************************************
+ */
+uint8_t sensor_frame_capacity(void);
+
+/**
+ ****************************************************************************************
+ * @brief Encoded payload bytes that fit one framed notification.
+ *
+ * @return (MTU - 3) minus SENSOR_FRAME_HEADER_LEN, at most SENSOR_FRAME_PAYLOAD_MAX.
+ ****************************************************************************************
+ */
+uint8_t sensor_frame_payload_capacity(void);
+
+/**
+ ****************************************************************************************
+ * @brief Add a sensor reading to the current frame and send it when full.
+ *
+ * @param[in] sample_mv     Sensor reading in millivolts.
+ * @param[in] timestamp_us  BLE timebase stamp of the reading, used if it starts a new frame.
+ * @param[in] interval_us   Nominal spacing between readings, used if it starts a new frame.
+ *
+ * @details The reading is encoded with the client-selected sensor_encoding. The first
+ *          reading of a frame is a keyframe, so each frame decodes on its own. If the
+ *          encoded reading does not fit the remaining payload, the frame is sent first and
+ *          the reading starts the next one.
+ *
+ *          A frame only describes evenly spaced readings. If timestamp_us is further than
+ *          SENSOR_FRAME_MAX_JITTER_US (or half an interval) from base_us + count x interval_us,
+ *          or the interval changed, the frame is sent and the reading starts a new one with
+ *          its own base stamp, so reconstructed sample times never drift.
+ * @sa sensor_frame_send, sensor_frame_capacity, sample_codec_encode, timebase_now_us
+ ****************************************************************************************
+ */
+void sensor_frame_push(uint16_t sample_mv, uint32_t timestamp_us, uint32_t interval_us);
+
+/**
+ ****************************************************************************************
+ * @brief Send the buffered readings as one framed Sensor Voltage notification.
+ *
+ * @details Payload is little-endian:
+ *          [seq, count, encoding, base_us (4 bytes), interval_us (4 bytes), encoded samples].
+ *          The samples decode with sample_codec_decode(). Reading i was taken at
+ *          base_us + i * interval_us on the BLE timebase (microseconds, wraps every
+ *          71.6 minutes). A gap in seq tells the client that buffered readings were dropped.
+ *          Does nothing if the frame is empty.
+ * @sa KE_MSG_ALLOC_DYN, KE_MSG_SEND, sample_codec_decode
+ ****************************************************************************************
+ */
+void sensor_frame_send(void);
+
+/**
+ ****************************************************************************************
+ * @brief Discard buffered readings (e.g., on connect, disconnect or notification enable).
+ ****************************************************************************************
+ */
+void sensor_frame_reset(void);
+
+/**
+ ****************************************************************************************
+ * @brief Restart continuous sensor acquisition with the client-selected interval.
+ *
+ * @details Stops a running stream, then starts a new one if the interval is non-zero and
+ *          the sensor channel is scheduled. With an interval of 0 the scheduler takes one
+ *          burst per second instead.
+ * @sa gpadc_stream_start, user_svc1_sensor_stream_cfg_wr_ind_handler
+ ****************************************************************************************
+ */
+void sensor_stream_apply(void);
+
+/**
+ ****************************************************************************************
+ * @brief Switch offline logging of the sensor voltage on or off.
+ *
+ * @param[in] enable  true to log every sensor reading to the SPI flash.
+ *
+ * @details
+ *  - On: schedules the sensor channel (unless UVP shutdown is active), so the 1 s readings
+ *    continue without a client.
+ *  - Off: programs the partly filled block, then removes the sensor channel from the
+ *    schedule unless notifications still need it.
+ *
+ * @note Stays off on boards where the flash did not answer.
+ * @sa log_store_append, log_store_flush
+ ****************************************************************************************
+ */
+void sensor_log_set(bool enable);
+
+/**
+ ****************************************************************************************
+ * @brief Start log_erase_task if the log needs its next sector erased.
+ *
+ * @details Called after every appended reading and every flush. Does nothing during UVP
+ *          shutdown or while the task is already waiting to run.
+ * @sa log_store_erase_pending, log_erase_timer_cb
+ ****************************************************************************************
+ */
+void log_erase_schedule(void);
+
+/**
+ ****************************************************************************************
+ * @brief Erase the next log sector outside the sampling path.
+ *
+ * @param[in] periods  Unused, the task runs once.
  *
- * @note Client must wrie to CCCD to enable sensor notifications and for sampling/timers to run.
- * @sa gpadc_init_se, gpadc_collect_sample, gpadc_sample_to_mv, KE_MSG_ALLOC_DYN, KE_MSG_SEND, ke_state_get
+ * @details Runs LOG_ERASE_DELAY after log_erase_schedule() and stops itself. The sector
+ *          erase of up to about 240 ms happens here instead of in the ADC scheduler
+ *          callback, and a block that was waiting for the sector is programmed after it.
+ * @sa log_store_prepare
  ****************************************************************************************
  */
-void gpadc_wireless_timer_cb(void);
+void log_erase_timer_cb(uint8_t periods);
+
+/**
+ ****************************************************************************************
+ * @brief Send log download notifications while the BLE stack has room for them.
+ *
+ * @details
+ *  - Called when a download starts and on every CUSTS1_VAL_NTF_CFM of the data stream, so
+ *    the pace is set by the link instead of a timer.
+ *  - Queues notifications until LOG_DL_MAX_IN_FLIGHT wait for confirmation or the free
+ *    L2CAP TX buffers drop to LOG_DL_RESERVED_BUFFERS, which are left for the other
+ *    characteristics. One notification is always allowed, so the stream cannot stall.
+ *  - Each notification is filled to the negotiated MTU: [seq (4), offset, log bytes], where
+ *    seq and offset locate the first log byte. The log bytes are whole blocks back to back,
+ *    see log_store_read().
+ *  - Once the newest block has gone out, a notification without log bytes marks the end.
+ *    Its seq is the next block to ask for.
+ * @sa log_store_read, l2cm_get_nb_buffer_available
+ ****************************************************************************************
+ */
+void log_dl_pump(void);
+
+/**
+ ****************************************************************************************
+ * @brief ADC sampling scheduler timer callback.
+ *
+ * @param[in] periods  Scheduler ticks elapsed since the previous run (1 unless overrun).
+ *
+ * @details
+ *  - Runs every GPADC_SCHED_TICK (0.5 s) and advances the elapsed time of each enabled channel.
+ *    Channels with a period of 0 are skipped, they are read only through gpadc_sched_sample_now().
+ *    Dispatched by periodic_timer_cb() on an absolute schedule, so the ADC work and UART
+ *    prints do not stretch the period. Ticks skipped after an overrun (periods > 1) still
+ *    advance the channels.
+ *  - Every channel whose period has elapsed is passed to gpadc_sched_run() and read in a single ADC power-up: the first one
+ *    goes through gpadc_init_se(), the rest only switch input settings with gpadc_switch_channel().
+ *  - Each burst is converted to mV/uV right after it is read, while the ADC registers still
+ *    hold that channel's attenuation and oversampling.
+ *  - Results are published to the channel consumers after the ADC is disabled, in table order
+ *    (UVP first so a shutdown can stop the sensor channel before it is published).
+ *  - A running continuous stream is suspended around the power-up. A due sensor channel is
+ *    drained from the stream instead of being sampled.
+ *  - Each burst is stamped with timebase_now_us() when it starts, so consumers see when the
+ *    reading was actually taken rather than when the timer chain happened to run.
+ *
+ * @note With VBAT_HIGH every 0.5 s and the sensor every 1 s, every other VBAT power-up also
+ *       reads the sensor, so ADC LDO power-ups drop from 3 to 2 per second.
+ * @sa gpadc_sched_enable, uvp_on_sample, sensor_on_sample
+ ****************************************************************************************
+ */
+void gpadc_sched_timer_cb(uint8_t periods);
+
+/**
+ ****************************************************************************************
+ * @brief Read a set of scheduler channels in one ADC power-up and publish the results.
+ *
+ * @param[in] due  Bit mask of channels to read, bit i is gpadc_channel_id_t i.
+ *
+ * @details Body of gpadc_sched_timer_cb() after the due channels are known: suspends a running
+ *          stream, reads and converts each burst, powers the ADC down and calls the channel
+ *          consumers in table order. A due sensor channel is drained from a running stream.
+ ****************************************************************************************
+ */
+void gpadc_sched_run(uint8_t due);
+
+/**
+ ****************************************************************************************
+ * @brief Read one scheduled channel now instead of at its next period.
+ *
+ * @param[in] ch  Channel index in the scheduler table.
+ *
+ * @details Does nothing if the channel is not enabled. Its period restarts from this reading,
+ *          so an event (e.g., a settled PWM bias) can place a conversion exactly when it is
+ *          useful without disturbing the spacing of the readings that follow.
+ * @sa gpadc_sched_run, pwm_ramp_timer_cb
+ ****************************************************************************************
+ */
+void gpadc_sched_sample_now(gpadc_channel_id_t ch);
+
+/**
+ ****************************************************************************************
+ * @brief Add or remove a channel from the sampling schedule.
+ *
+ * @param[in] ch      Channel index in the scheduler table.
+ * @param[in] enable  true to sample the channel, false to stop.
+ *
+ * @details A newly enabled channel is first sampled one full period later.
+ ****************************************************************************************
+ */
+void gpadc_sched_enable(gpadc_channel_id_t ch, bool enable);
+
+/**
+ ****************************************************************************************
+ * @brief Check whether a channel is in the sampling schedule.
+ *
+ * @param[in] ch  Channel index in the scheduler table.
+ * @return true if the channel is enabled.
+ ****************************************************************************************
+ */
+bool gpadc_sched_is_enabled(gpadc_channel_id_t ch);
+
+/**
+ ****************************************************************************************
+ * @brief Switch an enabled ADC to another channel without powering it down.
+ *
+ * @param[in] channel  Scheduler channel to select.
+ *
+ * @details Reprograms input, attenuation, sample time, chopping and oversampling,
+ *          then restores the cached offsets for the new input/attenuation.
+ * @sa gpadc_cal_apply, gpadc_sched_timer_cb
+ ****************************************************************************************
+ */
+void gpadc_switch_channel(gpadc_sched_channel_t const *channel);
  
 /**
  ****************************************************************************************
@@ -119,79 +609,341 @@ void gpadc_wireless_timer_cb(void);
  *            - disable die temperature sensor
  *            - set ADC startup delay (adc_delay_set(64) for 16 MHz system)
  *            - enable ADC's LDO load current
- *            - reset and calibrate ADC offset
+ *            - restore cached ADC offsets, or reset and calibrate them when the cache is stale
+ *
+ * @note Input mode is fixed to single-ended in the implementation.
+ *       ADC should be disabled before re-configuring.
+ *       The offset calibration runs extra conversions and is the slowest part of this function,
+ *       so its result is kept in gpadc_cal_cache[] and reused until gpadc_cal_is_fresh() fails.
+ * @sa adc_init, adc_input_shift_disable, adc_temp_sensor_disable, adc_delay_set, adc_offset_calibrate, gpadc_cal_lookup
+ ****************************************************************************************
+ */
+void gpadc_init_se(adc_input_se_t input, uint8_t smpl_time_mult, adc_input_attn_t input_attenuator, bool chopping, uint8_t oversampling);
+
+/**
+ ****************************************************************************************
+ * @brief Apply a full ADC configuration followed by the recommended setup calls.
+ *
+ * @param[in] adc_config  ADC configuration structure (single-shot or continuous).
+ *
+ * @details Shared by gpadc_init_se() and the continuous stream so both paths use the
+ *          same startup delay, LDO current setting and cached offset calibration.
+ * @sa gpadc_init_se, gpadc_stream_start, gpadc_cal_lookup
+ ****************************************************************************************
+ */
+void gpadc_configure(const adc_config_t *adc_config);
+
+/**
+ ****************************************************************************************
+ * @brief Restore cached ADC offsets for an input/attenuation, or calibrate and cache them.
+ *
+ * @param[in] input            ADC input channel.
+ * @param[in] input_attenuator Attenuation factor for the ADC input.
+ *
+ * @sa gpadc_cal_lookup, gpadc_cal_is_fresh, gpadc_configure, gpadc_switch_channel
+ ****************************************************************************************
+ */
+void gpadc_cal_apply(adc_input_se_t input, adc_input_attn_t input_attenuator);
+
+/**
+ ****************************************************************************************
+ * @brief Find the offset calibration cache entry for an input/attenuation combination.
+ *
+ * @param[in] input            ADC input channel.
+ * @param[in] input_attenuator Attenuation factor for the ADC input.
+ * @return Pointer to the matching entry, or to a free/evicted entry marked invalid.
+ *
+ * @details When no entry matches, an empty slot is used first, otherwise the entry
+ *          with the most reuses is evicted. The caller fills in a non-matching entry
+ *          after running the calibration.
+ * @sa gpadc_init_se, gpadc_cal_is_fresh
+ ****************************************************************************************
+ */
+gpadc_cal_entry_t *gpadc_cal_lookup(adc_input_se_t input, adc_input_attn_t input_attenuator);
+
+/**
+ ****************************************************************************************
+ * @brief Check whether a cached offset calibration can still be reused.
+ *
+ * @param[in] entry  Cache entry returned by gpadc_cal_lookup().
+ * @return true if the cached offsets are valid, false if a new calibration is required.
+ *
+ * @details An entry goes stale when:
+ *   - it has been reused GPADC_CAL_MAX_USES times (periodic recalibration for temperature drift),
+ *   - the last VBAT reading moved more than GPADC_CAL_VBAT_DELTA_MV since it was measured.
+ * @sa gpadc_cal_lookup, gpadc_cal_invalidate
+ ****************************************************************************************
+ */
+bool gpadc_cal_is_fresh(gpadc_cal_entry_t const *entry);
+
+/**
+ ****************************************************************************************
+ * @brief Drop all cached ADC offset calibrations.
+ *
+ * @details The next gpadc_init_se() call for each input runs the full offset calibration.
+ *          Called at boot and when the UVP logic restarts the system after a brown-out.
+ * @sa gpadc_init_se
+ ****************************************************************************************
+ */
+void gpadc_cal_invalidate(void);
+
+/**
+ ****************************************************************************************
+ * @brief Collect a corrected raw ADC sample.
+ *
+ * @return Corrected raw ADC sample (already processed with adc_correct_sample()).
+ *
+ * @details This function calls adc_get_sample() and then applies the SDK
+ *          correction helper adc_correct_sample() to return a usable raw sample.
+ * @sa adc_get_sample, adc_correct_sample
+ ****************************************************************************************
+ */
+uint16_t gpadc_collect_sample(void);
+
+/**
+ ****************************************************************************************
+ * @brief Collect a burst of 2^log2_n samples and decimate it with a boxcar filter.
+ *
+ * @param[in]  log2_n  Burst length as a power of two (0 to 6, larger values are clamped).
+ * @param[out] burst   Decimated value, full-precision sum and noise estimate.
+ *
+ * @details
+ *  - ADC must already be configured and enabled, all samples are taken in the same power-up.
+ *  - The boxcar sum keeps log2_n extra fractional bits, so averaging 2^log2_n samples adds
+ *    up to log2_n/2 bits of effective resolution for white noise.
+ *  - The noise estimate is the population standard deviation of the burst. Deviations are
+ *    taken from the first sample so each square fits in 32 bits; only the final variance
+ *    uses 64-bit arithmetic. No floating point or division is used.
+ *
+ * @note Integer-only since the Cortex-M0+ has no FPU or hardware divider.
+ * @sa gpadc_collect_sample, gpadc_burst_to_uv, gpadc_isqrt
+ ****************************************************************************************
+ */
+void gpadc_collect_burst(uint8_t log2_n, gpadc_burst_t *burst);
+
+/**
+ ****************************************************************************************
+ * @brief Convert a decimated burst to microvolts using its full-precision sum.
+ *
+ * @param[in] burst  Result from gpadc_collect_burst().
+ * @return Burst mean in microvolts (uV).
+ *
+ * @details Same descriptor as gpadc_sample_to_mv(), but the shift for the burst length is
+ *          applied last so the extra resolution from decimation is not truncated away.
+ * @sa gpadc_sample_to_mv, gpadc_conv_to_uv
+ ****************************************************************************************
+ */
+uint32_t gpadc_burst_to_uv(gpadc_burst_t const *burst);
+
+/**
+ ****************************************************************************************
+ * @brief Convert a corrected ADC sample to a millivolt value.
+ *
+ * @param[in] sample		Corrected ADC sample value from gpadc_collect_sample().
+ * @return Corrected ADC sample value in millivolts (mV).
+ *
+ * @details Applies the gpadc_conv descriptor built by gpadc_conv_init() when the ADC was
+ *          last configured, so no ADC registers are read on every conversion.
+ *
+ * @note The returned uint16_t represents millivolts. When transmitted over BLE
+ *       the two payload bytes are placed LSB-first (little-endian).
+ * @sa gpadc_conv_init, gpadc_conv_apply
+ ****************************************************************************************
+ */
+uint16_t gpadc_sample_to_mv(uint16_t sample);
+
+/**
+ ****************************************************************************************
+ * @brief Build the millivolt conversion descriptor for an ADC configuration.
+ *
+ * @param[out] conv             Descriptor to fill.
+ * @param[in]  input_attenuator Attenuation factor for the ADC input.
+ * @param[in]  oversampling     Oversampling setting (0 to 7).
+ *
+ * @details The conversion accounts for:
+ *   - base ADC resolution (10 bits) plus any oversampling contribution,
+ *   - the ADC internal reference (900 mV) scaled by the input attenuator setting,
+ *   - a two-point linearity correction from GPADC_LIN_CAL that maps the raw reading for
+ *     0 V (34 mV with no attenuation) and for full scale onto their true values.
+ *   Gain and zero error are folded into one Q16 scale and bias so the hot path is a single
+ *   multiply-add. The only division runs here, once per configuration.
+ *
+ * @note Called by gpadc_configure() and gpadc_switch_channel().
+ * @sa gpadc_conv_build, gpadc_conv_apply
+ ****************************************************************************************
+ */
+void gpadc_conv_init(gpadc_conv_t *conv, adc_input_attn_t input_attenuator, uint8_t oversampling);
+
+ /**
+ ****************************************************************************************
+ * @brief PWM dither step timer callback (CFG_PWM_DITHER builds only).
+ *
+ * @param[in] periods  Dither ticks elapsed since the previous run (1 unless overrun).
+ *
+ * @details
+ *  - Runs every PWM_DITHER_TICK (10 ms) while the outputs are enabled.
+ *  - Each active channel adds its pulse_frac to its dither_acc. An overflow past 256 widens the
+ *    pulse by one count for this step, otherwise the floor pulse width is used, so the mean pulse
+ *    width resolves 1/256 of a timer count.
+ *  - Steps are staged and committed for all channels together with pwm_shadow_commit().
+ *
+ * @note Timer2 has no period interrupt, so the dither runs at the 10 ms timer tick instead of
+ *       per PWM period. The bias filter must average over the dither pattern (up to 256 steps,
+ *       2.56 s for a fraction of 1/256), otherwise the ripple of one count shows on the bias.
+ * @sa pwm_comp_pulse_width_q8, timer2_pwm_enable
+ ****************************************************************************************
+ */
+void pwm_dither_timer_cb(uint8_t periods);
+
+ /**
+ ****************************************************************************************
+ * @brief PWM bias ramp timer callback.
+ *
+ * @param[in] periods  Ramp ticks elapsed since the previous run (1 unless overrun).
+ *
+ * @details
+ *  - Runs every PWM_RAMP_TICK (10 ms) while a channel ramps with the outputs on, and is
+ *    stopped while they are off; a ramp holds its position until timer2_pwm_enable().
+ *  - Moves the ramp of every active channel toward its setpoint by the client slew rate,
+ *    recomputes the duty cycle when target_mv changes by a whole millivolt and commits all
+ *    channels together. Ticks that change no duty cycle commit nothing.
+ *  - Once every ramp has reached its setpoint, waits for the bias filter with a single run at
+ *    the settle deadline. A first-order filter trails a ramp by slew * tau (a jump by the whole
+ *    step), and the remaining lag halves every tau * ln 2, so the wait is that many halvings
+ *    until the lag is below PWM_SETTLE_TOLERANCE_MV.
+ *  - When the wait ends, marks the bias settled, records the settle time from the last bias
+ *    change and takes a sensor sample at once with gpadc_sched_sample_now().
+ *
+ * @note The settle time is a model of the hardware filter, not a measurement. Set tau to the
+ *       filter of the board over the PWM Bias Ramp characteristic.
+ * @sa timer2_pwm_set_bias, gpadc_sched_sample_now, user_svc1_pwm_ramp_wr_ind_handler
+ ****************************************************************************************
+ */
+void pwm_ramp_timer_cb(uint8_t periods);
+
+ /**
+ ****************************************************************************************
+ * @brief Closed-loop bias timer callback.
+ *
+ * @param[in] periods  Loop periods elapsed since the previous run (1 unless overrun).
+ *
+ * @details Runs at the client loop period while the closed-loop mode is on and reads the
+ *          bias feedback channel with gpadc_sched_sample_now(). The result reaches
+ *          pwm_loop_on_sample() in the same call.
+ * @sa pwm_loop_on_sample, user_svc1_pwm_loop_wr_ind_handler
+ ****************************************************************************************
+ */
+void pwm_loop_timer_cb(uint8_t periods);
+
+ /**
+ ****************************************************************************************
+ * @brief Automatic zero calibration timer callback.
+ *
+ * @param[in] periods  Calibration ticks elapsed since the previous run (1 unless overrun).
+ *
+ * @details Runs every PWM_ZCAL_TICK (20 ms) during a calibration. After each target change
+ *          it waits PWM_ZCAL_SETTLE_TAUS bias filter time constants, then reads one bias
+ *          burst per tick with gpadc_sched_sample_now(). Ends the run as aborted if the time
+ *          budget set at the start is used up or the PWM turns off; the channel being
+ *          measured keeps its previous calibration.
+ * @sa pwm_zcal_on_sample, user_svc1_pwm_zcal_wr_ind_handler
+ ****************************************************************************************
+ */
+void pwm_zcal_timer_cb(uint8_t periods);
+
+ /**
+ ****************************************************************************************
+ * @brief Collect the PWM settings worth keeping across a power loss.
+ *
+ * @param[out] cfg  Settings record, padding zeroed so equal settings compare equal.
  *
- * @note Input mode is fixed to single-ended in the implementation.
- *       ADC should be disabled before re-configuring.
- * @sa adc_init, adc_input_shift_disable, adc_temp_sensor_disable, adc_delay_set, adc_offset_calibrate
+ * @details Takes the client intent rather than the live state: a PWM switched off by the
+ *          UVP shutdown is stored as whatever the client last wrote, because only the BLE
+ *          handlers call pwm_cfg_changed().
  ****************************************************************************************
  */
-void gpadc_init_se(adc_input_se_t input, uint8_t smpl_time_mult, adc_input_attn_t input_attenuator, bool chopping, uint8_t oversampling);
+void pwm_cfg_capture(pwm_cfg_t *cfg);
 
-/**
+ /**
  ****************************************************************************************
- * @brief Collect a corrected raw ADC sample.
+ * @brief Restore PWM settings loaded from the SPI flash.
  *
- * @return Corrected raw ADC sample (already processed with adc_correct_sample()).
+ * @param[in] cfg  Settings record.
  *
- * @details This function calls adc_get_sample() and then applies the SDK
- *          correction helper adc_correct_sample() to return a usable raw sample.
- * @sa adc_get_sample, adc_correct_sample
+ * @details Called once from user_app_on_system_powered(), the first pass of the main loop,
+ *          where the easy timers the ramp and loop tasks need are available. Applies the
+ *          frequency, ramp settings, calibration, offsets and biases in that order, switches
+ *          the outputs on if they were on and restarts the closed loop. The duty cycles
+ *          follow the first VBAT sample like after any bias write.
  ****************************************************************************************
  */
-uint16_t gpadc_collect_sample(void);
+void pwm_cfg_apply(pwm_cfg_t const *cfg);
 
-/**
+ /**
  ****************************************************************************************
- * @brief Convert a corrected ADC sample to a millivolt value.
+ * @brief Note a client change to the PWM settings.
  *
- * @param[in] sample		Corrected ADC sample value from gpadc_collect_sample().
- * @return Corrected ADC sample value in millivolts (mV).
+ * @details Restarts the PWM_CFG_SAVE_DELAY countdown, so a burst of writes ends in one
+ *          flash record. Called by the BLE write handlers and at the end of a zero
+ *          calibration that stored a channel.
+ * @sa pwm_cfg_save_timer_cb
+ ****************************************************************************************
+ */
+void pwm_cfg_changed(void);
+
+ /**
+ ****************************************************************************************
+ * @brief Save the PWM settings once the client has stopped changing them.
  *
- * @details The conversion accounts for:
- *   - base ADC resolution (10 bits) plus any oversampling contribution,
- *   - the ADC internal reference (900 mV) scaled by the input attenuator setting.
+ * @param[in] periods  Unused, the task runs once.
  *
- * @note The returned uint16_t represents millivolts. When transmitted over BLE
- *       the two payload bytes are placed LSB-first (little-endian).
- * @sa adc_get_oversampling, GetBits16(GP_ADC_CTRL2_REG, GP_ADC_ATTN)
+ * @details Runs PWM_CFG_SAVE_DELAY after the last pwm_cfg_changed() and stops itself.
+ *          cfg_store_save() writes a record only if the settings differ from the newest one.
+ * @sa pwm_cfg_capture, cfg_store_save
  ****************************************************************************************
  */
-uint16_t gpadc_sample_to_mv(uint16_t sample);
- 
+void pwm_cfg_save_timer_cb(uint8_t periods);
+
  /**
  ****************************************************************************************
- * @brief Periodic timer callback that runs the control loop to adjust the PWM Duty Cycle (DC) to compensate for battery voltage (VBAT) changes.
+ * @brief Event-driven control loop that adjusts the PWM Duty Cycle (DC) to compensate for battery voltage (VBAT) changes.
  *
- * @details This function is executed periodically (every 50ms).
- * It sequentially calls the main control function, `timer2_pwm_dc_control`, for each active PWM channel
- * (`TIM2_PWM_2` and `TIM2_PWM_3`) to update their Duty Cycles.
+ * @param[in] vbat_mv  New VBAT_HIGH reading in mV.
+ *
+ * @details Called by `uvp_on_sample` for every VBAT measurement (every 500 ms), so no timer of its own is needed.
+ * It walks the PWM channel state table and recomputes the Duty Cycle of every channel marked active,
+ * so any of `TIM2_PWM_2` to `TIM2_PWM_7` is driven without channel-specific code.
  * * **Control Sequence:**
- * 1. Restarts the timer (`app_easy_timer`).
- * 2. Reads the global battery voltage (VBAT) from the last ADC reading.
- * 3. Calls `timer2_pwm_dc_control` to calculate the new PWM pulse width.
- * 4. Writes the result to the PWM hardware register.
+ * 1. Returns at once if VBAT is within CFG_PWM_VBAT_DEADBAND_MV of the value the duty cycles were computed for.
+ *    A frequency change does not wait for this, timer2_pwm_set_frequency() re-derives the channels itself.
+ * 2. Rebuilds the compensation reciprocal with `pwm_comp_set_vbat` (ignores readings below 100 mV).
+ * 3. Recomputes the pulse width of every active channel.
+ * 4. Stages `END_CYCLE` only for channels whose value changed.
+ * 5. Commits the staged values of all channels together with `pwm_shadow_commit`, at a point in the
+ *    PWM period where no edge can be skipped. This runs even inside the deadband to keep the phase estimate fresh.
  *
- * @sa timer2_pwm_dc_control, gpadc_collect_sample
+ * @sa timer2_pwm_dc_control, uvp_on_sample, pwm_comp_set_vbat, pwm_shadow_commit
  ****************************************************************************************
  */
-void timer2_pwm_dc_control_timer_cb(void);
+void timer2_pwm_vbat_update(uint16_t vbat_mv);
  
  /**
  ****************************************************************************************
  * @brief Calculates and updates the PWM Duty Cycle (DC) value based on a target output voltage and the current battery voltage (VBAT).
  *
  * @param[in] target_vbias_mv	  The desired DC target voltage (in mV) for the channel.
- * @param[in] channel           The Timer2 PWM channel to be controlled (`TIM2_PWM_CHANNEL1` to `TIM2_PWM_CHANNEL7`).
+ * @param[in] channel           The Timer2 PWM channel to be controlled (`TIM2_PWM_2` to `TIM2_PWM_7`).
  *
- * @details This function implements the core control logic, calculating the precise Duty Cycle required
- * to maintain the target output voltage despite fluctuations in the battery voltage (VBAT). It is typically called
- * by the periodic timer (`timer2_pwm_dc_control_timer_cb()`).
+ * @details Stores the target in the channel's state entry and marks it active, so the periodic loop keeps it compensated.
+ * This function implements the core control logic, calculating the precise Duty Cycle required
+ * to maintain the target output voltage despite fluctuations in the battery voltage (VBAT). The channel is then
+ * kept compensated by `timer2_pwm_vbat_update()` on every VBAT change.
  *
- * * **Control Logic:** This function reads VBAT, applies it to the compensation formula, calculates the necessary PWM pulse width,
- * and writes the resulting `END_CYCLE` value to the hardware register for the specified channel.
+ * * **Control Logic:** This function takes VBAT from the reciprocal cached by `pwm_comp_set_vbat()` on every VBAT sample, applies it to the compensation formula without a division, calculates the necessary PWM pulse width,
+ * and stages the resulting `END_CYCLE` value for the specified channel if it changed.
  *
- * @sa timer2_pwm_dc_control_timer_cb, timer2_pwm_set_offset
+ * @note The value reaches the hardware on the next `pwm_shadow_commit()`, so several channels can be changed in the same period.
+ * @sa timer2_pwm_vbat_update, timer2_pwm_set_offset, pwm_shadow_commit
  ****************************************************************************************
  */
 void timer2_pwm_dc_control(int16_t target_vbias_mv, tim2_pwm_t channel);
@@ -201,19 +953,52 @@ void timer2_pwm_dc_control(int16_t target_vbias_mv, tim2_pwm_t channel);
  * @brief Directly sets the PWM offset (`START_CYCLE`) as a fixed Duty Cycle (DC) percentage for a channel.
  *
  * @param[in] offset_percentage	The desired PWM Duty Cycle (DC) offset, expressed as a percentage (0-100).
- * @param[in] channel           The Timer2 PWM channel to configure (`TIM2_PWM_CHANNEL1` to `TIM2_PWM_CHANNEL7`).
+ * @param[in] channel           The Timer2 PWM channel to configure (`TIM2_PWM_2` to `TIM2_PWM_7`).
  *
  * @details This function is used to apply a fixed Duty Cycle (DC) offset to the PWM signal
- * by writing the corresponding timer count value directly to the channel's `START_CYCLE` register.
+ * by staging the corresponding timer count value for the channel's `START_CYCLE` register.
  * This function is separate from the main VBAT compensation control loop entirely.
  *
- * @note The calculated `START_CYCLE` value depends on the configured Timer2 period.
+ * @note The calculated `START_CYCLE` value depends on the configured Timer2 period. It reaches the
+ *       hardware with the `END_CYCLE` computed from it on the next `pwm_shadow_commit()`.
  *
  * @sa timer2_pwm_set_dc_and_offset
  ****************************************************************************************
  */
 void timer2_pwm_set_offset(uint8_t offset_percentage, tim2_pwm_t channel);
 
+/**
+ ****************************************************************************************
+ * @brief Set the bias of one channel from a requested voltage and its zero calibration.
+ *
+ * @param[in] vbias_mv      Requested bias in mV.
+ * @param[in] zero_cal_mv   Bias measured on this channel with a 0 V target, in mV.
+ * @param[in] channel       The Timer2 PWM channel (`TIM2_PWM_2` to `TIM2_PWM_7`).
+ *
+ * @details Keeps both values in the channel state, divides vbias_mv - zero_cal_mv by the
+ *          calibrated gain if there is one, clamps it to the hardware range of -1000 to 1000 mV
+ *          and ramps the output there at the client slew
+ *          rate with pwm_ramp_timer_cb(). With a slew rate of 0 the output jumps at once and
+ *          only the settle wait runs. The bias is marked not settled until the filter catches up.
+ * @note timer2_pwm_dc_control() still sets a target directly and stops any ramp of the channel.
+ * @sa pwm_ramp_timer_cb, timer2_pwm_dc_control, timer2_pwm_release
+ ****************************************************************************************
+ */
+void timer2_pwm_set_bias(int16_t vbias_mv, int16_t zero_cal_mv, tim2_pwm_t channel);
+
+/**
+ ****************************************************************************************
+ * @brief Take a channel out of the battery-compensation loop.
+ *
+ * @param[in] channel   The Timer2 PWM channel (`TIM2_PWM_2` to `TIM2_PWM_7`).
+ *
+ * @details Leaves the output at a 0 mV target (half-period pulse width), which does not
+ *          depend on VBAT and so stays correct without further updates. Staged like
+ *          timer2_pwm_dc_control(), the caller commits.
+ ****************************************************************************************
+ */
+void timer2_pwm_release(tim2_pwm_t channel);
+
 /**
  ****************************************************************************************
  * @brief Configure Timer2 PWM frequency.
@@ -224,12 +1009,16 @@ void timer2_pwm_set_offset(uint8_t offset_percentage, tim2_pwm_t channel);
  *
  * @details
  *   - Computes input_freq = clk_freq / (1 << clk_div).
- *   - Configures timer0_2 clock division and timer2 configuration structs.
- *   - Calls timer2_pwm_freq_set(input_freq / pwm_div, input_freq) to program the timer.
+ *   - Writes clock division, timer2 configuration and the period count that
+ *     timer2_pwm_freq_set(input_freq / pwm_div, input_freq) would program through
+ *     pwm_shadow_set_frequency(), so they are restored after extended sleep. A running
+ *     timer is restarted so the commit phase estimate starts over from zero.
+ *   - Re-derives START_CYCLE (offset percentage) and END_CYCLE of every active channel
+ *     for the new period and commits them together.
  *
  * @note After setting frequency, duty cycle and offsets are configured separately
  *       via timer2_pwm_set_dc_and_offset() and the output enabled with timer2_pwm_enable().
- * @sa timer0_2_clk_div_set, timer2_config, timer2_pwm_freq_set
+ * @sa pwm_shadow_set_frequency, timer2_pwm_freq_set
  ****************************************************************************************
  */
 void timer2_pwm_set_frequency(tim0_2_clk_div_t clk_div, tim2_clk_src_t clk_src, uint16_t pwm_div);
@@ -238,9 +1027,14 @@ void timer2_pwm_set_frequency(tim0_2_clk_div_t clk_div, tim2_clk_src_t clk_src,
  ****************************************************************************************
  * @brief Enable Timer2 PWM outputs.
  *
- * @details Enables timer input clock via timer0_2_clk_enable() and starts Timer2 via
- *          timer2_start(). Ensure PWM frequency, duty cycles, and offsets are configured prior to enabling.
- * @sa timer0_2_clk_enable, timer2_start, timer2_pwm_set_frequency, timer2_pwm_set_dc_and_offset
+ * @details Takes the SLEEP_OWNER_PWM sleep inhibit at pwm_shadow_sleep_level(), recomputes
+ *          the active channel duty cycles from the latest VBAT and starts the timer input clock
+ *          and Timer2 via pwm_shadow_run(), which commits the staged values first. In a
+ *          CFG_PWM_DITHER build it also starts the dither task.
+ *
+ * @note The hold is ARCH_SLEEP_OFF unless CFG_PWM_RUN_IN_SLEEP is defined and the PWM runs
+ *       from TIM2_CLK_LP, in which case extended sleep stays allowed.
+ * @sa pwm_shadow_run, timer2_pwm_set_frequency, sleep_inhibit_acquire
  ****************************************************************************************
  */
 void timer2_pwm_enable(void);
@@ -249,9 +1043,10 @@ void timer2_pwm_enable(void);
  ****************************************************************************************
  * @brief Disable Timer2 PWM outputs.
  *
- * @details Stops Timer2 and disables the timer input clock to save power. Per-channel
- *          PWM settings are retained in registers and will take effect again when enabled.
- * @sa timer2_stop, timer0_2_clk_disable
+ * @details Stops Timer2 and disables the timer input clock to save power, then releases
+ *          the SLEEP_OWNER_PWM sleep inhibit. Per-channel PWM settings stay in the retained
+ *          register shadows and are rewritten on every wake-up.
+ * @sa pwm_shadow_run, sleep_inhibit_release
  ****************************************************************************************
  */
 void timer2_pwm_disable(void);
@@ -308,9 +1103,9 @@ void user_catch_rest_hndl(ke_msg_id_t const msgid, void const *param, ke_task_id
  * @param[in] src_id  Sender task id.
  *
  * @details Copies the 2-byte CCCD into a local variable and:
- *    - if CCCD = 0x0001 and connected, starts the periodic sensor voltage ADC timer (1 s).
- *    - if CCCD = 0x0000, cancels the sensor voltage timer.
- * @sa app_easy_timer, gpadc_wireless_timer_cb
+ *    - if CCCD = 0x0001 and connected, adds the sensor channel to the sampling schedule (1 s).
+ *    - if CCCD = 0x0000, removes the sensor channel from the schedule unless the sensor log is on.
+ * @sa gpadc_sched_enable, sensor_on_sample
  ****************************************************************************************
  */
 void user_svc1_sensor_voltage_cfg_ind_handler(ke_msg_id_t const msgid,
@@ -332,6 +1127,7 @@ void user_svc1_sensor_voltage_cfg_ind_handler(ke_msg_id_t const msgid,
  *  - Validates byte array length and ignores incomplete writes.
  *  - Validates clk_div and clk_src within enum ranges and invalid writes.
  *  - Calls timer2_pwm_set_frequency(...) which clamps pwm_div to datasheet range.
+ *  - Clears the last frequency planner result, its read then reports no plan applied.
  * @sa timer2_pwm_set_frequency, TIM0_2_CLK_DIV_*, TIM2_CLK_*, CLAMP
  ****************************************************************************************
  */
@@ -350,20 +1146,27 @@ void user_svc1_pwm_freq_wr_ind_handler(ke_msg_id_t const msgid,
  * @param[in] src_id        Sender task id.
  *
  * @details This function is executed when a BLE central device (e.g., a phone) writes to the custom
- * PWM VBIAS and Offset characteristic. It is responsible for parsing the 10-byte payload
- * and immediately applying the requested VBIAS target voltages and PWM offsets for
- * channels `TIM2_PWM_2` and `TIM2_PWM_3`.
+ * PWM VBIAS and Offset characteristic. It is responsible for parsing the variable-length payload
+ * and immediately applying the requested VBIAS target voltages and PWM offsets for every
+ * channel `TIM2_PWM_2` to `TIM2_PWM_7` selected in the channel mask.
+ *
+ * Payload is `[channel_mask, entry...]`, bit i of the mask selects PWM(i+2) and one 5-byte entry
+ * `[vbias_mv_msb, vbias_mv_lsb, zero_cal_msb, zero_cal_lsb, offset]` follows per set bit, lowest
+ * channel first (1 to 31 bytes). The old 10-byte PWM2/PWM3 layout without a mask is still accepted.
  *
  * The handler performs the following critical steps:
  * 1. **Guard Check:** Prevents changes if the Under Voltage Protection (UVP) shutdown is active.
- * 2. **Validation:** Checks if the received packet length is exactly 10 bytes.
- * 3. **Data Parsing:** Extracts two sets of `vbias_mv` (target voltage in mV), `zero_cal` (zero-voltage calibration value), and `offset` (Duty Cycle percentage).
- * 4. **Compensation:** Subtracts the `zero_cal` value from the raw `vbias_mv` targets to compensate for Op Amp rail offsets.
- * 5. **Clamping:** Clamps the resulting target voltages to the hardware-safe range (1000 mV).
- * 6. **PWM Configuration:** Calls `timer2_pwm_set_offset` for the new `START_CYCLE` value, and `timer2_pwm_dc_control` to set the initial PWM Duty Cycle (DC) based on the new targets.
- * 7. **Global Update:** Updates the global `target_vbias_1_mv` and `target_vbias_2_mv` variables, which the periodic compensation loop (`timer2_pwm_dc_control_timer_cb`) uses for subsequent Duty Cycle updates.
+ * 2. **Validation:** Checks the mask only names existing channels and the length matches its entry count.
+ * 3. **Data Parsing:** Extracts `vbias_mv` (target voltage in mV), `zero_cal` (zero-voltage calibration value), and `offset` (Duty Cycle percentage) per channel.
+ *    A `zero_cal` of 0x8000 keeps the channel's stored value, e.g. from the automatic zero calibration.
+ * 4. **Compensation and Clamping:** `timer2_pwm_set_bias` subtracts `zero_cal` to compensate for Op Amp rail offsets and clamps to the hardware-safe range (1000 mV).
+ * 5. **PWM Configuration:** Calls `timer2_pwm_set_offset` for the new `START_CYCLE` value before the bias so the first Duty Cycle uses it.
+ * 6. **Release:** Channels not in the mask leave the compensation loop via `timer2_pwm_release`, so every write describes the full set of active electrodes.
+ * 7. **Commit:** All staged `START_CYCLE`/`END_CYCLE` pairs are written with one `pwm_shadow_commit`, so every channel switches in the same PWM period without a skipped edge.
+ * 8. **Global Update:** The targets and offsets are kept in the retained `pwm_channels` state table, which the VBAT-driven compensation loop (`timer2_pwm_vbat_update`) uses for subsequent Duty Cycle updates.
  *
- * @sa timer2_pwm_set_offset, timer2_pwm_dc_control, timer2_pwm_dc_control_timer_cb
+ * @note PWM4 to PWM7 also need their pads assigned in user_periph_setup.c on boards that route them.
+ * @sa timer2_pwm_set_offset, timer2_pwm_set_bias, timer2_pwm_release, timer2_pwm_vbat_update, pwm_shadow_commit
  ****************************************************************************************
  */		
 void user_svc1_pwm_vbias_and_offset_wr_ind_handler(ke_msg_id_t const msgid,
@@ -408,12 +1211,12 @@ void user_svc1_pwm_state_wr_ind_handler(ke_msg_id_t const msgid,
  *
  * @details
  *  - Copies the 2-byte CCCD into a local variable and writes it to retained memory.
- *  - uvp_wireless_timer_cb() checks uvp_cccd_value and the connection state to decide whether to
+ *  - uvp_on_sample() checks uvp_cccd_value and the connection state to decide whether to
  *    build and send periodic battery notifications.
  *
- * @note The handler itself does not start/stop the UVP timer,
+ * @note The handler itself does not start/stop the UVP channel,
  *			 it only determines whether notifications will be sent
- * @sa uvp_wireless_timer_cb, KE_MSG_ALLOC_DYN, app_easy_timer
+ * @sa uvp_on_sample, KE_MSG_ALLOC_DYN, app_easy_timer
  ****************************************************************************************
  */
 void user_svc1_battery_voltage_cfg_ind_handler(ke_msg_id_t const msgid,
@@ -434,7 +1237,7 @@ void user_svc1_battery_voltage_cfg_ind_handler(ke_msg_id_t const msgid,
  *  - Allocates a dynamic message response.
  *  - Copies sensor voltage into payload (2 bytes, little-endian) and sends message.
  *
- * @note Uses retained sensor_adc_sample_mv so reads succeed even if sampling timer is stopped.
+ * @note Uses retained sensor_adc_sample_mv so reads succeed even if the sensor channel is stopped.
  * @sa KE_MSG_ALLOC_DYN, KE_MSG_SEND, app_env
  ****************************************************************************************
  */
@@ -456,7 +1259,7 @@ void user_svc1_read_sensor_voltage_handler(ke_msg_id_t const msgid,
  *  - Allocates a dynamic message response.
  *  - Copies battery voltage into payload (2 bytes, little-endian) and sends message.
  *
- * @sa KE_MSG_ALLOC_DYN, KE_MSG_SEND, uvp_wireless_timer_cb
+ * @sa KE_MSG_ALLOC_DYN, KE_MSG_SEND, uvp_on_sample
  ****************************************************************************************
  */
 void user_svc1_read_battery_voltage_handler(ke_msg_id_t const msgid,
@@ -464,6 +1267,369 @@ void user_svc1_read_battery_voltage_handler(ke_msg_id_t const msgid,
                                            ke_task_id_t const dest_id,
                                            ke_task_id_t const src_id);
 
+/**
+ ****************************************************************************************
+ * @brief Handle writes to the Sensor Stream Config characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VAL_WRITE_IND).
+ * @param[in] param   Pointer to custs1_val_write_ind (expects 4 bytes).
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details
+ *  - Byte order is [mode, samples_per_frame, stream_interval_mult, encoding].
+ *  - mode: 0 = one 2-byte notification per reading, 1 = framed notifications.
+ *  - samples_per_frame: clamped to 1..SENSOR_FRAME_MAX_SAMPLES, and to the MTU when sending.
+ *  - stream_interval_mult: 0 = one decimated burst per second, otherwise continuous ADC
+ *    conversions every stream_interval_mult x 1.024 ms, with every sample framed. The stream
+ *    ring is drained once per second, so 1 to 19 are rejected as they would overrun it.
+ *  - encoding: sample_codec_t for framed samples, 0 = raw 2-byte mV, 1 = zig-zag delta varint.
+ *    Reset to raw on disconnect so every connection selects its own.
+ *  - A partly filled frame is flushed before the new settings apply.
+ *
+ * @note Ignores writes while UVP shutdown is active or with an invalid length, mode, interval
+ *       or encoding.
+ * @sa sensor_frame_capacity, sensor_stream_apply
+ ****************************************************************************************
+ */
+void user_svc1_sensor_stream_cfg_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle read request for the Sensor Stream Config characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VALUE_REQ_IND).
+ * @param[in] param   Pointer to custs1_value_req_ind.
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details Responds with the same 4-byte layout as the write. samples_per_frame is the
+ *          effective value after the MTU limit, so the client can see what it negotiated.
+ * @sa sensor_frame_capacity
+ ****************************************************************************************
+ */
+void user_svc1_read_sensor_stream_cfg_handler(ke_msg_id_t const msgid,
+                                           struct custs1_value_req_ind const *param,
+                                           ke_task_id_t const dest_id,
+                                           ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle writes to the Sensor Log characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VAL_WRITE_IND).
+ * @param[in] param   Pointer to custs1_val_write_ind (expects 1 byte).
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details
+ *  - Byte is 0 = logging off, 1 = logging on.
+ *  - The setting is saved with the configuration record, so logging resumes after a reset.
+ *
+ * @note Ignores writes while UVP shutdown is active, with an invalid length or value, and
+ *       when the SPI flash did not answer at boot.
+ * @sa sensor_log_set, user_svc1_read_sensor_log_handler
+ ****************************************************************************************
+ */
+void user_svc1_sensor_log_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle read request for the Sensor Log characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VALUE_REQ_IND).
+ * @param[in] param   Pointer to custs1_value_req_ind.
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details Responds with 20 little-endian bytes:
+ *          [flags, buffered, boot (2), first_seq (4), next_seq (4), writes (2), erases (2),
+ *          skipped (2), failed (2)]. flags bit 0 = logging on, bit 1 = flash ready.
+ *          Blocks first_seq to next_seq - 1 are in flash, buffered samples are still in RAM.
+ *          Counters count since boot.
+ * @sa log_store_get, user_svc1_sensor_log_wr_ind_handler
+ ****************************************************************************************
+ */
+void user_svc1_read_sensor_log_handler(ke_msg_id_t const msgid,
+                                    struct custs1_value_req_ind const *param,
+                                    ke_task_id_t const dest_id,
+                                    ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle writes to the Log Download Control characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VAL_WRITE_IND).
+ * @param[in] param   Pointer to custs1_val_write_ind (expects 5 bytes).
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details
+ *  - Byte order is [opcode, start_seq (4 bytes, MSB first)].
+ *  - opcode 1 starts a download at block start_seq; blocks already overwritten start at the
+ *    oldest one left. To resume after a disconnect, the client asks for the block after the
+ *    last one it received complete. Samples buffered in RAM are programmed first so the
+ *    download runs up to the present.
+ *  - Also asks the central for the 10 to 20 ms connection interval of user_config.h, the
+ *    notifications of one connection event are limited by its length.
+ *  - opcode 0 stops a running download.
+ *
+ * @note Ignores writes while UVP shutdown is active, with an invalid length or opcode, and
+ *       starts while Log Download Data notifications are off or without the SPI flash.
+ * @sa log_dl_pump, log_store_seek, user_svc1_read_log_ctrl_handler
+ ****************************************************************************************
+ */
+void user_svc1_log_ctrl_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle read request for the Log Download Control characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VALUE_REQ_IND).
+ * @param[in] param   Pointer to custs1_value_req_ind.
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details Responds with 21 little-endian bytes:
+ *          [state, first_seq (4), next_seq (4), cursor_seq (4), bytes (4), duration_ms (4)].
+ *          state is a log_dl_state_t. first_seq to next_seq - 1 are the blocks in flash.
+ *          cursor_seq is the block being sent, bytes the log bytes sent so far and
+ *          duration_ms the time since the start, final once the end is reached, so the
+ *          client can work out the throughput.
+ * @sa user_svc1_log_ctrl_wr_ind_handler
+ ****************************************************************************************
+ */
+void user_svc1_read_log_ctrl_handler(ke_msg_id_t const msgid,
+                                  struct custs1_value_req_ind const *param,
+                                  ke_task_id_t const dest_id,
+                                  ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle CCCD writes to the Log Download Data characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VAL_WRITE_IND).
+ * @param[in] param   Pointer to custs1_val_write_ind.
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details Keeps the 2-byte CCCD for the connection. Disabling notifications stops a
+ *          running download.
+ * @sa user_svc1_log_ctrl_wr_ind_handler
+ ****************************************************************************************
+ */
+void user_svc1_log_data_cfg_ind_handler(ke_msg_id_t const msgid,
+                                     struct custs1_val_write_ind const *param,
+                                     ke_task_id_t const dest_id,
+                                     ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle writes to the PWM Frequency Planner characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VAL_WRITE_IND).
+ * @param[in] param   Pointer to custs1_val_write_ind (expects 6 bytes).
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details
+ *  - Byte order is [target_hz (4 bytes, MSB first), min_resolution_mv_MSB, min_resolution_mv_LSB].
+ *    min_resolution_mv is the coarsest acceptable bias step, 0 for no requirement.
+ *  - Runs pwm_plan_search() over both clock sources and all dividers at the VBAT the
+ *    compensation uses (3000 mV before the first reading). In a CFG_PWM_DITHER build the
+ *    resolution includes the 8 dither bits.
+ *  - Applies the result with timer2_pwm_set_frequency() and keeps it for the read handler.
+ *
+ * @note Ignores writes while UVP shutdown is active, with an invalid length or a 0 Hz target.
+ * @sa pwm_plan_search, timer2_pwm_set_frequency, user_svc1_read_pwm_freq_plan_handler
+ ****************************************************************************************
+ */
+void user_svc1_pwm_freq_plan_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle read request for the PWM Frequency Planner characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VALUE_REQ_IND).
+ * @param[in] param   Pointer to custs1_value_req_ind.
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details Responds with 13 little-endian bytes:
+ *          [flags, clk_src, clk_div, pwm_div (2), freq_hz (4), resolution_uv (4)].
+ *          flags bit 0 is set once a plan was applied (cleared by a manual PWM Frequency
+ *          write), bit 1 if the requested resolution was met, bit 2 in CFG_PWM_DITHER builds.
+ *          freq_hz is rounded to the nearest Hz, resolution_uv is the bias step at the
+ *          planning VBAT.
+ * @sa user_svc1_pwm_freq_plan_wr_ind_handler
+ ****************************************************************************************
+ */
+void user_svc1_read_pwm_freq_plan_handler(ke_msg_id_t const msgid,
+                                           struct custs1_value_req_ind const *param,
+                                           ke_task_id_t const dest_id,
+                                           ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle writes to the PWM Bias Ramp characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VAL_WRITE_IND).
+ * @param[in] param   Pointer to custs1_val_write_ind (expects 4 bytes).
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details
+ *  - Byte order is [slew_mv_per_s_MSB, slew_mv_per_s_LSB, tau_ms_MSB, tau_ms_LSB].
+ *  - slew_mv_per_s limits how fast a new bias is approached, 0 (the default) jumps.
+ *  - tau_ms is the time constant of the bias filter used for the settle estimate (default 100 ms).
+ *  - A running ramp continues at the new rate from its next step.
+ *
+ * @note Ignores writes while UVP shutdown is active or with an invalid length.
+ * @sa pwm_ramp_timer_cb, user_svc1_read_pwm_ramp_handler
+ ****************************************************************************************
+ */
+void user_svc1_pwm_ramp_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle read request for the PWM Bias Ramp characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VALUE_REQ_IND).
+ * @param[in] param   Pointer to custs1_value_req_ind.
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details Responds with 9 little-endian bytes:
+ *          [slew_mv_per_s (2), tau_ms (2), flags, settle_ms (4)].
+ *          flags bit 0 is set once the bias has settled, bit 1 while a ramp runs and bit 2
+ *          while waiting for the filter after the ramp. settle_ms is the time from the last
+ *          bias change to the settle point.
+ * @sa user_svc1_pwm_ramp_wr_ind_handler
+ ****************************************************************************************
+ */
+void user_svc1_read_pwm_ramp_handler(ke_msg_id_t const msgid,
+                                      struct custs1_value_req_ind const *param,
+                                      ke_task_id_t const dest_id,
+                                      ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle writes to the PWM Closed-Loop Bias characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VAL_WRITE_IND).
+ * @param[in] param   Pointer to custs1_val_write_ind (expects 5 bytes).
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details
+ *  - Byte order is [channel, period_ms_MSB, period_ms_LSB, kp_q8, ki_q8].
+ *  - channel 0 to 5 regulates PWM2 to PWM7 from the feedback pin, 0xFF returns to open loop
+ *    and clears the trim.
+ *  - period_ms is the loop period, rounded down to 10 ms and no shorter than PWM_LOOP_MIN_PERIOD.
+ *    It should be longer than the bias filter time constant so each sample sees the last step.
+ *  - kp_q8 and ki_q8 are the PI gains in 1/256 steps, 0 for both selects the defaults (64, 128).
+ *  - Every accepted write resets the controller and the convergence timer.
+ *
+ * @note Ignores writes while UVP shutdown is active, with an invalid length or channel, and
+ *       any write that enables the loop in a build without CFG_PWM_BIAS_LOOP.
+ * @sa pwm_loop_timer_cb, pwm_loop_on_sample, user_svc1_read_pwm_loop_handler
+ ****************************************************************************************
+ */
+void user_svc1_pwm_loop_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle read request for the PWM Closed-Loop Bias characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VALUE_REQ_IND).
+ * @param[in] param   Pointer to custs1_value_req_ind.
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details Responds with 16 little-endian bytes:
+ *          [flags, channel, period_ms (2), kp_q8, ki_q8, trim_mv (2), residual_uv (4), converge_ms (4)].
+ *          flags bit 0 is set while the loop runs, bit 1 once it has converged, bit 2 while the
+ *          trim is at its limit and bit 3 in CFG_PWM_BIAS_LOOP builds. trim_mv and residual_uv
+ *          are signed; residual_uv is the error of the last sample. converge_ms is 0 until the
+ *          loop has converged after the last setpoint change.
+ * @sa user_svc1_pwm_loop_wr_ind_handler
+ ****************************************************************************************
+ */
+void user_svc1_read_pwm_loop_handler(ke_msg_id_t const msgid,
+                                      struct custs1_value_req_ind const *param,
+                                      ke_task_id_t const dest_id,
+                                      ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle writes to the PWM Zero Calibration characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VAL_WRITE_IND).
+ * @param[in] param   Pointer to custs1_val_write_ind (expects 3 bytes).
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details
+ *  - Byte order is [channel_mask, gain_point_mv_MSB, gain_point_mv_LSB].
+ *  - Bit i of channel_mask selects PWM(i+2). The channels are measured one after the other on
+ *    the bias feedback pin, so the pin must see the bias node of the channel being measured.
+ *  - gain_point_mv is a second target (-1000 to 1000 mV) for a gain calibration, 0 for offset only.
+ *  - Stops the closed-loop mode, then drives each channel to 0 V (and to the gain point) with
+ *    the ramp bypassed and measures it with pwm_zcal_timer_cb() and pwm_zcal_on_sample().
+ *  - The time budget is fixed when the run starts: per point PWM_ZCAL_SETTLE_TAUS filter time
+ *    constants plus the bursts, plus a quarter for margin. Runs that would need more than
+ *    PWM_ZCAL_MAX_MS are refused.
+ *
+ * @note Ignores writes while UVP shutdown is active, while the PWM is off, while a calibration
+ *       runs, with an invalid length, mask or gain point, and in builds without CFG_PWM_BIAS_LOOP.
+ * @sa pwm_zcal_timer_cb, user_svc1_read_pwm_zcal_handler
+ ****************************************************************************************
+ */
+void user_svc1_pwm_zcal_wr_ind_handler(ke_msg_id_t const msgid,
+                               struct custs1_val_write_ind const *param,
+                               ke_task_id_t const dest_id,
+                               ke_task_id_t const src_id);
+
+/**
+ ****************************************************************************************
+ * @brief Handle read request for the PWM Zero Calibration characteristic.
+ *
+ * @param[in] msgid   Message ID (CUSTS1_VALUE_REQ_IND).
+ * @param[in] param   Pointer to custs1_value_req_ind.
+ * @param[in] dest_id Receiver task id.
+ * @param[in] src_id  Sender task id.
+ *
+ * @details Responds with 35 little-endian bytes:
+ *          [state, done_mask, failed_mask, duration_ms (2), 6 x [zero_cal_mv (2), gain_q12 (2), confidence]].
+ *          state is a pwm_zcal_state_t. Channel entries run from PWM2 to PWM7 and hold the last
+ *          result of each channel, stored or not. The value is longer than a default-MTU read,
+ *          the client reads it after the MTU exchange the firmware starts on connection.
+ * @sa user_svc1_pwm_zcal_wr_ind_handler
+ ****************************************************************************************
+ */
+void user_svc1_read_pwm_zcal_handler(ke_msg_id_t const msgid,
+                                      struct custs1_value_req_ind const *param,
+                                      ke_task_id_t const dest_id,
+                                      ke_task_id_t const src_id);
+
 /**
  ****************************************************************************************
  * @brief User callback when the system is powered on.
@@ -478,6 +1644,27 @@ void user_svc1_read_battery_voltage_handler(ke_msg_id_t const msgid,
  */
 arch_main_loop_callback_ret_t user_app_on_system_powered(void);
 
+/**
+ ****************************************************************************************
+ * @brief User callback right before the SoC enters sleep (app_going_to_sleep).
+ *
+ * @details Sets the PD_TIM sleep behaviour through pwm_shadow_going_to_sleep().
+ * @sa user_app_resume_from_sleep
+ ****************************************************************************************
+ */
+void user_app_going_to_sleep(void);
+
+/**
+ ****************************************************************************************
+ * @brief User callback when the SoC wakes up from sleep (app_resume_from_sleep).
+ *
+ * @details Rewrites the Timer2 PWM registers from retention RAM through
+ *          pwm_shadow_restore() if they were lost while PD_TIM was powered down.
+ * @sa user_app_going_to_sleep
+ ****************************************************************************************
+ */
+void user_app_resume_from_sleep(void);
+
 /**
  ****************************************************************************************
  * @brief User initialization callback executed at boot.
@@ -0,0 +1,98 @@
+/**
+ ****************************************************************************************
+ * @file user_gpadc_conv.c
+ * @brief Integer-only conversion of ADC samples and decimated bursts to mV and uV.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "user_gpadc_conv.h"
+
+/*
+ ****************************************************************************************
+ * ADC CONVERSION FUNCTIONS
+ ****************************************************************************************
+*/
+
+void gpadc_conv_build(gpadc_conv_t *conv, gpadc_lin_cal_t const *cal,
+                      uint8_t input_attenuator, uint8_t oversampling)
+{
+	// Effective resolution of ADC sample based on oversampling rate
+	uint32_t adc_resolution = 10 + ((6 < oversampling) ? 6 : oversampling);
+
+	// Reference voltage is 900mv but is scaled based on input attenation
+	uint32_t ref_mv = 900 * (input_attenuator + 1);
+
+	// Two-point correction maps the raw zero and full-scale readings onto 0 V and full scale
+	// Gain is ref_mv / span_mv, divide once per configuration and round each result once
+	uint32_t span_mv = cal->raw_fs_mv - cal->raw_zero_mv;
+
+	// Corrected mV per LSB is ref_mv / 2^resolution * ref_mv / span_mv
+	conv->scale_q24 = (uint32_t)((((uint64_t)ref_mv * ref_mv << (24 - adc_resolution)) + (span_mv >> 1)) / span_mv);
+	conv->scale_q16 = (conv->scale_q24 + (1UL << 7)) >> 8;
+
+	// Fold the corrected zero error into the bias, with 0.5 mV added for rounding
+	uint32_t zero_q16 = (uint32_t)((((uint64_t)cal->raw_zero_mv * ref_mv << 16) + (span_mv >> 1)) / span_mv);
+	conv->bias_q16 = (int32_t)GPADC_CONV_ROUND_Q16 - (int32_t)zero_q16;
+}
+
+uint16_t gpadc_conv_apply(gpadc_conv_t const *conv, uint16_t sample)
+{
+	// Single multiply-add, fits in 32 bits since sample * scale is below 2^16 * full scale
+	int32_t mv_q16 = (int32_t)((uint32_t)sample * conv->scale_q16) + conv->bias_q16;
+
+	// Branch-free clamp of readings below the zero point to 0 mV
+	mv_q16 &= ~(mv_q16 >> 31);
+
+	return (uint16_t)(mv_q16 >> 16);
+}
+
+uint32_t gpadc_conv_to_uv(gpadc_conv_t const *conv, uint32_t sum, uint8_t log2_n)
+{
+	// Boxcar sum carries log2_n extra fractional bits that are kept until the final shift
+	// The mV rounding term would be worth 500 uV once scaled, round at 0.5 uV instead
+	int64_t uv_q16 = (int64_t)(((uint64_t)sum * conv->scale_q24 * 1000U) >> (log2_n + 8U))
+	               + (int64_t)(conv->bias_q16 - GPADC_CONV_ROUND_Q16) * 1000
+	               + GPADC_CONV_ROUND_Q16;
+
+	// Clamp negative results to 0 V
+	return (uv_q16 < 0) ? 0 : (uint32_t)(uv_q16 >> 16);
+}
+
+uint16_t gpadc_isqrt(uint32_t value)
+{
+	// Bit-by-bit integer square root, no divides or multiplies (Cortex-M0+ has no FPU)
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+
+	while (bit != 0)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (uint16_t)root;
+}
+
+/// @} APP
@@ -0,0 +1,124 @@
+/**
+ ****************************************************************************************
+ * @file user_gpadc_conv.h
+ * @brief Integer-only conversion of ADC samples and decimated bursts to mV and uV.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_GPADC_CONV_H_
+#define _USER_GPADC_CONV_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+// No SDK headers so a host-side check can build the same source
+#include <stdint.h>
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// 0.5 in Q16, folded into bias_q16 so the mV path rounds to nearest with a plain shift
+#define GPADC_CONV_ROUND_Q16 (1L << 15)
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Two-point ADC linearity correction, raw readings for a true 0 V and a true full-scale input
+typedef struct
+{
+    uint16_t raw_zero_mv;       ///< Uncorrected reading (mV) with the input tied to GND
+    uint16_t raw_fs_mv;         ///< Uncorrected reading (mV) at the attenuator full-scale voltage
+} gpadc_lin_cal_t;
+
+/// Precomputed millivolt conversion for one ADC configuration: mV = (sample * scale + bias) >> 16
+typedef struct
+{
+    uint32_t scale_q16;         ///< Corrected mV per LSB (Q16)
+    uint32_t scale_q24;         ///< Same scale in Q24 for the uV path, Q16 keeps only 10 bits at 16-bit resolution
+    int32_t bias_q16;           ///< Corrected zero offset plus GPADC_CONV_ROUND_Q16 (Q16)
+} gpadc_conv_t;
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Build the conversion descriptor for an ADC configuration.
+ *
+ * @param[out] conv              Descriptor to fill.
+ * @param[in]  cal               Linearity correction measured for the attenuator setting.
+ * @param[in]  input_attenuator  Attenuator setting, 0 (none) to 3 (4x).
+ * @param[in]  oversampling      Oversampling setting (0 to 7).
+ *
+ * @details Gain and zero error are folded into one scale and bias so the hot path is a
+ *          single multiply-add. The only divisions run here, once per configuration.
+ ****************************************************************************************
+ */
+void gpadc_conv_build(gpadc_conv_t *conv, gpadc_lin_cal_t const *cal,
+                      uint8_t input_attenuator, uint8_t oversampling);
+
+/**
+ ****************************************************************************************
+ * @brief Convert a corrected ADC sample to millivolts with a precomputed descriptor.
+ *
+ * @param[in] conv    Descriptor from gpadc_conv_build().
+ * @param[in] sample  Corrected ADC sample value.
+ * @return Sample in millivolts (mV), rounded to nearest and clamped at 0 mV.
+ *
+ * @details Branch-free: one 32-bit multiply, one add, a sign-mask clamp and a shift.
+ ****************************************************************************************
+ */
+uint16_t gpadc_conv_apply(gpadc_conv_t const *conv, uint16_t sample);
+
+/**
+ ****************************************************************************************
+ * @brief Convert a boxcar sum of 2^log2_n samples to microvolts.
+ *
+ * @param[in] conv    Descriptor from gpadc_conv_build().
+ * @param[in] sum     Sum of the corrected samples.
+ * @param[in] log2_n  Number of samples summed, as a power of two (0 to 6).
+ * @return Mean in microvolts (uV), rounded to nearest and clamped at 0 uV.
+ *
+ * @details The shift for the burst length is applied last and the Q24 scale is used, so the
+ *          extra resolution from decimation is not truncated away. The 0.5 mV rounding term
+ *          in bias_q16 is taken out before the bias is scaled to uV and 0.5 uV added in its
+ *          place.
+ ****************************************************************************************
+ */
+uint32_t gpadc_conv_to_uv(gpadc_conv_t const *conv, uint32_t sum, uint8_t log2_n);
+
+/**
+ ****************************************************************************************
+ * @brief Integer square root.
+ *
+ * @param[in] value  Input value.
+ * @return floor(sqrt(value)).
+ ****************************************************************************************
+ */
+uint16_t gpadc_isqrt(uint32_t value);
+
+/// @} APP
+
+#endif // _USER_GPADC_CONV_H_
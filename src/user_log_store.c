@@ -0,0 +1,614 @@
+/**
+ ****************************************************************************************
+ * @file user_log_store.c
+ * @brief Timestamped sensor samples batched in RAM and appended to SPI flash as
+ *        page-sized, CRC-protected blocks in a wear-levelled ring.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h" // SW configuration
+#include "user_log_store.h"
+#include "user_cfg_store.h" // shared CRC-16
+#include "user_periph_setup.h"
+
+#ifdef CFG_SPI_FLASH_ENABLE
+#include "spi_flash.h"
+#endif
+
+#include <string.h>
+
+/*
+ ****************************************************************************************
+ * DEFINITIONS
+ ****************************************************************************************
+ */
+
+static const uint16_t LOG_STORE_SECTORS = LOG_STORE_FLASH_SIZE / LOG_STORE_SECTOR_SIZE;
+static const uint16_t LOG_STORE_PAGES = (LOG_STORE_FLASH_SIZE / LOG_STORE_SECTOR_SIZE) * LOG_STORE_PAGES_PER_SECTOR;
+static const uint8_t LOG_STORE_CHUNK = 32U; // CRC, blank checks and read-back go through a small stack buffer
+
+/*
+----------------------------------
+- Retained / Global variables
+----------------------------------
+*/
+
+// These variables are retained across sleep cycles
+
+log_store_t log_store __SECTION_ZERO("retention_mem_area0");
+uint8_t log_store_page[LOG_STORE_PAGE_SIZE] __SECTION_ZERO("retention_mem_area0"); // block being filled, header written on flush
+
+/*
+ ****************************************************************************************
+ * LOCAL FUNCTIONS
+ ****************************************************************************************
+*/
+
+#ifdef CFG_SPI_FLASH_ENABLE
+
+static uint32_t log_store_page_addr(uint16_t page)
+{
+	return LOG_STORE_FLASH_ADDR + (uint32_t)page * LOG_STORE_PAGE_SIZE;
+}
+
+static uint16_t log_store_next_sector(uint16_t page)
+{
+	return (uint16_t)(((page / LOG_STORE_PAGES_PER_SECTOR + 1U) % LOG_STORE_SECTORS) * LOG_STORE_PAGES_PER_SECTOR);
+}
+
+static bool log_store_read_flash(uint32_t addr, uint8_t *data, uint32_t length)
+{
+	uint32_t actual = 0;
+
+	return (spi_flash_read_data(data, addr, length, &actual) == SPI_FLASH_ERR_OK) && (actual == length);
+}
+
+static bool log_store_read_block(uint16_t page, log_store_block_t *block)
+{
+	uint8_t data[LOG_STORE_CHUNK];
+
+	// Header first, blank and foreign pages are rejected without reading the samples
+	if (!log_store_read_flash(log_store_page_addr(page), data, LOG_STORE_HEADER_SIZE))
+	{
+		return false;
+	}
+
+	uint16_t magic = (uint16_t)(data[0] | (data[1] << 8));
+	if (magic != LOG_STORE_MAGIC || data[2] != LOG_STORE_VERSION || data[3] == 0 || data[3] > LOG_STORE_MAX_SAMPLES)
+	{
+		return false;
+	}
+
+	block->count = data[3];
+	block->seq = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+	block->base_ms = (uint32_t)data[8] | ((uint32_t)data[9] << 8) | ((uint32_t)data[10] << 16) | ((uint32_t)data[11] << 24);
+	block->boot = (uint16_t)(data[12] | (data[13] << 8));
+	uint16_t crc_stored = (uint16_t)(data[14] | (data[15] << 8));
+
+	// CRC covers the header up to the CRC field and the used samples
+	uint16_t crc = cfg_store_crc16(0xFFFFU, data, LOG_STORE_HEADER_SIZE - 2U);
+	uint32_t addr = log_store_page_addr(page) + LOG_STORE_HEADER_SIZE;
+	uint32_t remaining = (uint32_t)block->count * LOG_STORE_SAMPLE_SIZE;
+	while (remaining > 0)
+	{
+		uint32_t length = (remaining < LOG_STORE_CHUNK) ? remaining : LOG_STORE_CHUNK;
+		if (!log_store_read_flash(addr, data, length))
+		{
+			return false;
+		}
+		crc = cfg_store_crc16(crc, data, length);
+		addr += length;
+		remaining -= length;
+	}
+
+	return crc == crc_stored;
+}
+
+static bool log_store_page_equals(uint16_t page, uint8_t const *expected)
+{
+	uint8_t data[LOG_STORE_CHUNK];
+
+	// expected is NULL for an erased page
+	for (uint16_t pos = 0; pos < LOG_STORE_PAGE_SIZE; pos += LOG_STORE_CHUNK)
+	{
+		if (!log_store_read_flash(log_store_page_addr(page) + pos, data, sizeof(data)))
+		{
+			return false;
+		}
+
+		for (uint8_t i = 0; i < LOG_STORE_CHUNK; i++)
+		{
+			if (data[i] != ((expected != NULL) ? expected[pos + i] : 0xFFU))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool log_store_program(uint16_t page)
+{
+	uint32_t actual = 0;
+
+	if (spi_flash_write_data(log_store_page, log_store_page_addr(page), LOG_STORE_PAGE_SIZE, &actual) != SPI_FLASH_ERR_OK ||
+	    actual != LOG_STORE_PAGE_SIZE)
+	{
+		return false;
+	}
+
+	// Read back, a worn or disturbed cell shows up here instead of in a download
+	return log_store_page_equals(page, log_store_page);
+}
+
+static void log_store_find_tail(void)
+{
+	log_store_block_t block;
+
+	// Oldest block is the first one of the next sector that still holds any
+	for (uint16_t i = 1; i < LOG_STORE_SECTORS; i++)
+	{
+		uint16_t sector = (uint16_t)((log_store.tail_sector + i) % LOG_STORE_SECTORS);
+		if (log_store_read_block((uint16_t)(sector * LOG_STORE_PAGES_PER_SECTOR), &block))
+		{
+			log_store.tail_sector = sector;
+			log_store.first_seq = block.seq;
+			return;
+		}
+	}
+
+	log_store.first_seq = log_store.next_seq;
+}
+
+static void log_store_seek_page(log_store_cursor_t *cursor)
+{
+	log_store_block_t block;
+
+	// Sectors from the tail onwards start with growing sequence numbers
+	cursor->page = (uint16_t)(log_store.tail_sector * LOG_STORE_PAGES_PER_SECTOR);
+	for (uint16_t i = 0; i < LOG_STORE_SECTORS; i++)
+	{
+		uint16_t page = (uint16_t)(((log_store.tail_sector + i) % LOG_STORE_SECTORS) * LOG_STORE_PAGES_PER_SECTOR);
+		if (!log_store_read_block(page, &block))
+		{
+			continue;
+		}
+		if (block.seq > cursor->seq)
+		{
+			break;
+		}
+		cursor->page = page;
+	}
+}
+
+static bool log_store_cursor_load(log_store_cursor_t *cursor)
+{
+	log_store_block_t block;
+
+	// A whole sector of older blocks and a skipped gap are the most that can come first
+	for (uint16_t i = 0; i < 2U * LOG_STORE_PAGES_PER_SECTOR + 1U; i++)
+	{
+		if (cursor->seq >= log_store.next_seq)
+		{
+			return false;
+		}
+
+		if (log_store_read_block(cursor->page, &block) && block.seq >= cursor->seq)
+		{
+			cursor->seq = block.seq;
+			cursor->offset = 0;
+			cursor->length = (uint16_t)(LOG_STORE_HEADER_SIZE + (uint16_t)block.count * LOG_STORE_SAMPLE_SIZE);
+			return true;
+		}
+
+		cursor->page = (uint16_t)((cursor->page + 1U) % LOG_STORE_PAGES);
+	}
+
+	return false;
+}
+
+static uint16_t log_store_erase_target(void)
+{
+	// A head on a sector's first page needs that sector, any other page the one after it
+	if ((log_store.head % LOG_STORE_PAGES_PER_SECTOR) == 0)
+	{
+		return (uint16_t)(log_store.head / LOG_STORE_PAGES_PER_SECTOR);
+	}
+
+	return (uint16_t)(log_store_next_sector(log_store.head) / LOG_STORE_PAGES_PER_SECTOR);
+}
+
+static bool log_store_erase(uint16_t page)
+{
+	if (spi_flash_block_erase(log_store_page_addr(page), SPI_FLASH_OP_SE) != SPI_FLASH_ERR_OK)
+	{
+		return false;
+	}
+	log_store.erases++;
+
+	// Erasing the oldest sector moves the tail of the ring forward
+	if (log_store.first_seq != log_store.next_seq && (page / LOG_STORE_PAGES_PER_SECTOR) == log_store.tail_sector)
+	{
+		log_store_find_tail();
+	}
+
+	return true;
+}
+
+#endif
+
+/*
+ ****************************************************************************************
+ * LOG STORE FUNCTIONS
+ ****************************************************************************************
+*/
+
+bool log_store_init(void)
+{
+	memset(&log_store, 0, sizeof(log_store));
+	memset(log_store_page, 0xFF, sizeof(log_store_page));
+	log_store.boot = 1;
+	log_store.first_seq = 1;
+	log_store.next_seq = 1;
+	log_store.erased_sector = LOG_STORE_NO_SECTOR;
+
+	#ifdef CFG_SPI_FLASH_ENABLE
+	uint8_t dev_id = 0;
+
+	// Boards without the flash fitted run without a log
+	spi_flash_release_from_power_down();
+	if (spi_flash_auto_detect(&dev_id) != SPI_FLASH_ERR_OK)
+	{
+		return false;
+	}
+
+	// First pages give the newest and oldest sector, sequence numbers only grow
+	log_store_block_t block;
+	log_store_block_t newest = {0};
+	bool found = false;
+	uint16_t newest_sector = 0;
+	for (uint16_t sector = 0; sector < LOG_STORE_SECTORS; sector++)
+	{
+		if (!log_store_read_block((uint16_t)(sector * LOG_STORE_PAGES_PER_SECTOR), &block))
+		{
+			continue;
+		}
+
+		if (!found || block.seq > newest.seq)
+		{
+			newest = block;
+			newest_sector = sector;
+		}
+		if (!found || block.seq < log_store.first_seq)
+		{
+			log_store.first_seq = block.seq;
+			log_store.tail_sector = sector;
+		}
+		found = true;
+	}
+
+	if (found)
+	{
+		// Blocks fill a sector from its first page, the first invalid page ends the scan
+		uint16_t page = (uint16_t)(newest_sector * LOG_STORE_PAGES_PER_SECTOR + 1U);
+		uint16_t end = (uint16_t)((newest_sector + 1U) * LOG_STORE_PAGES_PER_SECTOR);
+		while (page < end && log_store_read_block(page, &block) && block.seq > newest.seq)
+		{
+			newest = block;
+			page++;
+		}
+
+		log_store.head = (uint16_t)(page % LOG_STORE_PAGES);
+		log_store.next_seq = newest.seq + 1U;
+		log_store.boot = (uint16_t)(newest.boot + 1U);
+	}
+
+	log_store.ready = true;
+
+	spi_flash_power_down();
+
+	return true;
+	#else
+	return false;
+	#endif
+}
+
+uint32_t log_store_clock(uint32_t time_us)
+{
+	// Extend the wrapping microsecond timebase into milliseconds since boot
+	uint32_t elapsed_us = (time_us - log_store.now_us) + log_store.rem_us;
+	log_store.now_ms += elapsed_us / 1000U;
+	log_store.rem_us = (uint16_t)(elapsed_us % 1000U);
+	log_store.now_us = time_us;
+
+	return log_store.now_ms;
+}
+
+void log_store_append(uint32_t time_us, uint16_t mv)
+{
+	log_store_clock(time_us);
+
+	if (!log_store.ready)
+	{
+		return;
+	}
+
+	// Delta to the previous sample must fit 16 bits, a longer gap starts a new block
+	bool gap = (log_store.count > 0 && (log_store.now_ms - log_store.last_ms) > 0xFFFFU);
+	if (gap)
+	{
+		log_store_flush();
+	}
+
+	// A block still waiting for its sector erase leaves no room for the sample
+	if (log_store.count >= LOG_STORE_MAX_SAMPLES || (gap && log_store.count > 0))
+	{
+		log_store.dropped++;
+		return;
+	}
+
+	if (log_store.count == 0)
+	{
+		log_store.base_ms = log_store.now_ms;
+		log_store.last_ms = log_store.now_ms;
+	}
+
+	uint16_t dt_ms = (uint16_t)(log_store.now_ms - log_store.last_ms);
+	uint8_t *sample = &log_store_page[LOG_STORE_HEADER_SIZE + (uint16_t)log_store.count * LOG_STORE_SAMPLE_SIZE];
+	sample[0] = (uint8_t)(dt_ms & 0xFF);
+	sample[1] = (uint8_t)(dt_ms >> 8);
+	sample[2] = (uint8_t)(mv & 0xFF);
+	sample[3] = (uint8_t)(mv >> 8);
+	log_store.last_ms = log_store.now_ms;
+	log_store.count++;
+
+	if (log_store.count >= LOG_STORE_MAX_SAMPLES)
+	{
+		log_store_flush();
+	}
+}
+
+void log_store_flush(void)
+{
+	if (!log_store.ready || log_store.count == 0)
+	{
+		return;
+	}
+
+	#ifdef CFG_SPI_FLASH_ENABLE
+	uint32_t seq = log_store.next_seq;
+
+	// Unused samples stay erased, the whole page is programmed and verified
+	log_store_page[0] = (uint8_t)(LOG_STORE_MAGIC & 0xFF);
+	log_store_page[1] = (uint8_t)(LOG_STORE_MAGIC >> 8);
+	log_store_page[2] = LOG_STORE_VERSION;
+	log_store_page[3] = log_store.count;
+	log_store_page[4] = (uint8_t)(seq & 0xFF);
+	log_store_page[5] = (uint8_t)((seq >> 8) & 0xFF);
+	log_store_page[6] = (uint8_t)((seq >> 16) & 0xFF);
+	log_store_page[7] = (uint8_t)(seq >> 24);
+	log_store_page[8] = (uint8_t)(log_store.base_ms & 0xFF);
+	log_store_page[9] = (uint8_t)((log_store.base_ms >> 8) & 0xFF);
+	log_store_page[10] = (uint8_t)((log_store.base_ms >> 16) & 0xFF);
+	log_store_page[11] = (uint8_t)(log_store.base_ms >> 24);
+	log_store_page[12] = (uint8_t)(log_store.boot & 0xFF);
+	log_store_page[13] = (uint8_t)(log_store.boot >> 8);
+	uint16_t crc = cfg_store_crc16(0xFFFFU, log_store_page, LOG_STORE_HEADER_SIZE - 2U);
+	crc = cfg_store_crc16(crc, &log_store_page[LOG_STORE_HEADER_SIZE], (uint32_t)log_store.count * LOG_STORE_SAMPLE_SIZE);
+	log_store_page[14] = (uint8_t)(crc & 0xFF);
+	log_store_page[15] = (uint8_t)(crc >> 8);
+
+	uint16_t page = log_store.head;
+	bool written = false;
+
+	log_store.waiting = false;
+	spi_flash_release_from_power_down();
+
+	// Left over from a write cut short by a reset, start on a fresh sector
+	if ((page % LOG_STORE_PAGES_PER_SECTOR) != 0 && !log_store_page_equals(page, NULL))
+	{
+		log_store.skipped++;
+		page = log_store_next_sector(page);
+	}
+
+	// Sectors are erased ahead by log_store_prepare(), never here
+	if ((page % LOG_STORE_PAGES_PER_SECTOR) == 0 && (page / LOG_STORE_PAGES_PER_SECTOR) != log_store.erased_sector)
+	{
+		log_store.waiting = true;
+	}
+	else
+	{
+		written = log_store_program(page);
+
+		// A failed program or read-back moves on once more, if the next sector is ready
+		if (!written)
+		{
+			page = log_store_next_sector(page);
+			if ((page / LOG_STORE_PAGES_PER_SECTOR) == log_store.erased_sector)
+			{
+				written = log_store_program(page);
+				if (!written)
+				{
+					page = log_store_next_sector(page);
+				}
+			}
+		}
+	}
+
+	spi_flash_power_down();
+
+	if (log_store.waiting)
+	{
+		// Samples stay buffered until the idle task has erased the sector
+		log_store.head = page;
+		return;
+	}
+
+	if (written)
+	{
+		if (log_store.first_seq == log_store.next_seq)
+		{
+			log_store.first_seq = seq;
+			log_store.tail_sector = (uint16_t)(page / LOG_STORE_PAGES_PER_SECTOR);
+		}
+		log_store.next_seq = seq + 1U;
+		log_store.head = (uint16_t)((page + 1U) % LOG_STORE_PAGES);
+		log_store.writes++;
+	}
+	else
+	{
+		// Next block starts on a fresh sector
+		log_store.head = page;
+		log_store.failed++;
+	}
+	#endif
+
+	log_store.count = 0;
+	memset(log_store_page, 0xFF, sizeof(log_store_page));
+}
+
+bool log_store_erase_pending(void)
+{
+	#ifdef CFG_SPI_FLASH_ENABLE
+	return log_store.ready && log_store_erase_target() != log_store.erased_sector;
+	#else
+	return false;
+	#endif
+}
+
+void log_store_prepare(void)
+{
+	if (!log_store.ready)
+	{
+		return;
+	}
+
+	#ifdef CFG_SPI_FLASH_ENABLE
+	uint16_t sector = log_store_erase_target();
+	if (sector != log_store.erased_sector)
+	{
+		uint16_t page = (uint16_t)(sector * LOG_STORE_PAGES_PER_SECTOR);
+		bool blank = true;
+
+		spi_flash_release_from_power_down();
+
+		// A sector still blank from the last erase or from the factory is not erased again
+		for (uint16_t i = 0; i < LOG_STORE_PAGES_PER_SECTOR && blank; i++)
+		{
+			blank = log_store_page_equals((uint16_t)(page + i), NULL);
+		}
+		if (blank || log_store_erase(page))
+		{
+			log_store.erased_sector = sector;
+		}
+
+		spi_flash_power_down();
+	}
+
+	// A block that waited for this sector goes out now
+	if (log_store.waiting)
+	{
+		log_store_flush();
+	}
+	#endif
+}
+
+bool log_store_seek(uint32_t seq, log_store_cursor_t *cursor)
+{
+	memset(cursor, 0, sizeof(*cursor));
+	cursor->seq = (seq < log_store.first_seq) ? log_store.first_seq : seq;
+	cursor->chunk_seq = cursor->seq;
+
+	if (!log_store.ready)
+	{
+		return false;
+	}
+
+	#ifdef CFG_SPI_FLASH_ENABLE
+	spi_flash_release_from_power_down();
+	log_store_seek_page(cursor);
+	spi_flash_power_down();
+	#endif
+
+	return true;
+}
+
+uint16_t log_store_read(log_store_cursor_t *cursor, uint8_t *data, uint16_t max)
+{
+	uint16_t length = 0;
+
+	if (!log_store.ready)
+	{
+		return 0;
+	}
+
+	#ifdef CFG_SPI_FLASH_ENABLE
+	spi_flash_release_from_power_down();
+
+	// Logging erased the sector under the cursor, carry on from the oldest block left
+	if (cursor->seq < log_store.first_seq)
+	{
+		cursor->seq = log_store.first_seq;
+		cursor->offset = 0;
+		cursor->length = 0;
+		log_store_seek_page(cursor);
+	}
+
+	while (length < max)
+	{
+		if (cursor->offset >= cursor->length)
+		{
+			// Move past the block just finished, then find and check the next one
+			if (cursor->length != 0)
+			{
+				cursor->seq++;
+				cursor->page = (uint16_t)((cursor->page + 1U) % LOG_STORE_PAGES);
+				cursor->length = 0;
+			}
+			if (!log_store_cursor_load(cursor))
+			{
+				break;
+			}
+		}
+
+		if (length == 0)
+		{
+			cursor->chunk_seq = cursor->seq;
+			cursor->chunk_offset = cursor->offset;
+		}
+
+		uint16_t chunk = cursor->length - cursor->offset;
+		if (chunk > max - length)
+		{
+			chunk = max - length;
+		}
+		if (!log_store_read_flash(log_store_page_addr(cursor->page) + cursor->offset, &data[length], chunk))
+		{
+			break;
+		}
+		cursor->offset += chunk;
+		length += chunk;
+	}
+
+	spi_flash_power_down();
+	#endif
+
+	return length;
+}
+
+log_store_t const *log_store_get(void)
+{
+	return &log_store;
+}
+
+/// @} APP
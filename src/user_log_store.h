@@ -0,0 +1,243 @@
+/**
+ ****************************************************************************************
+ * @file user_log_store.h
+ * @brief Timestamped sensor samples batched in RAM and appended to SPI flash as
+ *        page-sized, CRC-protected blocks in a wear-levelled ring.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_LOG_STORE_H_
+#define _USER_LOG_STORE_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// Block layout, one block per flash page:
+// [magic (2), version, count, seq (4), base_ms (4), boot (2), crc (2), count x [dt_ms (2), mv (2)]]
+#define LOG_STORE_MAGIC          0x4C47U
+#define LOG_STORE_VERSION        1U
+#define LOG_STORE_PAGE_SIZE      256U
+#define LOG_STORE_HEADER_SIZE    16U
+#define LOG_STORE_SAMPLE_SIZE    4U
+#define LOG_STORE_MAX_SAMPLES    ((LOG_STORE_PAGE_SIZE - LOG_STORE_HEADER_SIZE) / LOG_STORE_SAMPLE_SIZE)
+
+// Ring at LOG_STORE_FLASH_ADDR (user_periph_setup.h), erased one sector at a time
+#define LOG_STORE_SECTOR_SIZE    4096U
+#define LOG_STORE_PAGES_PER_SECTOR (LOG_STORE_SECTOR_SIZE / LOG_STORE_PAGE_SIZE)
+#define LOG_STORE_NO_SECTOR      0xFFFFU
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Decoded block header
+typedef struct
+{
+    uint8_t count;              ///< Samples in the block, 1 to LOG_STORE_MAX_SAMPLES
+    uint32_t seq;               ///< Block sequence number, grows by one per block
+    uint32_t base_ms;           ///< Time of the first sample in ms since boot
+    uint16_t boot;              ///< Boot the block was recorded in, base_ms restarts at each boot
+} log_store_block_t;
+
+/// Log state, kept in retention RAM
+typedef struct
+{
+    bool ready;                 ///< Flash answered and the ring was scanned
+    uint16_t boot;              ///< Boot number stamped on blocks written by this boot
+    uint16_t head;              ///< Page the next block is programmed into
+    uint16_t tail_sector;       ///< Sector holding the oldest block
+    uint16_t erased_sector;     ///< Sector known blank ahead of the head, LOG_STORE_NO_SECTOR after boot
+    bool waiting;               ///< Buffered block waits for log_store_prepare() to erase its sector
+    uint32_t first_seq;         ///< Oldest block in flash, equals next_seq while the ring is empty
+    uint32_t next_seq;          ///< Sequence number of the next block
+    uint8_t count;              ///< Samples buffered in RAM for the next block
+    uint32_t base_ms;           ///< Time of the first buffered sample
+    uint32_t last_ms;           ///< Time of the newest buffered sample
+    uint32_t now_ms;            ///< Milliseconds since boot, extended from the timebase
+    uint32_t now_us;            ///< Timebase stamp now_ms was last advanced to
+    uint16_t rem_us;            ///< Microseconds not yet carried into now_ms
+    uint16_t writes;            ///< Blocks programmed since boot
+    uint16_t erases;            ///< Sectors erased since boot
+    uint16_t skipped;           ///< Pages skipped because they were not blank
+    uint16_t failed;            ///< Blocks dropped after a flash error
+    uint16_t dropped;           ///< Samples dropped while a full block waited for its sector
+} log_store_t;
+
+/// Read position for streaming blocks out of the ring
+typedef struct
+{
+    uint32_t seq;               ///< Block being read, or the oldest one still wanted
+    uint16_t page;              ///< Page of that block, or where the search for it continues
+    uint16_t offset;            ///< Next byte of the block to read
+    uint16_t length;            ///< Used bytes of the block, 0 until it has been found and checked
+    uint32_t chunk_seq;         ///< Block of the first byte returned by the last log_store_read()
+    uint16_t chunk_offset;      ///< Offset of that byte within its block
+} log_store_cursor_t;
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Detect the flash and recover the ring position.
+ *
+ * @return true if the flash answered, whether or not the ring held any blocks.
+ *
+ * @details
+ *  - Fast recovery: only the first page of every sector is checked to find the newest and
+ *    the oldest sector, then the newest sector is scanned page by page for the last valid
+ *    block. Blocks within a sector are always contiguous from its first page.
+ *  - A block counts only with the magic, a valid count and a matching CRC, so a page torn
+ *    by a reset is ignored and the samples buffered in RAM at that time are lost.
+ *  - Blocks written after this call are stamped with the newest boot number plus one.
+ *  - The flash is put back into power-down afterwards.
+ ****************************************************************************************
+ */
+bool log_store_init(void);
+
+/**
+ ****************************************************************************************
+ * @brief Buffer one sample and program the block once it fills a page.
+ *
+ * @param[in] time_us  Timebase stamp of the sample (timebase_now_us()).
+ * @param[in] mv       Sample in millivolts.
+ *
+ * @details
+ *  - Samples are kept in RAM until LOG_STORE_MAX_SAMPLES are buffered, so the flash sees
+ *    one page program per block. A gap too long for the 16-bit delta closes the block early.
+ *  - While a full block waits for log_store_prepare() to erase its sector, new samples are
+ *    dropped and counted.
+ *  - Advances log_store_clock() to the sample time.
+ ****************************************************************************************
+ */
+void log_store_append(uint32_t time_us, uint16_t mv);
+
+/**
+ ****************************************************************************************
+ * @brief Advance the log clock.
+ *
+ * @param[in] time_us  Current timebase stamp (timebase_now_us()).
+ * @return Milliseconds since boot.
+ *
+ * @details The timebase wraps every 71.6 minutes, so it is extended here into the 32-bit
+ *          millisecond count stamped on the blocks. Calls must be less than a wrap apart,
+ *          also while logging is off.
+ ****************************************************************************************
+ */
+uint32_t log_store_clock(uint32_t time_us);
+
+/**
+ ****************************************************************************************
+ * @brief Program the buffered samples as a partial block.
+ *
+ * @details
+ *  - Used before logging stops or the supply goes away. Does nothing if the buffer is empty.
+ *  - Never erases: blocks only for the page program and read-back. A block that starts a
+ *    sector log_store_prepare() has not erased yet stays buffered (log_store_t::waiting)
+ *    and is programmed by the next log_store_prepare().
+ *  - A page that is not blank (e.g. torn by a reset) is skipped by moving on to the next
+ *    sector. A failed program or read-back moves on once more, if that sector is already
+ *    erased, before the block is dropped.
+ ****************************************************************************************
+ */
+void log_store_flush(void);
+
+/**
+ ****************************************************************************************
+ * @brief Check whether log_store_prepare() has a sector to erase.
+ * @return true once the head has entered the sector before the one erased last.
+ ****************************************************************************************
+ */
+bool log_store_erase_pending(void);
+
+/**
+ ****************************************************************************************
+ * @brief Erase the sector after the head ahead of time and program a block waiting for it.
+ *
+ * @details
+ *  - Wear levelling: blocks are appended page by page around the ring, and the sector
+ *    after the head's is erased as soon as the head enters a sector. That drops the oldest
+ *    sector, so every sector is erased once per trip around the ring and the ring holds
+ *    one sector less than the flash area.
+ *  - A sector that is already blank (fresh flash, or erased before a reboot) is only read.
+ *  - A sector erase takes up to about 240 ms on the MX25R. Call from an idle task, not from
+ *    the sampling path or while the supply is low.
+ ****************************************************************************************
+ */
+void log_store_prepare(void);
+
+/**
+ ****************************************************************************************
+ * @brief Position a cursor on a block.
+ *
+ * @param[in]  seq     Block to start from. Older blocks start at the oldest one still in flash.
+ * @param[out] cursor  Cursor to set up.
+ * @return false if the flash did not answer at boot.
+ *
+ * @details Checks the first page of each sector from the tail onwards and keeps the last
+ *          one that starts at or before seq, so the block is found within one sector.
+ ****************************************************************************************
+ */
+bool log_store_seek(uint32_t seq, log_store_cursor_t *cursor);
+
+/**
+ ****************************************************************************************
+ * @brief Copy the next bytes of the log into a buffer.
+ *
+ * @param[in,out] cursor  Cursor set up by log_store_seek().
+ * @param[out]    data    Destination.
+ * @param[in]     max     Space in data.
+ * @return Number of bytes copied, 0 once the cursor has reached the newest block.
+ *
+ * @details
+ *  - Blocks are copied back to back, header included and the unused tail of each page left
+ *    out, so the reader splits them with the sample count of each header and checks each
+ *    one with its CRC. cursor->chunk_seq and cursor->chunk_offset give the position of the
+ *    first byte copied.
+ *  - Each block's CRC is checked before its first byte is copied. Pages that fail are
+ *    stepped over, so gaps left by skipped pages cost nothing.
+ *  - If logging has erased the cursor's sector since the last call, reading restarts at the
+ *    oldest block, with chunk_offset 0.
+ *  - Samples still buffered in RAM are not included, see log_store_flush().
+ ****************************************************************************************
+ */
+uint16_t log_store_read(log_store_cursor_t *cursor, uint8_t *data, uint16_t max);
+
+/**
+ ****************************************************************************************
+ * @brief Log state.
+ * @return Pointer to the retained log state.
+ ****************************************************************************************
+ */
+log_store_t const *log_store_get(void);
+
+/// @} APP
+
+#endif // _USER_LOG_STORE_H_
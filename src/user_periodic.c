@@ -0,0 +1,223 @@
+/**
+ ****************************************************************************************
+ * @file user_periodic.c
+ * @brief Drift-free periodic tasks sharing one tickless wake-up.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h" // SW configuration
+#include "user_periodic.h"
+#include "user_timebase.h"
+
+// For debugging
+#include "arch_console.h"
+
+/*
+----------------------------------
+- Retained / Global variables
+----------------------------------
+*/
+
+// These variables are retained across sleep cycles
+
+periodic_task_t *periodic_tasks[PERIODIC_MAX_TASKS] __SECTION_ZERO("retention_mem_area0"); // registered tasks in dispatch order
+periodic_stats_t periodic_stats __SECTION_ZERO("retention_mem_area0");
+bool periodic_dispatching __SECTION_ZERO("retention_mem_area0"); // timer is re-armed once after dispatch
+
+/*
+ ****************************************************************************************
+ * LOCAL FUNCTIONS
+ ****************************************************************************************
+*/
+
+static void periodic_schedule(void)
+{
+	uint32_t now_us = timebase_now_us();
+	bool any = false;
+	int32_t wake_in_us = 0;
+	
+	// Latest wake-up that still serves every task inside its window
+	for (uint8_t i = 0; i < PERIODIC_MAX_TASKS; i++)
+	{
+		periodic_task_t const *task = periodic_tasks[i];
+		if (task == NULL || !task->active)
+		{
+			continue;
+		}
+		
+		int32_t in_us = (int32_t)(task->deadline_us + task->slack_us - now_us);
+		if (!any || in_us < wake_in_us)
+		{
+			wake_in_us = in_us;
+			any = true;
+		}
+	}
+	
+	if (periodic_stats.timer != EASY_TIMER_INVALID_TIMER) // prevents cancel when timer does not exist
+	{
+		app_easy_timer_cancel(periodic_stats.timer);
+		periodic_stats.timer = EASY_TIMER_INVALID_TIMER;
+	}
+	
+	if (!any)
+	{
+		return; // nothing scheduled, no wake-up needed
+	}
+	
+	// Round to the nearest tick, the kernel timer needs at least one tick
+	uint32_t ticks = (wake_in_us > 0) ? (((uint32_t)wake_in_us + (PERIODIC_TICK_US >> 1)) / PERIODIC_TICK_US) : 0;
+	periodic_stats.timer = app_easy_timer((ticks == 0) ? 1 : ticks, periodic_timer_cb);
+}
+
+static uint8_t periodic_advance(periodic_task_t *task, uint32_t now_us)
+{
+	uint8_t periods = 1;
+	
+	// Lateness of this run, negative when run early inside the slack window
+	int32_t late_us = (int32_t)(now_us - task->deadline_us);
+	if (late_us > 0 && (uint32_t)late_us > task->max_late_us)
+	{
+		task->max_late_us = (uint32_t)late_us;
+	}
+	
+	// Next deadline follows the absolute schedule, skip the ones already missed
+	task->deadline_us += task->period_us;
+	while ((int32_t)(task->deadline_us + task->slack_us - now_us) < 0)
+	{
+		task->deadline_us += task->period_us;
+		task->overruns++;
+		if (periods < UINT8_MAX)
+		{
+			periods++;
+		}
+	}
+	
+	task->runs++;
+	
+	#ifdef CFG_PRINTF
+	if (periods > 1)
+	{
+		arch_printf("[PERIODIC] Overrun, %u periods skipped (%u in total) \n\r", periods - 1, task->overruns);
+	}
+	#endif
+	
+	return periods;
+}
+
+/*
+ ****************************************************************************************
+ * PERIODIC TASK FUNCTIONS
+ ****************************************************************************************
+*/
+
+bool periodic_task_start(periodic_task_t *task, uint16_t period_ticks, uint16_t slack_ticks, periodic_callback_t callback)
+{
+	int8_t slot = -1;
+	
+	// Find the task or the first free slot
+	for (uint8_t i = 0; i < PERIODIC_MAX_TASKS; i++)
+	{
+		if (periodic_tasks[i] == task)
+		{
+			slot = i;
+			break;
+		}
+		if (periodic_tasks[i] == NULL && slot < 0)
+		{
+			slot = i;
+		}
+	}
+	
+	if (slot < 0)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[PERIODIC] No free task slot \n\r");
+		#endif
+		
+		return false;
+	}
+	
+	periodic_tasks[slot] = task;
+	
+	task->callback = callback;
+	task->period_us = (uint32_t)period_ticks * PERIODIC_TICK_US;
+	task->slack_us = (uint32_t)slack_ticks * PERIODIC_TICK_US;
+	task->deadline_us = timebase_now_us() + task->period_us;
+	task->runs = 0;
+	task->overruns = 0;
+	task->max_late_us = 0;
+	task->active = true;
+	
+	// A task started from a callback is picked up when the dispatch re-arms the timer
+	if (!periodic_dispatching)
+	{
+		periodic_schedule();
+	}
+	
+	return true;
+}
+
+void periodic_task_stop(periodic_task_t *task)
+{
+	task->active = false;
+	
+	if (!periodic_dispatching)
+	{
+		periodic_schedule();
+	}
+}
+
+bool periodic_task_is_running(periodic_task_t const *task)
+{
+	return task->active;
+}
+
+void periodic_timer_cb(void)
+{
+	// Timer has expired, its handle is no longer valid
+	periodic_stats.timer = EASY_TIMER_INVALID_TIMER;
+	periodic_stats.wakeups++;
+	periodic_dispatching = true;
+	
+	uint32_t now_us = timebase_now_us();
+	
+	for (uint8_t i = 0; i < PERIODIC_MAX_TASKS; i++)
+	{
+		periodic_task_t *task = periodic_tasks[i];
+		if (task == NULL || !task->active)
+		{
+			continue;
+		}
+		
+		// Window opens slack before the deadline, half a tick covers the timer rounding
+		if ((int32_t)(task->deadline_us - task->slack_us - now_us) > (int32_t)(PERIODIC_TICK_US >> 1))
+		{
+			continue;
+		}
+		
+		uint8_t periods = periodic_advance(task, now_us);
+		periodic_stats.dispatches++;
+		task->callback(periods);
+	}
+	
+	periodic_dispatching = false;
+	
+	// One wake-up for whatever is due next
+	periodic_schedule();
+}
+
+periodic_stats_t const *periodic_get_stats(void)
+{
+	return &periodic_stats;
+}
+
+/// @} APP
@@ -0,0 +1,152 @@
+/**
+ ****************************************************************************************
+ * @file user_periodic.h
+ * @brief Drift-free periodic tasks sharing one tickless wake-up.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_PERIODIC_H_
+#define _USER_PERIODIC_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// For timer_hnd
+#include "app_easy_timer.h"
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// app_easy_timer() delays are in 10 ms ticks
+#define PERIODIC_TICK_US 10000U
+
+// Number of tasks that can share the wake-up timer
+#define PERIODIC_MAX_TASKS 8
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Task body, periods is 1 normally and more after an overrun
+typedef void (*periodic_callback_t)(uint8_t periods);
+
+/// Periodic task scheduled against absolute deadlines on the BLE timebase
+typedef struct
+{
+    periodic_callback_t callback; ///< Task body
+    bool active;                  ///< Task is scheduled
+    uint32_t period_us;           ///< Task period in microseconds
+    uint32_t slack_us;            ///< Task may run this much before or after its deadline
+    uint32_t deadline_us;         ///< Timebase deadline of the next run
+    uint32_t runs;                ///< Periods run since the task was started
+    uint16_t overruns;            ///< Periods skipped because the task ran a full period late
+    uint32_t max_late_us;         ///< Largest lateness of a run behind its deadline
+} periodic_task_t;
+
+/// Wake-up statistics shared by every task
+typedef struct
+{
+    timer_hnd timer;              ///< Pending easy timer, EASY_TIMER_INVALID_TIMER when idle
+    uint32_t wakeups;             ///< Timer expiries since boot
+    uint32_t dispatches;          ///< Task runs since boot, dispatches / wakeups is the coalescing gain
+} periodic_stats_t;
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Start a periodic task, the first run is one period from now.
+ *
+ * @param[in,out] task          Task state, must live in retention RAM.
+ * @param[in]     period_ticks  Period in 10 ms timer ticks.
+ * @param[in]     slack_ticks   Window in 10 ms ticks, either side of each deadline, in which
+ *                              the task may run so it can share another task's wake-up.
+ * @param[in]     callback      Task body.
+ * @return false if PERIODIC_MAX_TASKS other tasks are already registered.
+ *
+ * @details The first start registers the task; tasks are dispatched in registration order
+ *          when they share a wake-up. Restarting a running task restarts its schedule and
+ *          clears its statistics.
+ * @sa periodic_task_stop
+ ****************************************************************************************
+ */
+bool periodic_task_start(periodic_task_t *task, uint16_t period_ticks, uint16_t slack_ticks, periodic_callback_t callback);
+
+/**
+ ****************************************************************************************
+ * @brief Stop a periodic task.
+ *
+ * @param[in,out] task  Task state.
+ *
+ * @details Safe to call from any task callback, including the task's own.
+ ****************************************************************************************
+ */
+void periodic_task_stop(periodic_task_t *task);
+
+/**
+ ****************************************************************************************
+ * @brief Check whether a periodic task is scheduled.
+ *
+ * @param[in] task  Task state.
+ * @return true if the task is active.
+ ****************************************************************************************
+ */
+bool periodic_task_is_running(periodic_task_t const *task);
+
+/**
+ ****************************************************************************************
+ * @brief Wake-up timer callback, dispatches every task inside its window.
+ *
+ * @details
+ *  - Every active task whose window [deadline - slack, deadline + slack] has opened is run,
+ *    in registration order, so jobs with compatible windows share one active period.
+ *  - A task's next deadline is its previous deadline plus one period, so callback latency,
+ *    execution time, UART prints and running early or late inside the slack never shift
+ *    its phase.
+ *  - If a whole period was missed (e.g., a long flash operation), the missed deadlines are
+ *    skipped and counted in periodic_task_t::overruns instead of firing back-to-back.
+ *  - Only one easy timer is ever pending. It is armed for the earliest deadline + slack
+ *    over all tasks (tickless), rounded to the nearest 10 ms tick.
+ *
+ * @sa timebase_now_us, app_easy_timer
+ ****************************************************************************************
+ */
+void periodic_timer_cb(void);
+
+/**
+ ****************************************************************************************
+ * @brief Wake-up statistics.
+ *
+ * @return Pointer to the retained wake-up and dispatch counters.
+ ****************************************************************************************
+ */
+periodic_stats_t const *periodic_get_stats(void);
+
+/// @} APP
+
+#endif // _USER_PERIODIC_H_
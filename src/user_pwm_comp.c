@@ -0,0 +1,116 @@
+/**
+ ****************************************************************************************
+ * @file user_pwm_comp.c
+ * @brief Division-free battery compensation of the PWM bias pulse width.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "user_pwm_comp.h"
+
+/*
+ ****************************************************************************************
+ * LOCAL FUNCTIONS
+ ****************************************************************************************
+*/
+
+static uint32_t pwm_comp_divide(pwm_comp_t const *comp, uint32_t numerator)
+{
+	// Estimate is floor(numerator / denominator) or one less, fix it with one multiply-compare
+	uint32_t quotient = (uint32_t)(((uint64_t)numerator * comp->reciprocal) >> 32);
+	if (numerator - quotient * comp->denominator >= comp->denominator)
+	{
+		quotient++;
+	}
+
+	return quotient;
+}
+
+/*
+ ****************************************************************************************
+ * PWM COMPENSATION FUNCTIONS
+ ****************************************************************************************
+*/
+
+bool pwm_comp_set_vbat(pwm_comp_t *comp, uint16_t vbat_mv)
+{
+	if (vbat_mv < PWM_COMP_MIN_VBAT_MV)
+	{
+		comp->vbat_mv = 0;
+		return false;
+	}
+
+	if (vbat_mv != comp->vbat_mv)
+	{
+		comp->vbat_mv = vbat_mv;
+		comp->denominator = 7U * vbat_mv;
+		comp->reciprocal = 0xFFFFFFFFU / comp->denominator;
+	}
+
+	return true;
+}
+
+bool pwm_comp_ready(pwm_comp_t const *comp)
+{
+	return (comp->vbat_mv != 0);
+}
+
+uint32_t pwm_comp_pulse_width(pwm_comp_t const *comp, int16_t target_mv, uint32_t period_count)
+{
+	// Work on the magnitude so the quotient truncates toward zero like the signed division did
+	uint32_t magnitude = (target_mv < 0) ? (uint32_t)(-(int32_t)target_mv) : (uint32_t)target_mv;
+	uint32_t numerator = 5U * magnitude * period_count;
+	uint32_t quotient = pwm_comp_divide(comp, numerator);
+
+	int32_t second_term = (target_mv < 0) ? -(int32_t)quotient : (int32_t)quotient;
+	int32_t pulse_width_raw = (int32_t)(period_count >> 1) - second_term;
+
+	// Clamp pulse width as safety, not using CLAMP macro due to uint and int comparison
+	if (pulse_width_raw < 0)
+	{
+		return 0;
+	}
+	if (pulse_width_raw > (int32_t)period_count)
+	{
+		return period_count;
+	}
+
+	return (uint32_t)pulse_width_raw;
+}
+
+uint32_t pwm_comp_pulse_width_q8(pwm_comp_t const *comp, int16_t target_mv, uint32_t period_count)
+{
+	uint32_t magnitude = (target_mv < 0) ? (uint32_t)(-(int32_t)target_mv) : (uint32_t)target_mv;
+	uint32_t numerator = 5U * magnitude * period_count;
+	uint32_t quotient = pwm_comp_divide(comp, numerator);
+
+	// The fraction comes from the remainder, which stays below 2^31 after scaling by 2^8
+	uint32_t remainder = numerator - quotient * comp->denominator;
+	uint32_t fraction = pwm_comp_divide(comp, remainder << PWM_COMP_FRAC_BITS);
+	int32_t second_term_q8 = (int32_t)((quotient << PWM_COMP_FRAC_BITS) + fraction);
+
+	// Half a period is exact in Q8, an odd period keeps its half count
+	int32_t half_period_q8 = (int32_t)(period_count << (PWM_COMP_FRAC_BITS - 1U));
+	int32_t pulse_width_q8 = (target_mv < 0) ? (half_period_q8 + second_term_q8) : (half_period_q8 - second_term_q8);
+
+	if (pulse_width_q8 < 0)
+	{
+		return 0;
+	}
+	if (pulse_width_q8 > (int32_t)(period_count << PWM_COMP_FRAC_BITS))
+	{
+		return period_count << PWM_COMP_FRAC_BITS;
+	}
+
+	return (uint32_t)pulse_width_q8;
+}
+
+/// @} APP
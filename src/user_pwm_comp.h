@@ -0,0 +1,126 @@
+/**
+ ****************************************************************************************
+ * @file user_pwm_comp.h
+ * @brief Division-free battery compensation of the PWM bias pulse width.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_PWM_COMP_H_
+#define _USER_PWM_COMP_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+// No SDK headers so a host-side check can build the same source
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// VBAT readings below this are treated as invalid, the compensation divisor would be near zero
+#define PWM_COMP_MIN_VBAT_MV 100U
+
+// Fractional bits of the dithered pulse width, 1/256 of a timer count
+#define PWM_COMP_FRAC_BITS 8U
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Compensation state derived from one VBAT sample
+typedef struct
+{
+    uint16_t vbat_mv;           ///< VBAT the reciprocal was built for, 0 while no valid sample
+    uint32_t denominator;       ///< 7 * vbat_mv
+    uint32_t reciprocal;        ///< floor((2^32 - 1) / denominator)
+} pwm_comp_t;
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Rebuild the cached reciprocal for a new VBAT sample.
+ *
+ * @param[in,out] comp     Compensation state.
+ * @param[in]     vbat_mv  Battery voltage in mV.
+ * @return true if the sample is usable (at least PWM_COMP_MIN_VBAT_MV).
+ *
+ * @details The only division of the compensation path. Called when a VBAT sample leaves
+ *          the update deadband, an unchanged voltage keeps the existing reciprocal.
+ ****************************************************************************************
+ */
+bool pwm_comp_set_vbat(pwm_comp_t *comp, uint16_t vbat_mv);
+
+/**
+ ****************************************************************************************
+ * @brief Check whether a valid VBAT sample has been loaded.
+ *
+ * @param[in] comp  Compensation state.
+ * @return true once pwm_comp_set_vbat() accepted a sample.
+ ****************************************************************************************
+ */
+bool pwm_comp_ready(pwm_comp_t const *comp);
+
+/**
+ ****************************************************************************************
+ * @brief Pulse width that produces a bias at the cached VBAT.
+ *
+ * @param[in] comp          Compensation state, must be ready.
+ * @param[in] target_mv     Bias target, -1000 to 1000 mV.
+ * @param[in] period_count  PWM period in timer counts (2 to 16383).
+ * @return period_count / 2 - 5 * target_mv * period_count / (7 * vbat_mv), truncated toward
+ *         zero like C division and clamped to 0..period_count.
+ *
+ * @details The quotient is estimated with one 32x32 to 64-bit multiply by the reciprocal
+ *          and a shift. The estimate is the exact quotient or one less for any numerator
+ *          below 2^31, so a single multiply-compare correction makes the result bit-exact
+ *          with the division it replaces.
+ ****************************************************************************************
+ */
+uint32_t pwm_comp_pulse_width(pwm_comp_t const *comp, int16_t target_mv, uint32_t period_count);
+
+/**
+ ****************************************************************************************
+ * @brief Pulse width with PWM_COMP_FRAC_BITS fractional bits, for dithering.
+ *
+ * @param[in] comp          Compensation state, must be ready.
+ * @param[in] target_mv     Bias target, -1000 to 1000 mV.
+ * @param[in] period_count  PWM period in timer counts (2 to 16383).
+ * @return (period_count / 2 - 5 * target_mv * period_count / (7 * vbat_mv)) * 2^8, with the
+ *         magnitude of the second term truncated to a 1/256 count and the result clamped
+ *         to 0..period_count * 2^8.
+ *
+ * @details Same multiply-by-reciprocal evaluation as pwm_comp_pulse_width(), applied a second
+ *          time to the remainder for the fractional bits. Unlike pwm_comp_pulse_width() the
+ *          half period of an odd period_count is not truncated.
+ * @sa pwm_comp_pulse_width
+ ****************************************************************************************
+ */
+uint32_t pwm_comp_pulse_width_q8(pwm_comp_t const *comp, int16_t target_mv, uint32_t period_count);
+
+/// @} APP
+
+#endif // _USER_PWM_COMP_H_
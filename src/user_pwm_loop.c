@@ -0,0 +1,135 @@
+/**
+ ****************************************************************************************
+ * @file user_pwm_loop.c
+ * @brief Fixed-point PI controller with anti-windup for the closed-loop PWM bias.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "user_pwm_loop.h"
+#include "user_gpadc_conv.h"
+
+/*
+ ****************************************************************************************
+ * LOCAL FUNCTIONS
+ ****************************************************************************************
+*/
+
+static int32_t pwm_loop_clamp(int32_t value, int32_t limit)
+{
+	if (value > limit)
+	{
+		return limit;
+	}
+	if (value < -limit)
+	{
+		return -limit;
+	}
+
+	return value;
+}
+
+/*
+ ****************************************************************************************
+ * PI CONTROLLER FUNCTIONS
+ ****************************************************************************************
+*/
+
+int32_t pwm_loop_bias_uv(uint32_t pin_uv, uint16_t ref_mv)
+{
+	// The pin stays below the 3.6 V ADC range, far inside int32_t
+	return (int32_t)pin_uv - (int32_t)ref_mv * 1000;
+}
+
+void pwm_loop_pi_init(pwm_loop_pi_t *pi, uint8_t kp_q8, uint8_t ki_q8, int32_t limit_uv)
+{
+	pi->kp_q8 = kp_q8;
+	pi->ki_q8 = ki_q8;
+	pi->limit_uv = limit_uv;
+	pi->integ_uv = 0;
+	pi->out_uv = 0;
+	pi->saturated = false;
+}
+
+int32_t pwm_loop_pi_step(pwm_loop_pi_t *pi, int32_t error_uv)
+{
+	error_uv = pwm_loop_clamp(error_uv, PWM_LOOP_MAX_ERROR_UV);
+
+	// Division rounds toward zero, so small errors of either sign give the same step size
+	int32_t p_uv = ((int32_t)pi->kp_q8 * error_uv) / 256;
+	int32_t i_step_uv = ((int32_t)pi->ki_q8 * error_uv) / 256;
+
+	// Conditional integration, a saturated output is not driven further into its limit
+	bool winding_up = pi->saturated && ((pi->out_uv > 0) == (i_step_uv > 0)) && (i_step_uv != 0);
+	if (!winding_up)
+	{
+		pi->integ_uv = pwm_loop_clamp(pi->integ_uv + i_step_uv, pi->limit_uv);
+	}
+
+	int32_t out_uv = p_uv + pi->integ_uv;
+	pi->out_uv = pwm_loop_clamp(out_uv, pi->limit_uv);
+	pi->saturated = (pi->out_uv != out_uv);
+
+	return pi->out_uv;
+}
+
+/*
+ ****************************************************************************************
+ * ZERO CALIBRATION FUNCTIONS
+ ****************************************************************************************
+*/
+
+void pwm_zcal_stats_add(pwm_zcal_stats_t *stats, int32_t uv)
+{
+	if (stats->count == 0)
+	{
+		stats->first_uv = uv;
+		stats->sum_uv = 0;
+		stats->sum_sq_uv = 0;
+	}
+
+	int32_t dev_uv = uv - stats->first_uv;
+	stats->sum_uv += dev_uv;
+	stats->sum_sq_uv += (uint64_t)((int64_t)dev_uv * dev_uv);
+	stats->count++;
+}
+
+uint16_t pwm_zcal_stats_result(pwm_zcal_stats_t const *stats, uint8_t log2_n, int32_t *mean_uv)
+{
+	int32_t n = 1 << log2_n;
+	int64_t sum = stats->sum_uv;
+
+	*mean_uv = stats->first_uv + stats->sum_uv / n;
+
+	// Sample variance of the burst means, divided by n again for the variance of their mean
+	uint64_t sum_sq_dev = stats->sum_sq_uv - (uint64_t)((sum * sum) >> log2_n);
+	uint64_t var_mean = sum_sq_dev / (uint64_t)((n - 1) * n);
+
+	return gpadc_isqrt((var_mean > 0xFFFFFFFFU) ? 0xFFFFFFFFU : (uint32_t)var_mean);
+}
+
+int32_t pwm_zcal_gain_q12(int32_t zero_uv, int32_t point_uv, int16_t point_mv)
+{
+	// Measured bias per target mV between the two points
+	return (int32_t)(((int64_t)(point_uv - zero_uv) * PWM_ZCAL_GAIN_Q12_ONE) / ((int32_t)point_mv * 1000));
+}
+
+uint8_t pwm_zcal_confidence(uint16_t stderr_uv, uint16_t max_stderr_uv)
+{
+	if (stderr_uv >= max_stderr_uv)
+	{
+		return 0;
+	}
+
+	return (uint8_t)(100U - (100U * stderr_uv) / max_stderr_uv);
+}
+
+/// @} APP
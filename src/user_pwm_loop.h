@@ -0,0 +1,167 @@
+/**
+ ****************************************************************************************
+ * @file user_pwm_loop.h
+ * @brief Fixed-point PI controller with anti-windup for the closed-loop PWM bias.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_PWM_LOOP_H_
+#define _USER_PWM_LOOP_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+// No SDK headers so a host-side check can build the same source
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// Errors are clamped to this before the gains, so a 255 gain times the error stays inside 32 bits
+#define PWM_LOOP_MAX_ERROR_UV 4000000
+
+// Calibrated gain of 1.0, measured bias per target mV in Q12
+#define PWM_ZCAL_GAIN_Q12_ONE 4096
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// PI controller state, all values in microvolts of bias
+typedef struct
+{
+    uint8_t kp_q8;              ///< Proportional gain, 1/256 steps (64 = 0.25)
+    uint8_t ki_q8;              ///< Integral gain per sample, 1/256 steps (128 = 0.5)
+    int32_t limit_uv;           ///< Output and integrator limit, either sign
+    int32_t integ_uv;           ///< Integrator
+    int32_t out_uv;             ///< Last output, proportional term plus integrator, clamped
+    bool saturated;             ///< Last output hit the limit
+} pwm_loop_pi_t;
+
+/// Running statistics of the bias bursts of one calibration point
+typedef struct
+{
+    uint8_t count;              ///< Bursts added
+    int32_t first_uv;           ///< First burst, the sums are taken relative to it
+    int32_t sum_uv;             ///< Sum of burst deviations from first_uv
+    uint64_t sum_sq_uv;         ///< Sum of squared burst deviations from first_uv
+} pwm_zcal_stats_t;
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Bias read on the feedback pin.
+ *
+ * @param[in] pin_uv  Feedback pin voltage in uV, as returned by the ADC conversion.
+ * @param[in] ref_mv  Virtual ground the bias is referenced to, BIAS_FB_REF_MV of the board.
+ * @return Bias in uV, negative below the virtual ground.
+ ****************************************************************************************
+ */
+int32_t pwm_loop_bias_uv(uint32_t pin_uv, uint16_t ref_mv);
+
+/**
+ ****************************************************************************************
+ * @brief Reset the controller with new gains.
+ *
+ * @param[out] pi        Controller state.
+ * @param[in]  kp_q8     Proportional gain in 1/256 steps.
+ * @param[in]  ki_q8     Integral gain per sample in 1/256 steps.
+ * @param[in]  limit_uv  Largest output magnitude in uV.
+ ****************************************************************************************
+ */
+void pwm_loop_pi_init(pwm_loop_pi_t *pi, uint8_t kp_q8, uint8_t ki_q8, int32_t limit_uv);
+
+/**
+ ****************************************************************************************
+ * @brief Run one controller sample.
+ *
+ * @param[in,out] pi        Controller state.
+ * @param[in]     error_uv  Setpoint minus measurement in uV.
+ * @return Controller output in uV, within +-limit_uv.
+ *
+ * @details
+ *  - out = kp * error + integ, with integ += ki * error on every sample.
+ *  - Anti-windup: the integrator is clamped to the limit, and a step that would push a
+ *    saturated output further into the limit is not integrated (conditional integration),
+ *    so the output leaves the limit as soon as the error changes sign.
+ *  - Integer math only, products of 8-bit gains and errors clamped to PWM_LOOP_MAX_ERROR_UV.
+ ****************************************************************************************
+ */
+int32_t pwm_loop_pi_step(pwm_loop_pi_t *pi, int32_t error_uv);
+
+/**
+ ****************************************************************************************
+ * @brief Add one burst to the statistics of a calibration point.
+ *
+ * @param[in,out] stats  Point statistics, a count of 0 starts a new point.
+ * @param[in]     uv     Burst mean of the feedback pin in uV.
+ *
+ * @details Deviations from the first burst keep the sums small and exact.
+ ****************************************************************************************
+ */
+void pwm_zcal_stats_add(pwm_zcal_stats_t *stats, int32_t uv);
+
+/**
+ ****************************************************************************************
+ * @brief Mean and standard error of a calibration point.
+ *
+ * @param[in]  stats    Point statistics with exactly 2^log2_n bursts, log2_n of 1 to 6.
+ * @param[in]  log2_n   Bursts per point as a power of two.
+ * @param[out] mean_uv  Mean of the bursts in uV, truncated toward first_uv.
+ * @return Standard error of the mean in uV, the sample standard deviation of the bursts
+ *         divided by sqrt(n), rounded down and saturated at 65535.
+ ****************************************************************************************
+ */
+uint16_t pwm_zcal_stats_result(pwm_zcal_stats_t const *stats, uint8_t log2_n, int32_t *mean_uv);
+
+/**
+ ****************************************************************************************
+ * @brief Gain of a channel from its two calibration points.
+ *
+ * @param[in] zero_uv   Bias measured at the 0 V target.
+ * @param[in] point_uv  Bias measured at the gain point.
+ * @param[in] point_mv  Target of the gain point, not 0.
+ * @return Measured bias per target mV in Q12 (PWM_ZCAL_GAIN_Q12_ONE is 1.0), truncated
+ *         toward zero.
+ ****************************************************************************************
+ */
+int32_t pwm_zcal_gain_q12(int32_t zero_uv, int32_t point_uv, int16_t point_mv);
+
+/**
+ ****************************************************************************************
+ * @brief Confidence in a calibration from its standard error.
+ *
+ * @param[in] stderr_uv      Standard error of the noisier point.
+ * @param[in] max_stderr_uv  Rejection limit, not 0.
+ * @return 100 at no noise, falling linearly to 0 at the limit and beyond, rounded down.
+ ****************************************************************************************
+ */
+uint8_t pwm_zcal_confidence(uint16_t stderr_uv, uint16_t max_stderr_uv);
+
+/// @} APP
+
+#endif // _USER_PWM_LOOP_H_
@@ -0,0 +1,135 @@
+/**
+ ****************************************************************************************
+ * @file user_pwm_plan.c
+ * @brief Timer2 PWM frequency planner, picks clock source, divider and pwm_div for a target
+ *        frequency and bias resolution.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "user_pwm_plan.h"
+
+/*
+ ****************************************************************************************
+ * LOCAL FUNCTIONS
+ ****************************************************************************************
+*/
+
+static uint16_t pwm_plan_min_div(uint16_t min_resolution_mv, uint16_t vbat_mv, uint8_t frac_bits, bool *met)
+{
+	*met = true;
+	
+	if (min_resolution_mv == 0)
+	{
+		return PWM_PLAN_MIN_DIV;
+	}
+	
+	// Smallest pwm_div with 7 * vbat / (5 * pwm_div * 2^frac_bits) <= min_resolution, kept in mV to fit 32 bits
+	uint32_t denominator = (5U * min_resolution_mv) << frac_bits;
+	uint32_t min_div = (7U * vbat_mv + denominator - 1U) / denominator;
+	
+	if (min_div < PWM_PLAN_MIN_DIV)
+	{
+		return PWM_PLAN_MIN_DIV;
+	}
+	if (min_div > PWM_PLAN_MAX_DIV)
+	{
+		*met = false;
+		return PWM_PLAN_MAX_DIV;
+	}
+	
+	return (uint16_t)min_div;
+}
+
+/*
+ ****************************************************************************************
+ * PWM PLANNER FUNCTIONS
+ ****************************************************************************************
+*/
+
+uint32_t pwm_plan_resolution_uv(uint16_t pwm_div, uint16_t vbat_mv, uint8_t frac_bits)
+{
+	uint32_t numerator = 7000U * vbat_mv;
+	uint32_t denominator = (5U * pwm_div) << frac_bits;
+	
+	return (numerator + denominator - 1U) / denominator;
+}
+
+bool pwm_plan_search(uint32_t target_hz, uint16_t min_resolution_mv, uint16_t vbat_mv, uint8_t frac_bits, pwm_plan_t *plan)
+{
+	if (target_hz == 0 || vbat_mv == 0)
+	{
+		return false;
+	}
+	
+	bool met;
+	uint16_t min_div = pwm_plan_min_div(min_resolution_mv, vbat_mv, frac_bits, &met);
+	
+	bool found = false;
+	uint64_t best_err = 0;
+	uint32_t best_input_hz = 0;
+	pwm_plan_t best = {0};
+	
+	// System clock first, so an equally good LP clock setting replaces it on the tie-break
+	for (uint8_t src = 0; src < 2; src++)
+	{
+		bool lp_clock = (src == 1);
+		
+		for (uint8_t clk_div = 0; clk_div <= PWM_PLAN_MAX_CLK_DIV; clk_div++)
+		{
+			uint32_t input_hz = (lp_clock ? PWM_PLAN_LP_CLK_HZ : PWM_PLAN_SYS_CLK_HZ) >> clk_div;
+			uint32_t nearest = input_hz / target_hz;
+			uint32_t candidates[3] = {nearest, nearest + 1U, min_div};
+			
+			for (uint8_t i = 0; i < 3; i++)
+			{
+				uint32_t div = candidates[i];
+				
+				if (div < min_div)
+				{
+					div = min_div;
+				}
+				if (div > PWM_PLAN_MAX_DIV)
+				{
+					div = PWM_PLAN_MAX_DIV;
+				}
+				
+				// Frequency error is err / div Hz, compared across candidates by cross-multiplying
+				uint64_t period_hz = (uint64_t)target_hz * div;
+				uint64_t err = (period_hz > input_hz) ? (period_hz - input_hz) : (input_hz - period_hz);
+				uint64_t lhs = err * best.pwm_div;
+				uint64_t rhs = best_err * div;
+				
+				bool better = !found || (lhs < rhs) ||
+				              ((lhs == rhs) && ((div > best.pwm_div) || ((div == best.pwm_div) && lp_clock && !best.lp_clock)));
+				
+				if (better)
+				{
+					found = true;
+					best_err = err;
+					best_input_hz = input_hz;
+					best.lp_clock = lp_clock;
+					best.clk_div = clk_div;
+					best.pwm_div = (uint16_t)div;
+				}
+			}
+		}
+	}
+	
+	best.freq_hz = (best_input_hz + (best.pwm_div >> 1)) / best.pwm_div;
+	best.resolution_uv = pwm_plan_resolution_uv(best.pwm_div, vbat_mv, frac_bits);
+	best.resolution_met = met;
+	*plan = best;
+	
+	return true;
+}
+
+/// @} APP
@@ -0,0 +1,112 @@
+/**
+ ****************************************************************************************
+ * @file user_pwm_plan.h
+ * @brief Timer2 PWM frequency planner, picks clock source, divider and pwm_div for a target
+ *        frequency and bias resolution.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_PWM_PLAN_H_
+#define _USER_PWM_PLAN_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+// No SDK headers so a host-side check can build the same source
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// Timer2 input clocks before the Timer0/2 divider, as used by timer2_pwm_set_frequency()
+#define PWM_PLAN_SYS_CLK_HZ 16000000U
+#define PWM_PLAN_LP_CLK_HZ  32000U
+
+// Datasheet range of pwm_div (counts per PWM period) and the Timer0/2 divider as a shift
+#define PWM_PLAN_MIN_DIV      2U
+#define PWM_PLAN_MAX_DIV      16383U
+#define PWM_PLAN_MAX_CLK_DIV  3U
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Timer2 setting chosen by the planner
+typedef struct
+{
+    bool lp_clock;              ///< true for TIM2_CLK_LP, false for TIM2_CLK_SYS
+    uint8_t clk_div;            ///< Timer0/2 divider as a shift, input clock / (1 << clk_div)
+    uint16_t pwm_div;           ///< Input clock counts per PWM period
+    uint32_t freq_hz;           ///< Achieved PWM frequency, rounded to the nearest Hz
+    uint32_t resolution_uv;     ///< Bias step of one pulse-width step at the planning VBAT, rounded up
+    bool resolution_met;        ///< resolution_uv is no coarser than the requested minimum
+} pwm_plan_t;
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Bias step of one pulse-width step.
+ *
+ * @param[in] pwm_div    Counts per PWM period (2 to 16383).
+ * @param[in] vbat_mv    Battery voltage in mV.
+ * @param[in] frac_bits  Fractional pulse-width bits, PWM_COMP_FRAC_BITS when dithering, else 0.
+ * @return 7 * vbat_mv / (5 * pwm_div * 2^frac_bits) in uV, rounded up.
+ *
+ * @details The slope of the compensation formula, bias = (period / 2 - pulse) * 7 * vbat / (5 * period).
+ ****************************************************************************************
+ */
+uint32_t pwm_plan_resolution_uv(uint16_t pwm_div, uint16_t vbat_mv, uint8_t frac_bits);
+
+/**
+ ****************************************************************************************
+ * @brief Search clock source, divider and pwm_div for a target frequency and resolution.
+ *
+ * @param[in]  target_hz          Requested PWM frequency in Hz.
+ * @param[in]  min_resolution_mv  Coarsest acceptable bias step in mV, 0 for no requirement.
+ * @param[in]  vbat_mv            Battery voltage the resolution is planned for.
+ * @param[in]  frac_bits          Fractional pulse-width bits, PWM_COMP_FRAC_BITS when dithering.
+ * @param[out] plan               Chosen setting.
+ * @return false if target_hz or vbat_mv is 0, plan is left untouched.
+ *
+ * @details
+ *  - Every clock source and divider (8 input clocks) is tried. The resolution sets a smallest
+ *    pwm_div; the candidates are that minimum and the two pwm_div values either side of
+ *    input / target_hz, all clamped to 2 to 16383.
+ *  - The candidate closest to target_hz wins. Errors are compared as exact fractions
+ *    |input - target_hz * pwm_div| / pwm_div by cross-multiplication, so no division or
+ *    rounding is involved. Ties go to the finer resolution, then to the LP clock, which lets
+ *    the PWM run in extended sleep.
+ *  - If no pwm_div reaches the resolution, the finest one (16383) is planned and
+ *    resolution_met is false.
+ *  - Integer math only, two divisions per input clock.
+ ****************************************************************************************
+ */
+bool pwm_plan_search(uint32_t target_hz, uint16_t min_resolution_mv, uint16_t vbat_mv, uint8_t frac_bits, pwm_plan_t *plan);
+
+/// @} APP
+
+#endif // _USER_PWM_PLAN_H_
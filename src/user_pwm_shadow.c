@@ -0,0 +1,462 @@
+/**
+ ****************************************************************************************
+ * @file user_pwm_shadow.c
+ * @brief Retained shadow copies of the Timer2 PWM registers, restored after extended sleep
+ *        and committed to the hardware at a safe point in the PWM period.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h" // SW configuration
+#include "datasheet.h"
+#include "user_pwm_shadow.h"
+#include "user_timebase.h"
+
+// For debugging
+#include "arch_console.h"
+
+#include <string.h>
+
+/*
+ ****************************************************************************************
+ * DEFINITIONS
+ ****************************************************************************************
+ */
+
+// One entry per Timer2 PWM output, the order defines the channel index
+static const pwm_channel_desc_t PWM_CHANNEL_DESC[PWM_CHANNEL_COUNT] =
+{
+	{TIM2_PWM_2, (volatile uint16_t *)PWM2_START_CYCLE, (volatile uint16_t *)PWM2_END_CYCLE},
+	{TIM2_PWM_3, (volatile uint16_t *)PWM3_START_CYCLE, (volatile uint16_t *)PWM3_END_CYCLE},
+	{TIM2_PWM_4, (volatile uint16_t *)PWM4_START_CYCLE, (volatile uint16_t *)PWM4_END_CYCLE},
+#if defined (__DA14531__)
+	{TIM2_PWM_5, (volatile uint16_t *)PWM5_START_CYCLE, (volatile uint16_t *)PWM5_END_CYCLE},
+	{TIM2_PWM_6, (volatile uint16_t *)PWM6_START_CYCLE, (volatile uint16_t *)PWM6_END_CYCLE},
+	{TIM2_PWM_7, (volatile uint16_t *)PWM7_START_CYCLE, (volatile uint16_t *)PWM7_END_CYCLE},
+#endif
+};
+
+static const uint32_t PWM_SYS_COUNTS_PER_US = 16U;        // 16 MHz system clock ahead of the Timer0/2 divider
+static const uint32_t PWM_COMMIT_GUARD_US = 24U;          // phase error plus sample to last write, test/test_pwm_shadow.c checks the budget
+static const uint32_t PWM_COMMIT_MAX_WAIT_US = 2000U;     // periods longer than this are not waited for
+static const uint32_t PWM_PHASE_MAX_AGE_US = 60000000U;   // phase estimate is dropped if not refreshed within 60 s
+
+/*
+----------------------------------
+- Retained / Global variables
+----------------------------------
+*/
+
+// These variables are retained across sleep cycles
+
+pwm_shadow_t pwm_shadow __SECTION_ZERO("retention_mem_area0");
+
+/*
+ ****************************************************************************************
+ * LOCAL FUNCTIONS
+ ****************************************************************************************
+*/
+
+static void pwm_shadow_apply_clock(void)
+{
+	tim0_2_clk_div_config_t clk_cfg =
+	{
+		.clk_div = (tim0_2_clk_div_t)pwm_shadow.clk_div
+	};
+
+	tim2_config_t tmr_cfg =
+	{
+		.clk_source = (tim2_clk_src_t)pwm_shadow.clk_src,
+		.hw_pause = TIM2_HW_PAUSE_OFF
+	};
+
+	timer0_2_clk_div_set(&clk_cfg);
+	timer2_config(&tmr_cfg);
+}
+
+static void pwm_shadow_write_staged(void)
+{
+	for (uint8_t i = 0; i < PWM_CHANNEL_COUNT; i++)
+	{
+		if (pwm_shadow.staged & (1U << i))
+		{
+			SetWord16(PWM_CHANNEL_DESC[i].start_reg, pwm_shadow.start[i]);
+			SetWord16(PWM_CHANNEL_DESC[i].end_reg, pwm_shadow.end[i]);
+		}
+	}
+
+	pwm_shadow.staged = 0;
+}
+
+static uint32_t pwm_shadow_counts_per_us(void)
+{
+	// Only the system clock runs in step with the BLE timebase, both come from XTAL32M while awake
+	if (pwm_shadow.clk_src != TIM2_CLK_SYS)
+	{
+		return 0;
+	}
+
+	return PWM_SYS_COUNTS_PER_US >> pwm_shadow.clk_div;
+}
+
+static void pwm_shadow_anchor(void)
+{
+	// Called right after timer2_start(), the counter starts a period from zero
+	pwm_shadow.anchor_us = timebase_now_us();
+	pwm_shadow.anchor_phase = 0;
+	pwm_shadow.anchored = (pwm_shadow_counts_per_us() != 0);
+}
+
+static bool pwm_shadow_phase(uint32_t *count)
+{
+	uint32_t counts_per_us = pwm_shadow_counts_per_us();
+
+	if (!pwm_shadow.running || !pwm_shadow.anchored || counts_per_us == 0)
+	{
+		return false;
+	}
+
+	uint32_t now_us = timebase_now_us();
+	uint32_t elapsed_us = now_us - pwm_shadow.anchor_us;
+
+	// An old anchor may be ambiguous across the timebase wrap, stop predicting until the next start
+	if (elapsed_us > PWM_PHASE_MAX_AGE_US)
+	{
+		pwm_shadow.anchored = false;
+		return false;
+	}
+
+	// Whole counts per microsecond keep the estimate exact, 60 s of counts still fit in 32 bits
+	uint32_t period = pwm_shadow_period();
+	uint32_t phase = pwm_shadow.anchor_phase + elapsed_us * counts_per_us;
+
+	// Polled back to back the anchor is less than a period old, skip the software division
+	if (phase >= period)
+	{
+		phase -= period;
+		if (phase >= period)
+		{
+			phase %= period;
+		}
+	}
+
+	pwm_shadow.anchor_us = now_us;
+	pwm_shadow.anchor_phase = (uint16_t)phase;
+	*count = phase;
+
+	return true;
+}
+
+static bool pwm_shadow_moved_edges(uint32_t *first, uint32_t *last)
+{
+	bool moved = false;
+
+	*first = UINT32_MAX;
+	*last = 0;
+
+	// Old and new position of every edge that changes, the counter must not sit between them
+	for (uint8_t i = 0; i < PWM_CHANNEL_COUNT; i++)
+	{
+		if (!(pwm_shadow.staged & (1U << i)))
+		{
+			continue;
+		}
+
+		uint16_t edges[4] =
+		{
+			GetWord16(PWM_CHANNEL_DESC[i].start_reg), pwm_shadow.start[i],
+			GetWord16(PWM_CHANNEL_DESC[i].end_reg), pwm_shadow.end[i]
+		};
+
+		for (uint8_t e = 0; e < 4; e++)
+		{
+			// Pairs are (old, new), an unchanged edge fires where it always did
+			if (edges[e] == edges[e ^ 1U])
+			{
+				continue;
+			}
+
+			moved = true;
+			if (edges[e] < *first)
+			{
+				*first = edges[e];
+			}
+			if (edges[e] > *last)
+			{
+				*last = edges[e];
+			}
+		}
+	}
+
+	return moved;
+}
+
+static bool pwm_shadow_runs_in_sleep(void)
+{
+	#ifdef CFG_PWM_RUN_IN_SLEEP
+	return (pwm_shadow.running && pwm_shadow.clk_src == TIM2_CLK_LP);
+	#else
+	return false;
+	#endif
+}
+
+/*
+ ****************************************************************************************
+ * PWM SHADOW FUNCTIONS
+ ****************************************************************************************
+*/
+
+bool pwm_channel_index(tim2_pwm_t channel, uint8_t *index)
+{
+	for (uint8_t i = 0; i < PWM_CHANNEL_COUNT; i++)
+	{
+		if (PWM_CHANNEL_DESC[i].channel == channel)
+		{
+			*index = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+pwm_channel_desc_t const *pwm_channel_desc(uint8_t index)
+{
+	return &PWM_CHANNEL_DESC[index];
+}
+
+void pwm_shadow_set_frequency(tim0_2_clk_div_t clk_div, tim2_clk_src_t clk_src, uint16_t frequency)
+{
+	pwm_shadow.clk_div = clk_div;
+	pwm_shadow.clk_src = clk_src;
+	pwm_shadow.frequency = frequency;
+	pwm_shadow.configured = true;
+
+	// Restart a running timer so its period starts from zero again and the phase stays known
+	if (pwm_shadow.running)
+	{
+		timer2_stop();
+	}
+
+	pwm_shadow_apply_clock();
+	SetWord16(TRIPLE_PWM_FREQUENCY, frequency);
+
+	if (pwm_shadow.running)
+	{
+		timer2_start();
+		pwm_shadow_anchor();
+	}
+}
+
+void pwm_shadow_stage_start(uint8_t index, uint16_t value)
+{
+	pwm_shadow.start[index] = value;
+	pwm_shadow.staged |= (1U << index);
+}
+
+void pwm_shadow_stage_end(uint8_t index, uint16_t value)
+{
+	pwm_shadow.end[index] = value;
+	pwm_shadow.staged |= (1U << index);
+}
+
+void pwm_shadow_commit(void)
+{
+	uint32_t count;
+	uint32_t first_edge;
+	uint32_t last_edge;
+
+	// Refresh the phase estimate even with nothing staged, so it never ages out while running
+	bool synced = pwm_shadow_phase(&count);
+
+	if (pwm_shadow.staged == 0)
+	{
+		return;
+	}
+
+	if (!pwm_shadow_moved_edges(&first_edge, &last_edge))
+	{
+		pwm_shadow.staged = 0;
+		return;
+	}
+
+	// A stopped timer has no edges to miss, write straight away
+	if (!pwm_shadow.running)
+	{
+		pwm_shadow_write_staged();
+		pwm_shadow.commits++;
+		return;
+	}
+
+	bool committed = false;
+
+	if (synced)
+	{
+		uint32_t counts_per_us = pwm_shadow_counts_per_us();
+		uint32_t period = pwm_shadow_period();
+		uint32_t period_us = (period + counts_per_us - 1U) / counts_per_us;
+		uint32_t guard = PWM_COMMIT_GUARD_US * counts_per_us;
+
+		// Safe counts ahead of every moved edge (just after the period boundary) and past all of them
+		// with the writes done before the wrap. A short period or edges spread over it leave none.
+		uint32_t ahead = (first_edge > guard) ? (first_edge - guard) : 0;
+		uint32_t behind = (period > last_edge + 1U + guard) ? (period - last_edge - 1U - guard) : 0;
+		bool window = (ahead >= counts_per_us || behind >= counts_per_us);
+
+		// Each window comes round once per period, two periods are enough to catch one
+		uint32_t wait_us = (window && period_us <= PWM_COMMIT_MAX_WAIT_US) ? (2U * period_us) : 0;
+		uint32_t start_us = timebase_now_us();
+
+		while (wait_us != 0 && !committed && (timebase_now_us() - start_us) <= wait_us)
+		{
+			GLOBAL_INT_DISABLE();
+			if (pwm_shadow_phase(&count) &&
+			    ((count + guard < first_edge) || (count > last_edge && count + guard < period)))
+			{
+				pwm_shadow_write_staged();
+				committed = true;
+
+				// Worst delay from the phase sample to the last write, must stay within the guard
+				uint32_t lag_us = timebase_now_us() - pwm_shadow.anchor_us;
+				if (lag_us > pwm_shadow.commit_lag_us)
+				{
+					pwm_shadow.commit_lag_us = (uint16_t)lag_us;
+				}
+			}
+			GLOBAL_INT_RESTORE();
+		}
+	}
+
+	if (!committed)
+	{
+		// No safe point in reach, at least switch every channel on the same timer count. Pausing
+		// would shift the phase estimate, so only an unsynced timer is paused.
+		GLOBAL_INT_DISABLE();
+		if (!synced)
+		{
+			timer2_set_sw_pause(TIM2_SW_PAUSE_ON);
+		}
+		pwm_shadow_write_staged();
+		if (!synced)
+		{
+			timer2_set_sw_pause(TIM2_SW_PAUSE_OFF);
+		}
+		GLOBAL_INT_RESTORE();
+
+		pwm_shadow.missed++;
+	}
+
+	pwm_shadow.commits++;
+}
+
+uint32_t pwm_shadow_period(void)
+{
+	return (uint32_t)pwm_shadow.frequency + 1U;
+}
+
+uint16_t pwm_shadow_start(uint8_t index)
+{
+	return pwm_shadow.start[index];
+}
+
+uint16_t pwm_shadow_end(uint8_t index)
+{
+	return pwm_shadow.end[index];
+}
+
+void pwm_shadow_run(bool running)
+{
+	bool was_running = pwm_shadow.running;
+
+	// A stopped timer takes the staged values directly
+	pwm_shadow_commit();
+	pwm_shadow.running = running;
+
+	if (running)
+	{
+		timer0_2_clk_enable();
+		timer2_start();
+
+		if (!was_running)
+		{
+			pwm_shadow_anchor();
+		}
+	}
+	else
+	{
+		timer2_stop();
+		timer0_2_clk_disable();
+	}
+}
+
+sleep_state_t pwm_shadow_sleep_level(void)
+{
+	#ifdef CFG_PWM_RUN_IN_SLEEP
+	if (pwm_shadow.clk_src == TIM2_CLK_LP)
+	{
+		return ARCH_EXT_SLEEP_ON;
+	}
+	#endif
+
+	return ARCH_SLEEP_OFF;
+}
+
+void pwm_shadow_going_to_sleep(void)
+{
+	// PD_TIM powers down with the SoC unless the PWM is meant to keep running
+	SetBits16(PMU_CTRL_REG, TIM_SLEEP, pwm_shadow_runs_in_sleep() ? 0 : 1);
+}
+
+void pwm_shadow_restore(void)
+{
+	// Nothing was ever written, the reset values are already correct
+	if (!pwm_shadow.configured)
+	{
+		return;
+	}
+
+	// A surviving frequency register means PD_TIM stayed up, rewriting would glitch the outputs
+	if (GetWord16(TRIPLE_PWM_FREQUENCY) == pwm_shadow.frequency)
+	{
+		return;
+	}
+
+	pwm_shadow_apply_clock();
+	SetWord16(TRIPLE_PWM_FREQUENCY, pwm_shadow.frequency);
+
+	for (uint8_t i = 0; i < PWM_CHANNEL_COUNT; i++)
+	{
+		SetWord16(PWM_CHANNEL_DESC[i].start_reg, pwm_shadow.start[i]);
+		SetWord16(PWM_CHANNEL_DESC[i].end_reg, pwm_shadow.end[i]);
+	}
+	pwm_shadow.staged = 0;
+
+	if (pwm_shadow.running)
+	{
+		timer0_2_clk_enable();
+		timer2_start();
+		pwm_shadow_anchor();
+	}
+
+	pwm_shadow.restores++;
+}
+
+pwm_shadow_t const *pwm_shadow_get(void)
+{
+	return &pwm_shadow;
+}
+
+void pwm_shadow_init(void)
+{
+	memset(&pwm_shadow, 0, sizeof(pwm_shadow));
+}
+
+/// @} APP
@@ -0,0 +1,280 @@
+/**
+ ****************************************************************************************
+ * @file user_pwm_shadow.h
+ * @brief Retained shadow copies of the Timer2 PWM registers, restored after extended sleep
+ *        and committed to the hardware at a safe point in the PWM period.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_PWM_SHADOW_H_
+#define _USER_PWM_SHADOW_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// For sleep_state_t
+#include "arch_api.h"
+
+// For Timer2 types
+#include "timer0_2.h"
+#include "timer2.h"
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// Timer2 PWM outputs, TIM2_PWM_2 to TIM2_PWM_7 on the DA14531 and TIM2_PWM_2 to TIM2_PWM_4
+// on the DA14585/586, indexed from 0 by every PWM table
+#if defined (__DA14531__)
+#define PWM_CHANNEL_COUNT 6
+#else
+#define PWM_CHANNEL_COUNT 3
+#endif
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Static description of one Timer2 PWM output
+typedef struct
+{
+    tim2_pwm_t channel;                     ///< SDK channel id
+    volatile uint16_t *start_reg;           ///< PWMx_START_CYCLE, rising edge
+    volatile uint16_t *end_reg;             ///< PWMx_END_CYCLE, falling edge
+} pwm_channel_desc_t;
+
+/// Latest value of every Timer2 PWM register, kept in retention RAM
+typedef struct
+{
+    uint8_t clk_div;                        ///< tim0_2_clk_div_t applied with the frequency
+    uint8_t clk_src;                        ///< tim2_clk_src_t applied with the frequency
+    bool configured;                        ///< Clock and frequency have been written at least once
+    bool running;                           ///< Timer2 input clock and outputs are on
+    uint16_t frequency;                     ///< TRIPLE_PWM_FREQUENCY, period count - 1
+    uint16_t start[PWM_CHANNEL_COUNT];      ///< PWMx_START_CYCLE, by channel index, staged or committed
+    uint16_t end[PWM_CHANNEL_COUNT];        ///< PWMx_END_CYCLE, by channel index, staged or committed
+    uint8_t staged;                         ///< Channels with START/END values not yet committed, bit per index
+    bool anchored;                          ///< anchor_us and anchor_phase track the Timer2 counter
+    uint16_t anchor_phase;                  ///< Timer2 count at anchor_us
+    uint32_t anchor_us;                     ///< BLE timebase time of the last phase estimate
+    uint16_t restores;                      ///< Wake-ups that found the registers lost and rewrote them
+    uint16_t commits;                       ///< Staged sets written to the registers
+    uint16_t missed;                        ///< Commits of a running PWM written outside a safe point in the period
+    uint16_t commit_lag_us;                 ///< Longest time from phase sample to last write of a safe-point commit
+} pwm_shadow_t;
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Channel index of an SDK PWM channel id.
+ *
+ * @param[in]  channel  TIM2_PWM_2 to TIM2_PWM_7.
+ * @param[out] index    Position of the channel in every PWM table.
+ * @return false if the channel has no table entry.
+ *
+ * @details Public entry points check the channel once here, the per-channel paths then
+ *          index the tables without branching on the channel.
+ ****************************************************************************************
+ */
+bool pwm_channel_index(tim2_pwm_t channel, uint8_t *index);
+
+/**
+ ****************************************************************************************
+ * @brief Descriptor of one PWM output.
+ *
+ * @param[in] index  Channel index, 0 to PWM_CHANNEL_COUNT - 1.
+ * @return Pointer into the constant channel table.
+ ****************************************************************************************
+ */
+pwm_channel_desc_t const *pwm_channel_desc(uint8_t index);
+
+/**
+ ****************************************************************************************
+ * @brief Set the Timer2 clock and PWM frequency.
+ *
+ * @param[in] clk_div    Timer0/2 input clock divider.
+ * @param[in] clk_src    Timer2 clock source (TIM2_CLK_SYS or TIM2_CLK_LP).
+ * @param[in] frequency  Value for TRIPLE_PWM_FREQUENCY (period count - 1).
+ *
+ * @details Writes the shadow and the hardware. START/END values are left as they are,
+ *          callers recompute them from the new period. A running timer is stopped and
+ *          restarted around the change, so the new period starts from a known phase.
+ ****************************************************************************************
+ */
+void pwm_shadow_set_frequency(tim0_2_clk_div_t clk_div, tim2_clk_src_t clk_src, uint16_t frequency);
+
+/**
+ ****************************************************************************************
+ * @brief Stage the START_CYCLE (rising edge) of one output.
+ *
+ * @param[in] index  Channel index from pwm_channel_index().
+ * @param[in] value  Timer count of the rising edge.
+ *
+ * @details Only the shadow is written, the register follows on pwm_shadow_commit().
+ ****************************************************************************************
+ */
+void pwm_shadow_stage_start(uint8_t index, uint16_t value);
+
+/**
+ ****************************************************************************************
+ * @brief Stage the END_CYCLE (falling edge) of one output.
+ *
+ * @param[in] index  Channel index from pwm_channel_index().
+ * @param[in] value  Timer count of the falling edge.
+ *
+ * @details Only the shadow is written, the register follows on pwm_shadow_commit().
+ ****************************************************************************************
+ */
+void pwm_shadow_stage_end(uint8_t index, uint16_t value);
+
+/**
+ ****************************************************************************************
+ * @brief Write every staged START/END pair to the hardware in one go.
+ *
+ * @details Timer2 takes new START/END values immediately, so a write while the counter sits
+ *          between an old and a new edge skips or repeats that edge for one period. The
+ *          DA14531 cannot read the Timer2 counter, so for a system-clocked PWM its phase is
+ *          predicted from the BLE timebase (both run from XTAL32M), anchored when the timer
+ *          starts. The commit waits, for at most two PWM periods, until the predicted count
+ *          is a guard of 24 us ahead of every moved edge or past all of them, then writes all
+ *          pairs with interrupts disabled. A stopped timer is written directly.
+ *
+ *          Without a usable phase (LP clock, period over 2 ms) or when the moved edges leave
+ *          no window wider than the guard, it does not wait: the pairs are still written
+ *          together, under the Timer2 software pause when unsynced, and the commit is counted
+ *          in missed. Calling it with nothing staged refreshes the phase estimate, which
+ *          expires after 60 s.
+ ****************************************************************************************
+ */
+void pwm_shadow_commit(void);
+
+/**
+ ****************************************************************************************
+ * @brief Period of the PWM in timer counts, from the shadow.
+ *
+ * @return TRIPLE_PWM_FREQUENCY + 1 as last written.
+ *
+ * @details Use this instead of reading TRIPLE_PWM_FREQUENCY, which reads back as its
+ *          reset value after extended sleep until the next restore.
+ ****************************************************************************************
+ */
+uint32_t pwm_shadow_period(void);
+
+/**
+ ****************************************************************************************
+ * @brief START_CYCLE of one output, from the shadow.
+ *
+ * @param[in] index  Channel index from pwm_channel_index().
+ * @return Last value staged, committed or not.
+ ****************************************************************************************
+ */
+uint16_t pwm_shadow_start(uint8_t index);
+
+/**
+ ****************************************************************************************
+ * @brief END_CYCLE of one output, from the shadow.
+ *
+ * @param[in] index  Channel index from pwm_channel_index().
+ * @return Last value staged, committed or not.
+ ****************************************************************************************
+ */
+uint16_t pwm_shadow_end(uint8_t index);
+
+/**
+ ****************************************************************************************
+ * @brief Turn the Timer2 input clock and the PWM outputs on or off.
+ *
+ * @param[in] running  true to start, false to stop.
+ *
+ * @details Wraps timer0_2_clk_enable()/timer2_start() and timer2_stop()/timer0_2_clk_disable()
+ *          so the restore knows whether to restart the outputs after sleep. Staged values are
+ *          committed first, and starting the timer anchors the phase estimate.
+ ****************************************************************************************
+ */
+void pwm_shadow_run(bool running);
+
+/**
+ ****************************************************************************************
+ * @brief Deepest sleep mode the running PWM tolerates.
+ *
+ * @return ARCH_EXT_SLEEP_ON if the PWM runs from TIM2_CLK_LP in a CFG_PWM_RUN_IN_SLEEP build,
+ *         ARCH_SLEEP_OFF otherwise.
+ *
+ * @details The system clock stops in extended sleep, so only an LP-clocked Timer2 in a
+ *          powered PD_TIM keeps its outputs toggling while the SoC sleeps.
+ * @sa pwm_shadow_going_to_sleep
+ ****************************************************************************************
+ */
+sleep_state_t pwm_shadow_sleep_level(void);
+
+/**
+ ****************************************************************************************
+ * @brief Prepare the timer power domain for sleep.
+ *
+ * @details Called from the app_going_to_sleep hook. Keeps PD_TIM powered (TIM_SLEEP = 0)
+ *          while an LP-clocked PWM is running in a CFG_PWM_RUN_IN_SLEEP build, and lets it
+ *          power down otherwise.
+ ****************************************************************************************
+ */
+void pwm_shadow_going_to_sleep(void);
+
+/**
+ ****************************************************************************************
+ * @brief Rewrite the Timer2 registers from the shadow if they were lost in sleep.
+ *
+ * @details Called from the app_resume_from_sleep hook. The frequency register is compared
+ *          with its shadow first; if it survived, PD_TIM stayed powered and nothing is
+ *          written, so a PWM that ran through sleep is not glitched. Otherwise clock,
+ *          frequency and every START/END value are written back and the outputs restarted
+ *          if they were running.
+ ****************************************************************************************
+ */
+void pwm_shadow_restore(void);
+
+/**
+ ****************************************************************************************
+ * @brief Shadow state, restore and commit counts.
+ *
+ * @return Pointer to the retained shadow.
+ ****************************************************************************************
+ */
+pwm_shadow_t const *pwm_shadow_get(void);
+
+/**
+ ****************************************************************************************
+ * @brief Clear the shadow.
+ *
+ * @details Called once from user_app_on_init(). Registers read as their reset value
+ *          (all zero) at that point.
+ ****************************************************************************************
+ */
+void pwm_shadow_init(void);
+
+/// @} APP
+
+#endif // _USER_PWM_SHADOW_H_
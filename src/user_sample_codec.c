@@ -0,0 +1,134 @@
+/**
+ ****************************************************************************************
+ * @file user_sample_codec.c
+ * @brief Compact encodings for the sensor sample stream and their reference decoder.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "user_sample_codec.h"
+
+/*
+ ****************************************************************************************
+ * LOCAL FUNCTIONS
+ ****************************************************************************************
+*/
+
+static uint8_t varint_put(uint32_t value, uint8_t *dst)
+{
+	uint8_t len = 0;
+
+	// 7 data bits per byte, MSB set when more bytes follow
+	while (value >= 0x80U)
+	{
+		dst[len++] = (uint8_t)(value | 0x80U);
+		value >>= 7;
+	}
+	dst[len++] = (uint8_t)value;
+
+	return len;
+}
+
+static uint8_t varint_get(uint8_t const *src, uint16_t len, uint32_t *value)
+{
+	uint32_t result = 0;
+
+	// Stop after SAMPLE_CODEC_MAX_LEN bytes so a corrupt payload cannot run on
+	for (uint8_t i = 0; i < SAMPLE_CODEC_MAX_LEN && i < len; i++)
+	{
+		result |= (uint32_t)(src[i] & 0x7FU) << (7U * i);
+		if (!(src[i] & 0x80U))
+		{
+			*value = result;
+			return i + 1;
+		}
+	}
+
+	return 0; // truncated or too long
+}
+
+/*
+ ****************************************************************************************
+ * SAMPLE CODEC FUNCTIONS
+ ****************************************************************************************
+*/
+
+uint8_t sample_codec_encode(sample_codec_t codec, uint16_t sample, uint16_t prev, bool keyframe, uint8_t *dst)
+{
+	if (codec == SAMPLE_CODEC_ZIGZAG_VARINT)
+	{
+		if (keyframe)
+		{
+			return varint_put(sample, dst);
+		}
+
+		// Zig-zag maps small negative and positive deltas to small unsigned values
+		int32_t delta = (int32_t)sample - (int32_t)prev;
+		uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+
+		return varint_put(zigzag, dst);
+	}
+
+	// SAMPLE_CODEC_RAW16, LSB first like the other notifications
+	dst[0] = (uint8_t)(sample & 0xFF);
+	dst[1] = (uint8_t)(sample >> 8);
+
+	return 2;
+}
+
+uint16_t sample_codec_decode(sample_codec_t codec, uint8_t const *src, uint16_t len, uint16_t count, uint16_t *dst)
+{
+	uint16_t pos = 0;
+	uint16_t decoded = 0;
+
+	while (decoded < count)
+	{
+		if (codec == SAMPLE_CODEC_ZIGZAG_VARINT)
+		{
+			uint32_t value;
+			uint8_t used = varint_get(&src[pos], len - pos, &value);
+			if (used == 0)
+			{
+				break;
+			}
+			pos += used;
+
+			if (decoded == 0)
+			{
+				dst[0] = (uint16_t)value; // keyframe
+			}
+			else
+			{
+				int32_t delta = (int32_t)(value >> 1) ^ -(int32_t)(value & 1U);
+				dst[decoded] = (uint16_t)((int32_t)dst[decoded - 1] + delta);
+			}
+		}
+		else if (codec == SAMPLE_CODEC_RAW16)
+		{
+			if (len - pos < 2)
+			{
+				break;
+			}
+			dst[decoded] = (uint16_t)(src[pos] | (src[pos + 1] << 8));
+			pos += 2;
+		}
+		else
+		{
+			break; // unknown encoding
+		}
+
+		decoded++;
+	}
+
+	return decoded;
+}
+
+/// @} APP
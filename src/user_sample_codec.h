@@ -0,0 +1,104 @@
+/**
+ ****************************************************************************************
+ * @file user_sample_codec.h
+ * @brief Compact encodings for the sensor sample stream and their reference decoder.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_SAMPLE_CODEC_H_
+#define _USER_SAMPLE_CODEC_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+// No SDK headers so the same source builds into the phone-side or host decoder
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// Largest encoded size of one sample in any encoding (varint of a 17-bit zig-zag delta)
+#define SAMPLE_CODEC_MAX_LEN 3
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Sample stream encodings, value is sent in the frame header
+typedef enum
+{
+    SAMPLE_CODEC_RAW16 = 0,         ///< Every sample as a little-endian uint16_t (2 bytes)
+    SAMPLE_CODEC_ZIGZAG_VARINT,     ///< Keyframe as varint, then zig-zag deltas as varint (1 to 3 bytes)
+    SAMPLE_CODEC_COUNT
+} sample_codec_t;
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Encode one sample.
+ *
+ * @param[in]  codec     Encoding to use.
+ * @param[in]  sample    Sample value.
+ * @param[in]  prev      Previous sample in the frame (ignored for keyframes).
+ * @param[in]  keyframe  true for the first sample of a frame, which is encoded without a delta.
+ * @param[out] dst       Output buffer, at least SAMPLE_CODEC_MAX_LEN bytes.
+ * @return Number of bytes written.
+ *
+ * @details
+ *  - SAMPLE_CODEC_RAW16 writes the sample LSB first.
+ *  - SAMPLE_CODEC_ZIGZAG_VARINT writes a keyframe as an unsigned varint of the sample and
+ *    every other sample as an unsigned varint of zigzag(sample - prev). Deltas within
+ *    +/-63 take 1 byte and within +/-8191 take 2 bytes.
+ *
+ * @note Every frame starts with a keyframe so frames decode independently and a lost
+ *       notification never corrupts the following ones.
+ * @sa sample_codec_decode
+ ****************************************************************************************
+ */
+uint8_t sample_codec_encode(sample_codec_t codec, uint16_t sample, uint16_t prev, bool keyframe, uint8_t *dst);
+
+/**
+ ****************************************************************************************
+ * @brief Reference decoder for one encoded frame payload.
+ *
+ * @param[in]  codec   Encoding from the frame header.
+ * @param[in]  src     Encoded payload (after the frame header).
+ * @param[in]  len     Payload length in bytes.
+ * @param[in]  count   Number of samples in the frame header.
+ * @param[out] dst     Output array for at least count samples.
+ * @return Number of samples decoded, less than count if the payload is truncated or malformed.
+ *
+ * @details Plain C without SDK dependencies, so the phone application or a host-side
+ *          round-trip check can build it unchanged.
+ * @sa sample_codec_encode
+ ****************************************************************************************
+ */
+uint16_t sample_codec_decode(sample_codec_t codec, uint8_t const *src, uint16_t len, uint16_t count, uint16_t *dst);
+
+/// @} APP
+
+#endif // _USER_SAMPLE_CODEC_H_
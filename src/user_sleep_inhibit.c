@@ -0,0 +1,196 @@
+/**
+ ****************************************************************************************
+ * @file user_sleep_inhibit.c
+ * @brief Reference-counted sleep inhibit shared by every subsystem that needs the SoC awake.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h" // SW configuration
+#include "user_sleep_inhibit.h"
+#include "user_timebase.h"
+#include "user_periodic.h"
+
+// For debugging
+#include "arch_console.h"
+
+#include <string.h>
+
+/*
+ ****************************************************************************************
+ * DEFINITIONS
+ ****************************************************************************************
+ */
+
+// Held time is folded into the millisecond total before the 32-bit microsecond stamp wraps (71.6 min)
+static const uint16_t SLEEP_INHIBIT_FOLD_PERIOD = 6000U; // 60 s in 10 ms timer ticks
+static const uint16_t SLEEP_INHIBIT_FOLD_SLACK  = 3000U; // any time within the period, shares another wake-up
+
+#ifdef CFG_PRINTF
+static const char * const SLEEP_OWNER_NAMES[SLEEP_OWNER_COUNT] =
+{
+	"ADC STREAM",
+	"PWM",
+};
+#endif
+
+/*
+----------------------------------
+- Retained / Global variables
+----------------------------------
+*/
+
+// These variables are retained across sleep cycles
+
+sleep_hold_t sleep_holds[SLEEP_OWNER_COUNT] __SECTION_ZERO("retention_mem_area0");
+periodic_task_t sleep_inhibit_fold_task __SECTION_ZERO("retention_mem_area0");
+
+/*
+ ****************************************************************************************
+ * LOCAL FUNCTIONS
+ ****************************************************************************************
+*/
+
+static void sleep_inhibit_fold(sleep_hold_t *hold, uint32_t now_us)
+{
+	// Whole milliseconds move to the total, the remainder stays in since_us
+	uint32_t elapsed_ms = (now_us - hold->since_us) / 1000U;
+	
+	hold->held_ms += elapsed_ms;
+	hold->since_us += elapsed_ms * 1000U;
+}
+
+static void sleep_inhibit_fold_cb(uint8_t periods)
+{
+	uint32_t now_us = timebase_now_us();
+	
+	for (uint8_t i = 0; i < SLEEP_OWNER_COUNT; i++)
+	{
+		if (sleep_holds[i].count > 0)
+		{
+			sleep_inhibit_fold(&sleep_holds[i], now_us);
+		}
+	}
+}
+
+static void sleep_inhibit_apply(void)
+{
+	sleep_state_t mode = SLEEP_INHIBIT_DEFAULT_MODE;
+	bool any = false;
+	
+	// Lightest mode requested by any active owner wins
+	for (uint8_t i = 0; i < SLEEP_OWNER_COUNT; i++)
+	{
+		if (sleep_holds[i].count > 0)
+		{
+			any = true;
+			if (sleep_holds[i].level < mode)
+			{
+				mode = sleep_holds[i].level;
+			}
+		}
+	}
+	
+	arch_set_sleep_mode(mode);
+	
+	// Fold held time only while somebody holds, so an idle system gets no extra wake-ups
+	if (any && !periodic_task_is_running(&sleep_inhibit_fold_task))
+	{
+		periodic_task_start(&sleep_inhibit_fold_task, SLEEP_INHIBIT_FOLD_PERIOD, SLEEP_INHIBIT_FOLD_SLACK, sleep_inhibit_fold_cb);
+	}
+	else if (!any && periodic_task_is_running(&sleep_inhibit_fold_task))
+	{
+		periodic_task_stop(&sleep_inhibit_fold_task);
+	}
+}
+
+/*
+ ****************************************************************************************
+ * SLEEP INHIBIT FUNCTIONS
+ ****************************************************************************************
+*/
+
+void sleep_inhibit_acquire(sleep_owner_t owner, sleep_state_t level)
+{
+	sleep_hold_t *hold = &sleep_holds[owner];
+	
+	if (hold->count == 0)
+	{
+		hold->level = level;
+		hold->since_us = timebase_now_us();
+		hold->acquisitions++;
+	}
+	else if (level < hold->level)
+	{
+		hold->level = level;
+	}
+	
+	hold->count++;
+	sleep_inhibit_apply();
+}
+
+void sleep_inhibit_release(sleep_owner_t owner)
+{
+	sleep_hold_t *hold = &sleep_holds[owner];
+	
+	if (hold->count == 0)
+	{
+		#ifdef CFG_PRINTF
+		arch_printf("[SLEEP] Unbalanced release by %s ignored \n\r", SLEEP_OWNER_NAMES[owner]);
+		#endif
+		
+		return;
+	}
+	
+	hold->count--;
+	if (hold->count == 0)
+	{
+		sleep_inhibit_fold(hold, timebase_now_us());
+	}
+	
+	sleep_inhibit_apply();
+}
+
+bool sleep_inhibit_is_held(sleep_owner_t owner)
+{
+	return (sleep_holds[owner].count > 0);
+}
+
+sleep_hold_t const *sleep_inhibit_get(sleep_owner_t owner)
+{
+	if (sleep_holds[owner].count > 0)
+	{
+		sleep_inhibit_fold(&sleep_holds[owner], timebase_now_us());
+	}
+	
+	return &sleep_holds[owner];
+}
+
+void sleep_inhibit_print(void)
+{
+	#ifdef CFG_PRINTF
+	for (uint8_t i = 0; i < SLEEP_OWNER_COUNT; i++)
+	{
+		sleep_hold_t const *hold = sleep_inhibit_get((sleep_owner_t)i);
+		arch_printf("[SLEEP] %s: %u holds, level %u, %u acquisitions, held %lu ms \n\r",
+								SLEEP_OWNER_NAMES[i], hold->count, (uint8_t)hold->level, hold->acquisitions, hold->held_ms);
+	}
+	#endif
+}
+
+void sleep_inhibit_init(void)
+{
+	memset(sleep_holds, 0, sizeof(sleep_holds));
+	memset(&sleep_inhibit_fold_task, 0, sizeof(sleep_inhibit_fold_task));
+	arch_set_sleep_mode(SLEEP_INHIBIT_DEFAULT_MODE);
+}
+
+/// @} APP
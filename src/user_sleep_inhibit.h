@@ -0,0 +1,137 @@
+/**
+ ****************************************************************************************
+ * @file user_sleep_inhibit.h
+ * @brief Reference-counted sleep inhibit shared by every subsystem that needs the SoC awake.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_SLEEP_INHIBIT_H_
+#define _USER_SLEEP_INHIBIT_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// For sleep_state_t
+#include "arch_api.h"
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// Sleep mode when nobody holds an inhibit, matches app_default_sleep_mode in user_config.h
+#define SLEEP_INHIBIT_DEFAULT_MODE ARCH_EXT_SLEEP_ON
+
+/*
+ ****************************************************************************************
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Subsystems that can hold the SoC out of its default sleep mode
+typedef enum
+{
+    SLEEP_OWNER_ADC_STREAM = 0,     ///< Continuous ADC conversions, interval timer runs from the system clock
+    SLEEP_OWNER_PWM,                ///< Timer2 PWM outputs are running
+    SLEEP_OWNER_COUNT
+} sleep_owner_t;
+
+/// Hold state and statistics for one owner
+typedef struct
+{
+    uint8_t count;                  ///< Outstanding holds, the owner is active while non-zero
+    sleep_state_t level;            ///< Deepest sleep mode the owner tolerates while active
+    uint16_t acquisitions;          ///< Times the owner went from no hold to holding
+    uint32_t since_us;              ///< Timebase stamp up to which held_ms has been accumulated
+    uint32_t held_ms;               ///< Total time the owner has held the SoC since boot
+} sleep_hold_t;
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Take a hold that limits the SoC to at most the given sleep mode.
+ *
+ * @param[in] owner  Subsystem taking the hold.
+ * @param[in] level  Deepest sleep mode the owner tolerates (e.g., ARCH_SLEEP_OFF).
+ *
+ * @details Holds are counted per owner, every acquire needs one matching release. The SoC
+ *          uses the lightest level over all active owners, or SLEEP_INHIBIT_DEFAULT_MODE
+ *          when there are none. If an owner acquires again with a different level, the
+ *          lighter one applies until its last hold is released.
+ * @sa sleep_inhibit_release, arch_set_sleep_mode
+ ****************************************************************************************
+ */
+void sleep_inhibit_acquire(sleep_owner_t owner, sleep_state_t level);
+
+/**
+ ****************************************************************************************
+ * @brief Release one hold taken with sleep_inhibit_acquire().
+ *
+ * @param[in] owner  Subsystem releasing the hold.
+ *
+ * @note A release without an outstanding hold is ignored.
+ ****************************************************************************************
+ */
+void sleep_inhibit_release(sleep_owner_t owner);
+
+/**
+ ****************************************************************************************
+ * @brief Check whether an owner currently holds the SoC.
+ *
+ * @param[in] owner  Subsystem to check.
+ * @return true if the owner has at least one outstanding hold.
+ ****************************************************************************************
+ */
+bool sleep_inhibit_is_held(sleep_owner_t owner);
+
+/**
+ ****************************************************************************************
+ * @brief Hold state and statistics of one owner, held time brought up to date.
+ *
+ * @param[in] owner  Subsystem to report.
+ * @return Pointer to the retained hold state.
+ ****************************************************************************************
+ */
+sleep_hold_t const *sleep_inhibit_get(sleep_owner_t owner);
+
+/**
+ ****************************************************************************************
+ * @brief Print every owner's hold count and held time over UART (CFG_PRINTF builds only).
+ ****************************************************************************************
+ */
+void sleep_inhibit_print(void);
+
+/**
+ ****************************************************************************************
+ * @brief Clear every hold and statistic and return to the default sleep mode.
+ *
+ * @details Called once from user_app_on_init().
+ ****************************************************************************************
+ */
+void sleep_inhibit_init(void);
+
+/// @} APP
+
+#endif // _USER_SLEEP_INHIBIT_H_
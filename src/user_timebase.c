@@ -0,0 +1,64 @@
+/**
+ ****************************************************************************************
+ * @file user_timebase.c
+ * @brief Monotonic microsecond timestamps from the BLE timebase.
+ * @addtogroup APP
+ * @{
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h" // SW configuration
+#include "user_timebase.h"
+
+// For BLE base time and fine time counters
+#include "lld_evt.h"
+#include "reg_blecore.h"
+
+/*
+----------------------------------
+- Retained / Global variables
+----------------------------------
+*/
+
+// These variables are retained across sleep cycles
+
+uint32_t timebase_last_slot __SECTION_ZERO("retention_mem_area0"); // base time counter at the previous call
+uint32_t timebase_slot_us __SECTION_ZERO("retention_mem_area0");   // extended time of that slot in us
+
+/*
+ ****************************************************************************************
+ * TIMEBASE FUNCTIONS
+ ****************************************************************************************
+*/
+
+uint32_t timebase_now_us(void)
+{
+	uint32_t now;
+	
+	// Called from the ADC interrupt as well, keep the extension state consistent
+	GLOBAL_INT_DISABLE();
+	
+	// Sampling the base time counter latches the fine counter with it
+	uint32_t slot = lld_evt_time_get();
+	uint16_t fine = ble_finetimecnt_get();
+	
+	// Masked difference handles the 27-bit counter wrap, product wraps with the 32-bit count
+	timebase_slot_us += ((slot - timebase_last_slot) & TIMEBASE_SLOT_MASK) * TIMEBASE_SLOT_US;
+	timebase_last_slot = slot;
+	
+	// Fine counter counts down from 624 to 0 within the slot
+	now = timebase_slot_us + (TIMEBASE_SLOT_US - 1U - fine);
+	
+	GLOBAL_INT_RESTORE();
+	
+	return now;
+}
+
+/// @} APP
@@ -0,0 +1,71 @@
+/**
+ ****************************************************************************************
+ * @file user_timebase.h
+ * @brief Monotonic microsecond timestamps from the BLE timebase.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _USER_TIMEBASE_H_
+#define _USER_TIMEBASE_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup RICOW
+ * @brief
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ ****************************************************************************************
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+
+/*
+ ****************************************************************************************
+ * DEFINES
+ ****************************************************************************************
+ */
+
+// BLE base time counter ticks in 625 us slots and is 27 bits wide
+#define TIMEBASE_SLOT_US 625U
+#define TIMEBASE_SLOT_MASK 0x07FFFFFFU
+
+/*
+ ****************************************************************************************
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Current time in microseconds on the BLE timebase.
+ *
+ * @return Monotonic timestamp in microseconds, wraps every 2^32 us (about 71.6 minutes).
+ *
+ * @details
+ *  - Samples the BLE base time counter (625 us slots) and its fine counter together, so
+ *    the result has 1 us resolution.
+ *  - The base time counter keeps counting through extended sleep: on wake-up the BLE core
+ *    adds the sleep duration measured with the RCX20 low-power clock. Timestamps therefore
+ *    do not drift with the app_easy_timer chains, whose callbacks run late by their own
+ *    scheduling latency.
+ *  - The 27-bit slot counter is extended into a retained 32-bit microsecond count, which
+ *    only needs a call at least once every 23 hours to stay continuous.
+ *  - Safe to call from interrupt context.
+ *
+ * @note The BLE core must be awake, which is the case in kernel timer callbacks and
+ *       while sleep is disabled (e.g., during continuous ADC acquisition).
+ * @sa lld_evt_time_get
+ ****************************************************************************************
+ */
+uint32_t timebase_now_us(void);
+
+/// @} APP
+
+#endif // _USER_TIMEBASE_H_
@@ -0,0 +1,168 @@
+/**
+ ****************************************************************************************
+ * @file flash_model.c
+ * @brief RAM model of the MX25R SPI flash behind the SDK driver calls, with power cuts
+ *        that tear a page program or a sector erase part way.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#include <string.h>
+
+#include "flash_model.h"
+#include "spi_flash.h"
+
+#define FLASH_MODEL_MAX_WORN  4U
+
+uint8_t flash_model_mem[SPI_FLASH_DEV_SIZE];
+uint32_t flash_model_erases[FLASH_MODEL_SECTORS];
+uint32_t flash_model_overwrites;
+
+static bool flash_model_cut_pending;
+static bool flash_model_cut;
+static uint32_t flash_model_budget;
+static uint32_t flash_model_worn[FLASH_MODEL_MAX_WORN];
+static uint32_t flash_model_worn_count;
+
+/// Spend one byte of the cut budget, false once the power is gone
+static bool flash_model_spend(void)
+{
+	if (flash_model_cut)
+	{
+		return false;
+	}
+	if (flash_model_cut_pending)
+	{
+		if (flash_model_budget == 0)
+		{
+			flash_model_cut = true;
+			return false;
+		}
+		flash_model_budget--;
+	}
+
+	return true;
+}
+
+void flash_model_reset(void)
+{
+	memset(flash_model_mem, 0xFF, sizeof(flash_model_mem));
+	memset(flash_model_erases, 0, sizeof(flash_model_erases));
+	flash_model_overwrites = 0;
+	flash_model_worn_count = 0;
+	flash_model_power_on();
+}
+
+void flash_model_cut_after(uint32_t bytes)
+{
+	flash_model_cut_pending = true;
+	flash_model_budget = bytes;
+}
+
+void flash_model_wear_out(uint32_t addr)
+{
+	if (flash_model_worn_count < FLASH_MODEL_MAX_WORN)
+	{
+		flash_model_worn[flash_model_worn_count++] = addr;
+		flash_model_mem[addr] = 0;
+	}
+}
+
+bool flash_model_is_cut(void)
+{
+	return flash_model_cut;
+}
+
+void flash_model_power_on(void)
+{
+	flash_model_cut_pending = false;
+	flash_model_cut = false;
+	flash_model_budget = 0;
+}
+
+/*
+ * SDK driver stand-ins
+ */
+
+int8_t spi_flash_read_data(uint8_t *rd_data_ptr, uint32_t address, uint32_t size, uint32_t *actual_size)
+{
+	*actual_size = 0;
+	if (flash_model_cut || address > SPI_FLASH_DEV_SIZE || size > SPI_FLASH_DEV_SIZE - address)
+	{
+		return SPI_FLASH_ERR_TIMEOUT;
+	}
+
+	memcpy(rd_data_ptr, &flash_model_mem[address], size);
+	*actual_size = size;
+
+	return SPI_FLASH_ERR_OK;
+}
+
+int8_t spi_flash_write_data(uint8_t *wr_data_ptr, uint32_t address, uint32_t size, uint32_t *actual_size)
+{
+	*actual_size = 0;
+	if (address > SPI_FLASH_DEV_SIZE || size > SPI_FLASH_DEV_SIZE - address)
+	{
+		return SPI_FLASH_ERR_TIMEOUT;
+	}
+
+	// The driver splits writes at page boundaries, the bytes land in address order
+	for (uint32_t i = 0; i < size; i++)
+	{
+		if (!flash_model_spend())
+		{
+			return SPI_FLASH_ERR_TIMEOUT;
+		}
+		uint8_t *cell = &flash_model_mem[address + i];
+		flash_model_overwrites += (uint32_t)__builtin_popcount((unsigned)(wr_data_ptr[i] & ~*cell & 0xFFU));
+		*cell &= wr_data_ptr[i];
+		(*actual_size)++;
+	}
+
+	return SPI_FLASH_ERR_OK;
+}
+
+int8_t spi_flash_block_erase(uint32_t address, SPI_FLASH_OP_CODES_t spiEraseModule)
+{
+	if (spiEraseModule != SPI_FLASH_OP_SE || address >= SPI_FLASH_DEV_SIZE || flash_model_cut)
+	{
+		return SPI_FLASH_ERR_TIMEOUT;
+	}
+
+	uint32_t sector = address / FLASH_MODEL_SECTOR_SIZE;
+	for (uint32_t i = 0; i < FLASH_MODEL_SECTOR_SIZE; i++)
+	{
+		if (!flash_model_spend())
+		{
+			return SPI_FLASH_ERR_TIMEOUT;
+		}
+		flash_model_mem[sector * FLASH_MODEL_SECTOR_SIZE + i] = 0xFF;
+	}
+	for (uint32_t i = 0; i < flash_model_worn_count; i++)
+	{
+		if (flash_model_worn[i] / FLASH_MODEL_SECTOR_SIZE == sector)
+		{
+			flash_model_mem[flash_model_worn[i]] = 0;
+		}
+	}
+	flash_model_erases[sector]++;
+
+	return SPI_FLASH_ERR_OK;
+}
+
+int8_t spi_flash_auto_detect(uint8_t *dev_id)
+{
+	*dev_id = 0;
+
+	return flash_model_cut ? SPI_FLASH_ERR_TIMEOUT : SPI_FLASH_ERR_OK;
+}
+
+int8_t spi_flash_release_from_power_down(void)
+{
+	return flash_model_cut ? SPI_FLASH_ERR_TIMEOUT : SPI_FLASH_ERR_OK;
+}
+
+int8_t spi_flash_power_down(void)
+{
+	return flash_model_cut ? SPI_FLASH_ERR_TIMEOUT : SPI_FLASH_ERR_OK;
+}
@@ -0,0 +1,49 @@
+/**
+ ****************************************************************************************
+ * @file flash_model.h
+ * @brief RAM model of the MX25R SPI flash behind the SDK driver calls, with power cuts
+ *        that tear a page program or a sector erase part way.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _FLASH_MODEL_H_
+#define _FLASH_MODEL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "user_periph_setup.h"
+
+#define FLASH_MODEL_SECTOR_SIZE  4096U
+#define FLASH_MODEL_SECTORS      (SPI_FLASH_DEV_SIZE / FLASH_MODEL_SECTOR_SIZE)
+
+/// Flash contents, programming only clears bits and an erase sets a whole sector to 0xFF
+extern uint8_t flash_model_mem[SPI_FLASH_DEV_SIZE];
+
+/// Erases per sector since flash_model_reset()
+extern uint32_t flash_model_erases[FLASH_MODEL_SECTORS];
+
+/// Bits a program tried to set on cells that were not erased, NOR flash leaves them at 0
+extern uint32_t flash_model_overwrites;
+
+/// Blank flash, powered, no cut pending, no worn cells
+void flash_model_reset(void);
+
+/**
+ * Cut the power after this many more bytes were programmed or erased. The operation in
+ * progress stops there and every later call fails until flash_model_power_on(). An erase
+ * clears the sector from its first byte, so a cut at 0 loses the erase entirely.
+ */
+void flash_model_cut_after(uint32_t bytes);
+
+/// Wear a cell out, it reads 0x00 from now on and no erase brings it back
+void flash_model_wear_out(uint32_t addr);
+
+/// True once a pending cut has happened
+bool flash_model_is_cut(void);
+
+/// Power back on after a cut, with no cut pending
+void flash_model_power_on(void);
+
+#endif // _FLASH_MODEL_H_
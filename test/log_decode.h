@@ -0,0 +1,109 @@
+/**
+ ****************************************************************************************
+ * @file log_decode.h
+ * @brief Reassembles log blocks from the chunks log_store_read() returns, the way a client
+ *        of the download service splits and checks them.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _LOG_DECODE_H_
+#define _LOG_DECODE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "user_cfg_store.h"
+#include "user_log_store.h"
+
+/// Called for every complete block that passed its checks, samples as stored in flash
+typedef void (*log_decode_cb_t)(log_store_block_t const *block, uint8_t const *samples, void *ctx);
+
+typedef struct
+{
+	uint8_t block[LOG_STORE_PAGE_SIZE];
+	uint16_t have;              // bytes of the block being assembled
+	uint32_t seq;               // block being assembled
+	uint32_t blocks;            // blocks passed to on_block
+	uint32_t errors;            // chunks out of place, bad layouts and CRC failures
+	log_decode_cb_t on_block;
+	void *ctx;
+} log_decode_t;
+
+static inline void log_decode_init(log_decode_t *dec, log_decode_cb_t on_block, void *ctx)
+{
+	memset(dec, 0, sizeof(*dec));
+	dec->on_block = on_block;
+	dec->ctx = ctx;
+}
+
+static inline void log_decode_block(log_decode_t *dec)
+{
+	uint8_t const *b = dec->block;
+	log_store_block_t block;
+
+	block.count = b[3];
+	block.seq = (uint32_t)b[4] | ((uint32_t)b[5] << 8) | ((uint32_t)b[6] << 16) | ((uint32_t)b[7] << 24);
+	block.base_ms = (uint32_t)b[8] | ((uint32_t)b[9] << 8) | ((uint32_t)b[10] << 16) | ((uint32_t)b[11] << 24);
+	block.boot = (uint16_t)(b[12] | (b[13] << 8));
+
+	uint16_t crc = cfg_store_crc16(0xFFFFU, b, LOG_STORE_HEADER_SIZE - 2U);
+	crc = cfg_store_crc16(crc, &b[LOG_STORE_HEADER_SIZE], (uint32_t)block.count * LOG_STORE_SAMPLE_SIZE);
+
+	if ((uint16_t)(b[0] | (b[1] << 8)) != LOG_STORE_MAGIC || b[2] != LOG_STORE_VERSION || block.seq != dec->seq ||
+	    (uint16_t)(b[14] | (b[15] << 8)) != crc)
+	{
+		dec->errors++;
+		return;
+	}
+
+	dec->blocks++;
+	dec->on_block(&block, &b[LOG_STORE_HEADER_SIZE], dec->ctx);
+}
+
+/// Add the bytes of one read, positioned by the cursor's chunk_seq and chunk_offset
+static inline void log_decode_chunk(log_decode_t *dec, uint32_t seq, uint16_t offset, uint8_t const *data, uint16_t length)
+{
+	// A chunk that does not carry on the block in progress has to start a new one
+	if (seq != dec->seq || offset != dec->have)
+	{
+		if (offset != 0)
+		{
+			dec->errors++;
+			return;
+		}
+		dec->seq = seq;
+		dec->have = 0;
+	}
+
+	while (length > 0)
+	{
+		uint16_t want = LOG_STORE_HEADER_SIZE;
+		if (dec->have >= LOG_STORE_HEADER_SIZE)
+		{
+			if (dec->block[3] == 0 || dec->block[3] > LOG_STORE_MAX_SAMPLES)
+			{
+				dec->errors++;
+				dec->have = 0;
+				return;
+			}
+			want = (uint16_t)(LOG_STORE_HEADER_SIZE + dec->block[3] * LOG_STORE_SAMPLE_SIZE);
+		}
+
+		uint16_t n = (uint16_t)(want - dec->have);
+		n = (n < length) ? n : length;
+		memcpy(&dec->block[dec->have], data, n);
+		dec->have += n;
+		data += n;
+		length -= n;
+
+		if (dec->have > LOG_STORE_HEADER_SIZE && dec->have == want)
+		{
+			log_decode_block(dec);
+			dec->seq++;
+			dec->have = 0;
+		}
+	}
+}
+
+#endif // _LOG_DECODE_H_
@@ -0,0 +1,22 @@
+/**
+ ****************************************************************************************
+ * @file arch_api.h
+ * @brief Host stand-in for the SDK architecture API: sleep modes and interrupt masking.
+ ****************************************************************************************
+ */
+
+#ifndef _ARCH_API_H_
+#define _ARCH_API_H_
+
+typedef enum
+{
+    ARCH_SLEEP_OFF,
+    ARCH_EXT_SLEEP_ON,
+    ARCH_EXT_SLEEP_OTP_COPY_ON
+} sleep_state_t;
+
+// Same block structure as the SDK macros, the host has no interrupts to mask
+#define GLOBAL_INT_DISABLE() do {
+#define GLOBAL_INT_RESTORE() } while (0)
+
+#endif // _ARCH_API_H_
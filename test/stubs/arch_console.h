@@ -0,0 +1,15 @@
+/**
+ ****************************************************************************************
+ * @file arch_console.h
+ * @brief Host stand-in for the SDK UART console.
+ ****************************************************************************************
+ */
+
+#ifndef _ARCH_CONSOLE_H_
+#define _ARCH_CONSOLE_H_
+
+#include <stdio.h>
+
+#define arch_printf printf
+
+#endif // _ARCH_CONSOLE_H_
@@ -0,0 +1,38 @@
+/**
+ ****************************************************************************************
+ * @file datasheet.h
+ * @brief Host stand-in for the DA14531 register map, register accesses go to the test's
+ *        simulated hardware.
+ ****************************************************************************************
+ */
+
+#ifndef _DATASHEET_H_
+#define _DATASHEET_H_
+
+#include <stdint.h>
+
+// Register addresses only need to be distinct
+#define TRIPLE_PWM_FREQUENCY 0x50003400UL
+#define PWM2_START_CYCLE     0x50003404UL
+#define PWM2_END_CYCLE       0x50003406UL
+#define PWM3_START_CYCLE     0x50003408UL
+#define PWM3_END_CYCLE       0x5000340AUL
+#define PWM4_START_CYCLE     0x5000340CUL
+#define PWM4_END_CYCLE       0x5000340EUL
+#define PWM5_START_CYCLE     0x50003410UL
+#define PWM5_END_CYCLE       0x50003412UL
+#define PWM6_START_CYCLE     0x50003414UL
+#define PWM6_END_CYCLE       0x50003416UL
+#define PWM7_START_CYCLE     0x50003418UL
+#define PWM7_END_CYCLE       0x5000341AUL
+#define PMU_CTRL_REG         0x50000020UL
+#define TIM_SLEEP            0x0002U
+
+uint16_t sim_reg_read(uintptr_t addr);
+void sim_reg_write(uintptr_t addr, uint16_t value);
+
+#define GetWord16(addr)             sim_reg_read((uintptr_t)(addr))
+#define SetWord16(addr, value)      sim_reg_write((uintptr_t)(addr), (uint16_t)(value))
+#define SetBits16(addr, mask, value) ((void)(addr), (void)(mask), (void)(value))
+
+#endif // _DATASHEET_H_
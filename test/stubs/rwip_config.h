@@ -0,0 +1,13 @@
+/**
+ ****************************************************************************************
+ * @file rwip_config.h
+ * @brief Host stand-in for the SDK configuration header, retention sections are plain RAM.
+ ****************************************************************************************
+ */
+
+#ifndef _RWIP_CONFIG_H_
+#define _RWIP_CONFIG_H_
+
+#define __SECTION_ZERO(sec)
+
+#endif // _RWIP_CONFIG_H_
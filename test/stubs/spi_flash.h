@@ -0,0 +1,31 @@
+/**
+ ****************************************************************************************
+ * @file spi_flash.h
+ * @brief Host stand-in for the SDK SPI flash driver, implemented over RAM by flash_model.c.
+ ****************************************************************************************
+ */
+
+#ifndef _SPI_FLASH_H_
+#define _SPI_FLASH_H_
+
+#include <stdint.h>
+
+#define SPI_FLASH_ERR_OK        0
+#define SPI_FLASH_ERR_TIMEOUT   -1
+#define SPI_FLASH_ERR_NOT_ERASED -4
+
+typedef enum
+{
+    SPI_FLASH_OP_SE = 0x20,     // 4 KB sector erase
+    SPI_FLASH_OP_BE32 = 0x52,
+    SPI_FLASH_OP_BE64 = 0xD8
+} SPI_FLASH_OP_CODES_t;
+
+int8_t spi_flash_read_data(uint8_t *rd_data_ptr, uint32_t address, uint32_t size, uint32_t *actual_size);
+int8_t spi_flash_write_data(uint8_t *wr_data_ptr, uint32_t address, uint32_t size, uint32_t *actual_size);
+int8_t spi_flash_block_erase(uint32_t address, SPI_FLASH_OP_CODES_t spiEraseModule);
+int8_t spi_flash_auto_detect(uint8_t *dev_id);
+int8_t spi_flash_release_from_power_down(void);
+int8_t spi_flash_power_down(void);
+
+#endif // _SPI_FLASH_H_
@@ -0,0 +1,28 @@
+/**
+ ****************************************************************************************
+ * @file timer0_2.h
+ * @brief Host stand-in for the SDK Timer0/2 clock divider driver.
+ ****************************************************************************************
+ */
+
+#ifndef _TIMER0_2_H_
+#define _TIMER0_2_H_
+
+typedef enum
+{
+    TIM0_2_CLK_DIV_1,
+    TIM0_2_CLK_DIV_2,
+    TIM0_2_CLK_DIV_4,
+    TIM0_2_CLK_DIV_8
+} tim0_2_clk_div_t;
+
+typedef struct
+{
+    tim0_2_clk_div_t clk_div;
+} tim0_2_clk_div_config_t;
+
+void timer0_2_clk_div_set(tim0_2_clk_div_config_t *clk_div_config);
+void timer0_2_clk_enable(void);
+void timer0_2_clk_disable(void);
+
+#endif // _TIMER0_2_H_
@@ -0,0 +1,50 @@
+/**
+ ****************************************************************************************
+ * @file timer2.h
+ * @brief Host stand-in for the SDK Timer2 PWM driver.
+ ****************************************************************************************
+ */
+
+#ifndef _TIMER2_H_
+#define _TIMER2_H_
+
+typedef enum
+{
+    TIM2_CLK_LP,
+    TIM2_CLK_SYS
+} tim2_clk_src_t;
+
+typedef enum
+{
+    TIM2_HW_PAUSE_OFF,
+    TIM2_HW_PAUSE_ON
+} tim2_hw_pause_t;
+
+typedef enum
+{
+    TIM2_SW_PAUSE_OFF,
+    TIM2_SW_PAUSE_ON
+} tim2_sw_pause_t;
+
+typedef enum
+{
+    TIM2_PWM_2 = 2,
+    TIM2_PWM_3,
+    TIM2_PWM_4,
+    TIM2_PWM_5,
+    TIM2_PWM_6,
+    TIM2_PWM_7
+} tim2_pwm_t;
+
+typedef struct
+{
+    tim2_clk_src_t clk_source;
+    tim2_hw_pause_t hw_pause;
+} tim2_config_t;
+
+void timer2_config(tim2_config_t *config);
+void timer2_start(void);
+void timer2_stop(void);
+void timer2_set_sw_pause(tim2_sw_pause_t sw_pause);
+
+#endif // _TIMER2_H_
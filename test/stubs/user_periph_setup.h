@@ -0,0 +1,17 @@
+/**
+ ****************************************************************************************
+ * @file user_periph_setup.h
+ * @brief Host stand-in for the board setup header, only the SPI flash layout.
+ ****************************************************************************************
+ */
+
+#ifndef _USER_PERIPH_SETUP_H_
+#define _USER_PERIPH_SETUP_H_
+
+// Same layout as src/config/user_periph_setup.h
+#define SPI_FLASH_DEV_SIZE          (256 * 1024)
+#define CFG_STORE_FLASH_ADDR        (SPI_FLASH_DEV_SIZE - 0x2000)
+#define LOG_STORE_FLASH_ADDR        0x10000
+#define LOG_STORE_FLASH_SIZE        (CFG_STORE_FLASH_ADDR - LOG_STORE_FLASH_ADDR)
+
+#endif // _USER_PERIPH_SETUP_H_
@@ -0,0 +1,219 @@
+/**
+ ****************************************************************************************
+ * @file test_cfg_store.c
+ * @brief Configuration records on the RAM flash model: ring wrap, and recovery from a
+ *        power cut during the page program or the sector erase of a save.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "flash_model.h"
+#include "user_cfg_store.h"
+#include "test_check.h"
+
+#define VERSION   2U
+#define LENGTH    24U
+
+static uint8_t snapshot[SPI_FLASH_DEV_SIZE];
+
+/// Payload of the n-th save, every save differs from the one before
+static void payload_for(uint32_t n, uint8_t *payload)
+{
+	memcpy(payload, &n, sizeof(n));
+	for (uint8_t i = sizeof(n); i < LENGTH; i++)
+	{
+		payload[i] = (uint8_t)(n * 7U + i);
+	}
+}
+
+static cfg_store_result_t save(uint32_t n)
+{
+	uint8_t payload[LENGTH];
+
+	payload_for(n, payload);
+
+	return cfg_store_save(VERSION, payload, LENGTH);
+}
+
+/// Save the loaded record came from, 0 if there is none
+static uint32_t loaded(void)
+{
+	uint8_t payload[LENGTH];
+	uint8_t expected[LENGTH];
+	uint32_t n;
+
+	if (!cfg_store_load(VERSION, payload, LENGTH))
+	{
+		return 0;
+	}
+	memcpy(&n, payload, sizeof(n));
+	payload_for(n, expected);
+	CHECK(memcmp(payload, expected, LENGTH) == 0, "record of save %u corrupted", n);
+
+	return n;
+}
+
+static void reboot(void)
+{
+	flash_model_power_on();
+	CHECK(cfg_store_init(), "flash not found at boot");
+}
+
+static void check_basic(void)
+{
+	uint8_t payload[CFG_STORE_MAX_PAYLOAD + 1U] = { 0 };
+
+	flash_model_reset();
+	reboot();
+	CHECK(loaded() == 0, "record found on blank flash");
+
+	CHECK(save(1) == CFG_STORE_WRITTEN, "first save");
+	CHECK(save(1) == CFG_STORE_UNCHANGED && cfg_store_get()->skipped == 1, "unchanged save written");
+	CHECK(cfg_store_save(VERSION, payload, CFG_STORE_MAX_PAYLOAD + 1U) == CFG_STORE_ERROR, "oversized payload");
+
+	reboot();
+	CHECK(loaded() == 1, "first save lost across a reboot");
+	CHECK(!cfg_store_load(VERSION + 1U, payload, LENGTH) && !cfg_store_load(VERSION, payload, LENGTH - 1U),
+	      "record loaded with another layout");
+	CHECK(save(1) == CFG_STORE_UNCHANGED, "unchanged save after a reboot written");
+}
+
+static void check_ring_wrap(void)
+{
+	uint32_t saves = 3U * CFG_STORE_SLOTS + 5U;
+
+	// Three laps and a bit, rebooting every few saves to recover the position from flash
+	flash_model_reset();
+	reboot();
+	for (uint32_t n = 1; n <= saves; n++)
+	{
+		CHECK(save(n) == CFG_STORE_WRITTEN, "save %u failed", n);
+		if (n % 7U == 0)
+		{
+			reboot();
+			CHECK(loaded() == n && cfg_store_get()->seq == n, "save %u: loaded %u, seq %u after a reboot",
+			      n, loaded(), cfg_store_get()->seq);
+			CHECK(cfg_store_get()->next_slot == n % CFG_STORE_SLOTS, "save %u: next slot %u",
+			      n, cfg_store_get()->next_slot);
+		}
+	}
+	reboot();
+	CHECK(loaded() == saves, "loaded %u after %u saves", loaded(), saves);
+
+	// Every sector erased once per lap, each record programmed into blank cells
+	uint32_t first = CFG_STORE_FLASH_ADDR / FLASH_MODEL_SECTOR_SIZE;
+	for (uint32_t s = 0; s < CFG_STORE_SECTORS; s++)
+	{
+		uint32_t expected = (saves - s * (CFG_STORE_SLOTS / CFG_STORE_SECTORS) + CFG_STORE_SLOTS - 1U) / CFG_STORE_SLOTS;
+		CHECK(flash_model_erases[first + s] == expected, "sector %u erased %u times, expected %u",
+		      s, flash_model_erases[first + s], expected);
+	}
+	CHECK(flash_model_overwrites == 0, "%u bits programmed over data", flash_model_overwrites);
+}
+
+/// Cut the power cut bytes into save pos + 1, reboot, then carry on saving
+static void check_cut(uint32_t pos, uint32_t cut, uint32_t *newest_count)
+{
+	memcpy(flash_model_mem, snapshot, sizeof(snapshot));
+	reboot();
+
+	flash_model_cut_after(cut);
+	cfg_store_result_t result = save(pos + 1U);
+	bool was_cut = flash_model_is_cut();
+	CHECK(was_cut || result == CFG_STORE_WRITTEN, "save %u failed without a cut", pos + 1U);
+
+	// The previous record survives, the new one only counts if it was programmed completely
+	reboot();
+	uint32_t n = loaded();
+	CHECK(n == pos || n == pos + 1U, "save %u cut after %u bytes: loaded %u", pos + 1U, cut, n);
+	*newest_count += (n == pos + 1U);
+
+	// The ring goes on past the torn slot or the half-erased sector
+	for (uint32_t next = pos + 2U; next < pos + 2U + CFG_STORE_SLOTS; next++)
+	{
+		CHECK(save(next) == CFG_STORE_WRITTEN, "save %u after a cut at %u bytes failed", next, cut);
+	}
+	reboot();
+	CHECK(loaded() == pos + 1U + CFG_STORE_SLOTS, "cut at %u bytes: loaded %u after the ring went on",
+	      cut, loaded());
+	CHECK(flash_model_overwrites == 0, "cut at %u bytes: %u bits programmed over data", cut, flash_model_overwrites);
+}
+
+static void prepare(uint32_t pos)
+{
+	flash_model_reset();
+	reboot();
+	for (uint32_t n = 1; n <= pos; n++)
+	{
+		save(n);
+	}
+	memcpy(snapshot, flash_model_mem, sizeof(snapshot));
+}
+
+static void check_torn_write(void)
+{
+	// Saves into a slot inside a sector, the last slot of a sector and the last slot of the ring
+	static const uint32_t POSITIONS[] = { 5, 31, 2U * CFG_STORE_SLOTS - 1U };
+
+	for (uint32_t p = 0; p < sizeof(POSITIONS) / sizeof(POSITIONS[0]); p++)
+	{
+		uint32_t newest = 0;
+
+		prepare(POSITIONS[p]);
+		for (uint32_t cut = 0; cut <= CFG_STORE_SLOT_SIZE; cut++)
+		{
+			check_cut(POSITIONS[p], cut, &newest);
+		}
+
+		// Once the CRC is in, the rest of the slot is padding that is already erased
+		CHECK(newest == CFG_STORE_SLOT_SIZE - (CFG_STORE_HEADER_SIZE + LENGTH + 2U) + 1U,
+		      "slot after save %u: new record kept for %u cut points", POSITIONS[p], newest);
+	}
+}
+
+static void check_lost_erase(void)
+{
+	// Saves that start the second sector and wrap to the first, both holding records of the last lap
+	static const uint32_t POSITIONS[] = { CFG_STORE_SLOTS + CFG_STORE_SLOTS / 2U, 2U * CFG_STORE_SLOTS };
+
+	for (uint32_t p = 0; p < sizeof(POSITIONS) / sizeof(POSITIONS[0]); p++)
+	{
+		uint32_t newest = 0;
+
+		prepare(POSITIONS[p]);
+		for (uint32_t cut = 0; cut < CFG_STORE_SECTOR_SIZE; cut += (cut < 2U * CFG_STORE_SLOT_SIZE) ? 1U : 61U)
+		{
+			check_cut(POSITIONS[p], cut, &newest);
+		}
+		check_cut(POSITIONS[p], CFG_STORE_SECTOR_SIZE - 1U, &newest);
+		check_cut(POSITIONS[p], CFG_STORE_SECTOR_SIZE, &newest);
+		CHECK(newest == 0, "save %u: new record kept with the erase cut", POSITIONS[p] + 1U);
+	}
+}
+
+static void check_worn_slots(void)
+{
+	// The sector after the newest record fails its read-back and so does the one holding it:
+	// the save gives up rather than erase the newest record
+	prepare(CFG_STORE_SLOTS / 2U);
+	reboot();
+	flash_model_wear_out(CFG_STORE_FLASH_ADDR + CFG_STORE_SECTOR_SIZE + CFG_STORE_HEADER_SIZE);
+	flash_model_wear_out(CFG_STORE_FLASH_ADDR + CFG_STORE_HEADER_SIZE);
+	CHECK(save(CFG_STORE_SLOTS / 2U + 1U) == CFG_STORE_ERROR, "save into worn slots succeeded");
+	reboot();
+	CHECK(loaded() == CFG_STORE_SLOTS / 2U, "loaded %u after a failed save", loaded());
+}
+
+int main(void)
+{
+	check_basic();
+	check_ring_wrap();
+	check_torn_write();
+	check_lost_erase();
+	check_worn_slots();
+
+	return test_result("test_cfg_store");
+}
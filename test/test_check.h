@@ -0,0 +1,36 @@
+/**
+ ****************************************************************************************
+ * @file test_check.h
+ * @brief Minimal assertion helpers shared by the host-side checks.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#ifndef _TEST_CHECK_H_
+#define _TEST_CHECK_H_
+
+#include <stdio.h>
+
+static int test_failures;
+
+// Report a failed condition with its location and keep going, main() returns the count
+#define CHECK(cond, ...)                                                        \
+	do                                                                          \
+	{                                                                           \
+		if (!(cond))                                                            \
+		{                                                                       \
+			test_failures++;                                                    \
+			printf("%s:%d: CHECK(%s) failed: ", __FILE__, __LINE__, #cond);     \
+			printf(__VA_ARGS__);                                                \
+			printf("\n");                                                       \
+		}                                                                       \
+	} while (0)
+
+// Exit status for main(), prints a summary line
+static inline int test_result(char const *name)
+{
+	printf("%s: %s (%d failures)\n", name, (test_failures == 0) ? "PASS" : "FAIL", test_failures);
+	return (test_failures == 0) ? 0 : 1;
+}
+
+#endif // _TEST_CHECK_H_
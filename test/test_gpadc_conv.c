@@ -0,0 +1,127 @@
+/**
+ ****************************************************************************************
+ * @file test_gpadc_conv.c
+ * @brief Accuracy sweep of the integer ADC conversion against exact arithmetic.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include "user_gpadc_conv.h"
+#include "test_check.h"
+
+// Same values as GPADC_LIN_CAL in user_empty_peripheral_template.c, plus the identity correction
+static const gpadc_lin_cal_t LIN_CAL[] =
+{
+	{ .raw_zero_mv = 34U, .raw_fs_mv =  900U },
+	{ .raw_zero_mv =  0U, .raw_fs_mv =  900U },
+	{ .raw_zero_mv =  0U, .raw_fs_mv = 1800U },
+	{ .raw_zero_mv =  0U, .raw_fs_mv = 2700U },
+	{ .raw_zero_mv =  0U, .raw_fs_mv = 3600U }
+};
+static const uint8_t LIN_CAL_ATTN[] = { 0, 0, 1, 2, 3 };
+
+// uV path: 0.5 uV rounding, up to 2 uV from the Q24 scale over 2^16 codes and 1 uV from the bias
+#define UV_TOLERANCE 3.5
+
+// mV path: 0.5 mV rounding plus half a Q16 LSB of scale per code
+#define MV_TOLERANCE(code) (0.5 + (code) / 131072.0 + 0.001)
+
+// Corrected input voltage in uV for a mean raw code
+static double exact_uv(gpadc_lin_cal_t const *cal, uint32_t ref_mv, uint32_t resolution, double code)
+{
+	double raw_mv = code * ref_mv / (double)(1UL << resolution);
+	double uv = (raw_mv - cal->raw_zero_mv) * ref_mv / (cal->raw_fs_mv - cal->raw_zero_mv) * 1000.0;
+	return (uv < 0) ? 0 : uv;
+}
+
+static void check_config(gpadc_lin_cal_t const *cal, uint8_t attn, uint8_t oversampling)
+{
+	gpadc_conv_t conv;
+	gpadc_conv_build(&conv, cal, attn, oversampling);
+
+	uint32_t ref_mv = 900U * (attn + 1U);
+	uint32_t resolution = 10U + ((oversampling > 6U) ? 6U : oversampling);
+	uint32_t codes = 1UL << resolution;
+	double tolerance = UV_TOLERANCE;
+	double err_sum = 0;
+	double err_max = 0;
+	uint32_t n = 0;
+
+	for (uint32_t code = 0; code < codes; code++)
+	{
+		double exact = exact_uv(cal, ref_mv, resolution, code);
+
+		// Single samples through the mV path, rounded to nearest
+		uint16_t mv = gpadc_conv_apply(&conv, (uint16_t)code);
+		CHECK(fabs(mv - exact / 1000.0) <= MV_TOLERANCE(code),
+		      "attn %u os %u code %u: %u mV, exact %.3f mV", attn, oversampling, code, mv, exact / 1000.0);
+
+		// Bursts of 1 to 64 equal samples plus every fractional step of the longest one
+		for (uint8_t log2_n = 0; log2_n <= 6; log2_n++)
+		{
+			uint32_t sum = code << log2_n;
+			uint32_t uv = gpadc_conv_to_uv(&conv, sum, log2_n);
+			double err = uv - exact;
+			CHECK(fabs(err) <= tolerance, "attn %u os %u sum %u/2^%u: %u uV, exact %.1f uV",
+			      attn, oversampling, sum, log2_n, uv, exact);
+		}
+
+		for (uint32_t frac = 0; frac < 64U && code + 1U < codes; frac++)
+		{
+			uint32_t sum = (code << 6) + frac;
+			double exact_frac = exact_uv(cal, ref_mv, resolution, sum / 64.0);
+			uint32_t uv = gpadc_conv_to_uv(&conv, sum, 6);
+			double err = uv - exact_frac;
+			CHECK(fabs(err) <= tolerance, "attn %u os %u sum %u/64: %u uV, exact %.1f uV",
+			      attn, oversampling, sum, uv, exact_frac);
+
+			// Only the range above the clamp says anything about bias
+			if (exact_frac > 0)
+			{
+				err_sum += err;
+				n++;
+				if (fabs(err) > err_max)
+				{
+					err_max = fabs(err);
+				}
+			}
+		}
+	}
+
+	// Rounding errors average out to within the Q24 scale error, a bias term scaled wrong would not
+	double err_mean = err_sum / n;
+	CHECK(fabs(err_mean) <= 1.0, "attn %u os %u: mean error %.2f uV", attn, oversampling, err_mean);
+	printf("attn %u os %u: mean error %+.2f uV, max %.2f uV\n", attn, oversampling, err_mean, err_max);
+}
+
+static void check_isqrt(void)
+{
+	for (uint32_t root = 0; root < 65536U; root++)
+	{
+		uint32_t square = root * root;
+		CHECK(gpadc_isqrt(square) == root, "isqrt(%u)", square);
+		if (root != 0)
+		{
+			CHECK(gpadc_isqrt(square - 1U) == root - 1U, "isqrt(%u)", square - 1U);
+		}
+	}
+	CHECK(gpadc_isqrt(0xFFFFFFFFU) == 0xFFFFU, "isqrt(2^32 - 1)");
+}
+
+int main(void)
+{
+	for (uint32_t i = 0; i < sizeof(LIN_CAL) / sizeof(LIN_CAL[0]); i++)
+	{
+		for (uint8_t oversampling = 0; oversampling <= 6; oversampling++)
+		{
+			check_config(&LIN_CAL[i], LIN_CAL_ATTN[i], oversampling);
+		}
+	}
+
+	check_isqrt();
+
+	return test_result("test_gpadc_conv");
+}
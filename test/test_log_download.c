@@ -0,0 +1,268 @@
+/**
+ ****************************************************************************************
+ * @file test_log_download.c
+ * @brief Log download on the RAM flash model: notifications built as log_dl_pump() builds
+ *        them, a client resuming after disconnects, gaps left by torn pages and the sector
+ *        under the cursor erased by logging while the download runs.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flash_model.h"
+#include "log_decode.h"
+#include "user_log_store.h"
+#include "test_check.h"
+
+// Same layout as DEF_SVC1_LOG_DATA_HEADER_LEN and DEF_SVC1_LOG_DATA_CHAR_LEN in user_custs1_def.h
+#define DATA_HEADER_LEN  5U
+#define DATA_CHAR_LEN    244U
+
+#define SECTORS          (LOG_STORE_FLASH_SIZE / LOG_STORE_SECTOR_SIZE)
+#define PAGES            (SECTORS * LOG_STORE_PAGES_PER_SECTOR)
+#define PERIOD_US        100000U
+#define MAX_SEQ          (4U * PAGES)
+
+static uint32_t now_us;
+static uint32_t sample_n;
+
+/// Client side of the download
+typedef struct
+{
+	log_decode_t dec;
+	uint32_t received[MAX_SEQ]; // complete blocks received per sequence number
+	uint32_t last_seq;          // newest complete block, 0 before the first
+	uint32_t restarts;          // complete blocks that did not follow the one before
+	uint32_t end_seq;           // seq of the end marker, 0 until it came
+	uint32_t notifications;
+} client_t;
+
+static void client_block(log_store_block_t const *block, uint8_t const *samples, void *ctx)
+{
+	client_t *client = ctx;
+
+	(void)samples;
+	if (block->seq < MAX_SEQ)
+	{
+		client->received[block->seq]++;
+	}
+	client->restarts += (client->last_seq != 0 && block->seq != client->last_seq + 1U);
+	client->last_seq = block->seq;
+}
+
+static void client_init(client_t *client)
+{
+	memset(client, 0, sizeof(*client));
+	log_decode_init(&client->dec, client_block, client);
+}
+
+/// One notification as log_dl_pump() fills it, false once the end marker went out
+static bool notify(log_store_cursor_t *cursor, uint16_t capacity, client_t *client)
+{
+	uint8_t value[DATA_CHAR_LEN];
+
+	uint16_t length = log_store_read(cursor, &value[DATA_HEADER_LEN], (uint16_t)(capacity - DATA_HEADER_LEN));
+	uint32_t seq = (length > 0) ? cursor->chunk_seq : cursor->seq;
+	CHECK(length == 0 || cursor->chunk_offset <= 0xFFU, "offset %u does not fit the notification", cursor->chunk_offset);
+	uint8_t offset = (length > 0) ? (uint8_t)cursor->chunk_offset : 0;
+	client->notifications++;
+
+	if (length == 0)
+	{
+		client->end_seq = seq;
+		return false;
+	}
+
+	log_decode_chunk(&client->dec, seq, offset, &value[DATA_HEADER_LEN], length);
+
+	return true;
+}
+
+/// Start a download at the block after the last complete one, as the client resumes
+static void start(log_store_cursor_t *cursor, client_t *client)
+{
+	log_store_flush();
+	CHECK(log_store_seek(client->last_seq + 1U, cursor), "seek failed");
+}
+
+static void reboot(void)
+{
+	flash_model_power_on();
+	now_us = 0;
+	CHECK(log_store_init(), "flash not found at boot");
+}
+
+static void append(uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		now_us += PERIOD_US;
+		log_store_append(now_us, (uint16_t)sample_n++);
+
+		// log_erase_timer_cb() runs before the next sample
+		if (log_store_erase_pending())
+		{
+			log_store_prepare();
+		}
+	}
+}
+
+static void fresh_log(uint32_t blocks)
+{
+	flash_model_reset();
+	sample_n = 0;
+	reboot();
+	append(blocks * LOG_STORE_MAX_SAMPLES);
+}
+
+/// Every block the log holds arrived exactly once
+static void check_complete(client_t const *client, char const *scenario)
+{
+	log_store_t const *log = log_store_get();
+	uint32_t missing = 0;
+	uint32_t repeated = 0;
+
+	for (uint32_t seq = 1; seq < MAX_SEQ; seq++)
+	{
+		bool held = (seq >= log->first_seq && seq < log->next_seq);
+		missing += (held && client->received[seq] == 0);
+		repeated += (client->received[seq] > 1);
+	}
+	CHECK(missing == 0 && repeated == 0, "%s: %u blocks missing, %u repeated",
+	      scenario, missing, repeated);
+	CHECK(client->dec.errors == 0, "%s: %u bad chunks or blocks", scenario, client->dec.errors);
+	CHECK(client->end_seq == log->next_seq, "%s: end marker at %u, next block %u", scenario, client->end_seq,
+	      log->next_seq);
+}
+
+static void check_resume(void)
+{
+	static const uint16_t CAPACITIES[] = { 20, 64, 182, DATA_CHAR_LEN };
+	static client_t client;
+	log_store_cursor_t cursor;
+
+	// A partial block at the end, then disconnects at random points of the stream
+	fresh_log(300);
+	append(17);
+	srand(531);
+
+	for (uint32_t c = 0; c < sizeof(CAPACITIES) / sizeof(CAPACITIES[0]); c++)
+	{
+		uint32_t connections = 0;
+
+		client_init(&client);
+		while (client.end_seq == 0 && connections < 1000U)
+		{
+			uint32_t budget = 1U + (uint32_t)rand() % 400U;
+
+			start(&cursor, &client);
+			connections++;
+			while (budget-- > 0 && notify(&cursor, CAPACITIES[c], &client))
+			{
+			}
+		}
+
+		check_complete(&client, "resume");
+		CHECK(client.restarts == 0, "capacity %u: %u restarts", CAPACITIES[c], client.restarts);
+		printf("capacity %3u: %u blocks in %u notifications over %u connections\n", CAPACITIES[c],
+		       log_store_get()->next_seq - 1U, client.notifications, connections);
+	}
+
+	// A resume past the end only gets the end marker
+	client_init(&client);
+	client.last_seq = log_store_get()->next_seq - 1U;
+	start(&cursor, &client);
+	CHECK(!notify(&cursor, DATA_CHAR_LEN, &client) && client.end_seq == log_store_get()->next_seq,
+	      "resume past the end sent log bytes");
+}
+
+static void check_gaps(void)
+{
+	static client_t client;
+	log_store_cursor_t cursor;
+
+	// Torn pages inside a sector and on a sector's last page, each followed by a reboot
+	fresh_log(5);
+	static const uint32_t TORN_BLOCKS[] = { 20, LOG_STORE_PAGES_PER_SECTOR - 1U, 3U };
+	for (uint32_t t = 0; t < sizeof(TORN_BLOCKS) / sizeof(TORN_BLOCKS[0]); t++)
+	{
+		append(TORN_BLOCKS[t] * LOG_STORE_MAX_SAMPLES);
+		flash_model_cut_after(LOG_STORE_PAGE_SIZE / 2U);
+		append(LOG_STORE_MAX_SAMPLES);
+		reboot();
+	}
+	append(40U * LOG_STORE_MAX_SAMPLES);
+	CHECK(log_store_get()->skipped == 1, "%u pages skipped", log_store_get()->skipped);
+
+	client_init(&client);
+	start(&cursor, &client);
+	while (notify(&cursor, DATA_CHAR_LEN, &client))
+	{
+	}
+	check_complete(&client, "gaps");
+	CHECK(client.restarts == 0, "gaps: %u restarts", client.restarts);
+
+	// Resuming at any block, also the ones right after a gap, starts with that block
+	for (uint32_t seq = log_store_get()->first_seq; seq < log_store_get()->next_seq; seq++)
+	{
+		client_init(&client);
+		client.last_seq = seq - 1U;
+		start(&cursor, &client);
+		notify(&cursor, DATA_CHAR_LEN, &client);
+		CHECK(cursor.chunk_seq == seq && cursor.chunk_offset == 0, "resume at %u started at %u offset %u",
+		      seq, cursor.chunk_seq, cursor.chunk_offset);
+	}
+}
+
+static void check_erase_during_download(void)
+{
+	static client_t client;
+	log_store_cursor_t cursor;
+
+	// Full ring, download from the oldest block while logging carries on
+	fresh_log(PAGES + LOG_STORE_PAGES_PER_SECTOR / 2U);
+	client_init(&client);
+	start(&cursor, &client);
+
+	uint32_t first_before = log_store_get()->first_seq;
+	uint32_t n = 0;
+	while (notify(&cursor, DATA_CHAR_LEN, &client))
+	{
+		// One block logged per three notifications, and a burst that overtakes the cursor
+		if (++n % 3U == 0)
+		{
+			append(LOG_STORE_MAX_SAMPLES);
+		}
+		if (n == 50U)
+		{
+			append(3U * LOG_STORE_PAGES_PER_SECTOR * LOG_STORE_MAX_SAMPLES);
+		}
+	}
+
+	// The erase under the cursor restarts the stream at the oldest block left, once
+	CHECK(log_store_get()->first_seq > first_before + 3U * LOG_STORE_PAGES_PER_SECTOR,
+	      "burst did not move the tail: %u from %u", log_store_get()->first_seq, first_before);
+	CHECK(client.restarts == 1, "%u restarts", client.restarts);
+	CHECK(client.dec.errors == 0, "%u bad chunks or blocks", client.dec.errors);
+	CHECK(client.end_seq == log_store_get()->next_seq, "end marker at %u, next block %u", client.end_seq,
+	      log_store_get()->next_seq);
+
+	uint32_t missing = 0;
+	for (uint32_t seq = log_store_get()->first_seq; seq < log_store_get()->next_seq; seq++)
+	{
+		missing += (client.received[seq] != 1U);
+	}
+	CHECK(missing == 0, "%u blocks still in flash missing or repeated", missing);
+}
+
+int main(void)
+{
+	check_resume();
+	check_gaps();
+	check_erase_during_download();
+
+	return test_result("test_log_download");
+}
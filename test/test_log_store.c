@@ -0,0 +1,387 @@
+/**
+ ****************************************************************************************
+ * @file test_log_store.c
+ * @brief Log ring on the RAM flash model: three laps with reboots, a page torn by a power
+ *        cut, a sector erase lost to a reset, a block waiting for its erase and the log clock
+ *        across a timebase wrap.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "flash_model.h"
+#include "log_decode.h"
+#include "user_log_store.h"
+#include "test_check.h"
+
+#define SECTORS          (LOG_STORE_FLASH_SIZE / LOG_STORE_SECTOR_SIZE)
+#define PAGES            (SECTORS * LOG_STORE_PAGES_PER_SECTOR)
+#define FIRST_SECTOR     (LOG_STORE_FLASH_ADDR / FLASH_MODEL_SECTOR_SIZE)
+#define PERIOD_US        100000U
+
+static uint32_t now_us;             // timebase, restarts at 0 with every boot
+static uint32_t sample_n;           // samples appended, the low 16 bits are the sample value
+static uint8_t snapshot[SPI_FLASH_DEV_SIZE];
+static uint32_t snapshot_n;
+
+/// What reading the whole ring found
+typedef struct
+{
+	uint32_t blocks;
+	uint32_t first_seq;
+	uint32_t last_seq;
+	uint32_t breaks;            // samples that do not follow on from the one before
+	uint16_t mv;                // last sample
+	uint16_t boot;
+	uint32_t ms;
+	uint32_t period_ms;         // spacing checked within a boot, 0 for none
+	uint32_t *times_ms;         // every sample time if set
+	uint32_t samples;
+} log_check_t;
+
+static void check_block(log_store_block_t const *block, uint8_t const *samples, void *ctx)
+{
+	log_check_t *check = ctx;
+
+	CHECK(check->blocks == 0 || block->seq == check->last_seq + 1U, "block %u after %u", block->seq, check->last_seq);
+	if (check->blocks == 0)
+	{
+		check->first_seq = block->seq;
+	}
+
+	uint32_t ms = block->base_ms;
+	for (uint8_t i = 0; i < block->count; i++)
+	{
+		uint16_t dt_ms = (uint16_t)(samples[4U * i] | (samples[4U * i + 1U] << 8));
+		uint16_t mv = (uint16_t)(samples[4U * i + 2U] | (samples[4U * i + 3U] << 8));
+		ms += dt_ms;
+		CHECK(i > 0 || dt_ms == 0, "block %u starts %u ms after its base", block->seq, dt_ms);
+
+		bool follows = (check->samples > 0) && (mv == (uint16_t)(check->mv + 1U));
+		check->breaks += (check->samples > 0 && !follows);
+		if (follows && check->period_ms != 0 && block->boot == check->boot)
+		{
+			CHECK(ms - check->ms == check->period_ms, "block %u sample %u: %u ms after the one before",
+			      block->seq, i, ms - check->ms);
+		}
+		if (check->times_ms != NULL)
+		{
+			check->times_ms[check->samples] = ms;
+		}
+
+		check->mv = mv;
+		check->ms = ms;
+		check->samples++;
+	}
+
+	check->boot = block->boot;
+	check->last_seq = block->seq;
+	check->blocks++;
+}
+
+/// Read the whole ring in chunks of the given size, as a download would
+static void read_log(log_check_t *check, uint16_t chunk)
+{
+	log_store_cursor_t cursor;
+	log_decode_t dec;
+	uint8_t data[1024];
+	uint16_t length;
+
+	CHECK(log_store_seek(0, &cursor), "seek on a ready log failed");
+	log_decode_init(&dec, check_block, check);
+	while ((length = log_store_read(&cursor, data, chunk)) > 0)
+	{
+		log_decode_chunk(&dec, cursor.chunk_seq, cursor.chunk_offset, data, length);
+	}
+	CHECK(dec.errors == 0, "%u bad chunks or blocks", dec.errors);
+
+	// Exactly the blocks the log says it holds
+	log_store_t const *log = log_store_get();
+	CHECK(check->blocks == log->next_seq - log->first_seq, "read %u blocks, log holds %u to %u",
+	      check->blocks, log->first_seq, log->next_seq - 1U);
+	CHECK(check->blocks == 0 || (check->first_seq == log->first_seq && check->last_seq == log->next_seq - 1U),
+	      "read blocks %u to %u, log holds %u to %u", check->first_seq, check->last_seq,
+	      log->first_seq, log->next_seq - 1U);
+}
+
+static void reboot(void)
+{
+	flash_model_power_on();
+	now_us = 0;
+	CHECK(log_store_init(), "flash not found at boot");
+}
+
+/// log_erase_timer_cb(), scheduled after every sample and run before the next one
+static void idle(void)
+{
+	if (log_store_erase_pending())
+	{
+		log_store_prepare();
+	}
+}
+
+static void append(uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++)
+	{
+		uint16_t erases = log_store_get()->erases;
+
+		now_us += PERIOD_US;
+		log_store_append(now_us, (uint16_t)sample_n++);
+		CHECK(log_store_get()->erases == erases, "sample %u erased a sector", sample_n - 1U);
+		idle();
+	}
+}
+
+static void prepare(uint32_t blocks)
+{
+	flash_model_reset();
+	sample_n = 0;
+	reboot();
+	append(blocks * LOG_STORE_MAX_SAMPLES);
+	memcpy(snapshot, flash_model_mem, sizeof(snapshot));
+	snapshot_n = sample_n;
+}
+
+static void restore(void)
+{
+	memcpy(flash_model_mem, snapshot, sizeof(snapshot));
+	sample_n = snapshot_n;
+	reboot();
+}
+
+static void check_ring_wrap(void)
+{
+	uint32_t blocks = 3U * PAGES + PAGES / 3U;
+
+	flash_model_reset();
+	sample_n = 0;
+	reboot();
+	CHECK(log_store_get()->first_seq == 1 && log_store_get()->next_seq == 1, "blank flash holds blocks");
+
+	// Three laps and a third, flushing a partial block and rebooting every 150 blocks or so
+	while (log_store_get()->next_seq <= blocks)
+	{
+		append(150U * LOG_STORE_MAX_SAMPLES + 17U);
+		log_store_flush();
+
+		log_store_t before = *log_store_get();
+		reboot();
+		log_store_t const *log = log_store_get();
+		CHECK(log->first_seq == before.first_seq && log->next_seq == before.next_seq && log->head == before.head &&
+		      log->tail_sector == before.tail_sector && log->boot == before.boot + 1U,
+		      "reboot at block %u: blocks %u to %u head %u tail %u, before %u to %u head %u tail %u",
+		      before.next_seq, log->first_seq, log->next_seq, log->head, log->tail_sector,
+		      before.first_seq, before.next_seq, before.head, before.tail_sector);
+
+		// Once around, the ring holds all sectors but the one erased ahead of the head
+		uint32_t held = log->next_seq - log->first_seq;
+		if (log->next_seq > PAGES)
+		{
+			CHECK(held > (SECTORS - 2U) * LOG_STORE_PAGES_PER_SECTOR &&
+			      held <= (SECTORS - 1U) * LOG_STORE_PAGES_PER_SECTOR + 1U,
+			      "%u blocks held after block %u", held, log->next_seq - 1U);
+		}
+
+		log_check_t check = { .period_ms = PERIOD_US / 1000U };
+		read_log(&check, 1000);
+		CHECK(check.breaks == 0, "%u breaks in the samples", check.breaks);
+	}
+
+	// Every sector erased once per lap after the first, blank ones are not erased again
+	uint32_t least = UINT32_MAX;
+	uint32_t most = 0;
+	for (uint32_t s = 0; s < SECTORS; s++)
+	{
+		uint32_t erases = flash_model_erases[FIRST_SECTOR + s];
+		least = (erases < least) ? erases : least;
+		most = (erases > most) ? erases : most;
+	}
+	CHECK(least >= 2U && most - least <= 1U, "sectors erased %u to %u times", least, most);
+	CHECK(log_store_get()->dropped == 0, "%u samples dropped", log_store_get()->dropped);
+	CHECK(flash_model_overwrites == 0, "%u bits programmed over data", flash_model_overwrites);
+	printf("ring: %u blocks over %u pages, sectors erased %u to %u times\n", log_store_get()->next_seq - 1U,
+	       PAGES, least, most);
+}
+
+/// Cut a block and the erase after it cut bytes in, reboot, write two more blocks and read it all back
+static void check_cut(uint32_t blocks, uint32_t cut, bool *kept)
+{
+	restore();
+	flash_model_cut_after(cut);
+	append(LOG_STORE_MAX_SAMPLES);
+	idle();
+	bool was_cut = flash_model_is_cut();
+
+	reboot();
+	uint32_t next_seq = log_store_get()->next_seq;
+	CHECK(next_seq == blocks + 1U || next_seq == blocks + 2U, "cut at %u bytes: next block %u", cut, next_seq);
+	CHECK(was_cut || next_seq == blocks + 2U, "cut at %u bytes: block lost without a cut", cut);
+	*kept = (next_seq == blocks + 2U);
+
+	append(2U * LOG_STORE_MAX_SAMPLES);
+	CHECK(log_store_get()->next_seq == next_seq + 2U && log_store_get()->failed == 0,
+	      "cut at %u bytes: %u blocks written after it, %u failed", cut, log_store_get()->next_seq - next_seq,
+	      log_store_get()->failed);
+
+	reboot();
+	log_check_t check = { .period_ms = PERIOD_US / 1000U };
+	read_log(&check, 244);
+	CHECK(check.breaks == (*kept ? 0U : 1U), "cut at %u bytes: %u breaks in the samples", cut, check.breaks);
+	CHECK(flash_model_overwrites == 0, "cut at %u bytes: %u bits programmed over data", cut, flash_model_overwrites);
+}
+
+static void check_torn_page(void)
+{
+	// Blocks cut inside a sector, on its last page and on the last page of the ring
+	static const uint32_t BLOCKS[] = { 5, LOG_STORE_PAGES_PER_SECTOR - 1U, PAGES - 1U };
+
+	for (uint32_t b = 0; b < sizeof(BLOCKS) / sizeof(BLOCKS[0]); b++)
+	{
+		uint32_t kept_count = 0;
+
+		prepare(BLOCKS[b]);
+		for (uint32_t cut = 0; cut <= LOG_STORE_PAGE_SIZE; cut++)
+		{
+			bool kept;
+			check_cut(BLOCKS[b], cut, &kept);
+			kept_count += kept;
+
+			// A torn page is left alone, the blocks after it start a fresh sector
+			uint32_t head = BLOCKS[b] + (kept ? 3U : 2U);
+			if (cut > 0 && !kept)
+			{
+				head = (BLOCKS[b] / LOG_STORE_PAGES_PER_SECTOR + 1U) * LOG_STORE_PAGES_PER_SECTOR + 2U;
+			}
+			CHECK(log_store_get()->head == head % PAGES, "block %u cut at %u bytes: head page %u, expected %u",
+			      BLOCKS[b] + 1U, cut, log_store_get()->head, head % PAGES);
+		}
+
+		// A full block fills the page, it only counts once every byte is in
+		CHECK(kept_count == 1, "block %u kept for %u cut points", BLOCKS[b] + 1U, kept_count);
+	}
+}
+
+static void check_lost_erase(void)
+{
+	// Past one lap the next block enters a sector and the one after it holds the oldest blocks
+	uint32_t blocks = PAGES + 2U * LOG_STORE_PAGES_PER_SECTOR;
+	uint32_t tail_seq = blocks - PAGES + LOG_STORE_PAGES_PER_SECTOR + 1U;
+
+	prepare(blocks);
+	CHECK(log_store_get()->first_seq == tail_seq, "oldest block %u, expected %u", log_store_get()->first_seq, tail_seq);
+
+	for (uint32_t cut = 0; cut <= LOG_STORE_SECTOR_SIZE + LOG_STORE_PAGE_SIZE; cut += (cut < 520U) ? 1U : 97U)
+	{
+		bool kept;
+		check_cut(blocks, cut, &kept);
+		CHECK(kept == (cut >= LOG_STORE_PAGE_SIZE), "cut at %u bytes: block kept %u", cut, kept);
+
+		// Nothing erased leaves the oldest sector in the ring, any part of an erase drops it
+		restore();
+		flash_model_cut_after(cut);
+		append(LOG_STORE_MAX_SAMPLES);
+		idle();
+		reboot();
+		uint32_t expected = (cut <= LOG_STORE_PAGE_SIZE) ? tail_seq : tail_seq + LOG_STORE_PAGES_PER_SECTOR;
+		CHECK(log_store_get()->first_seq == expected, "cut at %u bytes: oldest block %u, expected %u",
+		      cut, log_store_get()->first_seq, expected);
+	}
+}
+
+static void check_waiting(void)
+{
+	flash_model_reset();
+	sample_n = 0;
+	reboot();
+
+	// Without the idle task the first block waits for its sector and the next one is dropped
+	for (uint32_t i = 0; i < 2U * LOG_STORE_MAX_SAMPLES; i++)
+	{
+		now_us += PERIOD_US;
+		log_store_append(now_us, (uint16_t)sample_n++);
+	}
+	log_store_flush();
+	log_store_t const *log = log_store_get();
+	CHECK(log->waiting && log->next_seq == 1 && log->count == LOG_STORE_MAX_SAMPLES, "full block did not wait");
+	CHECK(log->dropped == LOG_STORE_MAX_SAMPLES && log->erases == 0, "%u samples dropped, %u erases",
+	      log->dropped, log->erases);
+
+	// The idle task checks the sector and programs the block
+	idle();
+	CHECK(!log->waiting && log->next_seq == 2 && log->count == 0 && log->head == 1, "waiting block not written");
+	CHECK(log->erases == 0, "blank sector erased");
+
+	// A sector the idle task left dirty is erased before the block that needs it
+	uint32_t blocks = PAGES + 2U * LOG_STORE_PAGES_PER_SECTOR;
+	uint32_t full_n = 0;
+	for (uint32_t i = 1; i < blocks; i++)
+	{
+		uint32_t writes = log->writes;
+		append(LOG_STORE_MAX_SAMPLES);
+		full_n += (log->writes == writes + 1U);
+	}
+	CHECK(full_n == blocks - 1U && log->dropped == LOG_STORE_MAX_SAMPLES, "%u of %u blocks written, %u dropped",
+	      full_n, blocks - 1U, log->dropped);
+	CHECK(flash_model_overwrites == 0, "%u bits programmed over data", flash_model_overwrites);
+}
+
+static void check_clock_wrap(void)
+{
+	static uint32_t times_ms[4U * LOG_STORE_MAX_SAMPLES];
+	uint32_t expected_ms[4U * LOG_STORE_MAX_SAMPLES];
+	uint64_t elapsed_us = 0;
+	uint32_t n = 0;
+
+	flash_model_reset();
+	sample_n = 0;
+	reboot();
+
+	// Clock kept running by the battery channel until 3 s before the timebase wraps
+	while (elapsed_us < 0xFFFFFFFFULL - 3000000U)
+	{
+		uint64_t step = 0xFFFFFFFFULL - 3000000U - elapsed_us;
+		elapsed_us += (step > 59000123U) ? 59000123U : step;
+		CHECK(log_store_clock((uint32_t)elapsed_us) == elapsed_us / 1000U, "clock %u ms at %llu us",
+		      log_store_get()->now_ms, (unsigned long long)elapsed_us);
+	}
+
+	// Samples 250.123 ms apart across the wrap, then a gap too long for a 16-bit delta
+	for (uint32_t i = 0; i < 2U * LOG_STORE_MAX_SAMPLES + 10U; i++)
+	{
+		elapsed_us += 250123U;
+		log_store_append((uint32_t)elapsed_us, (uint16_t)sample_n++);
+		expected_ms[n++] = (uint32_t)(elapsed_us / 1000U);
+		idle();
+	}
+	uint32_t before_gap = log_store_get()->next_seq;
+	elapsed_us += 40000000U;
+	log_store_clock((uint32_t)elapsed_us);
+	elapsed_us += 30000000U;
+	log_store_append((uint32_t)elapsed_us, (uint16_t)sample_n++);
+	expected_ms[n++] = (uint32_t)(elapsed_us / 1000U);
+	CHECK(log_store_get()->next_seq == before_gap + 1U && log_store_get()->count == 1,
+	      "70 s gap did not close the block");
+	log_store_flush();
+
+	log_check_t check = { .times_ms = times_ms };
+	read_log(&check, 1000);
+	CHECK(check.samples == n && check.breaks == 0, "%u of %u samples read, %u breaks", check.samples, n, check.breaks);
+	for (uint32_t i = 0; i < n && i < check.samples; i++)
+	{
+		CHECK(times_ms[i] == expected_ms[i], "sample %u at %u ms, expected %u ms", i, times_ms[i], expected_ms[i]);
+	}
+}
+
+int main(void)
+{
+	check_ring_wrap();
+	check_torn_page();
+	check_lost_erase();
+	check_waiting();
+	check_clock_wrap();
+
+	return test_result("test_log_store");
+}
@@ -0,0 +1,146 @@
+/**
+ ****************************************************************************************
+ * @file test_pwm_comp.c
+ * @brief Bit-exactness of the reciprocal compensation against the int32 division it replaced,
+ *        and of the Q8 pulse width against exact 64-bit arithmetic.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+
+#include "user_pwm_comp.h"
+#include "test_check.h"
+
+// Input ranges accepted by timer2_pwm_set_vbias() and timer2_pwm_set_frequency()
+#define TARGET_MIN_MV  (-1000)
+#define TARGET_MAX_MV  1000
+#define PERIOD_MIN     2U
+#define PERIOD_MAX     16383U
+
+// VBAT values where the reciprocal or the old guard changes behaviour, plus the battery range ends
+static const uint16_t EDGE_VBAT[] =
+{
+	100, 101, 700, 1800, 1850, 1900, 2500, 3000, 3300, 3600, 3700, 4095, 4096, 10000, 32767, 32768, 65535
+};
+
+// Period counts around powers of two and the ends of the range
+static const uint16_t EDGE_PERIOD[] =
+{
+	2, 3, 4, 5, 7, 127, 128, 129, 255, 256, 257, 1000, 1023, 1024, 1025,
+	2047, 2048, 4095, 4096, 8191, 8192, 10000, 16000, 16381, 16382, 16383
+};
+
+/// Compensation as it was computed before the reciprocal, with the < 100 mV guard handled by the caller
+static uint32_t reference_pulse_width(int16_t target_mv, uint32_t period_count, uint16_t vbat_mv)
+{
+	int32_t half_period = (int32_t)period_count / 2;
+	int32_t numerator   = 5 * (int32_t)target_mv * (int32_t)period_count;
+	int32_t denominator = 7 * (int32_t)vbat_mv;
+	int32_t second_term = numerator / denominator;
+	int32_t pulse_width_raw = half_period - second_term;
+
+	if (pulse_width_raw < 0)
+	{
+		return 0;
+	}
+	if (pulse_width_raw > (int32_t)period_count)
+	{
+		return period_count;
+	}
+	return (uint32_t)pulse_width_raw;
+}
+
+/// Q8 pulse width in 64-bit arithmetic: second term truncated to 1/256 count toward zero, odd half period kept
+static uint32_t reference_pulse_width_q8(int16_t target_mv, uint32_t period_count, uint16_t vbat_mv)
+{
+	int64_t magnitude = (target_mv < 0) ? -(int64_t)target_mv : (int64_t)target_mv;
+	int64_t second_term_q8 = (magnitude * 5 * period_count << PWM_COMP_FRAC_BITS) / (7 * (int64_t)vbat_mv);
+	int64_t half_period_q8 = (int64_t)period_count << (PWM_COMP_FRAC_BITS - 1U);
+	int64_t pulse_width_q8 = (target_mv < 0) ? (half_period_q8 + second_term_q8) : (half_period_q8 - second_term_q8);
+	int64_t full_q8 = (int64_t)period_count << PWM_COMP_FRAC_BITS;
+
+	if (pulse_width_q8 < 0)
+	{
+		return 0;
+	}
+	if (pulse_width_q8 > full_q8)
+	{
+		return (uint32_t)full_q8;
+	}
+	return (uint32_t)pulse_width_q8;
+}
+
+/// Compare every target at one VBAT and period in both widths, stops reporting after the first mismatch
+static uint64_t check_point(pwm_comp_t const *comp, uint32_t period)
+{
+	for (int32_t target = TARGET_MIN_MV; target <= TARGET_MAX_MV; target++)
+	{
+		uint32_t expected = reference_pulse_width((int16_t)target, period, comp->vbat_mv);
+		uint32_t actual = pwm_comp_pulse_width(comp, (int16_t)target, period);
+		if (actual != expected)
+		{
+			CHECK(actual == expected, "vbat %u period %u target %d: %u, expected %u",
+			      comp->vbat_mv, period, target, actual, expected);
+			break;
+		}
+
+		uint32_t expected_q8 = reference_pulse_width_q8((int16_t)target, period, comp->vbat_mv);
+		uint32_t actual_q8 = pwm_comp_pulse_width_q8(comp, (int16_t)target, period);
+		if (actual_q8 != expected_q8)
+		{
+			CHECK(actual_q8 == expected_q8, "vbat %u period %u target %d: q8 %u, expected %u",
+			      comp->vbat_mv, period, target, actual_q8, expected_q8);
+			break;
+		}
+	}
+
+	return (uint64_t)(TARGET_MAX_MV - TARGET_MIN_MV + 1);
+}
+
+int main(void)
+{
+	pwm_comp_t comp = { 0 };
+	uint64_t cases = 0;
+
+	// Samples below the guard are refused and leave the state not ready
+	CHECK(!pwm_comp_set_vbat(&comp, 0) && !pwm_comp_ready(&comp), "0 mV accepted");
+	CHECK(!pwm_comp_set_vbat(&comp, PWM_COMP_MIN_VBAT_MV - 1U) && !pwm_comp_ready(&comp), "99 mV accepted");
+	CHECK(pwm_comp_set_vbat(&comp, PWM_COMP_MIN_VBAT_MV) && pwm_comp_ready(&comp), "100 mV refused");
+
+	// Every target and period at the edge VBAT values
+	for (uint32_t v = 0; v < sizeof(EDGE_VBAT) / sizeof(EDGE_VBAT[0]); v++)
+	{
+		pwm_comp_set_vbat(&comp, EDGE_VBAT[v]);
+		for (uint32_t period = PERIOD_MIN; period <= PERIOD_MAX; period++)
+		{
+			cases += check_point(&comp, period);
+		}
+	}
+
+	// Every target at the edge periods for every VBAT a cell can produce
+	for (uint32_t vbat = PWM_COMP_MIN_VBAT_MV; vbat <= 4200U; vbat++)
+	{
+		pwm_comp_set_vbat(&comp, (uint16_t)vbat);
+		for (uint32_t p = 0; p < sizeof(EDGE_PERIOD) / sizeof(EDGE_PERIOD[0]); p++)
+		{
+			cases += check_point(&comp, EDGE_PERIOD[p]);
+		}
+	}
+
+#ifdef PWM_COMP_EXHAUSTIVE
+	// Full grid over the battery operating range, 62 billion cases
+	for (uint32_t vbat = 1800U; vbat <= 3700U; vbat++)
+	{
+		pwm_comp_set_vbat(&comp, (uint16_t)vbat);
+		for (uint32_t period = PERIOD_MIN; period <= PERIOD_MAX; period++)
+		{
+			cases += check_point(&comp, period);
+		}
+	}
+#endif
+
+	printf("%llu cases compared\n", (unsigned long long)cases);
+
+	return test_result("test_pwm_comp");
+}
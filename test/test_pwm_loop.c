@@ -0,0 +1,215 @@
+/**
+ ****************************************************************************************
+ * @file test_pwm_loop.c
+ * @brief Closed-loop bias simulation: the PI controller regulating a first-order bias
+ *        filter with gain and offset errors, read back through the feedback pin.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "user_pwm_loop.h"
+#include "test_check.h"
+
+// Same values as the closed-loop constants in user_empty_peripheral_template.c
+#define TRIM_MAX_UV        200000
+#define TOLERANCE_UV       1000
+#define CONVERGED_SAMPLES  3U
+#define DEFAULT_KP_Q8      64U
+#define DEFAULT_KI_Q8      128U
+#define REF_MV             1350U
+
+/// Bias node behind the PWM: output = gain * drive + offset through a first-order filter
+typedef struct
+{
+	double gain;            // measured bias per target mV, the 5/7 constant is never exact
+	double offset_mv;       // op-amp rail offset
+	double tau_ms;          // filter time constant
+	double ref_mv;          // virtual ground the feedback pin actually sits on
+	double bias_mv;         // filter output
+} plant_t;
+
+/// One loop period of the firmware: read the pin, step the controller, drive target + trim
+typedef struct
+{
+	pwm_loop_pi_t pi;
+	int16_t trim_mv;
+	uint32_t in_band;
+	int32_t error_uv;
+} loop_t;
+
+static void plant_run(plant_t *plant, int32_t drive_mv, double period_ms)
+{
+	double target_mv = plant->gain * drive_mv + plant->offset_mv;
+	plant->bias_mv += (target_mv - plant->bias_mv) * (1.0 - exp(-period_ms / plant->tau_ms));
+}
+
+static void loop_step(loop_t *loop, plant_t *plant, int16_t setpoint_mv, uint16_t ref_mv)
+{
+	// Pin voltage rounded to a microvolt, as gpadc_conv_to_uv() returns it
+	uint32_t pin_uv = (uint32_t)lround((plant->ref_mv + plant->bias_mv) * 1000.0);
+	int32_t measured_uv = pwm_loop_bias_uv(pin_uv, ref_mv);
+
+	loop->error_uv = (int32_t)setpoint_mv * 1000 - measured_uv;
+	int32_t trim_uv = pwm_loop_pi_step(&loop->pi, loop->error_uv);
+	loop->trim_mv = (int16_t)((trim_uv >= 0 ? trim_uv + 500 : trim_uv - 500) / 1000);
+
+	bool in_band = (loop->error_uv <= TOLERANCE_UV && loop->error_uv >= -TOLERANCE_UV);
+	loop->in_band = in_band ? loop->in_band + 1U : 0;
+}
+
+/// Samples to convergence from a setpoint change, 0 if not converged within max_samples
+static uint32_t run_to_convergence(loop_t *loop, plant_t *plant, int16_t setpoint_mv, double period_ms,
+                                   uint32_t max_samples)
+{
+	loop->in_band = 0;
+	for (uint32_t n = 1; n <= max_samples; n++)
+	{
+		plant_run(plant, setpoint_mv + loop->trim_mv, period_ms);
+		loop_step(loop, plant, setpoint_mv, REF_MV);
+		if (loop->in_band == CONVERGED_SAMPLES)
+		{
+			return n;
+		}
+	}
+
+	return 0;
+}
+
+static void check_convergence(void)
+{
+	static const double GAINS[] = { 0.85, 0.95, 1.0, 1.05, 1.15 };
+	static const double OFFSETS_MV[] = { -150.0, -40.0, 0.0, 25.0, 150.0 };
+	static const int16_t SETPOINTS_MV[] = { -800, -100, 0, 300, 800 };
+	uint32_t worst = 0;
+	int32_t worst_hold_uv = 0;
+
+	// Default gains, 0.5 s loop period, filter tau 100 ms: every plant within the trim range settles
+	for (uint32_t g = 0; g < sizeof(GAINS) / sizeof(GAINS[0]); g++)
+	{
+		for (uint32_t o = 0; o < sizeof(OFFSETS_MV) / sizeof(OFFSETS_MV[0]); o++)
+		{
+			for (uint32_t s = 0; s < sizeof(SETPOINTS_MV) / sizeof(SETPOINTS_MV[0]); s++)
+			{
+				plant_t plant = { GAINS[g], OFFSETS_MV[o], 100.0, REF_MV, 0.0 };
+				loop_t loop = { 0 };
+				pwm_loop_pi_init(&loop.pi, DEFAULT_KP_Q8, DEFAULT_KI_Q8, TRIM_MAX_UV);
+
+				// The trim needed has to fit the limit for the loop to close the error
+				double trim_needed_mv = fabs(SETPOINTS_MV[s] * (1.0 - GAINS[g]) - OFFSETS_MV[o]) / GAINS[g];
+				if (trim_needed_mv > TRIM_MAX_UV / 1000.0 - 2.0)
+				{
+					continue;
+				}
+
+				uint32_t n = run_to_convergence(&loop, &plant, SETPOINTS_MV[s], 500.0, 40);
+				CHECK(n != 0, "gain %.2f offset %.0f mV setpoint %d mV: no convergence, error %d uV",
+				      GAINS[g], OFFSETS_MV[o], SETPOINTS_MV[s], loop.error_uv);
+				CHECK(!loop.pi.saturated, "gain %.2f offset %.0f mV setpoint %d mV: converged at the limit",
+				      GAINS[g], OFFSETS_MV[o], SETPOINTS_MV[s]);
+				worst = (n > worst) ? n : worst;
+
+				// The trim moves in whole millivolts, so a plant gain above 1 can hop just past the band
+				// afterwards, but never by more than one trim step
+				int32_t hold_uv = TOLERANCE_UV + (int32_t)(GAINS[g] * 1000.0);
+				for (uint32_t i = 0; i < 20; i++)
+				{
+					plant_run(&plant, SETPOINTS_MV[s] + loop.trim_mv, 500.0);
+					loop_step(&loop, &plant, SETPOINTS_MV[s], REF_MV);
+					CHECK(loop.error_uv <= hold_uv && loop.error_uv >= -hold_uv,
+					      "gain %.2f offset %.0f mV setpoint %d mV: left the band, error %d uV",
+					      GAINS[g], OFFSETS_MV[o], SETPOINTS_MV[s], loop.error_uv);
+					worst_hold_uv = (abs(loop.error_uv) > worst_hold_uv) ? abs(loop.error_uv) : worst_hold_uv;
+				}
+			}
+		}
+	}
+
+	printf("default gains: worst convergence %u samples (%.1f s), worst error after it %d uV\n",
+	       worst, worst * 0.5, worst_hold_uv);
+	CHECK(worst <= 25U, "worst convergence %u samples", worst);
+}
+
+static void check_windup(void)
+{
+	// An offset beyond the trim range pins the output at the limit without winding the integrator up
+	plant_t plant = { 1.0, 300.0, 100.0, REF_MV, 0.0 };
+	loop_t loop = { 0 };
+	pwm_loop_pi_init(&loop.pi, DEFAULT_KP_Q8, DEFAULT_KI_Q8, TRIM_MAX_UV);
+
+	for (uint32_t n = 0; n < 200; n++)
+	{
+		plant_run(&plant, 100 + loop.trim_mv, 500.0);
+		loop_step(&loop, &plant, 100, REF_MV);
+	}
+	CHECK(loop.pi.saturated && loop.pi.out_uv == -TRIM_MAX_UV, "output %d uV, saturated %u",
+	      loop.pi.out_uv, loop.pi.saturated);
+	CHECK(loop.pi.integ_uv >= -TRIM_MAX_UV, "integrator %d uV past the limit", loop.pi.integ_uv);
+
+	// Offset back in range: the output leaves the limit on the first sample whose error changed sign
+	plant.offset_mv = 20.0;
+	plant_run(&plant, 100 + loop.trim_mv, 500.0);
+	loop_step(&loop, &plant, 100, REF_MV);
+	CHECK(loop.error_uv > 0 && !loop.pi.saturated, "still at the limit, error %d uV", loop.error_uv);
+
+	uint32_t n = run_to_convergence(&loop, &plant, 100, 500.0, 40);
+	CHECK(n != 0 && n <= 25U, "recovery from the limit took %u samples", n);
+	printf("recovery from the trim limit: %u samples\n", n);
+}
+
+static void check_reference(void)
+{
+	// The loop regulates pin - BIAS_FB_REF_MV, a reference that is off by 40 mV leaves the bias off by 40 mV
+	plant_t plant = { 1.0, 10.0, 100.0, REF_MV + 40.0, 0.0 };
+	loop_t loop = { 0 };
+	pwm_loop_pi_init(&loop.pi, DEFAULT_KP_Q8, DEFAULT_KI_Q8, TRIM_MAX_UV);
+
+	for (uint32_t n = 0; n < 60; n++)
+	{
+		plant_run(&plant, 200 + loop.trim_mv, 500.0);
+		loop_step(&loop, &plant, 200, REF_MV);
+	}
+	CHECK(fabs(plant.bias_mv - 160.0) < 1.0, "bias %.2f mV with the reference 40 mV off", plant.bias_mv);
+
+	CHECK(pwm_loop_bias_uv(1350000U, 1350U) == 0, "pin at the reference");
+	CHECK(pwm_loop_bias_uv(350000U, 1350U) == -1000000, "pin 1 V below the reference");
+	CHECK(pwm_loop_bias_uv(3600000U, 1350U) == 2250000, "pin at full scale");
+}
+
+static void check_step_limits(void)
+{
+	pwm_loop_pi_t pi;
+
+	// Largest gains and errors stay inside 32 bits and inside the limit
+	pwm_loop_pi_init(&pi, 255U, 255U, TRIM_MAX_UV);
+	for (uint32_t n = 0; n < 10; n++)
+	{
+		int32_t out = pwm_loop_pi_step(&pi, INT32_MAX);
+		CHECK(out == TRIM_MAX_UV, "output %d uV at the largest error", out);
+	}
+	for (uint32_t n = 0; n < 10; n++)
+	{
+		int32_t out = pwm_loop_pi_step(&pi, INT32_MIN + 1);
+		CHECK(out >= -TRIM_MAX_UV && out <= TRIM_MAX_UV, "output %d uV at the smallest error", out);
+	}
+
+	// Small errors of either sign give equal steps
+	pwm_loop_pi_init(&pi, DEFAULT_KP_Q8, DEFAULT_KI_Q8, TRIM_MAX_UV);
+	int32_t up = pwm_loop_pi_step(&pi, 1000);
+	pwm_loop_pi_init(&pi, DEFAULT_KP_Q8, DEFAULT_KI_Q8, TRIM_MAX_UV);
+	int32_t down = pwm_loop_pi_step(&pi, -1000);
+	CHECK(up == -down, "steps %d and %d uV", up, down);
+}
+
+int main(void)
+{
+	check_convergence();
+	check_windup();
+	check_reference();
+	check_step_limits();
+
+	return test_result("test_pwm_loop");
+}
@@ -0,0 +1,139 @@
+/**
+ ****************************************************************************************
+ * @file test_pwm_plan.c
+ * @brief Frequency planner against a brute-force search over every clock source, divider
+ *        and pwm_div.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "user_pwm_comp.h"
+#include "user_pwm_plan.h"
+#include "test_check.h"
+
+/// Every setting Timer2 accepts, same preferences as pwm_plan_search(): closest frequency, then finer, then LP
+static pwm_plan_t reference_plan(uint32_t target_hz, uint16_t min_resolution_mv, uint16_t vbat_mv, uint8_t frac_bits)
+{
+	pwm_plan_t best = {0};
+	uint64_t best_err = 0;
+	uint32_t best_input_hz = 0;
+	bool found = false;
+	bool met = false;
+
+	// The resolution is met when 7 * vbat / (5 * pwm_div * 2^frac_bits) <= min_resolution, exactly
+	for (uint32_t div = PWM_PLAN_MIN_DIV; div <= PWM_PLAN_MAX_DIV && !met; div++)
+	{
+		met = (min_resolution_mv == 0) || (7ULL * vbat_mv <= ((5ULL * div * min_resolution_mv) << frac_bits));
+	}
+
+	for (uint8_t src = 0; src < 2; src++)
+	{
+		bool lp_clock = (src == 1);
+
+		for (uint8_t clk_div = 0; clk_div <= PWM_PLAN_MAX_CLK_DIV; clk_div++)
+		{
+			uint32_t input_hz = (lp_clock ? PWM_PLAN_LP_CLK_HZ : PWM_PLAN_SYS_CLK_HZ) >> clk_div;
+
+			for (uint32_t div = PWM_PLAN_MIN_DIV; div <= PWM_PLAN_MAX_DIV; div++)
+			{
+				bool div_met = (min_resolution_mv == 0) ||
+				               (7ULL * vbat_mv <= ((5ULL * div * min_resolution_mv) << frac_bits));
+
+				// Without a pwm_div fine enough only the finest one is planned
+				if ((met && !div_met) || (!met && div != PWM_PLAN_MAX_DIV))
+				{
+					continue;
+				}
+
+				uint64_t period_hz = (uint64_t)target_hz * div;
+				uint64_t err = (period_hz > input_hz) ? (period_hz - input_hz) : (input_hz - period_hz);
+				uint64_t lhs = err * best.pwm_div;
+				uint64_t rhs = best_err * div;
+
+				if (!found || lhs < rhs || (lhs == rhs && (div > best.pwm_div || (div == best.pwm_div && lp_clock && !best.lp_clock))))
+				{
+					found = true;
+					best_err = err;
+					best_input_hz = input_hz;
+					best.lp_clock = lp_clock;
+					best.clk_div = clk_div;
+					best.pwm_div = (uint16_t)div;
+				}
+			}
+		}
+	}
+
+	best.freq_hz = (uint32_t)(((uint64_t)best_input_hz * 2U + best.pwm_div) / (2U * best.pwm_div));
+	best.resolution_uv = (uint32_t)((7000ULL * vbat_mv + ((5ULL * best.pwm_div) << frac_bits) - 1U) /
+	                                ((5ULL * best.pwm_div) << frac_bits));
+	best.resolution_met = met;
+
+	return best;
+}
+
+static void check_plan(uint32_t target_hz, uint16_t min_resolution_mv, uint16_t vbat_mv, uint8_t frac_bits)
+{
+	pwm_plan_t plan;
+	pwm_plan_t expected = reference_plan(target_hz, min_resolution_mv, vbat_mv, frac_bits);
+
+	CHECK(pwm_plan_search(target_hz, min_resolution_mv, vbat_mv, frac_bits, &plan), "%u Hz refused", target_hz);
+	CHECK(plan.lp_clock == expected.lp_clock && plan.clk_div == expected.clk_div && plan.pwm_div == expected.pwm_div,
+	      "%u Hz %u mV vbat %u frac %u: %s /%u div %u, expected %s /%u div %u",
+	      target_hz, min_resolution_mv, vbat_mv, frac_bits,
+	      plan.lp_clock ? "LP" : "SYS", 1U << plan.clk_div, plan.pwm_div,
+	      expected.lp_clock ? "LP" : "SYS", 1U << expected.clk_div, expected.pwm_div);
+	CHECK(plan.freq_hz == expected.freq_hz && plan.resolution_uv == expected.resolution_uv &&
+	      plan.resolution_met == expected.resolution_met,
+	      "%u Hz %u mV vbat %u frac %u: %u Hz %u uV met %u, expected %u Hz %u uV met %u",
+	      target_hz, min_resolution_mv, vbat_mv, frac_bits, plan.freq_hz, plan.resolution_uv, plan.resolution_met,
+	      expected.freq_hz, expected.resolution_uv, expected.resolution_met);
+}
+
+int main(void)
+{
+	// Frequencies at the clock and divider boundaries, plus the 1 kHz default
+	static const uint32_t EDGE_HZ[] =
+	{
+		1, 2, 3, 7, 8, 15, 16, 1000, 1953, 1954, 3906, 4000, 15625, 16000, 32000, 32001,
+		976, 977, 488, 489, 1000000, 7999999, 8000000, 8000001, 16000000, 0xFFFFFFFFU
+	};
+	static const uint16_t RESOLUTION_MV[] = { 0, 1, 2, 5, 10, 100, 65535 };
+	static const uint16_t VBAT_MV[] = { 1, 1800, 3000, 3600, 65535 };
+	uint32_t plans = 0;
+
+	for (uint32_t f = 0; f < sizeof(EDGE_HZ) / sizeof(EDGE_HZ[0]); f++)
+	{
+		for (uint32_t r = 0; r < sizeof(RESOLUTION_MV) / sizeof(RESOLUTION_MV[0]); r++)
+		{
+			for (uint32_t v = 0; v < sizeof(VBAT_MV) / sizeof(VBAT_MV[0]); v++)
+			{
+				check_plan(EDGE_HZ[f], RESOLUTION_MV[r], VBAT_MV[v], 0);
+				check_plan(EDGE_HZ[f], RESOLUTION_MV[r], VBAT_MV[v], PWM_COMP_FRAC_BITS);
+				plans += 2;
+			}
+		}
+	}
+
+	// Random targets over the whole range the timer can reach, log-spread
+	srand(531);
+	for (uint32_t i = 0; i < 2000; i++)
+	{
+		uint32_t target_hz = 1U + ((uint32_t)rand() % 16000000U >> ((uint32_t)rand() % 24));
+		uint16_t min_resolution_mv = (uint16_t)((uint32_t)rand() % 8);
+		uint16_t vbat_mv = (uint16_t)(1800U + (uint32_t)rand() % 1900U);
+		check_plan(target_hz, min_resolution_mv, vbat_mv, (uint8_t)(((uint32_t)rand() & 1U) ? PWM_COMP_FRAC_BITS : 0));
+		plans++;
+	}
+
+	// Refused inputs leave the plan alone
+	pwm_plan_t plan = { .pwm_div = 1234 };
+	CHECK(!pwm_plan_search(0, 0, 3000, 0, &plan) && plan.pwm_div == 1234, "0 Hz accepted");
+	CHECK(!pwm_plan_search(1000, 0, 0, 0, &plan) && plan.pwm_div == 1234, "0 mV VBAT accepted");
+
+	printf("%u plans compared\n", plans);
+
+	return test_result("test_pwm_plan");
+}
@@ -0,0 +1,325 @@
+/**
+ ****************************************************************************************
+ * @file test_pwm_shadow.c
+ * @brief Safe-point commit of the Timer2 START/END shadows against a simulated timer and
+ *        a cycle-cost model of the DA14531 at 16 MHz.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "datasheet.h"
+#include "user_pwm_shadow.h"
+#include "user_timebase.h"
+#include "test_check.h"
+
+/*
+ * Cost model, 62.5 ns per cycle of the Cortex-M0+ running from SRAM:
+ *  - timebase_now_us() latches the BLE counters about 30 cycles in and returns about 30 cycles
+ *    later. Every read in the commit loop is followed by the phase arithmetic (about 40 cycles
+ *    on the division-free path) or the loop test, both charged to the tail.
+ *  - a register access with its loop overhead of pwm_shadow_write_staged() takes 12 cycles.
+ *  - timer2_start() takes 10 cycles after the counter starts.
+ * sim_cost_scale stretches all of them, the guard has to cover the nominal costs with margin.
+ */
+#define CYCLE_NS            62.5
+#define TIMEBASE_HEAD_CYC   30.0
+#define TIMEBASE_TAIL_CYC   70.0
+#define REG_ACCESS_CYC      12.0
+#define TIMER_START_CYC     10.0
+
+// PWM_COMMIT_GUARD_US and PWM_COMMIT_MAX_WAIT_US in user_pwm_shadow.c
+#define GUARD_US            24U
+#define PERIOD_MAX_WAIT_US  2000U
+
+// One poll of the commit loop, the slack on top of the two-period wait
+#define POLL_SLACK_US       50U
+
+static double sim_ns;               // simulated time since reset
+static double sim_cost_scale = 1.0;
+static uint32_t sim_timebase_offset_us;
+static bool sim_running;
+static double sim_start_ns;
+static uint32_t sim_counts_per_us = 16;
+static uint32_t sim_period;
+static uint16_t sim_regs[16];
+static uint32_t sim_violations;
+static uint32_t sim_writes;
+static uint16_t sim_worst_lag_us;
+
+static void sim_spend(double cycles)
+{
+	sim_ns += cycles * CYCLE_NS * sim_cost_scale;
+}
+
+static uint32_t sim_counter(void)
+{
+	uint64_t counts = (uint64_t)((sim_ns - sim_start_ns) * sim_counts_per_us / 1000.0);
+	return (uint32_t)(counts % sim_period);
+}
+
+/*
+ * SDK and hardware stand-ins
+ */
+
+uint32_t timebase_now_us(void)
+{
+	sim_spend(TIMEBASE_HEAD_CYC);
+	uint32_t now = (uint32_t)(uint64_t)(sim_ns / 1000.0) + sim_timebase_offset_us;
+	sim_spend(TIMEBASE_TAIL_CYC);
+	return now;
+}
+
+uint16_t sim_reg_read(uintptr_t addr)
+{
+	sim_spend(REG_ACCESS_CYC);
+	return sim_regs[(addr - TRIPLE_PWM_FREQUENCY) >> 1];
+}
+
+void sim_reg_write(uintptr_t addr, uint16_t value)
+{
+	uint32_t index = (addr - TRIPLE_PWM_FREQUENCY) >> 1;
+	uint16_t old = sim_regs[index];
+
+	sim_spend(REG_ACCESS_CYC);
+
+	// An edge moved across the running counter fires twice or not at all in this period
+	if (index != 0 && sim_running && old != value)
+	{
+		uint32_t count = sim_counter();
+		uint32_t lo = (old < value) ? old : value;
+		uint32_t hi = (old < value) ? value : old;
+		if (count >= lo && count <= hi)
+		{
+			sim_violations++;
+		}
+		sim_writes++;
+	}
+
+	sim_regs[index] = value;
+	if (index == 0)
+	{
+		sim_period = (uint32_t)value + 1U;
+	}
+}
+
+void timer0_2_clk_div_set(tim0_2_clk_div_config_t *clk_div_config)
+{
+	sim_counts_per_us = 16U >> clk_div_config->clk_div;
+}
+
+void timer0_2_clk_enable(void) {}
+void timer0_2_clk_disable(void) {}
+void timer2_config(tim2_config_t *config) { (void)config; }
+void timer2_set_sw_pause(tim2_sw_pause_t sw_pause) { (void)sw_pause; }
+
+void timer2_start(void)
+{
+	sim_running = true;
+	sim_start_ns = sim_ns;
+	sim_spend(TIMER_START_CYC);
+}
+
+void timer2_stop(void)
+{
+	sim_running = false;
+}
+
+/*
+ * Scenarios
+ */
+
+static void sim_reset(tim0_2_clk_div_t clk_div, uint32_t period)
+{
+	pwm_shadow_init();
+	memset(sim_regs, 0, sizeof(sim_regs));
+	sim_ns = 0;
+	sim_running = false;
+	sim_violations = 0;
+	sim_writes = 0;
+
+	pwm_shadow_set_frequency(clk_div, TIM2_CLK_SYS, (uint16_t)(period - 1U));
+	for (uint8_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		pwm_shadow_stage_start(ch, 0);
+		pwm_shadow_stage_end(ch, (uint16_t)(period / 2U));
+	}
+	pwm_shadow_run(true);
+}
+
+/// Move both edges of 1 to PWM_CHANNEL_COUNT channels and commit at a random point in time
+static void commit_random(uint32_t period, uint32_t *elapsed_us, bool *missed)
+{
+	uint16_t missed_before = pwm_shadow_get()->missed;
+	uint32_t channels = 1U + (uint32_t)rand() % PWM_CHANNEL_COUNT;
+
+	sim_spend((double)(rand() % 100000));
+	for (uint8_t ch = 0; ch < channels; ch++)
+	{
+		// Every staged edge moves, an unchanged one is dropped without a commit
+		uint16_t start = (uint16_t)((pwm_shadow_start(ch) + 1U + (uint32_t)rand() % (period - 1U)) % period);
+		uint16_t end = (uint16_t)((pwm_shadow_end(ch) + 1U + (uint32_t)rand() % (period - 1U)) % period);
+		pwm_shadow_stage_start(ch, start);
+		pwm_shadow_stage_end(ch, end);
+	}
+
+	double start = sim_ns;
+	pwm_shadow_commit();
+	*elapsed_us = (uint32_t)((sim_ns - start) / 1000.0);
+	*missed = (pwm_shadow_get()->missed != missed_before);
+}
+
+static uint32_t sweep(double cost_scale, bool report)
+{
+	static const uint32_t PERIODS[] = { 32, 64, 128, 200, 256, 300, 500, 1000, 1600, 4000, 16000, 32000, 65535 };
+	uint32_t violations = 0;
+
+	sim_cost_scale = cost_scale;
+	for (uint32_t div = TIM0_2_CLK_DIV_1; div <= TIM0_2_CLK_DIV_8; div++)
+	{
+		for (uint32_t p = 0; p < sizeof(PERIODS) / sizeof(PERIODS[0]); p++)
+		{
+			uint32_t period = PERIODS[p];
+			uint32_t counts_per_us = 16U >> div;
+			uint32_t period_us = (period + counts_per_us - 1U) / counts_per_us;
+			uint32_t worst_us = 0;
+			uint32_t missed = 0;
+			uint32_t runs = 2000;
+
+			sim_reset((tim0_2_clk_div_t)div, period);
+			for (uint32_t r = 0; r < runs; r++)
+			{
+				uint32_t elapsed_us;
+				bool was_missed;
+				uint32_t before = sim_violations;
+
+				commit_random(period, &elapsed_us, &was_missed);
+				sim_worst_lag_us = (pwm_shadow_get()->commit_lag_us > sim_worst_lag_us) ?
+				                   pwm_shadow_get()->commit_lag_us : sim_worst_lag_us;
+				worst_us = (elapsed_us > worst_us) ? elapsed_us : worst_us;
+				missed += was_missed;
+
+				// A missed commit writes anywhere, only safe-point commits must avoid the edges
+				if (!was_missed)
+				{
+					violations += sim_violations - before;
+				}
+
+				// Never longer than two periods plus the last poll, never at all past 2 ms
+				uint32_t limit_us = (period_us <= PERIOD_MAX_WAIT_US) ? (2U * period_us + POLL_SLACK_US) : POLL_SLACK_US;
+				if (report)
+				{
+					CHECK(elapsed_us <= limit_us, "div %u period %u: commit took %u us, limit %u us",
+					      div, period, elapsed_us, limit_us);
+				}
+			}
+
+			// Periods within the guard have no window and must not spin at all
+			if (report && period <= (GUARD_US + 1U) * counts_per_us)
+			{
+				CHECK(worst_us <= POLL_SLACK_US, "div %u period %u: spun %u us without a window", div, period, worst_us);
+				CHECK(missed == runs, "div %u period %u: %u of %u committed without a window",
+				      div, period, runs - missed, runs);
+			}
+
+			if (report)
+			{
+				printf("div %u period %5u (%4u us): worst commit %4u us, missed %4u of %u\n",
+				       div, period, period_us, worst_us, missed, runs);
+			}
+		}
+	}
+
+	return violations;
+}
+
+/// Duty steps of up to 5 % on one channel, as the dither, ramp and loop make them, always find a window
+static void check_duty_steps(void)
+{
+	sim_cost_scale = 1.0;
+	for (uint32_t div = TIM0_2_CLK_DIV_1; div <= TIM0_2_CLK_DIV_8; div++)
+	{
+		uint32_t counts_per_us = 16U >> div;
+
+		for (uint32_t period = 8U * GUARD_US * counts_per_us; period <= PERIOD_MAX_WAIT_US * counts_per_us; period *= 2U)
+		{
+			uint16_t end = (uint16_t)(period / 2U);
+
+			sim_reset((tim0_2_clk_div_t)div, period);
+			for (uint32_t r = 0; r < 500; r++)
+			{
+				sim_spend((double)(rand() % 100000));
+				end = (uint16_t)(end + (uint32_t)rand() % (period / 10U) - period / 20U);
+				end = (end < period / 4U || end > 3U * period / 4U) ? (uint16_t)(period / 2U) : end;
+				pwm_shadow_stage_end(0, end);
+				pwm_shadow_commit();
+			}
+
+			CHECK(pwm_shadow_get()->missed == 0 && sim_violations == 0,
+			      "div %u period %u: %u duty steps missed, %u unsafe writes",
+			      div, period, pwm_shadow_get()->missed, sim_violations);
+		}
+	}
+}
+
+static void check_commit_lag(void)
+{
+	// The lag the firmware records for the board to report has to read under the guard too
+	CHECK(sim_worst_lag_us < GUARD_US, "recorded commit lag %u us", sim_worst_lag_us);
+	printf("recorded commit lag %u us\n", sim_worst_lag_us);
+}
+
+static void check_phase_age(void)
+{
+	// A phase last refreshed 59 s ago takes the division path and must still be exact
+	sim_cost_scale = 1.0;
+	sim_reset(TIM0_2_CLK_DIV_1, 16000);
+	for (uint32_t r = 0; r < 200; r++)
+	{
+		uint32_t elapsed_us;
+		bool missed;
+		uint32_t before = sim_violations;
+
+		sim_spend(59e6 / CYCLE_NS);
+		commit_random(16000, &elapsed_us, &missed);
+		CHECK(missed || sim_violations == before, "unsafe commit after 59 s");
+	}
+
+	// Timebase wrap between anchor and commit
+	sim_timebase_offset_us = 0xFFFFFFFFU - 5000U;
+	sim_reset(TIM0_2_CLK_DIV_1, 16000);
+	for (uint32_t r = 0; r < 200; r++)
+	{
+		uint32_t elapsed_us;
+		bool missed;
+		uint32_t before = sim_violations;
+
+		commit_random(16000, &elapsed_us, &missed);
+		CHECK(missed || sim_violations == before, "unsafe commit across the timebase wrap");
+	}
+	sim_timebase_offset_us = 0;
+}
+
+int main(void)
+{
+	srand(531);
+
+	uint32_t nominal = sweep(1.0, true);
+	CHECK(nominal == 0, "%u unsafe writes at nominal cost", nominal);
+	check_commit_lag();
+	check_duty_steps();
+
+	// The guard keeps a margin over the model, and the model is tight enough to catch a short guard
+	uint32_t slow = sweep(1.3, false);
+	CHECK(slow == 0, "%u unsafe writes at 1.3x cost", slow);
+	uint32_t too_slow = sweep(3.0, false);
+	CHECK(too_slow > 0, "no unsafe write at 3x cost, the check has no teeth");
+	printf("unsafe writes: %u at 1x, %u at 1.3x, %u at 3x\n", nominal, slow, too_slow);
+
+	check_phase_age();
+
+	return test_result("test_pwm_shadow");
+}
@@ -0,0 +1,167 @@
+/**
+ ****************************************************************************************
+ * @file test_pwm_zcal.c
+ * @brief Zero calibration point statistics, gain and confidence against double arithmetic.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "user_pwm_loop.h"
+#include "test_check.h"
+
+// Same values as the zero calibration constants in user_empty_peripheral_template.c
+#define LOG2_BURSTS    4U
+#define MAX_STDERR_UV  1000U
+
+// Feedback pin range of the ADC at 3x attenuation
+#define PIN_MAX_UV     3600000
+
+/// Gaussian burst noise around a pin voltage, Box-Muller on rand()
+static int32_t noisy_uv(double mean_uv, double sigma_uv)
+{
+	double u1 = (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+	double u2 = (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+	double uv = mean_uv + sigma_uv * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+	return (int32_t)lround((uv < 0) ? 0 : ((uv > PIN_MAX_UV) ? PIN_MAX_UV : uv));
+}
+
+/// Compare one point of 2^log2_n bursts with the two-pass mean and standard error
+static void check_point(int32_t const *bursts, uint8_t log2_n)
+{
+	uint32_t n = 1U << log2_n;
+	pwm_zcal_stats_t stats = { 0 };
+	double sum = 0;
+	double sq = 0;
+
+	for (uint32_t i = 0; i < n; i++)
+	{
+		pwm_zcal_stats_add(&stats, bursts[i]);
+		sum += bursts[i];
+	}
+	double mean = sum / n;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		sq += (bursts[i] - mean) * (bursts[i] - mean);
+	}
+	double stderr_exact = sqrt(sq / (n - 1) / n);
+
+	int32_t mean_uv;
+	uint16_t stderr_uv = pwm_zcal_stats_result(&stats, log2_n, &mean_uv);
+
+	// Mean truncates toward the first burst. The standard error rounds down twice (variance and root),
+	// after the squared sum was taken off rounded down, which can only lift it by a fraction of 1 uV^2
+	CHECK(stats.count == n, "%u bursts counted, %u added", stats.count, n);
+	CHECK(fabs(mean_uv - mean) < 1.0, "n %u: mean %d uV, exact %.2f uV", n, mean_uv, mean);
+	double expected = (stderr_exact > 65535.0) ? 65535.0 : stderr_exact;
+	CHECK(stderr_uv <= expected + 0.01 && stderr_uv >= expected - 1.0,
+	      "n %u: stderr %u uV, exact %.3f uV", n, stderr_uv, stderr_exact);
+}
+
+static void check_stats(void)
+{
+	int32_t bursts[64];
+
+	srand(531);
+
+	// Pin voltages over the ADC range with noise from none to far past the rejection limit
+	static const double SIGMA_UV[] = { 0.0, 1.0, 50.0, 800.0, 4000.0, 100000.0, 2000000.0 };
+	for (uint32_t s = 0; s < sizeof(SIGMA_UV) / sizeof(SIGMA_UV[0]); s++)
+	{
+		for (uint32_t r = 0; r < 2000; r++)
+		{
+			double mean_uv = (double)(rand() % PIN_MAX_UV);
+			for (uint8_t log2_n = 1; log2_n <= 6; log2_n++)
+			{
+				for (uint32_t i = 0; i < (1U << log2_n); i++)
+				{
+					bursts[i] = noisy_uv(mean_uv, SIGMA_UV[s]);
+				}
+				check_point(bursts, log2_n);
+			}
+		}
+	}
+
+	// Extremes: every burst at one end of the range, alternating ends
+	for (uint32_t i = 0; i < 64; i++)
+	{
+		bursts[i] = PIN_MAX_UV;
+	}
+	check_point(bursts, LOG2_BURSTS);
+	for (uint32_t i = 0; i < 64; i++)
+	{
+		bursts[i] = (i & 1U) ? PIN_MAX_UV : 0;
+	}
+	for (uint8_t log2_n = 1; log2_n <= 6; log2_n++)
+	{
+		check_point(bursts, log2_n);
+	}
+
+	// A count of 0 starts a new point, nothing of the previous one is left
+	pwm_zcal_stats_t stats = { 0 };
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		pwm_zcal_stats_add(&stats, 3000000 - (int32_t)i * 1000);
+	}
+	stats.count = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		pwm_zcal_stats_add(&stats, 1350000);
+	}
+	int32_t mean_uv;
+	CHECK(pwm_zcal_stats_result(&stats, LOG2_BURSTS, &mean_uv) == 0 && mean_uv == 1350000,
+	      "second point kept the first: mean %d uV", mean_uv);
+}
+
+static void check_gain(void)
+{
+	static const int16_t POINTS_MV[] = { -1000, -500, -1, 1, 200, 500, 1000 };
+
+	// Every offset and measured slope a board could plausibly produce, truncated toward zero
+	for (uint32_t p = 0; p < sizeof(POINTS_MV) / sizeof(POINTS_MV[0]); p++)
+	{
+		for (int32_t zero_uv = -300000; zero_uv <= 300000; zero_uv += 7919)
+		{
+			for (int32_t slope_ppm = 500000; slope_ppm <= 1500000; slope_ppm += 1013)
+			{
+				int32_t point_uv = zero_uv + (int32_t)(((int64_t)POINTS_MV[p] * 1000 * slope_ppm) / 1000000);
+				double exact = (double)(point_uv - zero_uv) * PWM_ZCAL_GAIN_Q12_ONE / (POINTS_MV[p] * 1000.0);
+				int32_t gain_q12 = pwm_zcal_gain_q12(zero_uv, point_uv, POINTS_MV[p]);
+				CHECK(gain_q12 == (int32_t)exact, "zero %d uV point %d uV at %d mV: gain %d, exact %.3f",
+				      zero_uv, point_uv, POINTS_MV[p], gain_q12, exact);
+			}
+		}
+	}
+
+	// A reversed or dead channel gives a gain the acceptance window rejects
+	CHECK(pwm_zcal_gain_q12(0, -500000, 500) == -PWM_ZCAL_GAIN_Q12_ONE, "reversed channel");
+	CHECK(pwm_zcal_gain_q12(1000, 1000, 500) == 0, "dead channel");
+	CHECK(pwm_zcal_gain_q12(0, 500000, 500) == PWM_ZCAL_GAIN_Q12_ONE, "ideal channel");
+}
+
+static void check_confidence(void)
+{
+	for (uint32_t stderr_uv = 0; stderr_uv <= 65535U; stderr_uv++)
+	{
+		uint8_t confidence = pwm_zcal_confidence((uint16_t)stderr_uv, MAX_STDERR_UV);
+		double exact = 100.0 * (1.0 - (double)stderr_uv / MAX_STDERR_UV);
+		uint8_t expected = (stderr_uv >= MAX_STDERR_UV) ? 0 : (uint8_t)ceil(exact - 1e-9);
+		CHECK(confidence == expected, "stderr %u uV: confidence %u, expected %u", stderr_uv, confidence, expected);
+	}
+
+	CHECK(pwm_zcal_confidence(0, MAX_STDERR_UV) == 100, "noise-free point");
+	CHECK(pwm_zcal_confidence(MAX_STDERR_UV - 1U, MAX_STDERR_UV) == 1, "just under the limit");
+	CHECK(pwm_zcal_confidence(MAX_STDERR_UV, MAX_STDERR_UV) == 0, "at the limit");
+}
+
+int main(void)
+{
+	check_stats();
+	check_gain();
+	check_confidence();
+
+	return test_result("test_pwm_zcal");
+}
@@ -0,0 +1,234 @@
+/**
+ ****************************************************************************************
+ * @file test_sample_codec.c
+ * @brief Round trip of the sensor stream encodings through the reference decoder, plus
+ *        the frame size and throughput benchmark.
+ * @author Albert Nguyen
+ ****************************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "user_sample_codec.h"
+#include "test_check.h"
+
+// Payload after the 11-byte frame header at the default MTU of 23 and at the requested 247
+#define PAYLOAD_MIN_MTU 9U
+#define PAYLOAD_MAX_MTU 233U
+
+#define TRACE_LEN 20000U
+
+static const char *const CODEC_NAME[SAMPLE_CODEC_COUNT] = { "raw16", "zigzag-varint" };
+
+/// Fill one frame the way sensor_frame_push() does: keyframe first, stop when the next sample does not fit
+static uint16_t frame_encode(sample_codec_t codec, uint16_t const *samples, uint16_t count,
+                             uint16_t payload_max, uint8_t *payload, uint16_t *len)
+{
+	uint16_t n = 0;
+	*len = 0;
+
+	while (n < count)
+	{
+		uint8_t encoded[SAMPLE_CODEC_MAX_LEN];
+		uint8_t length = sample_codec_encode(codec, samples[n], (n > 0) ? samples[n - 1] : 0, (n == 0), encoded);
+		CHECK(length >= 1 && length <= SAMPLE_CODEC_MAX_LEN, "encoded length %u", length);
+
+		if (*len + length > payload_max)
+		{
+			break;
+		}
+		memcpy(&payload[*len], encoded, length);
+		*len += length;
+		n++;
+	}
+
+	return n;
+}
+
+/// Split a trace into frames, decode each and compare, returns the number of frames
+static uint32_t round_trip(sample_codec_t codec, uint16_t const *trace, uint32_t length, uint16_t payload_max,
+                           uint32_t *bytes)
+{
+	uint8_t payload[PAYLOAD_MAX_MTU];
+	uint16_t decoded[PAYLOAD_MAX_MTU];
+	uint32_t frames = 0;
+	uint32_t pos = 0;
+
+	*bytes = 0;
+	while (pos < length)
+	{
+		uint16_t len;
+		uint16_t remaining = (length - pos > PAYLOAD_MAX_MTU) ? PAYLOAD_MAX_MTU : (uint16_t)(length - pos);
+		uint16_t count = frame_encode(codec, &trace[pos], remaining, payload_max, payload, &len);
+		CHECK(count > 0, "%s: no sample fits a %u byte payload", CODEC_NAME[codec], payload_max);
+		if (count == 0)
+		{
+			break;
+		}
+
+		uint16_t got = sample_codec_decode(codec, payload, len, count, decoded);
+		CHECK(got == count, "%s: decoded %u of %u samples", CODEC_NAME[codec], got, count);
+		for (uint16_t i = 0; i < got; i++)
+		{
+			CHECK(decoded[i] == trace[pos + i], "%s: sample %u decoded as %u, sent %u",
+			      CODEC_NAME[codec], pos + i, decoded[i], trace[pos + i]);
+		}
+
+		// Every byte short of the full payload must lose at least the last sample
+		for (uint16_t cut = 0; cut < len; cut++)
+		{
+			uint16_t short_got = sample_codec_decode(codec, payload, cut, count, decoded);
+			CHECK(short_got < count, "%s: %u of %u bytes decoded all %u samples", CODEC_NAME[codec], cut, len, count);
+		}
+
+		pos += count;
+		*bytes += len;
+		frames++;
+	}
+
+	return frames;
+}
+
+static void trace_random_walk(uint16_t *trace, uint32_t length, int32_t step)
+{
+	int32_t value = 1500;
+
+	for (uint32_t i = 0; i < length; i++)
+	{
+		value += (rand() % (2 * step + 1)) - step;
+		value = (value < 0) ? 0 : ((value > 3600) ? 3600 : value);
+		trace[i] = (uint16_t)value;
+	}
+}
+
+static void trace_full_scale(uint16_t *trace, uint32_t length)
+{
+	for (uint32_t i = 0; i < length; i++)
+	{
+		trace[i] = (i & 1U) ? 0xFFFFU : 0U;
+	}
+}
+
+static uint32_t trace_boundaries(uint16_t *trace)
+{
+	// Deltas on both sides of each varint length step, up and down
+	static const int32_t DELTAS[] = { 0, 1, -1, 63, -63, 64, -64, 8191, -8191, 8192, -8192, 32767, -32768 };
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < sizeof(DELTAS) / sizeof(DELTAS[0]); i++)
+	{
+		int32_t base = (DELTAS[i] < 0) ? 40000 : 1000;
+		trace[n++] = (uint16_t)base;
+		trace[n++] = (uint16_t)(base + DELTAS[i]);
+	}
+
+	// Keyframe sizes: 1, 2 and 3 byte varints
+	static const uint16_t KEYS[] = { 0, 127, 128, 16383, 16384, 0xFFFFU };
+	for (uint32_t i = 0; i < sizeof(KEYS) / sizeof(KEYS[0]); i++)
+	{
+		trace[n++] = KEYS[i];
+	}
+
+	return n;
+}
+
+static void check_encoded_sizes(void)
+{
+	uint8_t buf[SAMPLE_CODEC_MAX_LEN];
+
+	CHECK(sample_codec_encode(SAMPLE_CODEC_ZIGZAG_VARINT, 1063, 1000, false, buf) == 1, "+63 takes 1 byte");
+	CHECK(sample_codec_encode(SAMPLE_CODEC_ZIGZAG_VARINT, 937, 1000, false, buf) == 1, "-63 takes 1 byte");
+	CHECK(sample_codec_encode(SAMPLE_CODEC_ZIGZAG_VARINT, 1064, 1000, false, buf) == 2, "+64 takes 2 bytes");
+	CHECK(sample_codec_encode(SAMPLE_CODEC_ZIGZAG_VARINT, 936, 1000, false, buf) == 1, "-64 takes 1 byte");
+	CHECK(sample_codec_encode(SAMPLE_CODEC_ZIGZAG_VARINT, 935, 1000, false, buf) == 2, "-65 takes 2 bytes");
+	CHECK(sample_codec_encode(SAMPLE_CODEC_ZIGZAG_VARINT, 9191, 1000, false, buf) == 2, "+8191 takes 2 bytes");
+	CHECK(sample_codec_encode(SAMPLE_CODEC_ZIGZAG_VARINT, 9192, 1000, false, buf) == 3, "+8192 takes 3 bytes");
+	CHECK(sample_codec_encode(SAMPLE_CODEC_ZIGZAG_VARINT, 0xFFFFU, 0, false, buf) == 3, "+65535 takes 3 bytes");
+	CHECK(sample_codec_encode(SAMPLE_CODEC_ZIGZAG_VARINT, 0, 0xFFFFU, false, buf) == 3, "-65535 takes 3 bytes");
+	CHECK(sample_codec_encode(SAMPLE_CODEC_RAW16, 0xFFFFU, 0, false, buf) == 2, "raw takes 2 bytes");
+
+	// A fourth continuation byte is rejected rather than read past
+	uint8_t const overlong[] = { 0x80U, 0x80U, 0x80U, 0x01U };
+	uint16_t out[1];
+	CHECK(sample_codec_decode(SAMPLE_CODEC_ZIGZAG_VARINT, overlong, sizeof(overlong), 1, out) == 0, "overlong varint");
+	CHECK(sample_codec_decode(SAMPLE_CODEC_COUNT, overlong, sizeof(overlong), 1, out) == 0, "unknown encoding");
+}
+
+/// Samples per notification and encode + decode speed for one trace
+static void benchmark(char const *name, uint16_t const *trace, uint32_t length)
+{
+	for (sample_codec_t codec = SAMPLE_CODEC_RAW16; codec < SAMPLE_CODEC_COUNT; codec++)
+	{
+		uint32_t bytes;
+		uint32_t frames = round_trip(codec, trace, length, PAYLOAD_MAX_MTU, &bytes);
+
+		// Timing excludes the truncation checks, only the encode and decode loops
+		uint8_t payload[PAYLOAD_MAX_MTU];
+		uint16_t decoded[PAYLOAD_MAX_MTU];
+		uint32_t reps = 50;
+		clock_t start = clock();
+		for (uint32_t r = 0; r < reps; r++)
+		{
+			for (uint32_t pos = 0; pos < length;)
+			{
+				uint16_t len;
+				uint16_t remaining = (length - pos > PAYLOAD_MAX_MTU) ? PAYLOAD_MAX_MTU : (uint16_t)(length - pos);
+				uint16_t count = frame_encode(codec, &trace[pos], remaining, PAYLOAD_MAX_MTU, payload, &len);
+				sample_codec_decode(codec, payload, len, count, decoded);
+				pos += count;
+			}
+		}
+		double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		printf("%-14s %-13s %6.2f bytes/sample %6.1f samples/frame %5u frames  %7.1f Msamples/s\n",
+		       name, CODEC_NAME[codec], (double)bytes / length, (double)length / frames, frames,
+		       (seconds > 0) ? (double)length * reps / seconds / 1e6 : 0.0);
+	}
+}
+
+int main(void)
+{
+	static uint16_t trace[TRACE_LEN];
+	uint32_t bytes;
+
+	srand(531);
+	check_encoded_sizes();
+
+	// Every trace through both codecs at both payload sizes
+	uint32_t n = trace_boundaries(trace);
+	for (sample_codec_t codec = SAMPLE_CODEC_RAW16; codec < SAMPLE_CODEC_COUNT; codec++)
+	{
+		round_trip(codec, trace, n, PAYLOAD_MIN_MTU, &bytes);
+		round_trip(codec, trace, n, PAYLOAD_MAX_MTU, &bytes);
+	}
+
+	trace_full_scale(trace, TRACE_LEN);
+	for (sample_codec_t codec = SAMPLE_CODEC_RAW16; codec < SAMPLE_CODEC_COUNT; codec++)
+	{
+		round_trip(codec, trace, TRACE_LEN, PAYLOAD_MIN_MTU, &bytes);
+	}
+	benchmark("full-scale", trace, TRACE_LEN);
+
+	static const int32_t STEPS[] = { 2, 50, 2000 };
+	static const char *const STEP_NAME[] = { "walk +/-2 mV", "walk +/-50 mV", "walk +/-2 V" };
+	for (uint32_t i = 0; i < sizeof(STEPS) / sizeof(STEPS[0]); i++)
+	{
+		trace_random_walk(trace, TRACE_LEN, STEPS[i]);
+		for (sample_codec_t codec = SAMPLE_CODEC_RAW16; codec < SAMPLE_CODEC_COUNT; codec++)
+		{
+			round_trip(codec, trace, TRACE_LEN, PAYLOAD_MIN_MTU, &bytes);
+		}
+		benchmark(STEP_NAME[i], trace, TRACE_LEN);
+	}
+
+	// Slow amperometric trace must fit close to twice the raw samples per notification, less the keyframes
+	trace_random_walk(trace, TRACE_LEN, 2);
+	uint32_t raw_frames = round_trip(SAMPLE_CODEC_RAW16, trace, TRACE_LEN, PAYLOAD_MAX_MTU, &bytes);
+	uint32_t varint_frames = round_trip(SAMPLE_CODEC_ZIGZAG_VARINT, trace, TRACE_LEN, PAYLOAD_MAX_MTU, &bytes);
+	CHECK(varint_frames * 19U <= raw_frames * 10U, "%u varint frames vs %u raw", varint_frames, raw_frames);
+
+	return test_result("test_sample_codec");
+}